@@ -148,7 +148,9 @@ u_int32_t
 libnet_getpacket_size(libnet_t *l);
 
 /**
- * Seeds the psuedo-random number generator.
+ * Seeds the calling thread's psuedo-random number generator. Every thread
+ * has a generator of its own, which is seeded on first use if this function
+ * is never called.
  * @param l pointer to a libnet context
  * @return 1 on success, -1 on failure
  */
@@ -195,6 +197,36 @@ libnet_get_prand(int mod);
 int
 libnet_toggle_checksum(libnet_t *l, libnet_ptag_t ptag, int mode);
 
+/**
+ * Adjusts an existing IP, ICMP, TCP or UDP checksum for a 16-bit field of
+ * the data it covers changing from old_v to new_v, as described in RFC 1624.
+ * This lets a program patch a port, an IP ID or any other field of a
+ * prebuilt packet without summing the whole packet again. All three values
+ * are taken exactly as they are stored in the packet (network byte order)
+ * and the returned checksum can be stored back as is. A change to a field
+ * the pseudo-header covers (addresses, length) must be applied to the TCP or
+ * UDP checksum as well as to the IPv4 header checksum.
+ * @param sum the checksum as currently stored in the packet
+ * @param old_v the old value of the field
+ * @param new_v the new value of the field
+ * @return the adjusted checksum
+ */
+u_int16_t
+libnet_adjust_checksum(u_int16_t sum, u_int16_t old_v, u_int16_t new_v);
+
+/**
+ * Same as libnet_adjust_checksum() for a 32-bit field such as an IPv4
+ * address or a TCP sequence number. The field has to start on an even
+ * offset from the start of the data the checksum covers, which is true for
+ * every such field in the IP, TCP and UDP headers.
+ * @param sum the checksum as currently stored in the packet
+ * @param old_v the old value of the field
+ * @param new_v the new value of the field
+ * @return the adjusted checksum
+ */
+u_int16_t
+libnet_adjust_checksum32(u_int16_t sum, u_int32_t old_v, u_int32_t new_v);
+
 /**
  * Takes a network byte ordered IPv4 address and returns a pointer to either a 
  * canonical DNS name (if it has one) or a string of dotted decimals. This may
@@ -216,7 +248,10 @@ libnet_addr2name4(u_int32_t in, u_int8_t use_name);
  * set to LIBNET_RESOLVE and host_name refers to a canonical DNS name. If mode
  * is set to LIBNET_DONT_RESOLVE no DNS lookup will occur. The function can
  * fail if DNS lookup fails or if mode is set to LIBNET_DONT_RESOLVE and
- * host_name refers to a canonical DNS name.
+ * host_name refers to a canonical DNS name. Names are looked up with
+ * getaddrinfo() and kept for LIBNET_RESOLVE_TTL seconds in a cache of the
+ * calling thread, so the function is thread safe and resolving the same name
+ * again does not go to DNS.
  * @param l pointer to a libnet context
  * @param host_name pointer to a string containing a presentation format host
  * name
@@ -258,7 +293,9 @@ char *host_name, int host_name_len);
  * a series of int8_tacters from the following list: "0123456789,-" of the
  * general format "x - y, z", where "xyz" are port numbers between 0 and 
  * 65,535. plist points to the front of the port list chain list for use in 
- * further libnet_plist_chain() functions. Upon success, the function returns
+ * further libnet_plist_chain() functions. The list is parsed into a port set
+ * (see libnet_pset_new()) first, so the chain holds its pairs in port order
+ * with overlapping ranges merged. Upon success, the function returns
  * 1. Upon failure, the function returns -1 and libnet_geterror() can tell you
  * why.
  * @param l pointer to a libnet context
@@ -312,6 +349,115 @@ libnet_plist_chain_dump_string(libnet_plist_t *plist);
 int
 libnet_plist_chain_free(libnet_plist_t *plist);
 
+/**
+ * Creates a new port set. A port set holds any subset of the 65,536 ports as
+ * a bitmap, so membership tests take constant time and large or sparse sets
+ * cost the same 8K. token_list has the same format as for
+ * libnet_plist_chain_new(), or is NULL for an empty set. Upon failure, the
+ * function returns NULL and libnet_geterror() can tell you why.
+ * @param l pointer to a libnet context
+ * @param token_list string containing the port list primitive, or NULL
+ * @return a port set on success, NULL on failure
+ */
+libnet_pset_t *
+libnet_pset_new(libnet_t *l, char *token_list);
+
+/**
+ * Adds the ports from bport through eport to the port set.
+ * @param ps previously created port set
+ * @param bport the first port to add
+ * @param eport the last port to add
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_pset_add(libnet_pset_t *ps, u_int16_t bport, u_int16_t eport);
+
+/**
+ * Removes the ports from bport through eport from the port set.
+ * @param ps previously created port set
+ * @param bport the first port to remove
+ * @param eport the last port to remove
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_pset_del(libnet_pset_t *ps, u_int16_t bport, u_int16_t eport);
+
+/**
+ * Tells if port is in the port set. ps->count is the number of ports in it.
+ * @param ps previously created port set
+ * @param port the port to look up
+ * @return 1 if port is in the set, 0 if not
+ */
+int
+libnet_pset_has(libnet_pset_t *ps, u_int16_t port);
+
+/**
+ * Adds every port of other to the port set ps.
+ * @param ps previously created port set, will contain the union
+ * @param other previously created port set
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_pset_union(libnet_pset_t *ps, libnet_pset_t *other);
+
+/**
+ * Removes every port that is not in other from the port set ps.
+ * @param ps previously created port set, will contain the intersection
+ * @param other previously created port set
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_pset_intersect(libnet_pset_t *ps, libnet_pset_t *other);
+
+/**
+ * Returns the ports of the port set one at a time, in order. iter should be
+ * 0 before the first call and is advanced by every call. The set is scanned
+ * a word at a time and empty blocks of 1024 ports are skipped whole. Upon
+ * success, the function returns 1 and fills in port; at the end of the set
+ * it returns 0.
+ * @param ps previously created port set
+ * @param iter iteration state, 0 to start over
+ * @param port will contain the next port in the set
+ * @return 1 on success, 0 at the end of the set, -1 on failure
+ */
+int
+libnet_pset_next(libnet_pset_t *ps, u_int32_t *iter, u_int16_t *port);
+
+/**
+ * Returns the runs of consecutive ports in the port set one at a time, in
+ * order, the way libnet_plist_chain_next_pair() returns the pairs of a port
+ * list chain. iter should be 0 before the first call and is advanced by
+ * every call.
+ * @param ps previously created port set
+ * @param iter iteration state, 0 to start over
+ * @param bport will contain the first port of the run
+ * @param eport will contain the last port of the run
+ * @return 1 on success, 0 at the end of the set, -1 on failure
+ */
+int
+libnet_pset_next_run(libnet_pset_t *ps, u_int32_t *iter, u_int16_t *bport,
+u_int16_t *eport);
+
+/**
+ * Takes a port out of the port set at random, every port in the set being
+ * equally likely, so successive calls sample the set without replacement.
+ * The draws come from libnet_get_prand(). To sample a set and keep it,
+ * sample a copy made with libnet_pset_new() and libnet_pset_union().
+ * @param ps previously created port set
+ * @param port will contain the port taken
+ * @return 1 on success, 0 if the set is empty, -1 on failure
+ */
+int
+libnet_pset_sample(libnet_pset_t *ps, u_int16_t *port);
+
+/**
+ * Frees the port set.
+ * @param ps previously created port set
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_pset_free(libnet_pset_t *ps);
+
 /**
  * @section PBF Packet Builder Functions
  *
@@ -1664,6 +1810,155 @@ libnet_t *l);
 int
 libnet_write(libnet_t *l);
 
+/**
+ * Creates a write batch for the context l. Packets queued on the batch with
+ * libnet_batch_add() are written by libnet_write_batch() through l's socket,
+ * up to size packets per system call where the platform has sendmmsg(). The
+ * batch has to be freed with libnet_batch_destroy() before l is destroyed.
+ * @param l pointer to a libnet context
+ * @param size the most packets to write with one system call
+ * @return a pointer to the batch, NULL on error
+ */
+libnet_batch_t *
+libnet_batch_init(libnet_t *l, u_int32_t size);
+
+/**
+ * Copies the packet currently built in l to the end of batch b. l can be
+ * the batch's own context or any other context with the same injection type
+ * (libnet_cq_* or a context per template works well), so several different
+ * packets can be queued without rebuilding them in between. Checksums are
+ * computed as libnet_write() would.
+ * @param b pointer to a write batch
+ * @param l pointer to the libnet context holding the packet
+ * @return the packet's index in the batch, -1 on error
+ */
+int
+libnet_batch_add(libnet_batch_t *b, libnet_t *l);
+
+/**
+ * Writes every packet queued on batch b to the network and empties the
+ * batch. A packet the kernel refuses does not stop the rest of the batch;
+ * the result of each packet is retrievable with libnet_batch_result() until
+ * the next call. The batch's and its context's stat counters are bumped up.
+ * @param b pointer to a write batch
+ * @return the number of packets written in full, -1 on error
+ */
+int
+libnet_write_batch(libnet_batch_t *b);
+
+/**
+ * Returns the result of packet i of the last libnet_write_batch() on b.
+ * @param b pointer to a write batch
+ * @param i the index libnet_batch_add() returned for the packet
+ * @return the number of bytes written, -1 if the packet was not written
+ */
+int
+libnet_batch_result(libnet_batch_t *b, u_int32_t i);
+
+/**
+ * Fills in a libnet_batch_stats structure with the batch's statistics
+ * (system calls made, packets written, bytes written, packet sending
+ * errors). Packets per system call is packets_sent / syscalls.
+ * @param b pointer to a write batch
+ * @param bs pointer to a libnet batch statistics structure
+ */
+void
+libnet_batch_stats(libnet_batch_t *b, struct libnet_batch_stats *bs);
+
+/**
+ * Frees batch b and every packet still queued on it.
+ * @param b pointer to a write batch
+ */
+void
+libnet_batch_destroy(libnet_batch_t *b);
+
+/**
+ * Switches link-layer context l to writing through a memory-mapped transmit
+ * ring (Linux PACKET_TX_RING, TPACKET_V2). libnet_write() then copies each
+ * frame into the ring and wakes the kernel up with a zero length send();
+ * libnet_write_batch() fills the ring with up to a batch worth of frames
+ * and sends them all with a single system call. A frame's result is the
+ * number of bytes queued on the ring, the kernel reports no per-frame
+ * errors. If the kernel refuses the ring (old kernel, no memory) or the
+ * platform has none, l keeps writing the usual way.
+ * @param l pointer to a libnet context initialized with LIBNET_LINK
+ * @param frames frames in the ring, 0 for LIBNET_TX_RING_FRAMES
+ * @return 1 if the ring is in use, 0 if l falls back to the usual writes
+ * (the reason is in the error buffer), -1 on error
+ */
+int
+libnet_tx_ring(libnet_t *l, u_int32_t frames);
+
+/**
+ * Compiles the packet currently built in l into a template: a copy of the
+ * packet as it goes on the wire, with the offsets of its IP and TCP, UDP or
+ * ICMP headers noted. Fields of the template are then changed in place with
+ * libnet_template_set() and libnet_template_set_payload(), which fix up the
+ * checksums incrementally (RFC 1624) instead of rebuilding the packet, so
+ * sending many variants of one packet costs a few stores per variant. The
+ * template is independent of l's pblocks, l can go on building other
+ * packets. Link-layer templates are understood for ethernet (802.1Q tagged
+ * or not); IPv6 extension headers are not followed.
+ * @param l pointer to a libnet context
+ * @return a pointer to the template, NULL on error
+ */
+libnet_template_t *
+libnet_template_compile(libnet_t *l);
+
+/**
+ * Sets a header field of template t and adjusts every checksum covering it.
+ * field is one of the LIBNET_TMPL_* symbolic constants; the IPv4 source and
+ * destination addresses also adjust the TCP or UDP checksum through the
+ * pseudo header. A UDP packet compiled without a checksum stays without.
+ * @param t pointer to a packet template
+ * @param field the field to set (LIBNET_TMPL_*)
+ * @param value the new value in host byte order (addresses as well)
+ * @return 1 on success, -1 if the template has no such field
+ */
+int
+libnet_template_set(libnet_template_t *t, int field, u_int32_t value);
+
+/**
+ * Overwrites n bytes of template t's payload (what follows the last header
+ * the template knows about) at offset off and adjusts the transport
+ * checksum. The payload can not grow.
+ * @param t pointer to a packet template
+ * @param off offset into the payload
+ * @param data the bytes to write
+ * @param n number of bytes to write
+ * @return 1 on success, -1 if the bytes do not fit in the payload
+ */
+int
+libnet_template_set_payload(libnet_template_t *t, u_int32_t off,
+const u_int8_t *data, u_int32_t n);
+
+/**
+ * Writes template t to the network through the context it was compiled
+ * from, as libnet_write() would.
+ * @param t pointer to a packet template
+ * @return the number of bytes written, -1 on error
+ */
+int
+libnet_template_write(libnet_template_t *t);
+
+/**
+ * Copies template t as it is now to the end of batch b, see
+ * libnet_batch_add().
+ * @param b pointer to a write batch
+ * @param t pointer to a packet template
+ * @return the packet's index in the batch, -1 on error
+ */
+int
+libnet_batch_add_template(libnet_batch_t *b, libnet_template_t *t);
+
+/**
+ * Frees template t. The template has to be freed before its context is
+ * destroyed.
+ * @param t pointer to a packet template
+ */
+void
+libnet_template_destroy(libnet_template_t *t);
+
 /**
  * Returns the IP address for the device libnet was initialized with. If
  * libnet was initialized without a device (in raw socket mode) the function
@@ -1715,8 +2010,9 @@ libnet_hex_aton(int8_t *s, int *len);
  * and is only available when libnet is initialized in advanced mode. It is
  * important to note that the function performs an implicit malloc() and a
  * corresponding call to libnet_adv_free_packet() should be made to free the
- * memory packet occupies. If the function fails libnet_geterror() can tell you
- * why.
+ * memory packet occupies. libnet_adv_cull_into(), libnet_adv_cull_view() and
+ * libnet_adv_cull_iov() yank the packet without the allocation and the copy.
+ * If the function fails libnet_geterror() can tell you why.
  * @param l pointer to a libnet context
  * @param packet will contain the wire-ready packet
  * @param packet_s will contain the packet size
@@ -1741,6 +2037,72 @@ int
 libnet_adv_cull_header(libnet_t *l, libnet_ptag_t ptag, u_int8_t **header,
 u_int32_t *header_s);
 
+/**
+ * [Advanced Interface] 
+ * Assembles the packet built in the given libnet context directly into buf,
+ * with all checksums written in, the way libnet_adv_cull_packet() would but
+ * without an allocation or an intermediate copy. buf can be anything the
+ * application transmits from: a ring slot, a pcap_inject() buffer or a
+ * simulator's packet. On strict alignment architectures it should be
+ * aligned the way libnet_adv_cull_packet() aligns its packets. This
+ * function is part of the advanced interface and is only available when
+ * libnet is initialized in advanced mode. If buf is too small the function
+ * fails and packet_s tells how large it has to be; libnet_geterror() can
+ * tell you why it failed otherwise.
+ * @param l pointer to a libnet context
+ * @param buf the buffer to assemble the packet into
+ * @param buf_s the size of buf
+ * @param packet_s will contain the packet size, or the size buf needs
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_adv_cull_into(libnet_t *l, u_int8_t *buf, u_int32_t buf_s,
+u_int32_t *packet_s);
+
+/**
+ * [Advanced Interface] 
+ * Assembles the packet built in the given libnet context, with all checksums
+ * written in, and returns a read-only view of it in the context's own
+ * coalesce buffer. Nothing is allocated or copied beyond what libnet_write()
+ * does, and there is nothing to free, but the view is only valid until the
+ * next build, write or cull on the context. This function is part of the
+ * advanced interface and is only available when libnet is initialized in
+ * advanced mode. If the function fails libnet_geterror() can tell you why.
+ * @param l pointer to a libnet context
+ * @param packet will point to the wire-ready packet
+ * @param packet_s will contain the packet size
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_adv_cull_view(libnet_t *l, const u_int8_t **packet,
+u_int32_t *packet_s);
+
+#if !(__WIN32__)
+/**
+ * [Advanced Interface] 
+ * Describes the packet built in the given libnet context as a scatter-gather
+ * list suitable for writev() or sendmsg(), outermost header first. If no
+ * checksum is left for libnet to compute (they were all supplied, or turned
+ * off with libnet_toggle_checksum()), the entries point straight at the
+ * headers and payloads and nothing is copied. Otherwise the packet is
+ * coalesced and described by a single entry, as libnet_adv_cull_view()
+ * would return it. Either way the entries are only valid until the next
+ * build, write or cull on the context. This function is part of the
+ * advanced interface and is only available when libnet is initialized in
+ * advanced mode. If iov is too short the function fails and iov_n tells
+ * how many entries are needed; libnet_geterror() can tell you why it failed
+ * otherwise.
+ * @param l pointer to a libnet context
+ * @param iov the scatter-gather list to fill in
+ * @param iov_n the number of entries in iov, will contain the number used
+ * @param packet_s will contain the packet size
+ * @return 1 on success, -1 on failure
+ */
+int
+libnet_adv_cull_iov(libnet_t *l, struct iovec *iov, int *iov_n,
+u_int32_t *packet_s);
+#endif
+
 /**
  * [Advanced Interface] 
  * Writes a packet the network at the link layer. This function is useful to
@@ -1834,7 +2196,11 @@ libnet_cq_find_by_label(char *label);
 /**
  * [Context Queue] 
  * Destroys the entire context queue, calling libnet_destroy() on each
- * member context.
+ * member context. Waits for loops of other threads over the queue to end.
+ * A loop ends when it reaches the end of the queue, when its thread starts
+ * another loop with libnet_cq_head() or when its thread calls
+ * libnet_cq_end_loop(). A thread that leaves a loop early and never does
+ * one of these makes this function wait forever.
  */
 void
 libnet_cq_destroy();
@@ -1842,10 +2208,13 @@ libnet_cq_destroy();
 /**
  * [Context Queue] 
  * Intiailizes the interator interface and set a write lock on the entire
- * queue. This function is intended to be called just prior to interating
- * through the entire list of contexts (with the probable intent of inject a
- * series of packets in rapid succession). This function is often used as
- * per the following:
+ * queue, which lasts until the loop reaches the end of the queue or is ended
+ * with libnet_cq_end_loop(). Every thread has an iterator of its own, so
+ * several threads can loop over the queue at once; the queue can not be
+ * added to or removed from until they are all done. This function is
+ * intended to be called just prior to interating through the entire list of
+ * contexts (with the probable intent of inject a series of packets in rapid
+ * succession). This function is often used as per the following:
  *
  *    for (l = libnet_cq_head(); libnet_cq_last(); l = libnet_cq_next())
  *    {
@@ -1855,7 +2224,10 @@ libnet_cq_destroy();
  * Much of the time, the application programmer will use the iterator as it is
  * written above; as such, libnet provides a macro to do exactly that,
  * for_each_context_in_cq(l). Warning: do not call the iterator more than once
- * in a single loop.
+ * in a single loop. The queue can't be changed or destroyed while any
+ * thread loops over it, so a loop left early (a break, return or goto out
+ * of it) must be followed by libnet_cq_end_loop(). Calling libnet_cq_head()
+ * again starts the thread over without taking a second hold.
  * @return the head of the context queue
  */
 libnet_t *
@@ -1877,6 +2249,18 @@ libnet_cq_last();
 libnet_t *
 libnet_cq_next();
 
+/**
+ * [Context Queue] 
+ * Ends the calling thread's loop over the context queue before it reached
+ * the end of the queue (a break out of for_each_context_in_cq()), which
+ * releases the thread's hold on the write lock. This is required after
+ * every loop left early: until then libnet_cq_add() and libnet_cq_remove()
+ * fail and libnet_cq_destroy() waits.
+ * @return 1 if a loop was ended, 0 if the thread was not looping
+ */
+int
+libnet_cq_end_loop();
+
 /**
  * [Context Queue] 
  * Function returns the number of libnet contexts that are in the queue.
@@ -1924,6 +2308,14 @@ libnet_diag_dump_pblock_type(u_int8_t type);
 void
 libnet_diag_dump_hex(u_int8_t *packet, u_int32_t len, int swap, FILE *stream);
 
+/*
+ * [Internal] 
+ * Writes packet the way l was initialized to and bumps up l's stat
+ * counters; libnet_write() and libnet_template_write() end up here.
+ */
+int
+libnet_write_packet(libnet_t *l, u_int8_t *packet, u_int32_t len);
+
 /*
  * [Internal] 
  */
@@ -1942,6 +2334,37 @@ libnet_write_raw_ipv6(libnet_t *l, u_int8_t *packet, u_int32_t size);
 int
 libnet_write_link(libnet_t *l, u_int8_t *packet, u_int32_t size);
 
+/*
+ * [Internal] 
+ * Fills in addr (room for a struct sockaddr_storage) with the address
+ * libnet_write_link() sends frames to and sets addr_len to its length.
+ * Linux only.
+ */
+int
+libnet_link_sockaddr(libnet_t *l, void *addr, int *addr_len);
+
+/*
+ * [Internal] 
+ * Copies a frame into the next slot of l's transmit ring, waiting for the
+ * kernel to free one if the ring is full. Linux only.
+ */
+int
+libnet_tx_ring_put(libnet_t *l, u_int8_t *packet, u_int32_t size);
+
+/*
+ * [Internal] 
+ * Has the kernel send every frame queued on l's transmit ring. Linux only.
+ */
+int
+libnet_tx_ring_kick(libnet_t *l);
+
+/*
+ * [Internal] 
+ * Unmaps l's transmit ring, if it has one. Linux only.
+ */
+void
+libnet_tx_ring_destroy(libnet_t *l);
+
 #if ((__WIN32__) && !(__CYGWIN__))
 /*
  * [Internal] 
@@ -2012,6 +2435,9 @@ libnet_ip_check(u_int16_t *addr, int len);
 
 /*
  * [Internal] 
+ * Returns the one's complement sum of len bytes at addr, folded to 16 bits
+ * but not complemented (see LIBNET_CKSUM_CARRY). Uses SSE2 or AVX2 when the
+ * CPU has them.
  */
 int
 libnet_in_cksum(u_int16_t *addr, int len);
@@ -2035,6 +2461,39 @@ u_int8_t type);
 libnet_pblock_t *
 libnet_pblock_new(libnet_t *l, u_int32_t size);
 
+/*
+ * [Internal] 
+ * Function takes an unlinked pblock with at least size bytes of zeroed
+ * buffer from the context's free list, growing the arena if the list is
+ * empty.
+ */
+libnet_pblock_t *
+libnet_pblock_alloc(libnet_t *l, u_int32_t size);
+
+/*
+ * [Internal] 
+ * Function makes sure a pblock's buffer holds at least size bytes.  The
+ * contents are kept only if no allocation was needed.
+ */
+int
+libnet_pblock_reserve(libnet_t *l, libnet_pblock_t *p, u_int32_t size);
+
+/*
+ * [Internal] 
+ * Function puts an unlinked pblock on the context's free list, keeping its
+ * buffer for the next pblock.
+ */
+void
+libnet_pblock_release(libnet_t *l, libnet_pblock_t *p);
+
+/*
+ * [Internal] 
+ * Function frees the arena, the free list and the coalesce buffer.  The
+ * pblock list must be empty.
+ */
+void
+libnet_pblock_arena_free(libnet_t *l);
+
 /*
  * [Internal] 
  * Function swaps two pblocks in memory.
@@ -2059,14 +2518,22 @@ libnet_pblock_delete(libnet_t *l, libnet_pblock_t *p);
 
 /*
  * [Internal] 
- * Function updates the pblock meta-inforation.  Internally it updates the
- * ptag with a monotonically increasing variable kept in l.  This way each
- * pblock has a succesively increasing ptag identifier.
+ * Function updates the pblock meta-inforation.  Internally it tags the
+ * pblock with libnet_pblock_tag().
  */
 libnet_ptag_t
 libnet_pblock_update(libnet_t *l, libnet_pblock_t *p, u_int32_t h, 
 u_int8_t type);
 
+/*
+ * [Internal] 
+ * Function gives the pblock a ptag, a slot of its own in l's ptag table
+ * that libnet_pblock_find() looks it up in.  The slot is handed back when
+ * the pblock is deleted or the packet is cleared.
+ */
+libnet_ptag_t
+libnet_pblock_tag(libnet_t *l, libnet_pblock_t *p);
+
 
  /*
   * [Internal]
@@ -2113,10 +2580,23 @@ libnet_pblock_p2p(u_int8_t type);
  * [Internal] 
  * Function assembles the packet for subsequent writing.  Function makes two
  * passes through the pblock list:
+ * The packet is built in the context's coalesce buffer, which grows to the
+ * largest packet seen and is never freed before the context is; it is only
+ * valid until the next call.
  */
 int
 libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size);
 
+/*
+ * [Internal] 
+ * Writes the packet described by l's pblock list, l->total_size bytes, to
+ * buf and fills in the checksums there.  libnet_pblock_coalesce() calls it
+ * on the coalesce buffer; the advanced interface calls it on buffers of the
+ * application's.
+ */
+int
+libnet_pblock_assemble(libnet_t *l, u_int8_t *buf);
+
 #if !(__WIN32__)
 /*
  * [Internal] 
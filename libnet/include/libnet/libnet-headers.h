@@ -504,6 +504,9 @@ struct libnet_ethernet_hdr
 #ifndef ETHERTYPE_MPLS
 #define ETHERTYPE_MPLS          0x8847  /* MPLS */
 #endif
+#ifndef ETHERTYPE_IPV6
+#define ETHERTYPE_IPV6          0x86dd  /* IP protocol version 6 */
+#endif
 #ifndef ETHERTYPE_LOOPBACK
 #define ETHERTYPE_LOOPBACK      0x9000  /* used to test interfaces */
 #endif
@@ -151,6 +151,15 @@
 #define LIBNET_ISLOOPBACK(p) (strcmp((p)->ifr_name, "lo0") == 0)
 #endif
 
+/* storage class of the state libnet keeps per thread */
+#if (__GNUC__)
+#define LIBNET_TLS __thread
+#elif (_MSC_VER)
+#define LIBNET_TLS __declspec(thread)
+#else
+#define LIBNET_TLS
+#endif
+
 /* advanced mode check */
 #define LIBNET_ISADVMODE(x) (x & 0x08)
 
@@ -158,13 +167,14 @@
 #define LIBNET_LABEL_SIZE   64
 #define LIBNET_LABEL_DEFAULT "cardshark"
 #define CQ_LOCK_UNLOCKED    (u_int)0x00000000
-#define CQ_LOCK_READ        (u_int)0x00000001
-#define CQ_LOCK_WRITE       (u_int)0x00000002
+#define CQ_LOCK_READ        (u_int)0x00000001   /* one per reader */
+#define CQ_LOCK_WRITE       (u_int)0x80000000   /* held by a writer */
 
 /**
  * Provides an interface to iterate through the context queue of libnet
  * contexts. Before calling this macro, be sure to set the queue using
- * libnet_cq_head().
+ * libnet_cq_head(). Leaving the loop early requires libnet_cq_end_loop()
+ * afterwards (see libnet_cq_head()).
  */
 #define for_each_context_in_cq(l) \
     for (l = libnet_cq_head(); libnet_cq_last(); l = libnet_cq_next())
@@ -172,11 +182,14 @@
 /* return 1 if write lock is set on cq */
 #define cq_is_wlocked() (l_cqd.cq_lock & CQ_LOCK_WRITE)
 
-/* return 1 if read lock is set on cq */
-#define cq_is_rlocked() (l_cqd.cq_lock & CQ_LOCK_READ)
+/* return the number of readers holding the cq */
+#define cq_is_rlocked() (l_cqd.cq_lock & ~CQ_LOCK_WRITE)
 
 /* return 1 if any lock is set on cq */
-#define cq_is_locked() (l_cqd.cq_lock & (CQ_LOCK_READ | CQ_LOCK_WRITE))
+#define cq_is_locked() (l_cqd.cq_lock != CQ_LOCK_UNLOCKED)
+
+/* return the number of threads looping over the cq */
+#define cq_is_looped() (l_cqd.loops)
 
 /* check if a context queue is locked */
 #define check_cq_lock(x) (l_cqd.cq_lock & x)
@@ -47,6 +47,17 @@ struct libnet_port_list_chain
     libnet_plist_t *next;               /* next node in the list */
 };
 
+/* port set, one bit per port */
+#define LIBNET_PSET_WORDS       2048    /* 65536 ports in 32 bit words */
+#define LIBNET_PSET_BLOCKS      64      /* blocks of 1024 ports */
+typedef struct libnet_port_set libnet_pset_t;
+struct libnet_port_set
+{
+    u_int32_t bits[LIBNET_PSET_WORDS];  /* port p is bit p % 32 of p / 32 */
+    u_int16_t pop[LIBNET_PSET_BLOCKS];  /* ports set in each block */
+    u_int32_t count;                    /* ports in the set */
+};
+
 
 /* libnet statistics structure */
 struct libnet_stats
@@ -78,6 +89,7 @@ struct libnet_protocol_block
 {
     u_int8_t *buf;                      /* protocol buffer */
     u_int32_t b_len;                    /* length of buf */
+    u_int32_t b_cap;                    /* bytes allocated to buf */
     u_int16_t h_len;                    /* header length (for checksumming) */
     u_int32_t ip_offset;                /* offset to IP header for csums */
     u_int32_t copied;                   /* bytes copied */
@@ -154,6 +166,64 @@ struct libnet_protocol_block
 };
 typedef struct libnet_protocol_block libnet_pblock_t;
 
+/*
+ *  Libnet pblock arena
+ *  pblocks are carved out of chunks that live as long as the context.  A
+ *  deleted or cleared pblock goes on the context's free list with its
+ *  buffer, so rebuilding a packet reuses memory instead of allocating it.
+ */
+#define LIBNET_ARENA_PBLOCKS    16      /* pblocks per arena chunk */
+#define LIBNET_ARENA_ALIGN      64      /* coalesce buffer alignment */
+struct libnet_arena_chunk
+{
+    struct libnet_arena_chunk *next;    /* next chunk */
+    libnet_pblock_t pblocks[LIBNET_ARENA_PBLOCKS];
+};
+typedef struct libnet_arena_chunk libnet_arena_chunk_t;
+
+/*
+ *  Libnet ptag table
+ *  A ptag is the index of a slot in the context's ptag table (plus one) in
+ *  its low 16 bits and the slot's generation above them, so finding a
+ *  pblock by ptag is one array access however many pblocks the packet has,
+ *  and a ptag whose pblock is gone no longer matches once its slot is
+ *  handed out again.  The table points at the pblocks, so ptags stay valid
+ *  across libnet_pblock_swap() and libnet_pblock_insert_before().
+ */
+#define LIBNET_PTAG_SLOT_BITS   16
+#define LIBNET_PTAG_SLOT_MASK   0xffff  /* slot index + 1 */
+#define LIBNET_PTAG_GEN_MASK    0x7fff  /* keeps ptags positive */
+struct libnet_ptag_slot
+{
+    libnet_pblock_t *p;                 /* pblock with this slot, or NULL */
+    u_int32_t gen;                      /* times the slot was handed out */
+    u_int32_t next;                     /* next free slot + 1, or 0 */
+};
+
+/*
+ *  Libnet link-layer transmit ring (Linux PACKET_TX_RING)
+ *  Frames are copied into the mmap()ed ring and the kernel is told to send
+ *  them with one system call, see libnet_tx_ring().
+ */
+#define LIBNET_TX_RING_FRAMES   256     /* default frames in the ring */
+#define LIBNET_TX_FRAME_SIZE    2048    /* ring frame size, header included */
+
+/*
+ *  Libnet name resolution cache
+ *  libnet_name2addr4() keeps the names it resolved in a small direct mapped
+ *  table per thread, so a name looked up again is a hash and a string
+ *  compare away and no lock is needed.
+ */
+#define LIBNET_RESOLVE_ENTRIES  16      /* names cached per thread */
+#define LIBNET_RESOLVE_NAME     64      /* longer names aren't cached */
+#define LIBNET_RESOLVE_TTL      300     /* seconds a name is kept */
+struct libnet_resolve_entry
+{
+    char name[LIBNET_RESOLVE_NAME];     /* host name, empty if unused */
+    u_int32_t addr;                     /* address, network byte order */
+    time_t expires;                     /* time the entry goes stale */
+};
+
 
 /*
  *  Libnet context
@@ -181,6 +251,18 @@ struct libnet_context
     libnet_pblock_t *protocol_blocks;   /* protocol headers / data */
     libnet_pblock_t *pblock_end;        /* last node in list */
     u_int32_t n_pblocks;                /* number of pblocks */
+    libnet_pblock_t *pblock_free;       /* retired pblocks kept for reuse */
+    libnet_arena_chunk_t *arena;        /* chunks the pblocks live in */
+    struct libnet_ptag_slot *ptag_tab;  /* ptag table */
+    u_int32_t ptag_slots;               /* slots in ptag_tab */
+    u_int32_t ptag_free;                /* first free slot + 1, or 0 */
+    u_int8_t *packet_buf;               /* coalesce buffer, cache aligned */
+    u_int8_t *packet_mem;               /* packet_buf as malloc()ed */
+    u_int32_t packet_cap;               /* size of packet_buf */
+    u_int8_t *tx_ring;                  /* link-layer transmit ring or NULL */
+    u_int32_t tx_ring_len;              /* size of the tx_ring mapping */
+    u_int32_t tx_frame_nr;              /* frames in tx_ring */
+    u_int32_t tx_frame;                 /* next frame of tx_ring to fill */
 
     int link_type;                      /* link-layer type */
     int link_offset;                    /* link-layer header size */
@@ -188,7 +270,7 @@ struct libnet_context
     char *device;                       /* device name */
 
     struct libnet_stats stats;          /* statistics */
-    libnet_ptag_t ptag_state;           /* state holder for pblock tag */
+    libnet_ptag_t ptag_state;           /* pblock tags handed out so far */
     char label[LIBNET_LABEL_SIZE];      /* textual label for cq interface */
 
     char err_buf[LIBNET_ERRBUF_SIZE];   /* error buffer */
@@ -212,11 +294,88 @@ struct _libnet_context_queue
 struct _libnet_context_queue_descriptor
 {
     u_int32_t node;                     /* number of nodes in the list */
-    u_int32_t cq_lock;                  /* lock status */
-    libnet_cq_t *current;               /* current context */
+    volatile u_int32_t cq_lock;         /* lock status, see CQ_LOCK_* */
+    volatile u_int32_t loops;           /* threads looping over the queue */
 };
 typedef struct _libnet_context_queue_descriptor libnet_cqd_t;
 
+/* libnet batch statistics structure */
+struct libnet_batch_stats
+{
+#if (!defined(__WIN32__) || (__CYGWIN__))
+    u_int64_t syscalls;                 /* system calls made */
+    u_int64_t packets_sent;             /* packets sent */
+    u_int64_t packet_errors;            /* packets errors */
+    u_int64_t bytes_written;            /* bytes written */
+#else
+    __int64 syscalls;                   /* system calls made */
+    __int64 packets_sent;               /* packets sent */
+    __int64 packet_errors;              /* packets errors */
+    __int64 bytes_written;              /* bytes written */
+#endif
+};
+
+/*
+ *  Libnet write batch structure
+ *  Opaque structure.  Packets are copied in by libnet_batch_add() and
+ *  written with as few system calls as the platform allows by
+ *  libnet_write_batch().
+ */
+struct libnet_batch
+{
+    libnet_t *l;                        /* context the batch writes through */
+    u_int32_t size;                     /* most packets per system call */
+    u_int32_t n;                        /* packets queued */
+    u_int32_t n_max;                    /* packets the arrays below hold */
+    u_int32_t n_results;                /* packets the last write covered */
+    u_int32_t *off;                     /* offset of each packet in buf */
+    u_int32_t *len;                     /* length of each packet */
+    int *result;                        /* bytes written, or -1 */
+    u_int8_t *buf;                      /* the queued packets */
+    u_int32_t buf_len;                  /* bytes of buf in use */
+    u_int32_t buf_cap;                  /* bytes allocated to buf */
+    void *msgs;                         /* sendmmsg() vector, size entries */
+    void *iovs;                         /* one iovec per msgs entry */
+    void *names;                        /* one address per msgs entry */
+    struct libnet_batch_stats stats;    /* statistics */
+};
+typedef struct libnet_batch libnet_batch_t;
+
+/*
+ *  Libnet compiled packet template
+ *  Opaque structure.  libnet_template_compile() freezes the packet built in
+ *  a context into a wire image and notes where its headers start, so that
+ *  libnet_template_set() can patch fields in place and fix up the
+ *  checksums incrementally.
+ */
+struct libnet_template
+{
+    libnet_t *l;                        /* context the template belongs to */
+    u_int8_t *buf;                      /* the wire image */
+    u_int32_t len;                      /* length of the wire image */
+    int32_t ip_off;                     /* offset of the IP header, or -1 */
+    int32_t l4_off;                     /* offset of the TCP/UDP/ICMP header */
+    u_int32_t data_off;                 /* offset of the payload */
+    u_int8_t ip_v;                      /* IP version, 4 or 6 */
+    u_int8_t l4_proto;                  /* IPPROTO_* of the l4 header, or 0 */
+};
+typedef struct libnet_template libnet_template_t;
+
+/* fields libnet_template_set() knows about */
+#define LIBNET_TMPL_IP_ID       0x01    /* IPv4 identification */
+#define LIBNET_TMPL_IP_TOS      0x02    /* IPv4 type of service */
+#define LIBNET_TMPL_IP_TTL      0x03    /* IPv4 ttl / IPv6 hop limit */
+#define LIBNET_TMPL_IP_SRC      0x04    /* IPv4 source address */
+#define LIBNET_TMPL_IP_DST      0x05    /* IPv4 destination address */
+#define LIBNET_TMPL_SRC_PORT    0x06    /* TCP/UDP source port */
+#define LIBNET_TMPL_DST_PORT    0x07    /* TCP/UDP destination port */
+#define LIBNET_TMPL_TCP_SEQ     0x08    /* TCP sequence number */
+#define LIBNET_TMPL_TCP_ACK     0x09    /* TCP acknowledgement number */
+#define LIBNET_TMPL_TCP_WIN     0x0a    /* TCP window */
+#define LIBNET_TMPL_TCP_FLAGS   0x0b    /* TCP control flags */
+#define LIBNET_TMPL_ICMP_ID     0x0c    /* ICMP echo identifier */
+#define LIBNET_TMPL_ICMP_SEQ    0x0d    /* ICMP echo sequence number */
+
 #endif  /* __LIBNET_STRUCTURES_H */
 
 /* EOF */
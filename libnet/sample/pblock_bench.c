@@ -0,0 +1,309 @@
+/*
+ *  $Id$
+ *
+ *  libnet 1.1
+ *  pblock_bench.c - Packet building and writing rate
+ *
+ *  Copyright (c) 1998 - 2004 Mike D. Schiffman <mike@infonexus.com>
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#if (HAVE_CONFIG_H)
+#include "../include/config.h"
+#endif
+#include "./libnet_test.h"
+#include <sys/time.h>
+
+/*
+ *  Builds and writes UDP packets to a local address as fast as it can and
+ *  reports the rate.  In "rebuild" mode every packet is built from scratch
+ *  after libnet_clear_packet(), the way most programs use libnet; in
+ *  "update" mode the headers are modified in place through their ptags.
+ *  Both modes exercise pblock allocation and packet coalescing.  In
+ *  "template" mode (-t) the packet is built once and compiled into a
+ *  template, then only the source port is patched in for every packet.
+ *  The write is one sendto() per packet unless -b queues the packets on a
+ *  write batch, which sends up to that many packets per sendmmsg().  -i
+ *  writes Ethernet frames on a device instead of using a raw socket, and -r
+ *  has those go through a transmit ring of that many frames.
+ */
+
+int
+build(libnet_t *l, libnet_ptag_t *udp, libnet_ptag_t *ip, libnet_ptag_t *eth,
+        u_long dst_ip, u_short sport, u_char *payload, u_short payload_s)
+{
+    *udp = libnet_build_udp(
+        sport,                                      /* source port */
+        9,                                          /* destination port */
+        LIBNET_UDP_H + payload_s,                   /* packet length */
+        0,                                          /* checksum */
+        payload,                                    /* payload */
+        payload_s,                                  /* payload size */
+        l,                                          /* libnet handle */
+        *udp);                                      /* libnet id */
+    if (*udp == -1)
+    {
+        fprintf(stderr, "Can't build UDP header: %s\n", libnet_geterror(l));
+        return (-1);
+    }
+
+    *ip = libnet_build_ipv4(
+        LIBNET_IPV4_H + LIBNET_UDP_H + payload_s,   /* length */
+        0,                                          /* TOS */
+        242,                                        /* IP ID */
+        0,                                          /* IP Frag */
+        64,                                         /* TTL */
+        IPPROTO_UDP,                                /* protocol */
+        0,                                          /* checksum */
+        dst_ip,                                     /* source IP */
+        dst_ip,                                     /* destination IP */
+        NULL,                                       /* payload */
+        0,                                          /* payload size */
+        l,                                          /* libnet handle */
+        *ip);                                       /* libnet id */
+    if (*ip == -1)
+    {
+        fprintf(stderr, "Can't build IP header: %s\n", libnet_geterror(l));
+        return (-1);
+    }
+    if (eth == NULL)
+    {
+        return (1);
+    }
+
+    *eth = libnet_build_ethernet(
+        enet_dst,                                   /* ethernet destination */
+        (u_char *)libnet_get_hwaddr(l),             /* ethernet source */
+        ETHERTYPE_IP,                               /* protocol type */
+        NULL,                                       /* payload */
+        0,                                          /* payload size */
+        l,                                          /* libnet handle */
+        *eth);                                      /* libnet id */
+    if (*eth == -1)
+    {
+        fprintf(stderr, "Can't build ethernet header: %s\n",
+                libnet_geterror(l));
+        return (-1);
+    }
+    return (1);
+}
+
+int
+main(int argc, char **argv)
+{
+    int c, update, tmpl;
+    u_long i, count, batch_size, ring;
+    libnet_t *l;
+    libnet_batch_t *b;
+    libnet_template_t *t;
+    struct libnet_batch_stats bs;
+    libnet_ptag_t udp, ip, eth;
+    u_long dst_ip;
+    char *device, *dst;
+    u_char payload[64];
+    struct timeval start, end, elapsed;
+    double secs;
+    char errbuf[LIBNET_ERRBUF_SIZE];
+
+    b      = NULL;
+    t      = NULL;
+    count  = 1000000;
+    update = 0;
+    tmpl   = 0;
+    batch_size = 0;
+    ring   = 0;
+    device = NULL;
+    dst    = "127.0.0.1";
+    while ((c = getopt(argc, argv, "b:c:d:i:r:tu")) != EOF)
+    {
+        switch (c)
+        {
+            case 'b':
+                batch_size = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                dst = optarg;
+                break;
+            case 'i':
+                device = optarg;
+                break;
+            case 'r':
+                ring = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                tmpl = 1;
+                break;
+            case 'u':
+                update = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("libnet 1.1 packet building rate: UDP[%s]\n",
+            device ? "link" : "raw");
+
+    /*
+     *  Initialize the library.  Root priviledges are required.
+     */
+    l = libnet_init(
+            device ? LIBNET_LINK : LIBNET_RAW4,     /* injection type */
+            device,                                 /* network interface */
+            errbuf);                                /* errbuf */
+    if (l == NULL)
+    {
+        fprintf(stderr, "libnet_init() failed: %s", errbuf);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((dst_ip = libnet_name2addr4(l, dst, LIBNET_DONT_RESOLVE)) == -1)
+    {
+        fprintf(stderr, "Bad destination IP address: %s\n", dst);
+        goto bad;
+    }
+    if (ring)
+    {
+        if (device == NULL)
+        {
+            fprintf(stderr, "The transmit ring needs -i\n");
+            goto bad;
+        }
+        if (libnet_tx_ring(l, ring) != 1)
+        {
+            fprintf(stderr, "%s", libnet_geterror(l));
+        }
+    }
+    memset(payload, 0x42, sizeof (payload));
+
+    if (batch_size)
+    {
+        b = libnet_batch_init(l, batch_size);
+        if (b == NULL)
+        {
+            fprintf(stderr, "Can't create batch: %s\n", libnet_geterror(l));
+            goto bad;
+        }
+    }
+
+    udp = ip = eth = LIBNET_PTAG_INITIALIZER;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++)
+    {
+        if (tmpl)
+        {
+            if (t == NULL)
+            {
+                if (build(l, &udp, &ip, device ? &eth : NULL, dst_ip, 1024,
+                        payload, sizeof (payload)) == -1)
+                {
+                    goto bad;
+                }
+                t = libnet_template_compile(l);
+                if (t == NULL)
+                {
+                    fprintf(stderr, "Can't compile template: %s\n",
+                            libnet_geterror(l));
+                    goto bad;
+                }
+            }
+            libnet_template_set(t, LIBNET_TMPL_SRC_PORT, 1024 + (i & 0x7fff));
+        }
+        else
+        {
+            if (!update)
+            {
+                libnet_clear_packet(l);
+                udp = ip = eth = LIBNET_PTAG_INITIALIZER;
+            }
+            if (build(l, &udp, &ip, device ? &eth : NULL, dst_ip,
+                    (u_short)(1024 + (i & 0x7fff)), payload,
+                    sizeof (payload)) == -1)
+            {
+                goto bad;
+            }
+        }
+        if (b)
+        {
+            if ((t ? libnet_batch_add_template(b, t) :
+                    libnet_batch_add(b, l)) == -1)
+            {
+                fprintf(stderr, "Batch error: %s\n", libnet_geterror(l));
+                goto bad;
+            }
+            if ((i + 1) % batch_size && i + 1 < count)
+            {
+                continue;
+            }
+            if (libnet_write_batch(b) == -1)
+            {
+                fprintf(stderr, "Write error: %s\n", libnet_geterror(l));
+                goto bad;
+            }
+        }
+        else if ((t ? libnet_template_write(t) : libnet_write(l)) == -1)
+        {
+            fprintf(stderr, "Write error: %s\n", libnet_geterror(l));
+            goto bad;
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    libnet_timersub(&end, &start, &elapsed);
+    secs = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+    printf("%s: %lu packets in %.3f seconds, %.0f packets/sec\n",
+            tmpl ? "template" : update ? "update" : "rebuild", count, secs,
+            secs > 0 ? count / secs : 0);
+    if (b)
+    {
+        libnet_batch_stats(b, &bs);
+        printf("batch: %lld packets (%lld errors) in %lld system calls\n",
+                (long long)bs.packets_sent, (long long)bs.packet_errors,
+                (long long)bs.syscalls);
+    }
+
+    libnet_template_destroy(t);
+    libnet_batch_destroy(b);
+    libnet_destroy(l);
+    return (EXIT_SUCCESS);
+bad:
+    libnet_template_destroy(t);
+    libnet_batch_destroy(b);
+    libnet_destroy(l);
+    return (EXIT_FAILURE);
+}
+
+void
+usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-b batch_size] [-c count] [-d destination_ip]"
+            " [-i device [-r ring_frames]] [-t | -u]\n", name);
+}
+
+/* EOF */
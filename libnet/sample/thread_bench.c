@@ -0,0 +1,288 @@
+/*
+ *  $Id$
+ *
+ *  libnet 1.1
+ *  thread_bench.c - Multi-threaded packet building and writing rate
+ *
+ *  Copyright (c) 1998 - 2004 Mike D. Schiffman <mike@infonexus.com>
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#if (HAVE_CONFIG_H)
+#include "../include/config.h"
+#endif
+#include "./libnet_test.h"
+#include <sys/time.h>
+#include <pthread.h>
+
+/*
+ *  Builds and writes UDP packets with random source ports and IP ids from
+ *  1, 2, 4 ... up to -T threads at once and reports the rate for each
+ *  thread count, to see how libnet scales.  Every thread has a context of
+ *  its own, found in the context queue by label, and every 1024 packets it
+ *  loops over the whole queue, the way a program injecting through several
+ *  contexts would.  -n only builds and coalesces the packets, leaving the
+ *  kernel out of the measurement.
+ */
+
+struct worker
+{
+    pthread_t tid;
+    char label[LIBNET_LABEL_SIZE];
+    u_long count;
+    u_long dst_ip;
+    int no_write;
+    int ret;
+};
+
+void *
+work(void *arg)
+{
+    struct worker *w;
+    libnet_t *l, *q;
+    libnet_ptag_t udp, ip;
+    u_char payload[64];
+    u_int8_t *packet;
+    u_int32_t len;
+    u_long i, n;
+
+    w = arg;
+    w->ret = -1;
+    l = libnet_cq_find_by_label(w->label);
+    if (l == NULL)
+    {
+        fprintf(stderr, "%s: not in the context queue\n", w->label);
+        return (NULL);
+    }
+    libnet_seed_prand(l);
+    memset(payload, 0x42, sizeof (payload));
+
+    udp = ip = LIBNET_PTAG_INITIALIZER;
+    for (i = 0; i < w->count; i++)
+    {
+        udp = libnet_build_udp(
+            libnet_get_prand(LIBNET_PRu16),             /* source port */
+            9,                                          /* destination port */
+            LIBNET_UDP_H + sizeof (payload),            /* packet length */
+            0,                                          /* checksum */
+            payload,                                    /* payload */
+            sizeof (payload),                           /* payload size */
+            l,                                          /* libnet handle */
+            udp);                                       /* libnet id */
+        ip = libnet_build_ipv4(
+            LIBNET_IPV4_H + LIBNET_UDP_H + sizeof (payload), /* length */
+            0,                                          /* TOS */
+            libnet_get_prand(LIBNET_PRu16),             /* IP ID */
+            0,                                          /* IP Frag */
+            64,                                         /* TTL */
+            IPPROTO_UDP,                                /* protocol */
+            0,                                          /* checksum */
+            w->dst_ip,                                  /* source IP */
+            w->dst_ip,                                  /* destination IP */
+            NULL,                                       /* payload */
+            0,                                          /* payload size */
+            l,                                          /* libnet handle */
+            ip);                                        /* libnet id */
+        if (udp == -1 || ip == -1)
+        {
+            fprintf(stderr, "%s: can't build packet: %s\n", w->label,
+                    libnet_geterror(l));
+            return (NULL);
+        }
+        if (w->no_write)
+        {
+            if (libnet_pblock_coalesce(l, &packet, &len) == -1)
+            {
+                fprintf(stderr, "%s: %s\n", w->label, libnet_geterror(l));
+                return (NULL);
+            }
+        }
+        else if (libnet_write(l) == -1)
+        {
+            fprintf(stderr, "%s: write error: %s\n", w->label,
+                    libnet_geterror(l));
+            return (NULL);
+        }
+
+        if ((i & 1023) == 0)
+        {
+            n = 0;
+            for_each_context_in_cq(q)
+            {
+                n += q != NULL;
+            }
+            if (n != libnet_cq_size())
+            {
+                fprintf(stderr, "%s: looped over %lu of %u contexts\n",
+                        w->label, n, libnet_cq_size());
+                return (NULL);
+            }
+        }
+    }
+    w->ret = 1;
+    return (NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    int c, no_write;
+    u_long k, n, threads, count, dst_ip;
+    struct worker *w;
+    libnet_t *l;
+    char *dst;
+    struct timeval start, end, elapsed;
+    double secs, rate, rate1;
+    char errbuf[LIBNET_ERRBUF_SIZE];
+
+    threads  = 4;
+    count    = 200000;
+    no_write = 0;
+    dst      = "127.0.0.1";
+    while ((c = getopt(argc, argv, "c:d:nT:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                dst = optarg;
+                break;
+            case 'n':
+                no_write = 1;
+                break;
+            case 'T':
+                threads = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (threads == 0)
+    {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("libnet 1.1 threaded packet building rate: UDP[raw]%s\n",
+            no_write ? ", not written" : "");
+
+    w = calloc(threads, sizeof (struct worker));
+    if (w == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     *  Initialize a context per thread.  Root priviledges are required.
+     */
+    for (k = 0; k < threads; k++)
+    {
+        l = libnet_init(
+                LIBNET_RAW4,                        /* injection type */
+                NULL,                               /* network interface */
+                errbuf);                            /* errbuf */
+        if (l == NULL)
+        {
+            fprintf(stderr, "libnet_init() failed: %s", errbuf);
+            goto bad;
+        }
+        snprintf(w[k].label, sizeof (w[k].label), "thread%lu", k);
+        if (libnet_cq_add(l, w[k].label) == -1)
+        {
+            fprintf(stderr, "libnet_cq_add() failed: %s", libnet_geterror(l));
+            libnet_destroy(l);
+            goto bad;
+        }
+    }
+
+    if ((dst_ip = libnet_name2addr4(l, dst, LIBNET_DONT_RESOLVE)) == -1)
+    {
+        fprintf(stderr, "Bad destination IP address: %s\n", dst);
+        goto bad;
+    }
+
+    rate1 = 0;
+    for (n = 1; n <= threads; n *= 2)
+    {
+        if (n * 2 > threads)
+        {
+            /* the last round runs every thread */
+            n = threads;
+        }
+        gettimeofday(&start, NULL);
+        for (k = 0; k < n; k++)
+        {
+            w[k].count    = count;
+            w[k].dst_ip   = dst_ip;
+            w[k].no_write = no_write;
+            if (pthread_create(&w[k].tid, NULL, work, &w[k]) != 0)
+            {
+                fprintf(stderr, "Can't start thread %lu\n", k);
+                goto bad;
+            }
+        }
+        for (k = 0; k < n; k++)
+        {
+            pthread_join(w[k].tid, NULL);
+            if (w[k].ret == -1)
+            {
+                goto bad;
+            }
+        }
+        gettimeofday(&end, NULL);
+
+        libnet_timersub(&end, &start, &elapsed);
+        secs = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+        rate = secs > 0 ? n * count / secs : 0;
+        if (n == 1)
+        {
+            rate1 = rate;
+        }
+        printf("%2lu threads: %lu packets in %.3f seconds, %.0f packets/sec"
+                " (%.2fx)\n", n, n * count, secs, rate,
+                rate1 > 0 ? rate / rate1 : 0);
+    }
+
+    libnet_cq_destroy();
+    free(w);
+    return (EXIT_SUCCESS);
+bad:
+    libnet_cq_destroy();
+    free(w);
+    return (EXIT_FAILURE);
+}
+
+void
+usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-c count_per_thread] [-d destination_ip]"
+            " [-n] [-T max_threads]\n", name);
+}
+
+/* EOF */
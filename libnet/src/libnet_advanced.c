@@ -42,6 +42,8 @@
 int
 libnet_adv_cull_packet(libnet_t *l, u_int8_t **packet, u_int32_t *packet_s)
 {
+    u_int8_t *built, *copy;
+
     *packet = NULL;
     *packet_s = 0;
 
@@ -53,7 +55,28 @@ libnet_adv_cull_packet(libnet_t *l, u_int8_t **packet, u_int32_t *packet_s)
     }
 
     /* checksums will be written in */
-    return (libnet_pblock_coalesce(l, packet, packet_s));
+    if (libnet_pblock_coalesce(l, &built, packet_s) == -1)
+    {
+        /* err msg set in libnet_pblock_coalesce() */
+        return (-1);
+    }
+
+    /*
+     *  The coalesce buffer is reused by the next write, and the caller
+     *  owns what it culls until libnet_adv_free_packet(), so hand out a
+     *  copy laid out the way libnet_adv_free_packet() expects.
+     */
+    copy = malloc(l->aligner + *packet_s);
+    if (copy == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        *packet_s = 0;
+        return (-1);
+    }
+    memcpy(copy + l->aligner, built, *packet_s);
+    *packet = copy + l->aligner;
+    return (1);
 }
 
 int
@@ -85,6 +108,145 @@ libnet_adv_cull_header(libnet_t *l, libnet_ptag_t ptag, u_int8_t **header,
     return (1);
 }
 
+int
+libnet_adv_cull_into(libnet_t *l, u_int8_t *buf, u_int32_t buf_s,
+        u_int32_t *packet_s)
+{
+    *packet_s = 0;
+
+    if (!(l->injection_type & LIBNET_ADV_MASK))
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): advanced mode not enabled\n", __func__);
+        return (-1);
+    }
+
+    if (l->total_size > buf_s)
+    {
+        /* tell the caller how much room it needs */
+        *packet_s = l->total_size;
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): packet is %d bytes, buffer holds %d\n", __func__,
+                l->total_size, buf_s);
+        return (-1);
+    }
+
+    /* checksums will be written in */
+    if (libnet_pblock_assemble(l, buf) == -1)
+    {
+        /* err msg set in libnet_pblock_assemble() */
+        return (-1);
+    }
+    *packet_s = l->total_size;
+    return (1);
+}
+
+int
+libnet_adv_cull_view(libnet_t *l, const u_int8_t **packet,
+        u_int32_t *packet_s)
+{
+    u_int8_t *built;
+
+    *packet = NULL;
+    *packet_s = 0;
+
+    if (!(l->injection_type & LIBNET_ADV_MASK))
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): advanced mode not enabled\n", __func__);
+        return (-1);
+    }
+
+    /*
+     *  The view is the coalesce buffer itself, so it only lasts until the
+     *  next build, write or cull on this context.
+     */
+    if (libnet_pblock_coalesce(l, &built, packet_s) == -1)
+    {
+        /* err msg set in libnet_pblock_coalesce() */
+        return (-1);
+    }
+    *packet = built;
+    return (1);
+}
+
+#if !(__WIN32__)
+int
+libnet_adv_cull_iov(libnet_t *l, struct iovec *iov, int *iov_n,
+        u_int32_t *packet_s)
+{
+    libnet_pblock_t *p;
+    u_int8_t *built;
+    int n;
+
+    *packet_s = 0;
+
+    if (!(l->injection_type & LIBNET_ADV_MASK))
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): advanced mode not enabled\n", __func__);
+        *iov_n = 0;
+        return (-1);
+    }
+
+    /*
+     *  A checksum covers everything after its header, so it can only be
+     *  computed over the coalesced packet.  If one is due the packet goes
+     *  out as one entry on the coalesce buffer.  Otherwise the entries
+     *  point at the pblocks themselves, outermost header first, and
+     *  nothing is copied at all.
+     */
+    for (n = 0, p = l->protocol_blocks; p; p = p->next)
+    {
+        if (p->flags & LIBNET_PBLOCK_DO_CHECKSUM)
+        {
+            break;
+        }
+        n += p->b_len > 0;
+    }
+
+    if (p)
+    {
+        if (*iov_n < 1)
+        {
+            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): iovec needs 1 entry\n", __func__);
+            *iov_n = 1;
+            return (-1);
+        }
+        if (libnet_pblock_coalesce(l, &built, packet_s) == -1)
+        {
+            /* err msg set in libnet_pblock_coalesce() */
+            return (-1);
+        }
+        iov[0].iov_base = built;
+        iov[0].iov_len  = *packet_s;
+        *iov_n = 1;
+        return (1);
+    }
+
+    if (*iov_n < n)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): iovec needs %d entries\n", __func__, n);
+        *iov_n = n;
+        return (-1);
+    }
+    for (n = 0, p = l->pblock_end; p; p = p->prev)
+    {
+        if (p->b_len)
+        {
+            iov[n].iov_base = p->buf;
+            iov[n].iov_len  = p->b_len;
+            n++;
+        }
+    }
+    *iov_n = n;
+    *packet_s = l->total_size;
+    return (1);
+}
+#endif
+
 int
 libnet_adv_write_link(libnet_t *l, u_int8_t *packet, u_int32_t packet_s)
 {
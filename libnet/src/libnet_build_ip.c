@@ -182,7 +182,7 @@ u_int8_t *payload, u_int32_t payload_s, libnet_t *l, libnet_ptag_t ptag)
             {
                 /* update without setting this as the final pblock */
                 p_data->type  =  LIBNET_PBLOCK_IPDATA;
-                p_data->ptag  =  ++(l->ptag_state);
+                libnet_pblock_tag(l, p_data);
                 p_data->h_len =  payload_s;
 
                 /* Adjust h_len for checksum. */
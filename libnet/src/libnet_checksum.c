@@ -38,26 +38,190 @@
 #else
 #include "../include/win32/libnet.h"
 #endif
-int
-libnet_in_cksum(u_int16_t *addr, int len)
+
+#if (defined(__GNUC__) && (__GNUC__ > 4 || \
+        (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+        (defined(__x86_64__) || defined(__i386__)))
+#define LIBNET_CKSUM_SIMD 1
+#endif
+
+/*
+ *  The one's complement sum does not depend on the byte order the words are
+ *  added in, nor on adding 32-bit words instead of 16-bit ones as long as the
+ *  carries are folded back in at the end.  All of the kernels below add the
+ *  buffer as native 32-bit words into a 64-bit accumulator, which can not
+ *  overflow for any buffer libnet builds, and leave the folding to the
+ *  caller.  The odd trailing byte is added as if it were followed by a zero.
+ */
+static u_int64_t
+libnet_cksum_scalar(const u_int8_t *p, int len)
 {
-    int sum;
+    u_int64_t sum;
+    u_int32_t w[4];
+    u_int16_t h;
 
     sum = 0;
-
-    while (len > 1)
+    while (len >= 16)
+    {
+        memcpy(w, p, 16);
+        sum += (u_int64_t)w[0] + w[1] + w[2] + w[3];
+        p   += 16;
+        len -= 16;
+    }
+    while (len >= 4)
+    {
+        memcpy(w, p, 4);
+        sum += w[0];
+        p   += 4;
+        len -= 4;
+    }
+    if (len >= 2)
     {
-        sum += *addr++;
+        memcpy(&h, p, 2);
+        sum += h;
+        p   += 2;
         len -= 2;
     }
     if (len == 1)
     {
-        sum += *(u_int16_t *)addr;
+        h = 0;
+        *(u_int8_t *)&h = *p;
+        sum += h;
     }
-
     return (sum);
 }
 
+#if (LIBNET_CKSUM_SIMD)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static u_int64_t
+libnet_cksum_sse2(const u_int8_t *p, int len)
+{
+    __m128i zero, v, acc0, acc1;
+    u_int64_t lanes[2];
+
+    zero = _mm_setzero_si128();
+    acc0 = zero;
+    acc1 = zero;
+    while (len >= 32)
+    {
+        v    = _mm_loadu_si128((const __m128i *)p);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        v    = _mm_loadu_si128((const __m128i *)(p + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        p   += 32;
+        len -= 32;
+    }
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    return (lanes[0] + lanes[1] + libnet_cksum_scalar(p, len));
+}
+
+__attribute__((target("avx2")))
+static u_int64_t
+libnet_cksum_avx2(const u_int8_t *p, int len)
+{
+    __m256i zero, v, acc0, acc1;
+    u_int64_t lanes[4];
+
+    zero = _mm256_setzero_si256();
+    acc0 = zero;
+    acc1 = zero;
+    while (len >= 64)
+    {
+        v    = _mm256_loadu_si256((const __m256i *)p);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        v    = _mm256_loadu_si256((const __m256i *)(p + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        p   += 64;
+        len -= 64;
+    }
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    return (lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+            libnet_cksum_sse2(p, len));
+}
+#endif /* LIBNET_CKSUM_SIMD */
+
+/*
+ *  The kernel libnet_in_cksum() uses, picked on the first call.  Picking it
+ *  twice from two threads is harmless, both store the same pointer.
+ */
+static u_int64_t (*libnet_cksum_kernel)(const u_int8_t *, int) = NULL;
+
+static void
+libnet_cksum_select()
+{
+#if (LIBNET_CKSUM_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        libnet_cksum_kernel = libnet_cksum_avx2;
+        return;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        libnet_cksum_kernel = libnet_cksum_sse2;
+        return;
+    }
+#endif
+    libnet_cksum_kernel = libnet_cksum_scalar;
+}
+
+int
+libnet_in_cksum(u_int16_t *addr, int len)
+{
+    u_int64_t sum;
+
+    if (len <= 0)
+    {
+        return (0);
+    }
+    if (libnet_cksum_kernel == NULL)
+    {
+        libnet_cksum_select();
+    }
+    sum = libnet_cksum_kernel((const u_int8_t *)addr, len);
+
+    /*
+     *  Fold down to 16 bits so callers can keep adding a few more sums into
+     *  an int before LIBNET_CKSUM_CARRY() without overflowing it.
+     */
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return ((int)sum);
+}
+
+
+u_int16_t
+libnet_adjust_checksum(u_int16_t sum, u_int16_t old_v, u_int16_t new_v)
+{
+    u_int32_t x;
+
+    /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+    x = (u_int16_t)~sum;
+    x += (u_int16_t)~old_v;
+    x += new_v;
+    x = (x >> 16) + (x & 0xffff);
+    x = (x >> 16) + (x & 0xffff);
+    return ((u_int16_t)~x);
+}
+
+
+u_int16_t
+libnet_adjust_checksum32(u_int16_t sum, u_int32_t old_v, u_int32_t new_v)
+{
+    sum = libnet_adjust_checksum(sum, (u_int16_t)(old_v >> 16),
+            (u_int16_t)(new_v >> 16));
+    return (libnet_adjust_checksum(sum, (u_int16_t)(old_v & 0xffff),
+            (u_int16_t)(new_v & 0xffff)));
+}
+
 int
 libnet_toggle_checksum(libnet_t *l, libnet_ptag_t ptag, int mode)
 {
@@ -40,6 +40,10 @@
 #include "../include/win32/libnet.h"
 #endif
 
+#if (!(_WIN32) || (__CYGWIN__))
+#include <sched.h>
+#endif
+
 /* private function prototypes */
 static libnet_cq_t *libnet_cq_find_internal(libnet_t *);
 static int libnet_cq_dup_check(libnet_t *, char *);
@@ -47,29 +51,62 @@ static libnet_cq_t *libnet_cq_find_by_label_internal(char *label);
 
 /* global context queue */
 static libnet_cq_t *l_cq = NULL;
-static libnet_cqd_t l_cqd = {0, CQ_LOCK_UNLOCKED, NULL};
+static libnet_cqd_t l_cqd = {0, CQ_LOCK_UNLOCKED, 0};
+
+/* where the calling thread's loop over the queue is */
+static LIBNET_TLS libnet_cq_t *l_cq_current = NULL;
 
+/*
+ *  The queue is guarded by a reader/writer spin lock in l_cqd.cq_lock:
+ *  lookups hold it shared for the length of a list walk, changes to the
+ *  list hold it exclusively.  A thread looping over the queue holds no lock
+ *  at all between libnet_cq_head() and the end of the loop, it only counts
+ *  itself in l_cqd.loops, and the list is not changed while anyone loops.
+ *  That lets any number of threads loop at once, each with its own cursor.
+ */
+#if ((__WIN32__) && !(__CYGWIN__))
+#define cq_cas(p, o, n) \
+    (InterlockedCompareExchange((LONG volatile *)(p), (n), (o)) == (LONG)(o))
+#define cq_add(p, v)    InterlockedExchangeAdd((LONG volatile *)(p), (v))
+#define cq_yield()      Sleep(0)
+#else
+#define cq_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define cq_add(p, v)    __sync_fetch_and_add((p), (v))
+#define cq_yield()      sched_yield()
+#endif
 
-static inline int set_cq_lock(u_int x) 
+static inline void cq_rlock(void)
 {
-    if (check_cq_lock(x))
+    u_int32_t x;
+
+    for (;;)
     {
-        return (0);
+        x = l_cqd.cq_lock;
+        if (!(x & CQ_LOCK_WRITE) &&
+                cq_cas(&l_cqd.cq_lock, x, x + CQ_LOCK_READ))
+        {
+            return;
+        }
+        cq_yield();
     }
+}
 
-    l_cqd.cq_lock |= x;
-    return (1);
+static inline void cq_runlock(void)
+{
+    cq_add(&l_cqd.cq_lock, -(int)CQ_LOCK_READ);
 }
 
-static inline int clear_cq_lock(u_int x) 
+static inline void cq_wlock(void)
 {
-    if (!check_cq_lock(x))
+    while (!cq_cas(&l_cqd.cq_lock, CQ_LOCK_UNLOCKED, CQ_LOCK_WRITE))
     {
-        return (0);
+        cq_yield();
     }
+}
 
-    l_cqd.cq_lock &= ~x;
-    return (1);
+static inline void cq_wunlock(void)
+{
+    cq_cas(&l_cqd.cq_lock, CQ_LOCK_WRITE, CQ_LOCK_UNLOCKED);
 }
 
 int 
@@ -82,14 +119,6 @@ libnet_cq_add(libnet_t *l, char *label)
         return (-1);
     }
 
-    /* check for write lock on the context queue */
-    if (cq_is_wlocked()) 
-    {
-        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                "%s(): can't add, context queue is write locked\n", __func__);
-        return (-1);
-    }
-  
     /* ensure there is a label */
     if (label == NULL)
     {
@@ -98,46 +127,32 @@ libnet_cq_add(libnet_t *l, char *label)
         return (-1);
     }
 
-    /* check to see if we're the first node on the list */
-    if (l_cq == NULL)
+    new = (libnet_cq_t *)malloc(sizeof (libnet_cq_t));
+    if (new == NULL)
     {
-        l_cq = (libnet_cq_t *)malloc(sizeof (libnet_cq_t));
-        if (l_cq == NULL)
-        {
-            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                    "%s(): can't malloc initial context queue: %s\n",
-                    __func__, strerror(errno));
-            return (-1);
-        }
-
-        l_cq->context = l;
-
-        /* label the context with the user specified string */
-        strncpy(l->label, label, LIBNET_LABEL_SIZE);
-        l->label[LIBNET_LABEL_SIZE] = '\0';
-
-        l_cq->next = NULL;
-        l_cq->prev = NULL;
-
-        /* track the number of nodes in the context queue */
-        l_cqd.node = 1;
-
-        return (1);
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): can't malloc new context queue: %s\n",
+                __func__, strerror(errno));
+        return (-1);
     }
 
-    /* check to see if the cq we're about to add is already in the list */
-    if (libnet_cq_dup_check(l, label)) 
+    cq_wlock();
+    /* the queue can't change under a loop */
+    if (cq_is_looped()) 
     {
-        /* error message set in libnet_cq_dup_check() */
+        cq_wunlock();
+        free(new);
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): can't add, context queue is write locked\n", __func__);
         return (-1);
     }
 
-    new = (libnet_cq_t *)malloc(sizeof (libnet_cq_t));
-    if (l_cq == NULL)
+    /* check to see if the cq we're about to add is already in the list */
+    if (libnet_cq_dup_check(l, label)) 
     {
-        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                "%s(): can't malloc new context queue: %s\n",
-                __func__, strerror(errno));
+        cq_wunlock();
+        free(new);
+        /* error message set in libnet_cq_dup_check() */
         return (-1);
     }
 
@@ -145,16 +160,20 @@ libnet_cq_add(libnet_t *l, char *label)
 
     /* label the context with the user specified string */
     strncpy(l->label, label, LIBNET_LABEL_SIZE);
-    l->label[LIBNET_LABEL_SIZE] = '\0';
+    l->label[LIBNET_LABEL_SIZE - 1] = '\0';
 
     new->next = l_cq;
     new->prev = NULL;
 
-    l_cq->prev = new;
+    if (l_cq)
+    {
+        l_cq->prev = new;
+    }
     l_cq = new;
 
     /* track the number of nodes in the context queue */
     l_cqd.node++;
+    cq_wunlock();
 
     return (1); 
 }
@@ -165,23 +184,24 @@ libnet_cq_remove(libnet_t *l)
     libnet_cq_t *p;
     libnet_t *ret;
 
-    if (l_cq == NULL) 
+    if (l == NULL)
     {
-        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                "%s(): can't remove from empty context queue\n", __func__);
         return (NULL);
     }
 
-    if (l == NULL)
+    cq_wlock();
+    if (l_cq == NULL) 
     {
+        cq_wunlock();
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                "%s(): can't remove empty libnet context\n", __func__);
-        return(NULL);
+                "%s(): can't remove from empty context queue\n", __func__);
+        return (NULL);
     }
 
     /* check for write lock on the cq */
-    if (cq_is_wlocked()) 
+    if (cq_is_looped()) 
     {
+        cq_wunlock();
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                 "%s(): can't remove, context queue is write locked\n",
                 __func__);
@@ -190,6 +210,7 @@ libnet_cq_remove(libnet_t *l)
   
     if ((p = libnet_cq_find_internal(l)) == NULL)
     {
+        cq_wunlock();
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                 "%s(): context not present in context queue\n", __func__);
         return (NULL);
@@ -208,12 +229,12 @@ libnet_cq_remove(libnet_t *l)
         p->next->prev = p->prev;
     }
 
-    ret = p->context;
-    free(p);
-
     /* track the number of nodes in the cq */
     l_cqd.node--;
-  
+    cq_wunlock();
+
+    ret = p->context;
+    free(p);
     return (ret);
 }
 
@@ -223,14 +244,17 @@ libnet_cq_remove_by_label(char *label)
     libnet_cq_t *p;
     libnet_t *ret;
 
+    cq_wlock();
     if ((p = libnet_cq_find_by_label_internal(label)) == NULL)
     {
+        cq_wunlock();
         /* no context to write an error message */
         return (NULL);
     }
 
-    if (cq_is_wlocked()) 
+    if (cq_is_looped()) 
     {
+        cq_wunlock();
         /* now we have a context, but the user can't see it */
         return (NULL);
     }
@@ -248,15 +272,16 @@ libnet_cq_remove_by_label(char *label)
         p->next->prev = p->prev;
     }
 
-    ret = p->context;
-    free(p);
-
     /* track the number of nodes in the cq */
     l_cqd.node--;
-  
+    cq_wunlock();
+
+    ret = p->context;
+    free(p);
     return (ret);
 }
 
+/* call with the cq locked */
 libnet_cq_t *
 libnet_cq_find_internal(libnet_t *l) 
 {
@@ -272,6 +297,7 @@ libnet_cq_find_internal(libnet_t *l)
     return (NULL);
 }
 
+/* call with the cq locked */
 int
 libnet_cq_dup_check(libnet_t *l, char *label)
 {
@@ -296,6 +322,7 @@ libnet_cq_dup_check(libnet_t *l, char *label)
     return (0);
 }
 
+/* call with the cq locked */
 libnet_cq_t *
 libnet_cq_find_by_label_internal(char *label) 
 {
@@ -321,7 +348,9 @@ libnet_cq_find_by_label(char *label)
 {
     libnet_cq_t *p;
   
+    cq_rlock();
     p = libnet_cq_find_by_label_internal(label);
+    cq_runlock();
     return (p ? p->context : NULL);
 }
 
@@ -334,9 +363,30 @@ libnet_cq_getlabel(libnet_t *l)
 void
 libnet_cq_destroy() 
 {
-    libnet_cq_t *p = l_cq;
+    libnet_cq_t *p;
     libnet_cq_t *tmp;
 
+    /*
+     *  A loop of our own would never end.  Other threads' loops end when
+     *  they reach the end of the queue, start over or call
+     *  libnet_cq_end_loop(); one left early for good is waited on forever.
+     */
+    libnet_cq_end_loop();
+    for (;;)
+    {
+        cq_wlock();
+        if (!cq_is_looped())
+        {
+            break;
+        }
+        cq_wunlock();
+        cq_yield();
+    }
+    p = l_cq;
+    l_cq = NULL;
+    l_cqd.node = 0;
+    cq_wunlock();
+
     while (p)
     {
         tmp = p;
@@ -349,24 +399,31 @@ libnet_cq_destroy()
 libnet_t *
 libnet_cq_head()
 {
+    cq_rlock();
     if (l_cq == NULL) 
     {
+        cq_runlock();
         return (NULL);
     }
 
-    if (!set_cq_lock(CQ_LOCK_WRITE)) 
+    /*
+     *  A loop holds the queue until it reaches the end.  A thread starting
+     *  over after leaving a loop early keeps the hold it has rather than
+     *  taking a second one, which would never be dropped.
+     */
+    if (l_cq_current == NULL)
     {
-        return (NULL);
+        cq_add(&l_cqd.loops, 1);
     }
-
-    l_cqd.current = l_cq;
-    return (l_cqd.current->context);
+    l_cq_current = l_cq;
+    cq_runlock();
+    return (l_cq_current->context);
 }
 
 int
 libnet_cq_last()
 {
-    if (l_cqd.current)
+    if (l_cq_current)
     {
         return (1);
     }
@@ -379,13 +436,33 @@ libnet_cq_last()
 libnet_t *
 libnet_cq_next()
 {
-    if (l_cqd.current == NULL)
+    if (l_cq_current == NULL)
     {
         return (NULL);
     }
 
-    l_cqd.current = l_cqd.current->next;
-    return (l_cqd.current ? l_cqd.current->context : NULL);
+    /* the list can't change while we loop, no need to lock */
+    l_cq_current = l_cq_current->next;
+    if (l_cq_current == NULL)
+    {
+        /* the loop is over */
+        cq_add(&l_cqd.loops, -1);
+        return (NULL);
+    }
+    return (l_cq_current->context);
+}
+
+int
+libnet_cq_end_loop()
+{
+    if (l_cq_current == NULL)
+    {
+        return (0);
+    }
+
+    l_cq_current = NULL;
+    cq_add(&l_cqd.loops, -1);
+    return (1);
 }
 
 u_int32_t
@@ -115,7 +115,7 @@ register int8_t *errbuf)
     register struct libnet_ifaddr_list *al;
     struct ifreq *ifr, *lifr, *pifr, nifr;
     int8_t device[sizeof(nifr.ifr_name)];
-    static struct libnet_ifaddr_list ifaddrlist[MAX_IPADDR];
+    static LIBNET_TLS struct libnet_ifaddr_list ifaddrlist[MAX_IPADDR];
     
     char *p;
     struct ifconf ifc;
@@ -270,8 +270,8 @@ register int8_t *errbuf)
 #define IPTOSBUFFERS    12
 static int8_t *iptos(u_int32_t in)
 {
-    static int8_t output[IPTOSBUFFERS][ 3 * 4 + 3 + 1];
-    static int16_t which;
+    static LIBNET_TLS int8_t output[IPTOSBUFFERS][ 3 * 4 + 3 + 1];
+    static LIBNET_TLS int16_t which;
     u_int8_t *p;
 
     p = (u_int8_t *)&in;
@@ -287,7 +287,7 @@ register int8_t *errbuf)
 {
     int nipaddr = 0;    int i = 0;
 
-    static struct libnet_ifaddr_list ifaddrlist[MAX_IPADDR];
+    static LIBNET_TLS struct libnet_ifaddr_list ifaddrlist[MAX_IPADDR];
     pcap_if_t *alldevs;
     pcap_if_t *d;
     int8_t err[PCAP_ERRBUF_SIZE];
@@ -132,12 +132,16 @@ libnet_destroy(libnet_t *l)
 {
     if (l)
     {
+#if (__linux__)
+        libnet_tx_ring_destroy(l);
+#endif
         close(l->fd);
         if (l->device)
         {
             free(l->device);
         }
         libnet_clear_packet(l);
+        libnet_pblock_arena_free(l);
         free(l);
     }
 }
@@ -150,20 +154,19 @@ libnet_clear_packet(libnet_t *l)
 
     if (l)
     {
+        /* the pblocks and their buffers are kept for the next packet */
         p = l->protocol_blocks;
         if (p)
         {
             for (; p; p = next)
             {
                 next = p->next;
-                if (p->buf)
-                {
-                    free(p->buf);
-                }
-                free(p);
+                libnet_pblock_release(l, p);
             }
         }
         l->protocol_blocks = NULL;
+        l->pblock_end = NULL;
+        l->n_pblocks = 0;
         l->total_size = 0;
     }
 }
@@ -28,6 +28,8 @@
 #include "../include/config.h"
 #endif
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <poll.h>
 
 #include <net/if.h>
 #if (__GLIBC__)
@@ -52,6 +54,12 @@
 #endif
 #endif  /* HAVE_PACKET_SOCKET */
 
+#if (HAVE_PACKET_SOCKET) && defined(PACKET_TX_RING) && defined(TPACKET2_HDRLEN)
+#define LIBNET_TX_RING  1
+/* where the frame starts in a ring slot, after the slot's header */
+#define LIBNET_TX_DATA  (TPACKET2_HDRLEN - sizeof (struct sockaddr_ll))
+#endif
+
 #include "../include/bpf.h"
 #include "../include/libnet.h"
 
@@ -162,6 +170,7 @@ bad:
 int
 libnet_close_link(libnet_t *l)
 {
+    libnet_tx_ring_destroy(l);
     if (close(l->fd) == 0)
     {
         return (1);
@@ -193,10 +202,38 @@ get_iface_index(int fd, const int8_t *device)
 #endif
 
 
+int
+libnet_link_sockaddr(libnet_t *l, void *addr, int *addr_len)
+{
+#if (HAVE_PACKET_SOCKET)
+    struct sockaddr_ll *sa;
+
+    sa = (struct sockaddr_ll *)addr;
+    memset(sa, 0, sizeof (*sa));
+    sa->sll_family    = AF_PACKET;
+    sa->sll_ifindex   = get_iface_index(l->fd, l->device);
+    if (sa->sll_ifindex == -1)
+    {
+        return (-1);
+    }
+    sa->sll_protocol  = htons(ETH_P_ALL);
+#else
+    struct sockaddr *sa;
+
+    sa = (struct sockaddr *)addr;
+    memset(sa, 0, sizeof (*sa));
+    strncpy(sa->sa_data, l->device, sizeof (sa->sa_data) - 1);
+    sa->sa_data[sizeof (sa->sa_data) - 1] = 0;
+#endif
+    *addr_len = sizeof (*sa);
+    return (1);
+}
+
+
 int
 libnet_write_link(libnet_t *l, u_int8_t *packet, u_int32_t size)
 {
-    int c;
+    int c, sa_len;
 #if (HAVE_PACKET_SOCKET)
     struct sockaddr_ll sa;
 #else
@@ -208,22 +245,24 @@ libnet_write_link(libnet_t *l, u_int8_t *packet, u_int32_t size)
         return (-1);
     }
 
-    memset(&sa, 0, sizeof (sa));
-#if (HAVE_PACKET_SOCKET)
-    sa.sll_family    = AF_PACKET;
-    sa.sll_ifindex   = get_iface_index(l->fd, l->device);
-    if (sa.sll_ifindex == -1)
+    if (l->tx_ring)
+    {
+        /* one frame, one kick: still saves copying it through sendto() */
+        c = libnet_tx_ring_put(l, packet, size);
+        if (c != -1 && libnet_tx_ring_kick(l) == -1)
+        {
+            c = -1;
+        }
+        return (c);
+    }
+
+    if (libnet_link_sockaddr(l, &sa, &sa_len) == -1)
     {
         return (-1);
     }
-    sa.sll_protocol  = htons(ETH_P_ALL);
-#else
-	strncpy(sa.sa_data, l->device, sizeof (sa.sa_data) - 1);
-    sa.sa_data[sizeof (sa.sa_data) - 1] = 0;
-#endif
 
     c = sendto(l->fd, packet, size, 0,
-            (struct sockaddr *)&sa, sizeof (sa));
+            (struct sockaddr *)&sa, sa_len);
     if (c != size)
     {
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
@@ -234,6 +273,182 @@ libnet_write_link(libnet_t *l, u_int8_t *packet, u_int32_t size)
 }
 
 
+int
+libnet_tx_ring(libnet_t *l, u_int32_t frames)
+{
+#if (LIBNET_TX_RING)
+    struct tpacket_req req;
+    struct sockaddr_ll sa;
+    int version, sa_len;
+    u_int32_t per_block;
+    void *ring;
+#endif
+
+    if (l == NULL)
+    { 
+        return (-1);
+    }
+
+    if ((l->injection_type & ~LIBNET_ADV_MASK) != LIBNET_LINK)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): the tx ring is only for link-layer injection\n",
+                __func__);
+        return (-1);
+    }
+    if (l->tx_ring)
+    {
+        return (1);
+    }
+
+#if (LIBNET_TX_RING)
+    if (frames == 0)
+    {
+        frames = LIBNET_TX_RING_FRAMES;
+    }
+    memset(&req, 0, sizeof (req));
+    req.tp_frame_size = LIBNET_TX_FRAME_SIZE;
+    req.tp_block_size = getpagesize();
+    if (req.tp_block_size < req.tp_frame_size)
+    {
+        req.tp_block_size = req.tp_frame_size;
+    }
+    per_block = req.tp_block_size / req.tp_frame_size;
+    req.tp_block_nr = (frames + per_block - 1) / per_block;
+    req.tp_frame_nr = req.tp_block_nr * per_block;
+
+    /*
+     *  Any of these can be refused (old kernel, no CAP_NET_RAW, out of
+     *  memory).  The context then keeps writing with sendto().
+     */
+    version = TPACKET_V2;
+    if (setsockopt(l->fd, SOL_PACKET, PACKET_VERSION, &version,
+            sizeof (version)) == -1)
+    {
+        goto refused;
+    }
+    if (setsockopt(l->fd, SOL_PACKET, PACKET_TX_RING, &req,
+            sizeof (req)) == -1)
+    {
+        goto refused;
+    }
+    ring = mmap(NULL, req.tp_block_size * req.tp_block_nr,
+            PROT_READ | PROT_WRITE, MAP_SHARED, l->fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        goto release;
+    }
+
+    /* the kernel sends ring frames to the address the socket is bound to */
+    if (libnet_link_sockaddr(l, &sa, &sa_len) == -1 ||
+            bind(l->fd, (struct sockaddr *)&sa, sa_len) == -1)
+    {
+        munmap(ring, req.tp_block_size * req.tp_block_nr);
+        goto release;
+    }
+
+    l->tx_ring     = ring;
+    l->tx_ring_len = req.tp_block_size * req.tp_block_nr;
+    l->tx_frame_nr = req.tp_frame_nr;
+    l->tx_frame    = 0;
+    return (1);
+release:
+    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+            "%s(): tx ring refused (%s), using sendto()\n", __func__,
+            strerror(errno));
+    memset(&req, 0, sizeof (req));
+    setsockopt(l->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof (req));
+    return (0);
+refused:
+    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+            "%s(): tx ring refused (%s), using sendto()\n", __func__,
+            strerror(errno));
+    return (0);
+#else
+    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+            "%s(): no tx ring support, using sendto()\n", __func__);
+    return (0);
+#endif /* LIBNET_TX_RING */
+}
+
+
+int
+libnet_tx_ring_put(libnet_t *l, u_int8_t *packet, u_int32_t size)
+{
+#if (LIBNET_TX_RING)
+    struct tpacket2_hdr *hdr;
+    struct pollfd pfd;
+
+    if (size > LIBNET_TX_FRAME_SIZE - LIBNET_TX_DATA)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): frame too large for the tx ring (%d bytes)\n",
+                __func__, size);
+        return (-1);
+    }
+
+    hdr = (struct tpacket2_hdr *)(l->tx_ring +
+            l->tx_frame * LIBNET_TX_FRAME_SIZE);
+    while (hdr->tp_status != TP_STATUS_AVAILABLE)
+    {
+        if (hdr->tp_status == TP_STATUS_WRONG_FORMAT)
+        {
+            /* the kernel dropped the frame last in this slot, reuse it */
+            break;
+        }
+        /*
+         *  The ring is full: make sure the kernel is sending and wait for
+         *  it to hand a frame back.
+         */
+        send(l->fd, NULL, 0, MSG_DONTWAIT);
+        pfd.fd      = l->fd;
+        pfd.events  = POLLOUT;
+        pfd.revents = 0;
+        poll(&pfd, 1, 1);
+    }
+
+    memcpy((u_int8_t *)hdr + LIBNET_TX_DATA, packet, size);
+    hdr->tp_len = size;
+    /* the frame has to be complete before the kernel may see the status */
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+    l->tx_frame = (l->tx_frame + 1) % l->tx_frame_nr;
+    return (size);
+#else
+    return (-1);
+#endif /* LIBNET_TX_RING */
+}
+
+
+int
+libnet_tx_ring_kick(libnet_t *l)
+{
+    int c;
+
+    c = send(l->fd, NULL, 0, MSG_DONTWAIT);
+    if (c == -1 && errno != EAGAIN && errno != ENOBUFS)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): send(): %s\n", __func__, strerror(errno));
+        return (-1);
+    }
+    return (1);
+}
+
+
+void
+libnet_tx_ring_destroy(libnet_t *l)
+{
+    if (l == NULL || l->tx_ring == NULL)
+    {
+        return;
+    }
+    munmap(l->tx_ring, l->tx_ring_len);
+    l->tx_ring     = NULL;
+    l->tx_ring_len = 0;
+}
+
+
 struct libnet_ether_addr *
 libnet_get_hwaddr(libnet_t *l)
 {
@@ -241,9 +456,9 @@ libnet_get_hwaddr(libnet_t *l)
     struct ifreq ifr;
     struct libnet_ether_addr *eap;
     /*
-     *  XXX - non-re-entrant!
+     *  XXX - non-re-entrant!  Per thread, at least.
      */
-    static struct libnet_ether_addr ea;
+    static LIBNET_TLS struct libnet_ether_addr ea;
 
     if (l == NULL)
     { 
@@ -61,7 +61,7 @@ libnet_pblock_probe(libnet_t *l, libnet_ptag_t ptag, u_int32_t n, u_int8_t type)
     {
         /*
          *  Update this pblock, don't create a new one.  Note that if the
-         *  new packet size is larger than the old one we will do a malloc.
+         *  new packet size is larger than the buffer we will do a malloc.
          */
         p = libnet_pblock_find(l, ptag);
 
@@ -78,22 +78,26 @@ libnet_pblock_probe(libnet_t *l, libnet_ptag_t ptag, u_int32_t n, u_int8_t type)
             return (NULL); 
         }
         /*
-         *  If size is greater than the original block of memory, we need 
-         *  to malloc more memory.  Should we use realloc?
+         *  If size is greater than the original block of memory, the
+         *  buffer may still have room from an earlier, larger build.  Only
+         *  the bytes past the old length need zeroing.
          */
         if (n > p->b_len)
         {
             offset = n - p->b_len;  /* how many bytes larger new pblock is */
-            free(p->buf);
-            p->buf = malloc(n);
-            if (p->buf == NULL)
+            if (n > p->b_cap)
             {
-                snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                        "%s(): can't resize pblock buffer: %s\n", __func__,
-                        strerror(errno));
-                return (NULL);
+                if (libnet_pblock_reserve(l, p, n) == -1)
+                {
+                    /* err msg set in libnet_pblock_reserve() */
+                    return (NULL);
+                }
+                memset(p->buf, 0, n);
+            }
+            else
+            {
+                memset(p->buf + p->b_len, 0, offset);
             }
-            memset(p->buf, 0, n);
             p->h_len += offset; /* new length for checksums */
             p->b_len = n;       /* new buf len */
             l->total_size += offset;
@@ -120,47 +124,176 @@ libnet_pblock_new(libnet_t *l, u_int32_t size)
      *  the user tries to write some ridiculously huge packet?
      */
 
+    p = libnet_pblock_alloc(l, size);
+    if (p == NULL)
+    {
+        /* err msg set in libnet_pblock_alloc() */
+        return (NULL);
+    }
+
     /* make the head node if it doesn't exist */
     if (l->protocol_blocks == NULL)
     {
-        p = l->protocol_blocks = malloc(sizeof (libnet_pblock_t));
-        if (p == NULL)
-        {
-            goto bad;
-        }
-        memset(p, 0, sizeof (libnet_pblock_t));
+        l->protocol_blocks = p;
     }
     else
     {
-        p = l->pblock_end;
-        p->next = malloc(sizeof (libnet_pblock_t));
+        p->prev = l->pblock_end;
+        l->pblock_end->next = p;
+    }
+
+    p->b_len      = size;
+    l->total_size += size;
+    l->n_pblocks++;
+    return (p);
+}
+
+libnet_pblock_t *
+libnet_pblock_alloc(libnet_t *l, u_int32_t size)
+{
+    libnet_arena_chunk_t *chunk;
+    libnet_pblock_t *p, **pp;
+    u_int8_t *buf;
+    u_int32_t cap;
+    int i;
 
-        if (p->next == NULL)
+    /*
+     *  Carve a new chunk of pblocks when the free list runs dry.  The
+     *  chunk stays on the context's arena list until libnet_destroy().
+     */
+    if (l->pblock_free == NULL)
+    {
+        chunk = malloc(sizeof (libnet_arena_chunk_t));
+        if (chunk == NULL)
+        {
+            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                    __func__, strerror(errno));
+            return (NULL);
+        }
+        memset(chunk, 0, sizeof (libnet_arena_chunk_t));
+        chunk->next = l->arena;
+        l->arena    = chunk;
+        for (i = 0; i < LIBNET_ARENA_PBLOCKS; i++)
         {
-            goto bad;
+            chunk->pblocks[i].next = l->pblock_free;
+            l->pblock_free = &chunk->pblocks[i];
         }
-        memset(p->next, 0, sizeof (libnet_pblock_t));
-        p->next->prev = p;
-        p = p->next;
     }
 
-    p->buf = malloc(size);
-    if (p->buf == NULL)
+    /* prefer a pblock whose buffer is already large enough */
+    for (pp = &l->pblock_free; *pp; pp = &(*pp)->next)
     {
-        free(p);
-        p = NULL;
-        goto bad;
+        if ((*pp)->b_cap >= size)
+        {
+            break;
+        }
+    }
+    if (*pp == NULL)
+    {
+        pp = &l->pblock_free;
+    }
+    p   = *pp;
+    *pp = p->next;
+
+    buf = p->buf;
+    cap = p->b_cap;
+    memset(p, 0, sizeof (libnet_pblock_t));
+    p->buf   = buf;
+    p->b_cap = cap;
+
+    if (libnet_pblock_reserve(l, p, size) == -1)
+    {
+        /* err msg set in libnet_pblock_reserve() */
+        libnet_pblock_release(l, p);
+        return (NULL);
     }
     memset(p->buf, 0, size);
-    p->b_len      = size;
-    l->total_size += size;
-    l->n_pblocks++;
     return (p);
+}
 
-    bad:
-    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n", __func__, 
-            strerror(errno));
-    return (NULL);
+int
+libnet_pblock_reserve(libnet_t *l, libnet_pblock_t *p, u_int32_t size)
+{
+    u_int8_t *buf;
+
+    if (size <= p->b_cap && p->buf)
+    {
+        return (1);
+    }
+
+    /* a zero sized pblock still gets a buffer, like malloc(0) did */
+    buf = malloc(size ? size : 1);
+    if (buf == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): can't resize pblock buffer: %s\n", __func__,
+                strerror(errno));
+        return (-1);
+    }
+    if (p->buf)
+    {
+        free(p->buf);
+    }
+    p->buf   = buf;
+    p->b_cap = size;
+    return (1);
+}
+
+void
+libnet_pblock_release(libnet_t *l, libnet_pblock_t *p)
+{
+    struct libnet_ptag_slot *s;
+
+    if (p->ptag > 0)
+    {
+        /* hand the ptag's slot back, the next user gets a new generation */
+        s = &l->ptag_tab[(p->ptag & LIBNET_PTAG_SLOT_MASK) - 1];
+        s->p    = NULL;
+        s->next = l->ptag_free;
+        l->ptag_free = (p->ptag & LIBNET_PTAG_SLOT_MASK);
+        p->ptag = LIBNET_PTAG_INITIALIZER;
+    }
+    p->prev = NULL;
+    p->next = l->pblock_free;
+    l->pblock_free = p;
+}
+
+void
+libnet_pblock_arena_free(libnet_t *l)
+{
+    libnet_arena_chunk_t *chunk, *next;
+    int i;
+
+    for (chunk = l->arena; chunk; chunk = next)
+    {
+        next = chunk->next;
+        for (i = 0; i < LIBNET_ARENA_PBLOCKS; i++)
+        {
+            if (chunk->pblocks[i].buf)
+            {
+                free(chunk->pblocks[i].buf);
+            }
+        }
+        free(chunk);
+    }
+    l->arena       = NULL;
+    l->pblock_free = NULL;
+
+    if (l->ptag_tab)
+    {
+        free(l->ptag_tab);
+    }
+    l->ptag_tab   = NULL;
+    l->ptag_slots = 0;
+    l->ptag_free  = 0;
+
+    if (l->packet_mem)
+    {
+        free(l->packet_mem);
+    }
+    l->packet_mem = NULL;
+    l->packet_buf = NULL;
+    l->packet_cap = 0;
 }
 
 int
@@ -238,12 +371,18 @@ libnet_pblock_t *
 libnet_pblock_find(libnet_t *l, libnet_ptag_t ptag)
 {
     libnet_pblock_t *p;
+    u_int32_t i;
 
-    for (p = l->protocol_blocks; p; p = p->next)
+    if (ptag > 0)
     {
-        if (p->ptag == ptag)
+        i = (ptag & LIBNET_PTAG_SLOT_MASK) - 1;
+        if (i < l->ptag_slots)
         {
-            return (p); 
+            p = l->ptag_tab[i].p;
+            if (p && p->ptag == ptag)
+            {
+                return (p);
+            }
         }
     }
     snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
@@ -277,19 +416,64 @@ libnet_pblock_update(libnet_t *l, libnet_pblock_t *p, u_int32_t h,
 u_int8_t type)
 {
     p->type  =  type;
-    p->ptag  =  ++(l->ptag_state);
     p->h_len = h;
     l->pblock_end = p;              /* point end of pblock list here */
 
+    return (libnet_pblock_tag(l, p));
+}
+
+libnet_ptag_t
+libnet_pblock_tag(libnet_t *l, libnet_pblock_t *p)
+{
+    struct libnet_ptag_slot *s;
+    u_int32_t i, n;
+
+    if (l->ptag_free == 0)
+    {
+        /* grow the table, the new slots go on the free list */
+        n = l->ptag_slots ? l->ptag_slots * 2 : LIBNET_ARENA_PBLOCKS;
+        if (n > LIBNET_PTAG_SLOT_MASK)
+        {
+            n = LIBNET_PTAG_SLOT_MASK;
+        }
+        if (n == l->ptag_slots)
+        {
+            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): too many protocol blocks (%d)\n", __func__, n);
+            return (-1);
+        }
+        s = realloc(l->ptag_tab, n * sizeof (struct libnet_ptag_slot));
+        if (s == NULL)
+        {
+            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): realloc(): %s\n",
+                    __func__, strerror(errno));
+            return (-1);
+        }
+        for (i = n; i > l->ptag_slots; i--)
+        {
+            s[i - 1].p    = NULL;
+            s[i - 1].gen  = 0;
+            s[i - 1].next = l->ptag_free;
+            l->ptag_free  = i;
+        }
+        l->ptag_tab   = s;
+        l->ptag_slots = n;
+    }
+
+    i = l->ptag_free;
+    s = &l->ptag_tab[i - 1];
+    l->ptag_free = s->next;
+    s->p    = p;
+    p->ptag = ((s->gen++ & LIBNET_PTAG_GEN_MASK) << LIBNET_PTAG_SLOT_BITS) | i;
+
+    /* ptag_state keeps counting pblocks, libnet_autobuild_ipv4() uses it */
+    l->ptag_state++;
     return (p->ptag);
 }
 
 int
 libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
 {
-    libnet_pblock_t *p, *q;
-    u_int32_t c, n;
-
     /*
      *  Determine the offset required to keep memory aligned (strict
      *  architectures like solaris enforce this, but's a good practice
@@ -307,15 +491,44 @@ libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
         l->aligner = 0;
     }
 
-    *packet = malloc(l->aligner + l->total_size);
-    if (*packet == NULL)
+    /*
+     *  The packet is assembled in the context's coalesce buffer, which
+     *  only grows, to the largest packet built so far.  It starts on a
+     *  cache line so the aligner keeps its meaning.  Every byte after the
+     *  aligner is written by libnet_pblock_assemble(), so there is nothing
+     *  to clear.
+     */
+    if (l->aligner + l->total_size > l->packet_cap)
     {
-        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
-                __func__, strerror(errno));
-        return (-1);
+        if (l->packet_mem)
+        {
+            free(l->packet_mem);
+        }
+        l->packet_cap = l->aligner + l->total_size;
+        l->packet_mem = malloc(l->packet_cap + LIBNET_ARENA_ALIGN - 1);
+        if (l->packet_mem == NULL)
+        {
+            l->packet_buf = NULL;
+            l->packet_cap = 0;
+            snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                    __func__, strerror(errno));
+            return (-1);
+        }
+        l->packet_buf = (u_int8_t *)(((unsigned long)l->packet_mem +
+                (LIBNET_ARENA_ALIGN - 1)) &
+                ~((unsigned long)LIBNET_ARENA_ALIGN - 1));
     }
+    *packet = l->packet_buf + l->aligner;
+    *size   = l->total_size;
+
+    return (libnet_pblock_assemble(l, *packet));
+}
 
-    memset(*packet, 0, l->aligner + l->total_size);
+int
+libnet_pblock_assemble(libnet_t *l, u_int8_t *buf)
+{
+    libnet_pblock_t *p, *q;
+    u_int32_t c, n;
 
     if (l->injection_type == LIBNET_RAW4 && 
         l->pblock_end->type == LIBNET_PBLOCK_IPV4_H)
@@ -371,7 +584,7 @@ libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
     }
 
     q = NULL; 
-    for (n = l->aligner + l->total_size, p = l->protocol_blocks; p || q; )
+    for (n = l->total_size, p = l->protocol_blocks; p || q; )
     {
         if (q)
         {
@@ -381,7 +594,7 @@ libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
         {
             n -= p->b_len;
             /* copy over the packet chunk */
-            memcpy(*packet + n, p->buf, p->b_len);
+            memcpy(buf + n, p->buf, p->b_len);
         }
         if (q)
         {
@@ -389,8 +602,8 @@ libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
             {
                 if ((q->flags) & LIBNET_PBLOCK_DO_CHECKSUM)
                 {
-                    int offset = (l->total_size + l->aligner) - q->ip_offset;
-                    c = libnet_do_checksum(l, *packet + offset,
+                    c = libnet_do_checksum(l,
+                            buf + l->total_size - q->ip_offset,
                             libnet_pblock_p2p(q->type), q->h_len);
                     if (c == -1)
                     {
@@ -406,18 +619,6 @@ libnet_pblock_coalesce(libnet_t *l, u_int8_t **packet, u_int32_t *size)
             q = p;
         }
     }
-    *size = l->aligner + l->total_size;
-
-    /*
-     *  Set the packet pointer to the true beginning of the packet and set
-     *  the size for transmission.
-     */
-    if ((l->injection_type == LIBNET_LINK ||
-        l->injection_type == LIBNET_LINK_ADV) && l->aligner)
-    {
-        *packet += l->aligner;
-        *size -= l->aligner;
-    }
     return (1);
 }
 
@@ -446,12 +647,7 @@ libnet_pblock_delete(libnet_t *l, libnet_pblock_t *p)
             l->pblock_end = p->prev;
         }
 
-        if (p->buf)
-        {
-          free(p->buf);
-        }
-
-        free(p);
+        libnet_pblock_release(l, p);
         p = NULL;
     }
 }
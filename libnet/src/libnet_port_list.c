@@ -41,25 +41,122 @@
 
 u_int16_t *all_lists;
 
-int
-libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
+/*
+ *  A port set is a bitmap of all 65536 ports plus the number of ports in
+ *  each 1024 port block.  The block counts summarize the runs: iteration
+ *  skips a block in one step when it is empty (or full, when looking for
+ *  the end of a run), and sampling uses them to find the nth port without
+ *  counting every word.
+ */
+#if (__GNUC__)
+#define libnet_pset_popcount(w) __builtin_popcount(w)
+#define libnet_pset_ctz(w)      __builtin_ctz(w)
+#else
+static int
+libnet_pset_popcount(u_int32_t w)
 {
-    int8_t libnet_plist_legal_tokens[] = "0123456789,- ";
-    libnet_plist_t *tmp;
-    int8_t *tok;
-    int i, j, valid_token, cur_node;
-    u_int16_t *all_lists_tmp;
-    static u_int8_t cur_id;
+    w = w - ((w >> 1) & 0x55555555);
+    w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+    w = (w + (w >> 4)) & 0x0f0f0f0f;
+    return ((w * 0x01010101) >> 24);
+}
 
-    if (l == NULL)
-    { 
-        return (-1);
-    } 
+static int
+libnet_pset_ctz(u_int32_t w)
+{
+    int n;
 
-    if (token_list == NULL)
+    for (n = 0; !(w & 1); n++, w >>= 1) ;
+    return (n);
+}
+#endif
+
+static void libnet_pset_range(libnet_pset_t *, u_int32_t, u_int32_t, int);
+static void libnet_pset_recount(libnet_pset_t *);
+static u_int32_t libnet_pset_find(libnet_pset_t *, u_int32_t, int);
+static int libnet_pset_parse(libnet_t *, libnet_pset_t *, char *);
+
+
+static void
+libnet_pset_range(libnet_pset_t *ps, u_int32_t bport, u_int32_t eport,
+        int set)
+{
+    u_int32_t i, mask, old;
+
+    for (i = bport >> 5; i <= eport >> 5; i++)
     {
-        return (-1);
+        mask = 0xffffffff;
+        if (i == bport >> 5)
+        {
+            mask &= 0xffffffff << (bport & 31);
+        }
+        if (i == eport >> 5)
+        {
+            mask &= 0xffffffff >> (31 - (eport & 31));
+        }
+        old = ps->bits[i];
+        ps->bits[i] = set ? old | mask : old & ~mask;
+
+        /* the count of a 1024 port block moves by what the word did */
+        ps->pop[i >> 5] += libnet_pset_popcount(ps->bits[i]) -
+                libnet_pset_popcount(old);
+        ps->count += libnet_pset_popcount(ps->bits[i]) -
+                libnet_pset_popcount(old);
     }
+}
+
+
+static void
+libnet_pset_recount(libnet_pset_t *ps)
+{
+    u_int32_t i;
+
+    ps->count = 0;
+    memset(ps->pop, 0, sizeof (ps->pop));
+    for (i = 0; i < LIBNET_PSET_WORDS; i++)
+    {
+        ps->pop[i >> 5] += libnet_pset_popcount(ps->bits[i]);
+    }
+    for (i = 0; i < LIBNET_PSET_BLOCKS; i++)
+    {
+        ps->count += ps->pop[i];
+    }
+}
+
+
+static u_int32_t
+libnet_pset_find(libnet_pset_t *ps, u_int32_t port, int set)
+{
+    u_int32_t w;
+
+    /* first port from port on that is in (set) or out of (!set) ps */
+    while (port < 65536)
+    {
+        if (ps->pop[port >> 10] == (set ? 0 : 1024))
+        {
+            /* nothing to find in this block */
+            port = (port | 1023) + 1;
+            continue;
+        }
+        w = set ? ps->bits[port >> 5] : ~ps->bits[port >> 5];
+        w &= 0xffffffff << (port & 31);
+        if (w)
+        {
+            return ((port & ~31) + libnet_pset_ctz(w));
+        }
+        port = (port | 31) + 1;
+    }
+    return (65536);
+}
+
+
+static int
+libnet_pset_parse(libnet_t *l, libnet_pset_t *ps, char *token_list)
+{
+    int8_t libnet_plist_legal_tokens[] = "0123456789,- ";
+    char *tok;
+    int i, j, valid_token;
+    u_int16_t bport, eport, tmp;
 
     /*
      *  Make sure we have legal tokens.
@@ -77,14 +174,287 @@ libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
         if (!valid_token)
         {
             snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                    "libnet_build_plist_chain: illegal token # %d (%c)\n",
-                    i + 1,
+                    "%s(): illegal token # %d (%c)\n", __func__, i + 1,
                     token_list[i]);
-            *plist = NULL;
             return (-1);
         }
     }
 
+    /*
+     *  Each comma separated token is a port or a range of ports; a
+     *  trailing dash means every port from there up to 65535.  In the case
+     *  of bport > eport, we swap them.  The list is walked in place rather
+     *  than with strtok(), which would write into it.
+     */
+    for (tok = token_list; *tok; tok += j)
+    {
+        if (*tok == ',')
+        {
+            /* step over the comma, or an empty token */
+            j = 1;
+            continue;
+        }
+        bport = atoi(tok);
+
+        /*
+         *  Step past this port number.
+         */
+        for (j = 0; isdigit((int)tok[j]); j++) ;
+
+        if (tok[j] == '-')
+        {
+            j++;
+            eport = (tok[j] && tok[j] != ',') ? atoi(&tok[j]) : 65535;
+        }
+        else
+        {
+            eport = bport;
+        }
+        if (bport > eport)
+        {
+            tmp   = bport;
+            bport = eport;
+            eport = tmp;
+        }
+        libnet_pset_range(ps, bport, eport, 1);
+
+        /* on to the comma ending this token */
+        for (; tok[j] && tok[j] != ','; j++) ;
+    }
+    return (1);
+}
+
+
+libnet_pset_t *
+libnet_pset_new(libnet_t *l, char *token_list)
+{
+    libnet_pset_t *ps;
+
+    if (l == NULL)
+    {
+        return (NULL);
+    }
+
+    ps = malloc(sizeof (libnet_pset_t));
+    if (ps == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        return (NULL);
+    }
+    memset(ps, 0, sizeof (libnet_pset_t));
+
+    if (token_list && libnet_pset_parse(l, ps, token_list) == -1)
+    {
+        /* err msg set in libnet_pset_parse() */
+        free(ps);
+        return (NULL);
+    }
+    return (ps);
+}
+
+
+int
+libnet_pset_add(libnet_pset_t *ps, u_int16_t bport, u_int16_t eport)
+{
+    if (ps == NULL || bport > eport)
+    {
+        return (-1);
+    }
+    libnet_pset_range(ps, bport, eport, 1);
+    return (1);
+}
+
+
+int
+libnet_pset_del(libnet_pset_t *ps, u_int16_t bport, u_int16_t eport)
+{
+    if (ps == NULL || bport > eport)
+    {
+        return (-1);
+    }
+    libnet_pset_range(ps, bport, eport, 0);
+    return (1);
+}
+
+
+int
+libnet_pset_has(libnet_pset_t *ps, u_int16_t port)
+{
+    return ((ps->bits[port >> 5] >> (port & 31)) & 1);
+}
+
+
+int
+libnet_pset_union(libnet_pset_t *ps, libnet_pset_t *other)
+{
+    u_int32_t i;
+
+    if (ps == NULL || other == NULL)
+    {
+        return (-1);
+    }
+    for (i = 0; i < LIBNET_PSET_WORDS; i++)
+    {
+        ps->bits[i] |= other->bits[i];
+    }
+    libnet_pset_recount(ps);
+    return (1);
+}
+
+
+int
+libnet_pset_intersect(libnet_pset_t *ps, libnet_pset_t *other)
+{
+    u_int32_t i;
+
+    if (ps == NULL || other == NULL)
+    {
+        return (-1);
+    }
+    for (i = 0; i < LIBNET_PSET_WORDS; i++)
+    {
+        ps->bits[i] &= other->bits[i];
+    }
+    libnet_pset_recount(ps);
+    return (1);
+}
+
+
+int
+libnet_pset_next(libnet_pset_t *ps, u_int32_t *iter, u_int16_t *port)
+{
+    u_int32_t p;
+
+    if (ps == NULL)
+    {
+        return (-1);
+    }
+    p = libnet_pset_find(ps, *iter, 1);
+    if (p == 65536)
+    {
+        *iter = 65536;
+        return (0);
+    }
+    *port = p;
+    *iter = p + 1;
+    return (1);
+}
+
+
+int
+libnet_pset_next_run(libnet_pset_t *ps, u_int32_t *iter, u_int16_t *bport,
+        u_int16_t *eport)
+{
+    u_int32_t b, e;
+
+    if (ps == NULL)
+    {
+        return (-1);
+    }
+    b = libnet_pset_find(ps, *iter, 1);
+    if (b == 65536)
+    {
+        *iter = 65536;
+        return (0);
+    }
+    e = libnet_pset_find(ps, b, 0);
+    *bport = b;
+    *eport = e - 1;
+    *iter  = e;
+    return (1);
+}
+
+
+int
+libnet_pset_sample(libnet_pset_t *ps, u_int16_t *port)
+{
+    u_int32_t b, i, r, w;
+    int c;
+
+    if (ps == NULL)
+    {
+        return (-1);
+    }
+    if (ps->count == 0)
+    {
+        return (0);
+    }
+
+    /*
+     *  Pick the rth port of the set, uniformly, then find it: first the
+     *  1024 port block, then the word, then the bit.  The port leaves the
+     *  set, so repeated calls sample without replacement.
+     */
+    r = ((u_int64_t)libnet_get_prand(LIBNET_PRu32) * ps->count) >> 32;
+    for (b = 0; r >= ps->pop[b]; b++)
+    {
+        r -= ps->pop[b];
+    }
+    for (i = b << 5; r >= (c = libnet_pset_popcount(ps->bits[i])); i++)
+    {
+        r -= c;
+    }
+    for (w = ps->bits[i]; r; r--)
+    {
+        /* drop the lowest bit */
+        w &= w - 1;
+    }
+    *port = (i << 5) + libnet_pset_ctz(w);
+
+    ps->bits[i] &= ~((u_int32_t)1 << (*port & 31));
+    ps->pop[b]--;
+    ps->count--;
+    return (1);
+}
+
+
+int
+libnet_pset_free(libnet_pset_t *ps)
+{
+    if (ps == NULL)
+    {
+        return (-1);
+    }
+    free(ps);
+    return (1);
+}
+
+
+int
+libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
+{
+    libnet_pset_t *ps;
+    libnet_plist_t *tmp;
+    int cur_node;
+    u_int16_t *all_lists_tmp;
+    u_int16_t bport, eport;
+    u_int32_t iter;
+    static u_int8_t cur_id;
+
+    if (l == NULL)
+    { 
+        return (-1);
+    } 
+
+    if (token_list == NULL)
+    {
+        return (-1);
+    }
+
+    /*
+     *  The list is parsed into a port set and the chain is made of the
+     *  set's runs, so the pairs come out in port order with overlapping
+     *  and adjacent ranges merged.
+     */
+    ps = libnet_pset_new(l, token_list);
+    if (ps == NULL)
+    {
+        /* err msg set in libnet_pset_new() */
+        *plist = NULL;
+        return (-1);
+    }
+
     /* head node */
     *plist = malloc(sizeof (libnet_plist_t));
 
@@ -92,12 +462,14 @@ libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
     {
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                     "libnet_build_plist_chain: malloc %s\n", strerror(errno));
+        libnet_pset_free(ps);
         *plist = NULL;
         return (-1);
     }
 
     tmp = *plist;
     tmp->node = cur_node = 0;
+    tmp->bport = tmp->eport = 0;
     tmp->next = NULL;
     tmp->id = cur_id;
     all_lists_tmp = all_lists;
@@ -107,34 +479,31 @@ libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
         all_lists = all_lists_tmp;
         snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                     "libnet_build_plist_chain: realloc %s\n", strerror(errno));
+        libnet_pset_free(ps);
+        free(*plist);
         *plist = NULL;
         return(-1);
     }
 
     all_lists[cur_id++] = 0;
 
-    /*
-     *  Using strtok successively proved problematic.  We solve this by
-     *  calling it once, then manually extracting the elements from the token.
-     *  In the case of bport > eport, we swap them.
-     */
-    for (i = 0; (tok = strtok(!i ? token_list : NULL, ",")); i = 1, cur_node++)
+    for (iter = 0; libnet_pset_next_run(ps, &iter, &bport, &eport) == 1;
+            cur_node++)
     {
         /*
          *  The first iteration we will have a head node allocated so we don't
          *  need to malloc().
          */
-        if (i)
+        if (cur_node)
         {
             tmp->next = malloc(sizeof (libnet_plist_t));
-            if (!tmp)
+            if (!tmp->next)
             {
                 snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                     "libnet_build_plist_chain: malloc %s\n", strerror(errno));
-                /*
-                 *  XXX - potential memory leak if other nodes are allocated
-                 *  but not freed.
-                 */
+                (*plist)->node = cur_node;
+                libnet_plist_chain_free(*plist);
+                libnet_pset_free(ps);
                 *plist = NULL;
                 return(-1);
             }
@@ -142,43 +511,10 @@ libnet_plist_chain_new(libnet_t *l, libnet_plist_t **plist, char *token_list)
             tmp->node = cur_node;
             tmp->next = NULL;
         }
-        tmp->bport = atoi(tok);
-
-        /*
-         *  Step past this port number.
-         */
-        j = 0;
-        while (isdigit((int)tok[j]))
-        {
-            j++;
-        }
-
-        /*
-         *  If we have a delimiting dash and are NOT at the end of the token
-         *  array, we can assume it's the end port, otherwise if we just have
-         *  a dash, we consider it int16_thand for `inclusive of all ports up to
-         *  65535.  Finally, if we have no dash, we assume this token is a
-         *  single port only.
-         */
-        if (tok[j] == '-')
-        {
-            tmp->eport = (++j != strlen(tok)) ? atoi(&tok[j]) : 65535;
-        }
-        else
-        {
-            tmp->eport = tmp->bport;
-        }
-
-        /*
-         *  Do we need to swap the values?
-         */
-        if (tmp->bport > tmp->eport)
-        {
-            tmp->bport ^= tmp->eport;
-            tmp->eport ^= tmp->bport;
-            tmp->bport ^= tmp->eport;
-        }
+        tmp->bport = bport;
+        tmp->eport = eport;
     }
+    libnet_pset_free(ps);
 
     /*
      *  The head node needs to hold the total node count.
@@ -38,33 +38,98 @@
 #else
 #include "../include/win32/libnet.h"
 #endif
-int
-libnet_seed_prand(libnet_t *l)
+
+/*
+ *  Every thread has a generator of its own, xoshiro128** (Blackman and
+ *  Vigna), so threads neither share state nor serialize on a lock the way
+ *  random() does.  A thread that never called libnet_seed_prand() is seeded
+ *  on its first draw.
+ */
+static LIBNET_TLS u_int32_t l_prand[4];
+
+static u_int32_t libnet_prand_next(void);
+static void libnet_prand_seed(u_int64_t);
+static u_int64_t libnet_prand_entropy(void);
+
+
+static void
+libnet_prand_seed(u_int64_t x)
 {
+    u_int64_t z;
+    int i;
+
+    /* splitmix64 spreads the seed over the whole state */
+    for (i = 0; i < 4; i += 2)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        l_prand[i]     = (u_int32_t)z;
+        l_prand[i + 1] = (u_int32_t)(z >> 32);
+    }
+    if ((l_prand[0] | l_prand[1] | l_prand[2] | l_prand[3]) == 0)
+    {
+        /* the one state xoshiro can't leave */
+        l_prand[0] = 1;
+    }
+}
+
+
+static u_int64_t
+libnet_prand_entropy(void)
+{
+    u_int64_t x;
 	#if !(__WIN32__)
     struct timeval seed;
+
+    gettimeofday(&seed, NULL);
+    x = ((u_int64_t)seed.tv_sec << 20) ^ seed.tv_usec;
+	#else
+    x = ((u_int64_t)time(NULL) << 32) ^ GetTickCount();
 	#endif
 
+    /* the state's address tells threads seeded at the same time apart */
+    return (x ^ ((u_int64_t)(unsigned long)l_prand << 16));
+}
+
+
+static u_int32_t
+libnet_prand_next(void)
+{
+    u_int32_t n, t;
+
+    if ((l_prand[0] | l_prand[1] | l_prand[2] | l_prand[3]) == 0)
+    {
+        libnet_prand_seed(libnet_prand_entropy());
+    }
+
+    n = l_prand[1] * 5;
+    n = ((n << 7) | (n >> 25)) * 9;
+    t = l_prand[1] << 9;
+    l_prand[2] ^= l_prand[0];
+    l_prand[3] ^= l_prand[1];
+    l_prand[1] ^= l_prand[2];
+    l_prand[0] ^= l_prand[3];
+    l_prand[2] ^= t;
+    l_prand[3] = (l_prand[3] << 11) | (l_prand[3] >> 21);
+    return (n);
+}
+
+
+int
+libnet_seed_prand(libnet_t *l)
+{
     if (l == NULL)
     { 
         return (-1);
     } 
 
-	#if __WIN32__
-    srand((unsigned)time(NULL));
-	#else
-    if (gettimeofday(&seed, NULL) == -1)
-    {
-        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                "%s(): cannot gettimeofday\n", __func__);
-        return (-1);
-    }
-
     /*
      *  More entropy then just seeding with time(2).
      */
-    srandom((unsigned)(seed.tv_sec ^ seed.tv_usec));
-	#endif
+    libnet_prand_seed(libnet_prand_entropy());
     return (1);
 }
 
@@ -73,18 +138,8 @@ u_int32_t
 libnet_get_prand(int mod)
 {
     u_int32_t n;  /* 0 to 4,294,967,295 */
-#ifndef _WIN32
-    n = random();
-#else
-	HCRYPTPROV hProv = 0;
-	CryptAcquireContext(&hProv, 
-		0, 0, PROV_RSA_FULL, 
-		CRYPT_VERIFYCONTEXT);
-	
-	CryptGenRandom(hProv, 
-		sizeof(n), (BYTE*)&n);
-	CryptReleaseContext(hProv, 0); 
-#endif
+
+    n = libnet_prand_next();
     switch (mod)
     {
         case LIBNET_PR2:
@@ -39,12 +39,33 @@
 #include "../include/win32/libnet.h"
 #endif
 
+static LIBNET_TLS struct libnet_resolve_entry
+        l_resolve_cache[LIBNET_RESOLVE_ENTRIES];
+
+static u_int32_t libnet_resolve_hash(char *);
+
+
+static u_int32_t
+libnet_resolve_hash(char *name)
+{
+    u_int32_t h;
+
+    /* FNV-1a */
+    for (h = 2166136261U; *name; name++)
+    {
+        h = (h ^ (u_int8_t)*name) * 16777619U;
+    }
+    return (h);
+}
+
+
 char *
 libnet_addr2name4(u_int32_t in, u_int8_t use_name)
 {
 	#define HOSTNAME_SIZE 512
-    static char hostname[HOSTNAME_SIZE+1], hostname2[HOSTNAME_SIZE+1];
-    static u_int16_t which;
+    static LIBNET_TLS char hostname[HOSTNAME_SIZE+1];
+    static LIBNET_TLS char hostname2[HOSTNAME_SIZE+1];
+    static LIBNET_TLS u_int16_t which;
     u_int8_t *p;
 
     struct hostent *host_ent = NULL;
@@ -53,9 +74,9 @@ libnet_addr2name4(u_int32_t in, u_int8_t use_name)
     /*
      *  Swap to the other buffer.  We swap static buffers to avoid having to
      *  pass in a int8_t *.  This makes the code that calls this function more
-     *  intuitive, but makes this function ugly.  This function is seriously
-     *  non-reentrant.  For threaded applications (or for signal handler code)
-     *  use host_lookup_r().
+     *  intuitive, but makes this function ugly.  The buffers are per thread,
+     *  but this function is still seriously non-reentrant.  For signal
+     *  handler code use host_lookup_r().
      */
     which++;
     
@@ -114,7 +135,9 @@ u_int32_t
 libnet_name2addr4(libnet_t *l, char *host_name, u_int8_t use_name)
 {
     struct in_addr addr;
-    struct hostent *host_ent; 
+    struct addrinfo hints, *res;
+    struct libnet_resolve_entry *e;
+    time_t now;
     u_int32_t m;
     u_int val;
     int i;
@@ -123,14 +146,40 @@ libnet_name2addr4(libnet_t *l, char *host_name, u_int8_t use_name)
     {
 		if ((addr.s_addr = inet_addr(host_name)) == -1)
         {
-            if (!(host_ent = gethostbyname(host_name)))
+            e = &l_resolve_cache[libnet_resolve_hash(host_name) %
+                    LIBNET_RESOLVE_ENTRIES];
+            now = time(NULL);
+            if (e->expires > now && strcmp(e->name, host_name) == 0)
             {
-                snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
-                        "%s(): %s\n", __func__, strerror(errno));
+                return (e->addr);
+            }
+
+            /*
+             *  getaddrinfo() is reentrant, unlike gethostbyname() whose
+             *  answer lives in static storage shared by every thread.
+             */
+            memset(&hints, 0, sizeof (hints));
+            hints.ai_family   = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if ((i = getaddrinfo(host_name, NULL, &hints, &res)) != 0)
+            {
+                if (l)
+                {
+                    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                            "%s(): %s\n", __func__, gai_strerror(i));
+                }
                 /* XXX - this is actually 255.255.255.255 */
                 return (-1);
             }
-            memcpy(&addr.s_addr, host_ent->h_addr, host_ent->h_length);
+            addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+            freeaddrinfo(res);
+
+            if (strlen(host_name) < LIBNET_RESOLVE_NAME)
+            {
+                strcpy(e->name, host_name);
+                e->addr    = addr.s_addr;
+                e->expires = now + LIBNET_RESOLVE_TTL;
+            }
         }
         /* network byte order */
         return (addr.s_addr);
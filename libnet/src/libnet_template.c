@@ -0,0 +1,487 @@
+/*
+ *  $Id$
+ *
+ *  libnet
+ *  libnet_template.c - compiled packet templates
+ *
+ *  Copyright (c) 1998 - 2004 Mike D. Schiffman <mike@infonexus.com>
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#if (HAVE_CONFIG_H)
+#include "../include/config.h"
+#endif
+#if (!(_WIN32) || (__CYGWIN__))
+#include "../include/libnet.h"
+#else
+#include "../include/win32/libnet.h"
+#endif
+
+/* checksums a patch has to fix up */
+#define LIBNET_TMPL_CK_IP       0x01    /* the IPv4 header checksum */
+#define LIBNET_TMPL_CK_L4       0x02    /* the TCP/UDP/ICMP checksum */
+
+/* private function prototypes */
+static u_int16_t libnet_template_sum(libnet_template_t *, u_int32_t,
+        u_int32_t);
+static void libnet_template_patch(libnet_template_t *, u_int32_t,
+        const u_int8_t *, u_int32_t, int);
+
+
+libnet_template_t *
+libnet_template_compile(libnet_t *l)
+{
+    libnet_template_t *t;
+    u_int8_t *packet, *p;
+    u_int32_t len, off;
+    u_int16_t type;
+    int c;
+
+    if (l == NULL)
+    {
+        return (NULL);
+    }
+
+    c = libnet_pblock_coalesce(l, &packet, &len);
+    if (c == - 1)
+    {
+        /* err msg set in libnet_pblock_coalesce() */
+        return (NULL);
+    }
+
+    t = malloc(sizeof (libnet_template_t));
+    if (t == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        return (NULL);
+    }
+    t->buf = malloc(len);
+    if (t->buf == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        free(t);
+        return (NULL);
+    }
+    memcpy(t->buf, packet, len);
+    t->l        = l;
+    t->len      = len;
+    t->ip_off   = -1;
+    t->l4_off   = -1;
+    t->data_off = 0;
+    t->ip_v     = 0;
+    t->l4_proto = 0;
+    p = t->buf;
+
+    /*
+     *  Find the IP header.  Link-layer packets are only looked into when
+     *  they are ethernet, with or without an 802.1Q tag; anything else can
+     *  still be written and have its payload patched, just without any
+     *  checksums fixed up.
+     */
+    switch (l->injection_type)
+    {
+        case LIBNET_RAW4:
+        case LIBNET_RAW4_ADV:
+        case LIBNET_RAW6:
+        case LIBNET_RAW6_ADV:
+            off = 0;
+            break;
+        case LIBNET_LINK:
+        case LIBNET_LINK_ADV:
+            if (l->link_type != 1 /* DLT_EN10MB */ || len < LIBNET_ETH_H)
+            {
+                return (t);
+            }
+            off  = LIBNET_ETH_H;
+            type = (p[12] << 8) | p[13];
+            if (type == ETHERTYPE_VLAN && len >= LIBNET_ETH_H + 4)
+            {
+                off += 4;
+                type = (p[16] << 8) | p[17];
+            }
+            t->data_off = off;
+            if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6)
+            {
+                return (t);
+            }
+            break;
+        default:
+            return (t);
+    }
+
+    if (len >= off + LIBNET_IPV4_H && (p[off] >> 4) == 4)
+    {
+        t->ip_off   = off;
+        t->ip_v     = 4;
+        t->data_off = off + (p[off] & 0x0f) * 4;
+        /* a fragment past the first carries no transport header */
+        if (((p[off + 6] << 8) | p[off + 7]) & IP_OFFMASK)
+        {
+            return (t);
+        }
+        t->l4_proto = p[off + 9];
+    }
+    else if (len >= off + LIBNET_IPV6_H && (p[off] >> 4) == 6)
+    {
+        t->ip_off   = off;
+        t->ip_v     = 6;
+        t->data_off = off + LIBNET_IPV6_H;
+        /* extension headers are not followed */
+        t->l4_proto = p[off + 6];
+    }
+    else
+    {
+        return (t);
+    }
+
+    off = t->data_off;
+    switch (t->l4_proto)
+    {
+        case IPPROTO_TCP:
+            if (len >= off + LIBNET_TCP_H)
+            {
+                t->l4_off   = off;
+                t->data_off = off + (p[off + 12] >> 4) * 4;
+            }
+            break;
+        case IPPROTO_UDP:
+            if (len >= off + LIBNET_UDP_H)
+            {
+                t->l4_off   = off;
+                t->data_off = off + LIBNET_UDP_H;
+            }
+            break;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMP6:
+            if (len >= off + LIBNET_ICMPV4_ECHO_H)
+            {
+                t->l4_off   = off;
+                t->data_off = off + LIBNET_ICMPV4_ECHO_H;
+            }
+            break;
+    }
+    if (t->l4_off == -1 || t->data_off > len)
+    {
+        /* nothing we know how to patch */
+        t->l4_off   = -1;
+        t->l4_proto = 0;
+        t->data_off = len;
+    }
+    return (t);
+}
+
+
+/*
+ *  Sums the 16-bit words of the wire image from off to off + len, both
+ *  already on the checksum grid of the packet, padding past its end with
+ *  zero.  The words are summed as they lie in memory, which is all an
+ *  RFC 1624 update needs.
+ */
+static u_int16_t
+libnet_template_sum(libnet_template_t *t, u_int32_t off, u_int32_t len)
+{
+    u_int32_t sum;
+    u_int16_t w;
+
+    for (sum = 0; len; off += 2, len -= 2)
+    {
+        if (off + 1 < t->len)
+        {
+            memcpy(&w, t->buf + off, 2);
+        }
+        else
+        {
+            w = 0;
+            memcpy(&w, t->buf + off, 1);
+        }
+        sum += w;
+    }
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    return ((u_int16_t)sum);
+}
+
+
+/*
+ *  Copies n bytes of data into the wire image at off and fixes up the
+ *  checksums in ck by the difference between the words that were there
+ *  and the words that are there now.  Words are counted from the IP
+ *  header, every checksum we know of starts at an even offset from it.
+ */
+static void
+libnet_template_patch(libnet_template_t *t, u_int32_t off,
+        const u_int8_t *data, u_int32_t n, int ck)
+{
+    u_int32_t start, end, ck_off;
+    u_int16_t old_v, new_v, sum;
+
+    if (t->ip_off == -1 || ck == 0)
+    {
+        memcpy(t->buf + off, data, n);
+        return;
+    }
+
+    start = off - ((off - t->ip_off) & 1);
+    end   = off + n + ((off + n - t->ip_off) & 1);
+    old_v = libnet_template_sum(t, start, end - start);
+    memcpy(t->buf + off, data, n);
+    new_v = libnet_template_sum(t, start, end - start);
+    if (old_v == new_v)
+    {
+        return;
+    }
+
+    if ((ck & LIBNET_TMPL_CK_IP) && t->ip_v == 4)
+    {
+        ck_off = t->ip_off + 10;
+        memcpy(&sum, t->buf + ck_off, 2);
+        sum = libnet_adjust_checksum(sum, old_v, new_v);
+        memcpy(t->buf + ck_off, &sum, 2);
+    }
+    if ((ck & LIBNET_TMPL_CK_L4) && t->l4_off != -1)
+    {
+        switch (t->l4_proto)
+        {
+            case IPPROTO_TCP:
+                ck_off = t->l4_off + 16;
+                break;
+            case IPPROTO_UDP:
+                ck_off = t->l4_off + 6;
+                break;
+            default:
+                ck_off = t->l4_off + 2;
+                break;
+        }
+        memcpy(&sum, t->buf + ck_off, 2);
+        if (t->l4_proto == IPPROTO_UDP && sum == 0)
+        {
+            /* UDP sent without a checksum */
+            return;
+        }
+        sum = libnet_adjust_checksum(sum, old_v, new_v);
+        if (t->l4_proto == IPPROTO_UDP && sum == 0)
+        {
+            /* zero means no checksum to UDP, RFC 768 */
+            sum = 0xffff;
+        }
+        memcpy(t->buf + ck_off, &sum, 2);
+    }
+}
+
+
+int
+libnet_template_set(libnet_template_t *t, int field, u_int32_t value)
+{
+    u_int8_t v[4];
+    u_int32_t off, n;
+    int ck, l4, l4_alt;
+
+    if (t == NULL)
+    {
+        return (-1);
+    }
+
+    /*
+     *  l4 (or l4_alt) is the protocol of the header the field lives in, 0
+     *  for the IP header.
+     */
+    l4 = l4_alt = 0;
+    switch (field)
+    {
+        case LIBNET_TMPL_IP_ID:
+            off = 4;
+            n   = 2;
+            break;
+        case LIBNET_TMPL_IP_TOS:
+            off = 1;
+            n   = 1;
+            break;
+        case LIBNET_TMPL_IP_TTL:
+            off = t->ip_v == 6 ? 7 : 8;
+            n   = 1;
+            break;
+        case LIBNET_TMPL_IP_SRC:
+            off = 12;
+            n   = 4;
+            break;
+        case LIBNET_TMPL_IP_DST:
+            off = 16;
+            n   = 4;
+            break;
+        case LIBNET_TMPL_SRC_PORT:
+            l4  = IPPROTO_TCP;
+            l4_alt = IPPROTO_UDP;
+            off = 0;
+            n   = 2;
+            break;
+        case LIBNET_TMPL_DST_PORT:
+            l4  = IPPROTO_TCP;
+            l4_alt = IPPROTO_UDP;
+            off = 2;
+            n   = 2;
+            break;
+        case LIBNET_TMPL_TCP_SEQ:
+            l4  = IPPROTO_TCP;
+            off = 4;
+            n   = 4;
+            break;
+        case LIBNET_TMPL_TCP_ACK:
+            l4  = IPPROTO_TCP;
+            off = 8;
+            n   = 4;
+            break;
+        case LIBNET_TMPL_TCP_FLAGS:
+            l4  = IPPROTO_TCP;
+            off = 13;
+            n   = 1;
+            break;
+        case LIBNET_TMPL_TCP_WIN:
+            l4  = IPPROTO_TCP;
+            off = 14;
+            n   = 2;
+            break;
+        case LIBNET_TMPL_ICMP_ID:
+            l4  = IPPROTO_ICMP;
+            l4_alt = IPPROTO_ICMP6;
+            off = 4;
+            n   = 2;
+            break;
+        case LIBNET_TMPL_ICMP_SEQ:
+            l4  = IPPROTO_ICMP;
+            l4_alt = IPPROTO_ICMP6;
+            off = 6;
+            n   = 2;
+            break;
+        default:
+            snprintf(t->l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): unknown field %d\n", __func__, field);
+            return (-1);
+    }
+
+    if (l4 == 0)
+    {
+        /* IPv6 addresses don't fit, neither do IPv4-only fields */
+        if (t->ip_off == -1 || (t->ip_v == 6 && field != LIBNET_TMPL_IP_TTL))
+        {
+            snprintf(t->l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): template has no IPv4 header for field %d\n",
+                    __func__, field);
+            return (-1);
+        }
+        off += t->ip_off;
+        ck = LIBNET_TMPL_CK_IP;
+        if (field == LIBNET_TMPL_IP_SRC || field == LIBNET_TMPL_IP_DST)
+        {
+            /* the addresses are in the TCP/UDP pseudo header */
+            if (t->l4_proto == IPPROTO_TCP || t->l4_proto == IPPROTO_UDP)
+            {
+                ck |= LIBNET_TMPL_CK_L4;
+            }
+        }
+    }
+    else
+    {
+        if (t->l4_off == -1 ||
+                (t->l4_proto != l4 && t->l4_proto != l4_alt))
+        {
+            snprintf(t->l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): template has no header for field %d\n",
+                    __func__, field);
+            return (-1);
+        }
+        off += t->l4_off;
+        ck = LIBNET_TMPL_CK_L4;
+    }
+
+    /* the field goes on the wire in network byte order */
+    switch (n)
+    {
+        case 4:
+            v[0] = (value >> 24) & 0xff;
+            v[1] = (value >> 16) & 0xff;
+            v[2] = (value >> 8) & 0xff;
+            v[3] = value & 0xff;
+            break;
+        case 2:
+            v[0] = (value >> 8) & 0xff;
+            v[1] = value & 0xff;
+            break;
+        default:
+            v[0] = value & 0xff;
+            break;
+    }
+    libnet_template_patch(t, off, v, n, ck);
+    return (1);
+}
+
+
+int
+libnet_template_set_payload(libnet_template_t *t, u_int32_t off,
+        const u_int8_t *data, u_int32_t n)
+{
+    if (t == NULL || data == NULL)
+    {
+        return (-1);
+    }
+
+    if (off > t->len - t->data_off || n > t->len - t->data_off - off)
+    {
+        snprintf(t->l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): %d bytes at %d run past the %d byte payload\n",
+                __func__, n, off, t->len - t->data_off);
+        return (-1);
+    }
+    libnet_template_patch(t, t->data_off + off, data, n, LIBNET_TMPL_CK_L4);
+    return (1);
+}
+
+
+int
+libnet_template_write(libnet_template_t *t)
+{
+    if (t == NULL)
+    {
+        return (-1);
+    }
+    return (libnet_write_packet(t->l, t->buf, t->len));
+}
+
+
+void
+libnet_template_destroy(libnet_template_t *t)
+{
+    if (t)
+    {
+        if (t->buf)
+        {
+            free(t->buf);
+        }
+        free(t);
+    }
+}
+
+/* EOF */
@@ -35,6 +35,9 @@
 #if (HAVE_CONFIG_H)
 #include "../include/config.h"
 #endif
+#if (HAVE_SENDMMSG)
+#define _GNU_SOURCE                     /* sendmmsg() and struct mmsghdr */
+#endif
 #if (!(_WIN32) || (__CYGWIN__)) 
 #include "../include/libnet.h"
 #else
@@ -63,6 +66,16 @@ libnet_write(libnet_t *l)
         return (-1);
     }
 
+    /* the packet lives in the context's coalesce buffer, nothing to free */
+    return (libnet_write_packet(l, packet, len));
+}
+
+
+int
+libnet_write_packet(libnet_t *l, u_int8_t *packet, u_int32_t len)
+{
+    int c;
+
     /* assume error */
     c = -1;
     switch (l->injection_type)
@@ -74,7 +87,7 @@ libnet_write(libnet_t *l)
                 snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                         "%s(): packet is too large (%d bytes)\n",
                         __func__, len);
-                goto done;
+                return (-1);
             }
             c = libnet_write_raw_ipv4(l, packet, len);
             break;
@@ -89,7 +102,7 @@ libnet_write(libnet_t *l)
         default:
             snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
                         "%s(): unsuported injection type\n", __func__);
-            goto done;
+            return (-1);
     }
 
     /* do statistics */
@@ -110,18 +123,431 @@ libnet_write(libnet_t *l)
             l->stats.bytes_written += c;
         }
     }
-done:
+    return (c);
+}
+
+libnet_batch_t *
+libnet_batch_init(libnet_t *l, u_int32_t size)
+{
+    libnet_batch_t *b;
+
+    if (l == NULL)
+    { 
+        return (NULL);
+    }
+
+    if (size == 0)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): batch size can't be zero\n", __func__);
+        return (NULL);
+    }
+
+    b = malloc(sizeof (libnet_batch_t));
+    if (b == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        return (NULL);
+    }
+    memset(b, 0, sizeof (libnet_batch_t));
+    b->l    = l;
+    b->size = size;
+
+#if (HAVE_SENDMMSG)
+    b->msgs  = malloc(size * sizeof (struct mmsghdr));
+    b->iovs  = malloc(size * sizeof (struct iovec));
+    b->names = malloc(size * sizeof (struct sockaddr_storage));
+    if (b->msgs == NULL || b->iovs == NULL || b->names == NULL)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): malloc(): %s\n",
+                __func__, strerror(errno));
+        libnet_batch_destroy(b);
+        return (NULL);
+    }
+#endif
+    return (b);
+}
+
+
+void
+libnet_batch_destroy(libnet_batch_t *b)
+{
+    if (b == NULL)
+    {
+        return;
+    }
+    free(b->off);
+    free(b->len);
+    free(b->result);
+    free(b->buf);
+    free(b->msgs);
+    free(b->iovs);
+    free(b->names);
+    free(b);
+}
+
+
+/*
+ *  Copies a packet onto the end of batch b, l is the context the packet
+ *  came from and gets the error message.
+ */
+static int
+libnet_batch_append(libnet_batch_t *b, libnet_t *l, u_int8_t *packet,
+        u_int32_t len)
+{
+    u_int32_t n_max, cap;
+    void *p;
+
     /*
-     *  Restore original pointer address so free won't complain about a
-     *  modified chunk pointer.
+     *  Packets from any context can be queued, but they all go out through
+     *  the batch's context, so they have to be of the same kind.
      */
-    if (l->aligner > 0)
+    if ((l->injection_type & ~LIBNET_ADV_MASK) !=
+            (b->l->injection_type & ~LIBNET_ADV_MASK))
     {
-        packet = packet - l->aligner;
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): context injection type differs from the batch's\n",
+                __func__);
+        return (-1);
+    }
+    if ((l->injection_type & ~LIBNET_ADV_MASK) == LIBNET_RAW4 &&
+            len > LIBNET_MAX_PACKET)
+    {
+        snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): packet is too large (%d bytes)\n", __func__, len);
+        return (-1);
+    }
+
+    if (b->n == b->n_max)
+    {
+        n_max = b->n_max ? b->n_max * 2 : b->size;
+        if ((p = realloc(b->off, n_max * sizeof (u_int32_t))) == NULL)
+        {
+            goto bad;
+        }
+        b->off = p;
+        if ((p = realloc(b->len, n_max * sizeof (u_int32_t))) == NULL)
+        {
+            goto bad;
+        }
+        b->len = p;
+        if ((p = realloc(b->result, n_max * sizeof (int))) == NULL)
+        {
+            goto bad;
+        }
+        b->result = p;
+        b->n_max  = n_max;
+    }
+    if (b->buf_len + len > b->buf_cap)
+    {
+        for (cap = b->buf_cap ? b->buf_cap : 4096; cap < b->buf_len + len;)
+        {
+            cap *= 2;
+        }
+        if ((p = realloc(b->buf, cap)) == NULL)
+        {
+            goto bad;
+        }
+        b->buf     = p;
+        b->buf_cap = cap;
+    }
+
+    memcpy(b->buf + b->buf_len, packet, len);
+    b->off[b->n] = b->buf_len;
+    b->len[b->n] = len;
+    b->buf_len  += len;
+    return (b->n++);
+bad:
+    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE, "%s(): realloc(): %s\n",
+            __func__, strerror(errno));
+    return (-1);
+}
+
+
+int
+libnet_batch_add(libnet_batch_t *b, libnet_t *l)
+{
+    int c;
+    u_int32_t len;
+    u_int8_t *packet;
+
+    if (b == NULL || l == NULL)
+    { 
+        return (-1);
+    }
+
+    c = libnet_pblock_coalesce(l, &packet, &len);
+    if (c == - 1)
+    {
+        /* err msg set in libnet_pblock_coalesce() */
+        return (-1);
+    }
+    return (libnet_batch_append(b, l, packet, len));
+}
+
+
+int
+libnet_batch_add_template(libnet_batch_t *b, libnet_template_t *t)
+{
+    if (b == NULL || t == NULL)
+    { 
+        return (-1);
+    }
+    return (libnet_batch_append(b, t->l, t->buf, t->len));
+}
+
+
+#if (HAVE_SENDMMSG)
+/*
+ *  Writes up to n of the queued packets starting at first with a single
+ *  sendmmsg() and returns how many packets it covered.  A packet the kernel
+ *  refused is covered too, with a result of -1, so one bad packet does not
+ *  hold up the rest of the batch.
+ */
+static int
+libnet_batch_mmsg(libnet_batch_t *b, u_int32_t first, u_int32_t n)
+{
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *names;
+    u_int32_t i;
+    int c, name_len;
+    u_int8_t *packet;
+
+    msgs  = (struct mmsghdr *)b->msgs;
+    iovs  = (struct iovec *)b->iovs;
+    names = (struct sockaddr_storage *)b->names;
+    name_len = 0;
+
+    if ((b->l->injection_type & ~LIBNET_ADV_MASK) == LIBNET_LINK)
+    {
+#if (__linux__)
+        if (b->l->tx_ring)
+        {
+            /* fill the ring and have the kernel send it all at once */
+            for (i = 0; i < n; i++)
+            {
+                b->result[first + i] = libnet_tx_ring_put(b->l,
+                        b->buf + b->off[first + i], b->len[first + i]);
+            }
+            b->stats.syscalls++;
+            if (libnet_tx_ring_kick(b->l) == -1)
+            {
+                for (i = 0; i < n; i++)
+                {
+                    b->result[first + i] = -1;
+                }
+            }
+            return (n);
+        }
+
+        /* every frame goes to the same device */
+        if (libnet_link_sockaddr(b->l, &names[0], &name_len) == -1)
+        {
+            snprintf(b->l->err_buf, LIBNET_ERRBUF_SIZE,
+                    "%s(): can't get the index of %s\n", __func__,
+                    b->l->device);
+            return (-1);
+        }
+        for (i = 1; i < n; i++)
+        {
+            memcpy(&names[i], &names[0], name_len);
+        }
+#else
+        /* the link layer writes through its own primitives here */
+        b->result[first] = libnet_write_link(b->l, b->buf + b->off[first],
+                b->len[first]);
+        b->stats.syscalls++;
+        return (1);
+#endif
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        packet = b->buf + b->off[first + i];
+        switch (b->l->injection_type & ~LIBNET_ADV_MASK)
+        {
+            case LIBNET_RAW4:
+            {
+                struct libnet_ipv4_hdr *ip_hdr;
+                struct sockaddr_in *sin;
+
+                ip_hdr = (struct libnet_ipv4_hdr *)packet;
+#if (LIBNET_BSD_BYTE_SWAP)
+                /* see libnet_write_raw_ipv4(), the copy is ours to change */
+                ip_hdr->ip_len = FIX(ip_hdr->ip_len);
+                ip_hdr->ip_off = FIX(ip_hdr->ip_off);
+#endif /* LIBNET_BSD_BYTE_SWAP */
+                sin = (struct sockaddr_in *)&names[i];
+                memset(sin, 0, sizeof (*sin));
+                sin->sin_family      = AF_INET;
+                sin->sin_addr.s_addr = ip_hdr->ip_dst.s_addr;
+                name_len = sizeof (*sin);
+                break;
+            }
+            case LIBNET_RAW6:
+            {
+                struct libnet_ipv6_hdr *ip_hdr;
+                struct sockaddr_in6 *sin;
+
+                ip_hdr = (struct libnet_ipv6_hdr *)packet;
+                sin = (struct sockaddr_in6 *)&names[i];
+                memset(sin, 0, sizeof (*sin));
+                sin->sin6_family = AF_INET6;
+                memcpy(sin->sin6_addr.s6_addr, ip_hdr->ip_dst.libnet_s6_addr,
+                        sizeof(ip_hdr->ip_dst.libnet_s6_addr));
+                name_len = sizeof (*sin);
+                break;
+            }
+        }
+        iovs[i].iov_base = packet;
+        iovs[i].iov_len  = b->len[first + i];
+        memset(&msgs[i], 0, sizeof (msgs[i]));
+        msgs[i].msg_hdr.msg_name    = &names[i];
+        msgs[i].msg_hdr.msg_namelen = name_len;
+        msgs[i].msg_hdr.msg_iov     = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    c = sendmmsg(b->l->fd, msgs, n, 0);
+    b->stats.syscalls++;
+    if (c <= 0)
+    {
+        /* the first packet failed, the error is about it */
+        snprintf(b->l->err_buf, LIBNET_ERRBUF_SIZE,
+                "%s(): packet %d not written (%s)\n", __func__, first,
+                strerror(errno));
+        b->result[first] = -1;
+        return (1);
+    }
+    for (i = 0; i < c; i++)
+    {
+        b->result[first + i] = msgs[i].msg_len;
     }
-    free(packet);
     return (c);
 }
+#endif /* HAVE_SENDMMSG */
+
+
+int
+libnet_write_batch(libnet_batch_t *b)
+{
+    u_int32_t i, n, sent;
+    int c;
+
+    if (b == NULL)
+    { 
+        return (-1);
+    }
+
+    for (i = 0; i < b->n; i += c)
+    {
+        n = b->n - i < b->size ? b->n - i : b->size;
+#if (HAVE_SENDMMSG)
+        c = libnet_batch_mmsg(b, i, n);
+        if (c == -1)
+        {
+            /* nothing can go out, fail the rest of the batch */
+            for (; i < b->n; i++)
+            {
+                b->result[i] = -1;
+            }
+            break;
+        }
+#else
+        /* one system call per packet, still saves the caller the loop */
+        switch (b->l->injection_type & ~LIBNET_ADV_MASK)
+        {
+            case LIBNET_RAW4:
+                b->result[i] = libnet_write_raw_ipv4(b->l, b->buf + b->off[i],
+                        b->len[i]);
+                break;
+            case LIBNET_RAW6:
+                b->result[i] = libnet_write_raw_ipv6(b->l, b->buf + b->off[i],
+                        b->len[i]);
+                break;
+            default:
+                b->result[i] = libnet_write_link(b->l, b->buf + b->off[i],
+                        b->len[i]);
+                break;
+        }
+        b->stats.syscalls++;
+        c = 1;
+#endif
+    }
+
+    /* do statistics, for the batch and for the context it writes through */
+    for (i = 0, sent = 0; i < b->n; i++)
+    {
+        if (b->result[i] == b->len[i])
+        {
+            sent++;
+            b->stats.packets_sent++;
+            b->stats.bytes_written += b->result[i];
+            b->l->stats.packets_sent++;
+            b->l->stats.bytes_written += b->result[i];
+        }
+        else
+        {
+            b->stats.packet_errors++;
+            b->l->stats.packet_errors++;
+            if (b->result[i] > 0)
+            {
+                b->stats.bytes_written += b->result[i];
+                b->l->stats.bytes_written += b->result[i];
+            }
+        }
+    }
+
+    /* the results stay until the next write, the queue starts over */
+    b->n_results = b->n;
+    b->n         = 0;
+    b->buf_len   = 0;
+    return (sent);
+}
+
+
+int
+libnet_batch_result(libnet_batch_t *b, u_int32_t i)
+{
+    if (b == NULL || i >= b->n_results)
+    {
+        return (-1);
+    }
+    return (b->result[i]);
+}
+
+
+void
+libnet_batch_stats(libnet_batch_t *b, struct libnet_batch_stats *bs)
+{
+    if (b == NULL || bs == NULL)
+    {
+        return;
+    }
+    bs->syscalls      = b->stats.syscalls;
+    bs->packets_sent  = b->stats.packets_sent;
+    bs->packet_errors = b->stats.packet_errors;
+    bs->bytes_written = b->stats.bytes_written;
+}
+
+
+#if !(__linux__)
+int
+libnet_tx_ring(libnet_t *l, u_int32_t frames)
+{
+    if (l == NULL)
+    { 
+        return (-1);
+    }
+    snprintf(l->err_buf, LIBNET_ERRBUF_SIZE,
+            "%s(): no tx ring support, using the regular writes\n",
+            __func__);
+    return (0);
+}
+#endif /* !__linux__ */
+
 
 #if defined (__WIN32__)
 libnet_ptag_t
@@ -282,6 +282,10 @@ SOURCE=..\src\libnet_resolve.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\libnet_template.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\libnet_version.c
 # End Source File
 # Begin Source File
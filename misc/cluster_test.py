@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+#
+# Copyright 2005 Daniel Ferullo
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""Helper cluster test on localhost.
+
+Starts --nodes helpers, node i listening on --listen_port+i and known to the
+others as 127.0.1.i, and runs buddy pairs through them.  The two buddies of
+a pair always connect to different nodes, so every pair needs one of its
+sessions forwarded to the node owning the pair.
+
+The peers are fake: they speak the helper protocol with the sizes a real
+peer uses but never send a packet past the helper, so no root, libnet or
+NAT is needed.  Peer a of pair i connects from 127.0.2.i, peer b from
+127.0.3.i.  The helpers tell cluster links from peers by source address,
+which is why the peers never use 127.0.1.x.
+
+Prints how many sessions finished and, from the debug lines on the
+helpers' stderr, how many sessions each node ran and forwarded.  Run it
+from the top of the tree (or use "make cluster_test").
+"""
+
+import argparse
+import os
+import re
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+CLUSTER_PORT = 8100
+NODE_IP = "127.0.1.%d"
+PEER_IP = {"a": "127.0.2.%d", "b": "127.0.3.%d"}
+# every peer binds two ports (helper connection and second connection) in
+# a block of its own, so no run hits TIME_WAIT sockets of an earlier one
+PEER_PORT_BASE = 30000
+PEER_PORT_STEP = 4
+
+# message types, see src/share/comm.h
+MSG = {"HELLO": 0x0001, "CONNECT_AGAIN": 0x1000, "CONNECTED_AGAIN": 0x0002,
+       "PORT_PRED": 0x1002, "WAITING_FOR_BUDDY_ALLOC": 0x0003,
+       "BUDDY_ALLOC": 0x1003, "WAITING_FOR_BUDDY_PORT": 0x0004,
+       "BUDDY_PORT": 0x1004, "BUDDY_SYN_SEQ": 0x0005,
+       "PEER_SYN_SEQ": 0x1005, "GOODBYE": 0x0006}
+
+# payload lengths of the messages the helper sends
+PORT_PRED_LEN = 5
+BUDDY_ALLOC_LEN = 2
+BUDDY_PORT_LEN = 3
+SYN_SEQ_LEN = 65
+
+# ip_t is an unsigned long on the wire
+IP_LEN = 8
+
+# the buddy's internal address is made up, only the pair key depends on it
+INT_IP = "10.0.0.1"
+INT_PORT_BASE = 42000
+
+# the helper's DEBUG lines are <function>:<level>:<message>
+RAN_RE = re.compile(r"^helper_fsm_hello:VERBOSE:Information from peer hello")
+FORWARDED_HERE_RE = re.compile(r"^[a-z_]+:CLUSTER:session from .* "
+                               r"forwarded here")
+FORWARDED_AWAY_RE = re.compile(r"^[a-z_]+:CLUSTER:session from .* "
+                               r"forwarded to node")
+
+
+def pack_ip(addr):
+    return socket.inet_aton(addr) + b"\0" * (IP_LEN - 4)
+
+
+def send(sd, name, payload=b""):
+    sd.sendall(struct.pack("!iI", MSG[name], len(payload)) + payload)
+
+
+def recv(sd, name, length):
+    buf = b""
+    while len(buf) < 8 + length:
+        chunk = sd.recv(8 + length - len(buf))
+        if not chunk:
+            raise EOFError("helper closed the connection")
+        buf += chunk
+    msg_type = struct.unpack("!iI", buf[:8])[0]
+    if msg_type != MSG[name]:
+        raise ValueError("expected %s, got 0x%x" % (name, msg_type))
+    return buf[8:]
+
+
+def connect(src_ip, src_port, listen_port, node):
+    sd = socket.socket()
+    sd.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sd.bind((src_ip, src_port))
+    sd.connect((NODE_IP % (node + 1), listen_port + node))
+    return sd
+
+
+def peer(listen_port, node, my_ip, my_port, buddy_ip, buddy_port, src_port):
+    """runs one peer's session against a node, raises on any failure"""
+    sd = connect(my_ip, src_port, listen_port, node)
+    hello = (pack_ip(INT_IP) + struct.pack("!H", my_port) +
+             pack_ip(INT_IP) + struct.pack("!H", buddy_port) +
+             pack_ip(buddy_ip) + struct.pack("bB", -1, 0))
+    send(sd, "HELLO", hello)
+    recv(sd, "CONNECT_AGAIN", 0)
+    sd2 = connect(my_ip, src_port + 1, listen_port, node)
+    send(sd, "CONNECTED_AGAIN")
+    send(sd, "WAITING_FOR_BUDDY_ALLOC")
+    recv(sd, "PORT_PRED", PORT_PRED_LEN)
+    recv(sd, "BUDDY_ALLOC", BUDDY_ALLOC_LEN)
+    send(sd, "WAITING_FOR_BUDDY_PORT")
+    recv(sd, "BUDDY_PORT", BUDDY_PORT_LEN)
+    send(sd, "BUDDY_SYN_SEQ", b"\1" + struct.pack("<Q", my_port) +
+         b"\0" * (SYN_SEQ_LEN - 9))
+    recv(sd, "PEER_SYN_SEQ", SYN_SEQ_LEN)
+    send(sd, "GOODBYE", b"\2")
+    sd2.close()
+    sd.close()
+
+
+def run_pairs(args):
+    done = [0]
+    failed = []
+    lock = threading.Lock()
+
+    def one(side, *peer_args):
+        try:
+            peer(*peer_args)
+            with lock:
+                done[0] += 1
+        except Exception as exc:
+            with lock:
+                failed.append("%s: %s" % (side, exc))
+
+    threads = []
+    start = time.time()
+    for i in range(args.pairs):
+        host = i % 250 + 1
+        a_ip, b_ip = PEER_IP["a"] % host, PEER_IP["b"] % host
+        a_port, b_port = INT_PORT_BASE + 2 * i, INT_PORT_BASE + 2 * i + 1
+        src = args.port_base + i * 2 * PEER_PORT_STEP
+        # the buddies of a pair go to neighbouring nodes
+        node_a = i % args.nodes
+        node_b = (i + 1) % args.nodes
+        threads.append(threading.Thread(target=one, args=(
+            "pair %d a" % i, args.listen_port, node_a, a_ip, a_port, b_ip, b_port, src)))
+        threads.append(threading.Thread(target=one, args=(
+            "pair %d b" % i, args.listen_port, node_b, b_ip, b_port, a_ip, a_port,
+            src + PEER_PORT_STEP)))
+        threads[-2].start()
+        threads[-1].start()
+        time.sleep(args.gap)
+    for thread in threads:
+        thread.join()
+    return done[0], failed, time.time() - start
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--bindir", default=".",
+                        help="directory holding the built helper")
+    parser.add_argument("--listen_port", type=int, default=CLUSTER_PORT,
+                        help="port of the first node, node i listens on "
+                        "this plus i (default %d)" % CLUSTER_PORT)
+    parser.add_argument("--nodes", type=int, default=3,
+                        help="helpers in the cluster (default 3)")
+    parser.add_argument("--pairs", type=int, default=60,
+                        help="buddy pairs to run (default 60)")
+    parser.add_argument("--gap", type=float, default=0.02,
+                        help="seconds between starting pairs (default 0.02)")
+    parser.add_argument("--port_base", type=int, default=PEER_PORT_BASE,
+                        help="first local port the peers bind")
+    parser.add_argument("--logs", default=None,
+                        help="directory to keep each helper's stderr in")
+    args = parser.parse_args()
+    if args.nodes < 2:
+        parser.error("a cluster needs at least 2 nodes")
+    return args
+
+
+def main():
+    args = get_args()
+    helper = os.path.join(args.bindir, "helper")
+    if not os.access(helper, os.X_OK):
+        sys.exit("cluster_test: helper not built in %s" % args.bindir)
+
+    nodes = ["%s:%d" % (NODE_IP % (n + 1), args.listen_port + n)
+             for n in range(args.nodes)]
+    logdir = args.logs or "."
+    logs = [os.path.join(logdir, "cluster_node%d.log" % n)
+            for n in range(args.nodes)]
+    helpers = []
+    try:
+        for n in range(args.nodes):
+            with open(logs[n], "w") as log:
+                helpers.append(subprocess.Popen(
+                    [helper, "--listen_port", str(args.listen_port + n),
+                     "--source_rate", "0", "--cluster", ",".join(nodes),
+                     "--cluster_self", nodes[n]],
+                    stdout=subprocess.DEVNULL, stderr=log))
+        time.sleep(0.5)
+        for n, proc in enumerate(helpers):
+            if proc.poll() is not None:
+                # most likely the port is still held by an earlier run
+                sys.exit("cluster_test: node %d exited, see %s"
+                         % (n, logs[n]))
+        done, failed, elapsed = run_pairs(args)
+        # let the last forwarded sessions be logged before reading the logs
+        time.sleep(0.5)
+    finally:
+        for proc in helpers:
+            proc.kill()
+            proc.wait()
+
+    print("sessions finished: %d of %d in %.3fs" %
+          (done, 2 * args.pairs, elapsed))
+    for line in failed[:10]:
+        print("  failed %s" % line)
+    for n in range(args.nodes):
+        ran = here = away = 0
+        with open(logs[n]) as log:
+            for line in log:
+                if RAN_RE.match(line):
+                    ran += 1
+                elif FORWARDED_HERE_RE.match(line):
+                    here += 1
+                elif FORWARDED_AWAY_RE.match(line):
+                    away += 1
+        print("node %d (%s): ran %d sessions (%d forwarded here), "
+              "forwarded %d away" % (n, nodes[n], ran, here, away))
+        if args.logs is None:
+            os.unlink(logs[n])
+    if done != 2 * args.pairs:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,363 @@
+#!/usr/bin/env python3
+#
+# Copyright 2005 Daniel Ferullo
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""Connection setup latency benchmark on a local NAT testbed.
+
+Builds this topology out of network namespaces and veth pairs:
+
+    peer_a -- nat_a --+
+                      |
+                    core -- helper
+                      |
+    peer_b -- nat_b --+
+
+nat_a and nat_b masquerade their inside network with iptables.  core is a
+plain router, so a SYN sent with the TTL the peer calibrates (one past the
+last private hop, see src/peer/ttlcal.h) opens a mapping in the peer's own
+NAT and then expires in core, exactly as it would on the way to a real
+buddy.
+
+The built helper and two peer binaries are run across the testbed.  Each
+trial times natblaster_connect() from entry to a usable socket and splits
+that time into the peer FSM phases using the DBG_TIME lines the peer
+prints on stderr.  Percentiles over all trials are printed and written to
+a JSON results file.
+
+NAT configurations (chosen per NAT with --nat_a / --nat_b):
+    preserve  MASQUERADE, the source port is kept whenever it is free
+    seq       SNAT into a port range that does not hold the peer's ports,
+              so every mapping is a newly allocated port.  Kernels that
+              pick the first port with a rover allocate sequentially;
+              newer kernels start from a random offset and behave more
+              like rand
+    rand      MASQUERADE --random-fully, the peer is run with --random
+
+Needs root, iproute2 and iptables.  Run it from the top of the tree (or
+use "make nat_bench").
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+# namespace names, all prefixed so a cleanup can never touch anything else
+NS_PREFIX = "nb_"
+NS = ["helper", "core", "nat_a", "nat_b", "peer_a", "peer_b"]
+
+# addressing.  "public" links are between core and the helper / NATs
+HELPER_IP = "198.18.0.2"
+NAT_EXT_IP = {"a": "198.18.1.2", "b": "198.18.2.2"}
+PEER_IP = {"a": "10.0.1.2", "b": "10.0.2.2"}
+
+HELPER_PORT = 8000
+# first buddy port used by a peer, every trial moves on by PORT_STEP so a
+# trial never runs into conntrack entries or TIME_WAIT sockets left over
+# from an earlier one
+PORT_BASE = {"a": 4000, "b": 24000}
+PORT_STEP = 5
+
+# SNAT port range for the "seq" configuration, clear of the peer ports
+SEQ_PORTS = "40000-49999"
+
+NAT_CONFIGS = ("preserve", "seq", "rand")
+
+# TIME:<function>:<message> <sec.usec>
+TIME_RE = re.compile(r"^TIME:([A-Za-z0-9_]+):(.*) <(\d+)\.(\d+)>$")
+
+PERCENTILES = (50, 90, 99)
+
+
+def ns(name):
+    return NS_PREFIX + name
+
+
+def run(cmd, check=True):
+    """run a command, raising on failure when check is set"""
+    return subprocess.run(cmd, check=check, stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, universal_newlines=True)
+
+
+def nsrun(name, cmd, check=True):
+    return run(["ip", "netns", "exec", ns(name)] + cmd, check)
+
+
+def link(ns1, dev1, ip1, ns2, dev2, ip2, prefix):
+    """create a veth pair between two namespaces and address both ends"""
+    run(["ip", "link", "add", dev1, "netns", ns(ns1), "type", "veth",
+         "peer", "name", dev2, "netns", ns(ns2)])
+    nsrun(ns1, ["ip", "addr", "add", "%s/%d" % (ip1, prefix), "dev", dev1])
+    nsrun(ns2, ["ip", "addr", "add", "%s/%d" % (ip2, prefix), "dev", dev2])
+    nsrun(ns1, ["ip", "link", "set", dev1, "up"])
+    nsrun(ns2, ["ip", "link", "set", dev2, "up"])
+
+
+def masquerade(side, config):
+    """install the NAT rules for one side"""
+    nat = "nat_" + side
+    rule = ["iptables", "-t", "nat", "-A", "POSTROUTING", "-o", "ext",
+            "-s", PEER_IP[side] + "/24"]
+    if config == "preserve":
+        rule += ["-j", "MASQUERADE"]
+    elif config == "rand":
+        rule += ["-j", "MASQUERADE", "--random-fully"]
+    else:
+        rule += ["-p", "tcp", "-j", "SNAT", "--to-source",
+                 "%s:%s" % (NAT_EXT_IP[side], SEQ_PORTS)]
+    nsrun(nat, rule)
+    if config == "seq":
+        # anything that is not tcp still needs to get out
+        nsrun(nat, ["iptables", "-t", "nat", "-A", "POSTROUTING", "-o", "ext",
+                    "-s", PEER_IP[side] + "/24", "-j", "MASQUERADE"])
+
+
+def teardown():
+    for name in NS:
+        run(["ip", "netns", "del", ns(name)], check=False)
+
+
+def setup(nat_a, nat_b):
+    teardown()
+    for name in NS:
+        run(["ip", "netns", "add", ns(name)])
+        nsrun(name, ["ip", "link", "set", "lo", "up"])
+
+    # core routes between the public links
+    link("core", "to_helper", "198.18.0.1", "helper", "eth0", HELPER_IP, 24)
+    link("core", "to_nat_a", "198.18.1.1", "nat_a", "ext",
+         NAT_EXT_IP["a"], 24)
+    link("core", "to_nat_b", "198.18.2.1", "nat_b", "ext",
+         NAT_EXT_IP["b"], 24)
+    nsrun("core", ["sysctl", "-qw", "net.ipv4.ip_forward=1"])
+    nsrun("helper", ["ip", "route", "add", "default", "via", "198.18.0.1"])
+
+    for side, config in (("a", nat_a), ("b", nat_b)):
+        nat, peer = "nat_" + side, "peer_" + side
+        link(nat, "int", PEER_IP[side].rsplit(".", 1)[0] + ".1",
+             peer, "eth0", PEER_IP[side], 24)
+        nsrun(nat, ["ip", "route", "add", "default", "via",
+                    "198.18.%d.1" % (1 if side == "a" else 2)])
+        nsrun(nat, ["sysctl", "-qw", "net.ipv4.ip_forward=1"])
+        nsrun(peer, ["ip", "route", "add", "default", "via",
+                     PEER_IP[side].rsplit(".", 1)[0] + ".1"])
+        masquerade(side, config)
+
+
+def peer_cmd(bindir, side, trial, configs, args):
+    other = "b" if side == "a" else "a"
+    cmd = ["ip", "netns", "exec", ns("peer_" + side),
+           os.path.join(bindir, "peer"),
+           "--helper_ip", HELPER_IP,
+           "--helper_port", str(HELPER_PORT),
+           "--local_ip", PEER_IP[side],
+           "--local_port", str(PORT_BASE[side] + trial * PORT_STEP),
+           "--buddy_ext_ip", NAT_EXT_IP[other],
+           "--buddy_int_ip", PEER_IP[other],
+           "--buddy_int_port", str(PORT_BASE[other] + trial * PORT_STEP),
+           "--device", "eth0",
+           "--message", "trial %d from %s" % (trial, side)]
+    if configs[side] == "rand":
+        cmd.append("--random")
+    if args.race_width > 1:
+        cmd += ["--race_width", str(args.race_width)]
+    return cmd
+
+
+def parse_times(stderr):
+    """pull the DBG_TIME points out of a peer's stderr.  Returns the total
+    connect time and the time spent in each FSM state, in milliseconds"""
+    points = []
+    for line in stderr.splitlines():
+        m = TIME_RE.match(line.strip())
+        if m:
+            t = int(m.group(3)) + int(m.group(4)) / 1e6
+            points.append((m.group(1), m.group(2), t))
+
+    start = end = None
+    states = []
+    for func, msg, t in points:
+        if func == "natblaster_connect":
+            if "start" in msg:
+                start = t
+            elif "end" in msg:
+                end = t
+        elif func.startswith("peer_fsm_") and "start" in msg:
+            states.append((func[len("peer_fsm_"):], t))
+    if start is None or end is None:
+        return None
+
+    # a state lasts until the next one starts, the last until the connect
+    # returns.  The states call each other, so the "end of function" marks
+    # would count every later state again
+    phases = {}
+    for i, (name, t) in enumerate(states):
+        stop = states[i + 1][1] if i + 1 < len(states) else end
+        phases[name] = phases.get(name, 0.0) + (stop - t) * 1000.0
+    phases["setup"] = ((states[0][1] if states else end) - start) * 1000.0
+    return (end - start) * 1000.0, phases
+
+
+def trial(bindir, n, configs, args):
+    """run one connection between peer_a and peer_b.  Returns a result
+    dictionary per side"""
+    procs = {}
+    for side in ("a", "b"):
+        procs[side] = subprocess.Popen(
+            peer_cmd(bindir, side, n, configs, args),
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+            universal_newlines=True)
+        # let peer a say hello first, as a user would
+        if side == "a":
+            time.sleep(args.stagger)
+
+    results = {}
+    for side, proc in procs.items():
+        try:
+            out, err = proc.communicate(timeout=args.timeout)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            out, err = proc.communicate()
+        parsed = parse_times(err)
+        results[side] = {
+            "success": "SUCCESS" in out and "UNSUCCESSFUL" not in out,
+            "relayed": "helper is relaying" in err,
+            "total_ms": parsed[0] if parsed else None,
+            "phases_ms": parsed[1] if parsed else {},
+        }
+    return results
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def summarize(values):
+    summary = {"count": len(values)}
+    for p in PERCENTILES:
+        summary["p%d" % p] = percentile(values, p)
+    summary["min"] = min(values) if values else None
+    summary["max"] = max(values) if values else None
+    return summary
+
+
+def report(configs, trials, args):
+    ok = [r for t in trials for r in t.values()
+          if r["success"] and r["total_ms"] is not None]
+    phases = sorted({p for r in ok for p in r["phases_ms"]})
+    summary = {
+        "nat_a": configs["a"],
+        "nat_b": configs["b"],
+        "race_width": args.race_width,
+        "trials": len(trials),
+        "connections": sum(1 for t in trials
+                           if t["a"]["success"] and t["b"]["success"]),
+        "relayed": sum(1 for t in trials if t["a"]["relayed"]),
+        "total_ms": summarize([r["total_ms"] for r in ok]),
+        "phases_ms": {p: summarize([r["phases_ms"][p] for r in ok
+                                    if p in r["phases_ms"]])
+                      for p in phases},
+    }
+
+    print("nat_a=%s nat_b=%s: %d/%d connected (%d relayed)" %
+          (configs["a"], configs["b"], summary["connections"],
+           summary["trials"], summary["relayed"]))
+    row = "  %-20s" + " %9s" * len(PERCENTILES)
+    print(row % (("phase",) + tuple("p%d ms" % p for p in PERCENTILES)))
+    for name, s in [("total", summary["total_ms"])] + \
+            sorted(summary["phases_ms"].items()):
+        print(row % ((name,) + tuple(
+            "-" if s["p%d" % p] is None else "%.2f" % s["p%d" % p]
+            for p in PERCENTILES)))
+    return summary
+
+
+def get_args():
+    parser = argparse.ArgumentParser(
+        description="natblaster connection setup latency on a local "
+                    "NAT testbed")
+    parser.add_argument("--bindir", default=".",
+                        help="directory holding the built helper and peer")
+    parser.add_argument("--trials", type=int, default=50,
+                        help="connections per NAT configuration")
+    parser.add_argument("--nat_a", choices=NAT_CONFIGS,
+                        help="NAT in front of peer a (default: all)")
+    parser.add_argument("--nat_b", choices=NAT_CONFIGS,
+                        help="NAT in front of peer b (default: same as a)")
+    parser.add_argument("--race_width", type=int, default=1,
+                        help="buddy ports raced by each peer")
+    parser.add_argument("--timeout", type=float, default=30.0,
+                        help="seconds before a peer is given up on")
+    parser.add_argument("--stagger", type=float, default=0.05,
+                        help="seconds between starting peer a and b")
+    parser.add_argument("--results", default="nat_bench.json",
+                        help="file the JSON results are written to")
+    parser.add_argument("--keep", action="store_true",
+                        help="leave the namespaces up when done")
+    return parser.parse_args()
+
+
+def main():
+    args = get_args()
+    if os.geteuid() != 0:
+        sys.exit("nat_testbed: must be run as root")
+    for exe in ("helper", "peer"):
+        if not os.access(os.path.join(args.bindir, exe), os.X_OK):
+            sys.exit("nat_testbed: %s not built in %s" % (exe, args.bindir))
+
+    if args.nat_a:
+        runs = [(args.nat_a, args.nat_b or args.nat_a)]
+    else:
+        runs = [(c, c) for c in NAT_CONFIGS]
+
+    summaries = []
+    try:
+        for nat_a, nat_b in runs:
+            configs = {"a": nat_a, "b": nat_b}
+            setup(nat_a, nat_b)
+            helper = subprocess.Popen(
+                ["ip", "netns", "exec", ns("helper"),
+                 os.path.join(args.bindir, "helper"),
+                 "--listen_port", str(HELPER_PORT), "--relay"],
+                stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            time.sleep(0.5)
+            try:
+                trials = [trial(args.bindir, n, configs, args)
+                          for n in range(args.trials)]
+            finally:
+                helper.kill()
+                helper.wait()
+            summaries.append(report(configs, trials, args))
+    finally:
+        if not args.keep:
+            teardown()
+
+    with open(args.results, "w") as out:
+        json.dump({"time": time.time(), "runs": summaries}, out, indent=2)
+    print("results written to %s" % args.results)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,241 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file admit.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief the helper's admission layer
+ */
+
+#include "admit.h"
+#include "admit_private.h"
+#include "debug.h"
+#include <string.h>
+#include <sys/time.h>
+
+errorcode admit_init(admit_t *admit, unsigned long max_sessions,
+		     unsigned long rate) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(admit,ERROR_NULL_ARG_1);
+
+	/* do function */
+	memset(admit,0,sizeof(admit_t));
+	admit->max_sessions = max_sessions;
+	admit->rate         = rate;
+	admit->reported     = time(NULL);
+
+	if (pthread_mutex_init(&admit->mutex,NULL)!=0)
+		return ERROR_1;
+
+	return SUCCESS;
+}
+
+flag_t admit_connection(admit_t *admit, ip_t ip) {
+
+	/* declare local variables */
+	flag_t ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(admit,FLAG_FAILED);
+
+	/* do function */
+	/* the bucket is checked first, it costs no lock */
+	if ( (admit->rate > 0) && (admit_take_token(admit,ip) != FLAG_SUCCESS)){
+		DEBUG(DBG_ADMIT,"ADMIT:%s over its rate\n",DBG_IP(ip));
+		ret = FLAG_FAILED;
+	}
+	else {
+		ret = FLAG_SUCCESS;
+	}
+
+	if (pthread_mutex_lock(&admit->mutex)!=0)
+		return FLAG_FAILED;
+
+	if (ret == FLAG_FAILED) {
+		admit->stats.shed_rate++;
+	}
+	else if ( (admit->max_sessions > 0) &&
+		  (admit->sessions >= admit->max_sessions) ) {
+		DEBUG(DBG_ADMIT,"ADMIT:full, turning %s away\n",DBG_IP(ip));
+		admit->stats.shed_full++;
+		ret = FLAG_FAILED;
+	}
+	else {
+		admit->sessions++;
+		admit->stats.admitted++;
+	}
+
+	admit_report(admit);
+
+	if (pthread_mutex_unlock(&admit->mutex)!=0)
+		return FLAG_FAILED;
+
+	return ret;
+}
+
+errorcode admit_release(admit_t *admit) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(admit,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&admit->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	if (admit->sessions > 0)
+		admit->sessions--;
+	if (pthread_mutex_unlock(&admit->mutex)!=0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+errorcode admit_resume(admit_t *admit) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(admit,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&admit->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	admit->sessions++;
+	if (pthread_mutex_unlock(&admit->mutex)!=0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+flag_t admit_hello(admit_t *admit, comm_msg_hello_t *hello) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(hello,FLAG_FAILED);
+
+	/* do function */
+	/* a peer always knows itself and who it wants to reach */
+	if ( (hello->peer_ip != IP_UNKNOWN) &&
+	     (hello->peer_port != PORT_UNKNOWN) &&
+	     (hello->buddy_int_ip != IP_UNKNOWN) &&
+	     (hello->buddy_int_port != PORT_UNKNOWN) &&
+	     (hello->buddy_ext_ip != IP_UNKNOWN) &&
+	     ( (hello->port_alloc == COMM_PORT_ALLOC_UNKNOWN) ||
+	       (hello->port_alloc == COMM_PORT_ALLOC_SEQ) ||
+	       (hello->port_alloc == COMM_PORT_ALLOC_RAND) ) &&
+	     (hello->stride <= COMM_MAX_STRIDE) )
+		return FLAG_SUCCESS;
+
+	DEBUG(DBG_ADMIT,"ADMIT:bad HELLO\n");
+	if (admit == NULL)
+		return FLAG_FAILED;
+	if (pthread_mutex_lock(&admit->mutex)!=0)
+		return FLAG_FAILED;
+	admit->stats.shed_hello++;
+	pthread_mutex_unlock(&admit->mutex);
+
+	return FLAG_FAILED;
+}
+
+errorcode admit_idle(admit_t *admit) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(admit,ERROR_NULL_ARG_1);
+
+	/* do function */
+	DEBUG(DBG_ADMIT,"ADMIT:no HELLO in time\n");
+	if (pthread_mutex_lock(&admit->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	admit->stats.shed_hello++;
+	if (pthread_mutex_unlock(&admit->mutex)!=0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+flag_t admit_take_token(admit_t *admit, ip_t ip) {
+
+	/* declare local variables */
+	admit_source_t *source;
+	struct timeval now;
+	unsigned long hash;
+
+	/* do function */
+	gettimeofday(&now,NULL);
+
+	hash = (unsigned long)ip;
+	hash = (hash ^ (hash>>16)) * 0x45d9f3b;
+	source = &admit->sources[(hash ^ (hash>>16)) % ADMIT_SOURCES];
+
+	if (source->ip != ip) {
+		/* a slot whose bucket filled up again has been idle, so it can
+		 * be given to the new source.  otherwise the two share it */
+		admit_refill(admit,source,&now);
+		if ( (source->ip == IP_UNKNOWN) ||
+		     (source->tokens == ADMIT_BURST*ADMIT_TOKEN_SCALE) ) {
+			source->ip     = ip;
+			source->tokens = ADMIT_BURST*ADMIT_TOKEN_SCALE;
+			source->refill = now;
+		}
+	}
+	else {
+		admit_refill(admit,source,&now);
+	}
+
+	if (source->tokens < ADMIT_TOKEN_SCALE)
+		return FLAG_FAILED;
+
+	source->tokens -= ADMIT_TOKEN_SCALE;
+	return FLAG_SUCCESS;
+}
+
+void admit_refill(admit_t *admit, admit_source_t *source,
+		  struct timeval *now) {
+
+	/* declare local variables */
+	long elapsed;
+
+	/* do function */
+	elapsed = (now->tv_sec - source->refill.tv_sec)*1000 +
+		  (now->tv_usec - source->refill.tv_usec)/1000;
+	if (elapsed <= 0)
+		return;
+
+	/* rate tokens a second are rate thousandths of a token a millisecond,
+	 * and a long idle time just fills the bucket */
+	if (elapsed > ADMIT_BURST*ADMIT_TOKEN_SCALE)
+		elapsed = ADMIT_BURST*ADMIT_TOKEN_SCALE;
+	source->tokens += elapsed * (long)admit->rate;
+	if (source->tokens > ADMIT_BURST*ADMIT_TOKEN_SCALE)
+		source->tokens = ADMIT_BURST*ADMIT_TOKEN_SCALE;
+	source->refill = *now;
+}
+
+void admit_report(admit_t *admit) {
+
+	/* declare local variables */
+	time_t now;
+
+	/* do function */
+	now = time(NULL);
+	if (now - admit->reported < ADMIT_REPORT_INTERVAL)
+		return;
+	admit->reported = now;
+
+	DEBUG(DBG_ADMIT,"ADMIT:%lu sessions, %lu admitted, shed %lu over "
+		"rate, %lu full, %lu bad hello\n",admit->sessions,
+		admit->stats.admitted,admit->stats.shed_rate,
+		admit->stats.shed_full,admit->stats.shed_hello);
+}
@@ -0,0 +1,182 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file admit.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief decides which connections the helper spends a thread and a
+ *        connection list entry on
+ *
+ * Every connection is checked before anything is allocated for it.  Each
+ * source ip has a token bucket, so a peer stuck reconnecting or a flood
+ * from one address is turned away right after accept.  A cap on the
+ * sessions running at once rejects connections early rather than letting
+ * the helper run out of threads.  A connection only gets an entry in the
+ * connection list once it sent a valid HELLO within ADMIT_HELLO_TIMEOUT.
+ * What was turned away is counted and reported every ADMIT_REPORT_INTERVAL
+ * seconds.
+ */
+
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include "errorcodes.h"
+#include "helperdef.h"
+#include "comm.h"
+#include <pthread.h>
+#include <time.h>
+
+/** @brief the number of source ips with their own token bucket.  sources
+ *  that hash to a slot in use share its bucket */
+#define ADMIT_SOURCES		1024
+
+/** @brief tokens are kept in thousandths so slow rates refill smoothly */
+#define ADMIT_TOKEN_SCALE	1000
+
+/** @brief the most connections one source may make at once before the
+ *  rate limit applies.  a connection takes two, and several peers may
+ *  share one NAT's address */
+#define ADMIT_BURST		8
+
+/** @brief structure for the token bucket of one source ip */
+struct admit_source {
+	/** @brief the source ip, 0 if the slot is free */
+	ip_t ip;
+	/** @brief the tokens left, in ADMIT_TOKEN_SCALE units */
+	long tokens;
+	/** @brief the time the tokens were last refilled */
+	struct timeval refill;
+} __attribute__((packed));
+
+/** @brief typedef for the admit_source structure */
+typedef struct admit_source admit_source_t;
+
+/** @brief structure for what admission has done */
+struct admit_stats {
+	/** @brief the connections let in */
+	unsigned long admitted;
+	/** @brief the connections refused because their source was over its
+	 *  rate */
+	unsigned long shed_rate;
+	/** @brief the connections refused because the helper was full */
+	unsigned long shed_full;
+	/** @brief the connections dropped for a bad or missing HELLO */
+	unsigned long shed_hello;
+} __attribute__((packed));
+
+/** @brief typedef for the admit_stats structure */
+typedef struct admit_stats admit_stats_t;
+
+/** @brief structure for the admission state */
+struct admit {
+	/** @brief the most sessions running at once, 0 for no limit */
+	unsigned long max_sessions;
+	/** @brief the connections per second each source may make, 0 for no
+	 *  limit */
+	unsigned long rate;
+	/** @brief the sessions running now */
+	unsigned long sessions;
+	/** @brief the token buckets, only used by the accepting thread */
+	admit_source_t sources[ADMIT_SOURCES];
+	/** @brief the counters */
+	admit_stats_t stats;
+	/** @brief the time the counters were last reported */
+	time_t reported;
+	/** @brief protects sessions and stats */
+	pthread_mutex_t mutex;
+} __attribute__((packed));
+
+/** @brief typedef for the admit structure */
+typedef struct admit admit_t;
+
+/**
+ * @brief initializes the admission state
+ *
+ * @param admit pointer to the admission state
+ * @param max_sessions the most sessions running at once, 0 for no limit
+ * @param rate the connections per second each source ip may make, 0 for no
+ *        limit
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode admit_init(admit_t *admit, unsigned long max_sessions,
+		     unsigned long rate);
+
+/**
+ * @brief decides if a just accepted connection gets a session.  a session
+ *        that is let in must be ended with admit_release.
+ *
+ * Only the accepting thread may call this function.
+ *
+ * @param admit pointer to the admission state
+ * @param ip the connection's source ip
+ *
+ * @return FLAG_SUCCESS if the connection is let in, FLAG_FAILED if it
+ *         should be closed right away
+ */
+flag_t admit_connection(admit_t *admit, ip_t ip);
+
+/**
+ * @brief ends a session let in by admit_connection
+ *
+ * This function is thread safe.
+ *
+ * @param admit pointer to the admission state
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode admit_release(admit_t *admit);
+
+/**
+ * @brief counts a session handed over by another helper process.  it was
+ *        let in by that process, so the limit is not checked.
+ *
+ * This function is thread safe.
+ *
+ * @param admit pointer to the admission state
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode admit_resume(admit_t *admit);
+
+/**
+ * @brief checks a HELLO before any state is kept for the session.  a bad
+ *        HELLO is counted.
+ *
+ * This function is thread safe.
+ *
+ * @param admit pointer to the admission state, NULL to check without
+ *        counting
+ * @param hello the received message
+ *
+ * @return FLAG_SUCCESS if the HELLO is sane, FLAG_FAILED otherwise
+ */
+flag_t admit_hello(admit_t *admit, comm_msg_hello_t *hello);
+
+/**
+ * @brief counts a connection that sent nothing before ADMIT_HELLO_TIMEOUT
+ *
+ * This function is thread safe.
+ *
+ * @param admit pointer to the admission state
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode admit_idle(admit_t *admit);
+
+#endif /* __ADMIT_H__ */
@@ -0,0 +1,62 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file admit_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the admission layer
+ */
+
+#ifndef __ADMIT_PRIVATE_H__
+#define __ADMIT_PRIVATE_H__
+
+#include "admit.h"
+
+/**
+ * @brief takes a token from a source's bucket, refilling it first
+ *
+ * @param admit pointer to the admission state
+ * @param ip the source ip
+ *
+ * @return FLAG_SUCCESS if there was a token, FLAG_FAILED otherwise
+ */
+flag_t admit_take_token(admit_t *admit, ip_t ip);
+
+/**
+ * @brief refills a bucket for the time passed since its last refill
+ *
+ * @param admit pointer to the admission state
+ * @param source the bucket
+ * @param now the time now
+ *
+ * @return void
+ */
+void admit_refill(admit_t *admit, admit_source_t *source,
+		  struct timeval *now);
+
+/**
+ * @brief reports the counters if ADMIT_REPORT_INTERVAL passed since the
+ *        last report.  the mutex must be held.
+ *
+ * @param admit pointer to the admission state
+ *
+ * @return void
+ */
+void admit_report(admit_t *admit);
+
+#endif /* __ADMIT_PRIVATE_H__ */
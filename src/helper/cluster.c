@@ -0,0 +1,393 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file cluster.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief routes each pair of buddies to the helper of a cluster owning it
+ */
+
+#include "cluster.h"
+#include "cluster_private.h"
+#include "berkeleyapi.h"
+#include "nethelp.h"
+#include "netio.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+errorcode cluster_init(cluster_t *cluster, char *nodes, char *self) {
+
+	/* declare local variables */
+	char list[CLUSTER_MAX_LIST];
+	char *str, *save;
+	cluster_node_t me;
+	unsigned int hash, place;
+	int i, j;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cluster,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(nodes,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(self,ERROR_NULL_ARG_3);
+
+	/* do function */
+	memset(cluster,0,sizeof(cluster_t));
+	if (strlen(nodes) >= CLUSTER_MAX_LIST)
+		return ERROR_BUF_SIZE;
+	strcpy(list,nodes);
+	for (str=strtok_r(list,",",&save); str!=NULL;
+	     str=strtok_r(NULL,",",&save)) {
+		if (cluster->count == CLUSTER_MAX_NODES)
+			return ERROR_OUT_OF_BOUNDS;
+		CHECK_FAILED(cluster_parse_node(str,
+			&cluster->nodes[cluster->count]),ERROR_ARG_2);
+		cluster->count++;
+	}
+
+	CHECK_FAILED(cluster_parse_node(self,&me),ERROR_ARG_3);
+	cluster->self = -1;
+	for (i=0;i<cluster->count;i++) {
+		if ( (cluster->nodes[i].ip == me.ip) &&
+		     (cluster->nodes[i].port == me.port) )
+			cluster->self = i;
+	}
+	if (cluster->self < 0)
+		return ERROR_NOT_FOUND;
+
+	/* every node puts the same places on the ring, as each place only
+	 * depends on the node's own address */
+	for (i=0;i<cluster->count;i++) {
+		for (j=0;j<CLUSTER_VNODES;j++) {
+			hash  = CLUSTER_FNV_OFFSET;
+			place = (unsigned int)cluster->nodes[i].ip;
+			hash  = cluster_hash(hash,&place,sizeof(place));
+			hash  = cluster_hash(hash,&cluster->nodes[i].port,
+				sizeof(port_t));
+			place = htonl(j);
+			hash  = cluster_hash(hash,&place,sizeof(place));
+			cluster->ring[cluster->points].hash = cluster_mix(hash);
+			cluster->ring[cluster->points].node = i;
+			cluster->points++;
+		}
+	}
+	qsort(cluster->ring,cluster->points,sizeof(cluster_point_t),
+	      cluster_point_compare);
+
+	if (pthread_mutex_init(&cluster->mutex,NULL)!=0)
+		return ERROR_INIT;
+	/* forwarded sessions are spliced without a rate limit, the owner
+	 * limits its own relayed sessions */
+	CHECK_FAILED(relay_init(&cluster->relay,0),ERROR_INIT);
+
+	DEBUG(DBG_CLUSTER,"CLUSTER:node %d of %d, %d places on the ring\n",
+		cluster->self,cluster->count,cluster->points);
+
+	return SUCCESS;
+}
+
+int cluster_owner(cluster_t *cluster, observed_data_t *obs,
+		  comm_msg_hello_t *hello) {
+
+	/* declare local variables */
+	cluster_key_half_t mine, buddy;
+	unsigned int hash;
+	int low, high, mid;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cluster,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(obs,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(hello,ERROR_NULL_ARG_3);
+
+	/* do function */
+	mine.ext_ip    = (unsigned int)obs->ip;
+	mine.int_ip    = (unsigned int)hello->peer_ip;
+	mine.int_port  = hello->peer_port;
+	buddy.ext_ip   = (unsigned int)hello->buddy_ext_ip;
+	buddy.int_ip   = (unsigned int)hello->buddy_int_ip;
+	buddy.int_port = hello->buddy_int_port;
+
+	/* the buddy sends the same two halves the other way around, so put
+	 * them in order before hashing */
+	hash = CLUSTER_FNV_OFFSET;
+	if (memcmp(&mine,&buddy,sizeof(cluster_key_half_t)) < 0) {
+		hash = cluster_hash(hash,&mine,sizeof(mine));
+		hash = cluster_hash(hash,&buddy,sizeof(buddy));
+	}
+	else {
+		hash = cluster_hash(hash,&buddy,sizeof(buddy));
+		hash = cluster_hash(hash,&mine,sizeof(mine));
+	}
+	hash = cluster_mix(hash);
+
+	/* the owner is at the first place at or after the hash, wrapping
+	 * around to the start of the ring */
+	low  = 0;
+	high = cluster->points;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (cluster->ring[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == cluster->points)
+		low = 0;
+
+	return cluster->ring[low].node;
+}
+
+flag_t cluster_is_node(cluster_t *cluster, ip_t ip) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	if (cluster == NULL)
+		return FLAG_UNSET;
+	for (i=0;i<cluster->count;i++) {
+		if ( (i != cluster->self) && (cluster->nodes[i].ip == ip) )
+			return FLAG_SET;
+	}
+
+	return FLAG_UNSET;
+}
+
+errorcode cluster_forward(cluster_t *cluster, int node, sock_t sd,
+			  observed_data_t *obs, comm_msg_hello_t *hello) {
+
+	/* declare local variables */
+	comm_msg_cluster_t msg;
+	cluster_expect_t *expect;
+	sock_t link;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cluster,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(obs,ERROR_NULL_ARG_4);
+	CHECK_NOT_NULL(hello,ERROR_NULL_ARG_5);
+	if ( (node < 0) || (node >= cluster->count) )
+		return ERROR_ARG_2;
+
+	/* do function */
+	memset(&msg,0,sizeof(msg));
+	msg.kind = COMM_CLUSTER_FORWARD;
+	msg.ip   = obs->ip;
+	msg.port = obs->port;
+	memcpy(&msg.hello,hello,sizeof(comm_msg_hello_t));
+
+	/* look out for the second connection before the owner can ask the
+	 * peer for it */
+	if (pthread_mutex_lock(&cluster->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	expect = &cluster->expect[cluster->expect_next];
+	cluster->expect_next = (cluster->expect_next + 1) % CLUSTER_EXPECT;
+	expect->obs.ip   = obs->ip;
+	expect->obs.port = PORT_ADD(obs->port,1);
+	expect->node     = node;
+	expect->at       = time(NULL);
+	pthread_mutex_unlock(&cluster->mutex);
+
+	CHECK_FAILED(cluster_send(cluster,node,&msg,&link),ERROR_1);
+	if (FAILED(relay_add(&cluster->relay,sd,link))) {
+		close(link);
+		return ERROR_2;
+	}
+
+	if (pthread_mutex_lock(&cluster->mutex)==0) {
+		cluster->forwarded++;
+		pthread_mutex_unlock(&cluster->mutex);
+	}
+	DEBUG(DBG_CLUSTER,"CLUSTER:session from %s:%u forwarded to node %d\n",
+		DBG_IP(obs->ip),DBG_PORT(obs->port),node);
+
+	return SUCCESS;
+}
+
+errorcode cluster_observe(cluster_t *cluster, observed_data_t *obs) {
+
+	/* declare local variables */
+	comm_msg_cluster_t msg;
+	sock_t link;
+	int i, node;
+	time_t now;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(obs,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (cluster == NULL)
+		return SUCCESS;
+
+	node = -1;
+	now  = time(NULL);
+	if (pthread_mutex_lock(&cluster->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	for (i=0;i<CLUSTER_EXPECT;i++) {
+		if ( (cluster->expect[i].at == 0) ||
+		     (now - cluster->expect[i].at >
+		      timeout_ceiling_sec(TIMEOUT_CONN2)) )
+			continue;
+		if ( (cluster->expect[i].obs.ip == obs->ip) &&
+		     (cluster->expect[i].obs.port == obs->port) ) {
+			node = cluster->expect[i].node;
+			cluster->expect[i].at = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cluster->mutex);
+
+	if (node < 0)
+		return SUCCESS;
+
+	memset(&msg,0,sizeof(msg));
+	msg.kind = COMM_CLUSTER_SEEN;
+	msg.ip   = obs->ip;
+	msg.port = obs->port;
+	CHECK_FAILED(cluster_send(cluster,node,&msg,&link),ERROR_1);
+	close(link);
+
+	DEBUG(DBG_CLUSTER,"CLUSTER:second connection from %s:%u reported to "
+		"node %d\n",DBG_IP(obs->ip),DBG_PORT(obs->port),node);
+
+	return SUCCESS;
+}
+
+unsigned int cluster_hash(unsigned int hash, void *buf, int len) {
+
+	/* declare local variables */
+	unsigned char *p;
+	int i;
+
+	/* do function */
+	p = (unsigned char*)buf;
+	for (i=0;i<len;i++) {
+		hash ^= p[i];
+		hash *= CLUSTER_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+unsigned int cluster_mix(unsigned int hash) {
+
+	/* do function */
+	/* the murmur3 finalizer */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+errorcode cluster_parse_node(char *str, cluster_node_t *node) {
+
+	/* declare local variables */
+	char host[CLUSTER_MAX_LIST];
+	char *colon;
+	ip_t ip;
+	int port;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(str,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(node,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (strlen(str) >= CLUSTER_MAX_LIST)
+		return ERROR_BUF_SIZE;
+	strcpy(host,str);
+	if ( (colon=strchr(host,':')) == NULL)
+		return ERROR_1;
+	*colon = '\0';
+	port = atoi(colon+1);
+	if ( (port <= 0) || (port > 65535) )
+		return ERROR_2;
+
+	ip = 0;
+	CHECK_FAILED(resolveIP(host,&ip),ERROR_HOST_NAME_LOOKUP);
+	/* only the address itself, so it compares equal to accepted
+	 * connections' addresses */
+	node->ip   = (ip_t)(unsigned int)ip;
+	node->port = htons(port);
+
+	return SUCCESS;
+}
+
+int cluster_point_compare(const void *a, const void *b) {
+
+	/* declare local variables */
+	const cluster_point_t *pa, *pb;
+
+	/* do function */
+	pa = (const cluster_point_t*)a;
+	pb = (const cluster_point_t*)b;
+	if (pa->hash != pb->hash)
+		return (pa->hash < pb->hash) ? -1 : 1;
+	/* two nodes at the same place, order them the same way everywhere */
+	return pa->node - pb->node;
+}
+
+errorcode cluster_send(cluster_t *cluster, int node, comm_msg_cluster_t *msg,
+		       sock_t *sd) {
+
+	/* declare local variables */
+	struct sockaddr_in addr;
+	struct timeval timeout;
+	int nodelay;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cluster,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(msg,ERROR_NULL_ARG_3);
+	CHECK_NOT_NULL(sd,ERROR_NULL_ARG_4);
+
+	/* do function */
+	if ( (*sd=socket(AF_INET,SOCK_STREAM,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+
+	/* the owner knows a node by the address it connects from */
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = cluster->nodes[cluster->self].ip;
+	addr.sin_port        = 0;
+	if (bind(*sd,(struct sockaddr*)&addr,sizeof(addr)) != 0) {
+		close(*sd);
+		return ERROR_BIND;
+	}
+
+	/* a node that is down must not hold up the peer for long */
+	timeout.tv_sec  = CLUSTER_CONNECT_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(*sd,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+	nodelay = 1;
+	setsockopt(*sd,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+
+	addr.sin_addr.s_addr = cluster->nodes[node].ip;
+	addr.sin_port        = cluster->nodes[node].port;
+	if (connect(*sd,(struct sockaddr*)&addr,sizeof(addr)) != 0) {
+		close(*sd);
+		return ERROR_TCP_CONNECT;
+	}
+	if (FAILED(sendMsg(*sd,COMM_MSG_CLUSTER,msg,
+			   sizeof(comm_msg_cluster_t)))) {
+		close(*sd);
+		return ERROR_TCP_SEND;
+	}
+
+	return SUCCESS;
+}
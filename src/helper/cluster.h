@@ -0,0 +1,197 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file cluster.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief lets several helpers share the peers, with both buddies of a pair
+ *        handled by the same helper wherever they connect
+ *
+ * Every helper of a cluster is started with the same list of nodes.  Each
+ * node is put on a hash ring CLUSTER_VNODES times.  A pair is keyed by both
+ * buddies' external ip and internal ip and port, sorted so both buddies
+ * get the same key, and is owned by the node after the key's hash on the
+ * ring.  A helper that is sent a HELLO for a pair it does not own connects
+ * to the owner, sends a COMM_MSG_CLUSTER forward message with the peer's
+ * address and HELLO, and then splices the peer's connection to the owner
+ * with a relay of its own.  The owner runs the session as if the peer had
+ * connected to it.  A port prediction second connection still reaches the
+ * helper the peer connected to, so that helper reports it to the owner
+ * with a seen message.
+ *
+ * Adding a node moves only about 1/n of the pairs.  A running helper can
+ * be given a new list of nodes by restarting it through a handover (see
+ * handover.h).  The helpers must reach each other from addresses no peer
+ * connects from, connections from them are trusted.
+ */
+
+#ifndef __CLUSTER_H__
+#define __CLUSTER_H__
+
+#include "errorcodes.h"
+#include "helperdef.h"
+#include "relay.h"
+#include "comm.h"
+#include <pthread.h>
+#include <time.h>
+
+/** @brief the most helpers in a cluster */
+#define CLUSTER_MAX_NODES	64
+
+/** @brief the number of places each node takes on the ring.  more places
+ *  spread the pairs more evenly */
+#define CLUSTER_VNODES		128
+
+/** @brief the number of forwarded sessions a second connection is looked
+ *  out for at once */
+#define CLUSTER_EXPECT		64
+
+/** @brief the FNV-1a offset basis */
+#define CLUSTER_FNV_OFFSET	2166136261U
+
+/** @brief the FNV-1a prime */
+#define CLUSTER_FNV_PRIME	16777619U
+
+/** @brief structure for a node of the cluster */
+struct cluster_node {
+	/** @brief the node's ip, the one it connects to the others from */
+	ip_t ip;
+	/** @brief the port the node listens on */
+	port_t port;
+} __attribute__((packed));
+
+/** @brief typedef for the cluster_node structure */
+typedef struct cluster_node cluster_node_t;
+
+/** @brief structure for one place on the ring */
+struct cluster_point {
+	/** @brief the place's hash */
+	unsigned int hash;
+	/** @brief the index of the node at the place */
+	int node;
+} __attribute__((packed));
+
+/** @brief typedef for the cluster_point structure */
+typedef struct cluster_point cluster_point_t;
+
+/** @brief structure for a forwarded session whose second connection may
+ *  still come */
+struct cluster_expect {
+	/** @brief the address the second connection comes from */
+	observed_data_t obs;
+	/** @brief the index of the node the session was forwarded to */
+	int node;
+	/** @brief the time the session was forwarded, 0 if the slot is free */
+	time_t at;
+} __attribute__((packed));
+
+/** @brief typedef for the cluster_expect structure */
+typedef struct cluster_expect cluster_expect_t;
+
+/** @brief structure for a helper's view of its cluster */
+struct cluster {
+	/** @brief the nodes */
+	cluster_node_t nodes[CLUSTER_MAX_NODES];
+	/** @brief the number of nodes */
+	int count;
+	/** @brief the index of this helper's node */
+	int self;
+	/** @brief the ring, sorted by hash */
+	cluster_point_t ring[CLUSTER_MAX_NODES*CLUSTER_VNODES];
+	/** @brief the number of places on the ring */
+	int points;
+	/** @brief the forwarded sessions a second connection may still come
+	 *  for */
+	cluster_expect_t expect[CLUSTER_EXPECT];
+	/** @brief the slot of expect to fill next */
+	int expect_next;
+	/** @brief the sessions forwarded to another node */
+	unsigned long forwarded;
+	/** @brief protects expect, expect_next and forwarded */
+	pthread_mutex_t mutex;
+	/** @brief the relay splicing forwarded peers to their owner */
+	relay_t relay;
+} __attribute__((packed));
+
+/** @brief typedef for the cluster structure */
+typedef struct cluster cluster_t;
+
+/**
+ * @brief builds the ring and starts the relay for forwarded sessions
+ *
+ * @param cluster pointer to the cluster
+ * @param nodes the nodes, as "ip:port,ip:port,...", the same on every node
+ * @param self this helper's node, as "ip:port", one of nodes
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode cluster_init(cluster_t *cluster, char *nodes, char *self);
+
+/**
+ * @brief finds the node owning a pair
+ *
+ * @param cluster pointer to the cluster
+ * @param obs the address the peer connected from
+ * @param hello the peer's HELLO
+ *
+ * @return the index of the owning node
+ */
+int cluster_owner(cluster_t *cluster, observed_data_t *obs,
+		  comm_msg_hello_t *hello);
+
+/**
+ * @brief finds out if a connection came from another node
+ *
+ * @param cluster pointer to the cluster, may be NULL
+ * @param ip the address the connection came from
+ *
+ * @return FLAG_SET if it did, FLAG_UNSET otherwise
+ */
+flag_t cluster_is_node(cluster_t *cluster, ip_t ip);
+
+/**
+ * @brief hands a peer's session to the node owning its pair.  on success
+ *        the relay owns the peer's connection.
+ *
+ * This function is thread safe.
+ *
+ * @param cluster pointer to the cluster
+ * @param node the index of the owning node
+ * @param sd the peer's connection
+ * @param obs the address the peer connected from
+ * @param hello the peer's HELLO
+ *
+ * @return SUCCESS, errorcode on failure (the connection is left open)
+ */
+errorcode cluster_forward(cluster_t *cluster, int node, sock_t sd,
+			  observed_data_t *obs, comm_msg_hello_t *hello);
+
+/**
+ * @brief tells the owner of a forwarded session about a connection
+ *        accepted here if it is the session's second connection
+ *
+ * This function is thread safe.
+ *
+ * @param cluster pointer to the cluster, may be NULL
+ * @param obs the address the connection came from
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode cluster_observe(cluster_t *cluster, observed_data_t *obs);
+
+#endif /* __CLUSTER_H__ */
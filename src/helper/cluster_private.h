@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file cluster_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the helper cluster
+ */
+
+#ifndef __CLUSTER_PRIVATE_H__
+#define __CLUSTER_PRIVATE_H__
+
+#include "cluster.h"
+
+/** @brief seconds to wait for another node to take a connection */
+#define CLUSTER_CONNECT_TIMEOUT	2
+
+/** @brief the most characters in a node list */
+#define CLUSTER_MAX_LIST	2048
+
+/** @brief structure for one buddy's part of a pair key.  the fields are 32
+ *  bits wide whatever the size of ip_t, so nodes of any kind agree */
+struct cluster_key_half {
+	/** @brief the external ip */
+	unsigned int ext_ip;
+	/** @brief the internal ip */
+	unsigned int int_ip;
+	/** @brief the internal port */
+	unsigned short int_port;
+} __attribute__((packed));
+
+/** @brief typedef for the cluster_key_half structure */
+typedef struct cluster_key_half cluster_key_half_t;
+
+/**
+ * @brief adds bytes to an FNV-1a hash
+ *
+ * @param hash the hash so far, CLUSTER_FNV_OFFSET to start one
+ * @param buf the bytes
+ * @param len the number of bytes
+ *
+ * @return the new hash
+ */
+unsigned int cluster_hash(unsigned int hash, void *buf, int len);
+
+/**
+ * @brief spreads the bits of a finished hash over the whole word.  FNV-1a
+ *        changes the top bits little for the last bytes hashed, and the
+ *        ring is ordered by the top bits, so without this the places of
+ *        one node bunch together and the nodes get very unequal shares.
+ *
+ * @param hash the hash
+ *
+ * @return the mixed hash
+ */
+unsigned int cluster_mix(unsigned int hash);
+
+/**
+ * @brief reads a node from an "ip:port" string
+ *
+ * @param str the string
+ * @param node pointer to the node to fill in
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode cluster_parse_node(char *str, cluster_node_t *node);
+
+/**
+ * @brief orders two places on the ring, for qsort
+ *
+ * @param a a place
+ * @param b another place
+ *
+ * @return negative, zero or positive as a is before, at or after b
+ */
+int cluster_point_compare(const void *a, const void *b);
+
+/**
+ * @brief connects to another node and sends it a cluster message
+ *
+ * @param cluster pointer to the cluster
+ * @param node the index of the node
+ * @param msg the message
+ * @param sd pointer to fill in with the connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode cluster_send(cluster_t *cluster, int node, comm_msg_cluster_t *msg,
+		       sock_t *sd);
+
+#endif /* __CLUSTER_PRIVATE_H__ */
@@ -24,10 +24,16 @@
  */
 
 #include "connlist.h"
+#include "connlist_private.h"
 #include <pthread.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
 #include "debug.h"
 
 #include <unistd.h>
+#include <fcntl.h>
 
 errorcode connlist_init(connlist_t *list) {
 
@@ -42,6 +48,29 @@ errorcode connlist_init(connlist_t *list) {
 	 **/
 	if (pthread_mutex_init(&(list->mutex),NULL)<0)
 		return ERROR_2;
+	if (pthread_cond_init(&(list->changed),NULL)!=0)
+		return ERROR_3;
+
+	/* relaying is off until a relay is attached */
+	list->relay = NULL;
+	/* and every connection is let in until admission is attached */
+	list->admit = NULL;
+	/* nothing is recorded until a trace is attached */
+	list->trace = NULL;
+	/* and every pair is handled here until a cluster is attached */
+	list->cluster = NULL;
+	memset(list->seen,0,sizeof(list->seen));
+	memset(list->seen_at,0,sizeof(list->seen_at));
+	list->seen_next = 0;
+
+	/* no handover is going on */
+	CHECK_FAILED(list_init(&list->sessions),ERROR_INIT);
+	list->parked   = 0;
+	list->handover = FLAG_UNSET;
+	if (pipe(list->wake)<0)
+		return ERROR_4;
+	fcntl(list->wake[0],F_SETFL,O_NONBLOCK);
+	fcntl(list->wake[1],F_SETFL,O_NONBLOCK);
 
 	return SUCCESS;
 }
@@ -58,6 +87,8 @@ errorcode connlist_add(connlist_t *list, connlist_item_t *item) {
 	DEBUG(DBG_THREAD,"THREAD:LOCKED MUTEX\n");
 	/* the thread adding the item is a watcher by default */
 	item->watchers = 1;
+	item->buddy    = NULL;
+	item->paired   = FLAG_UNSET;
 
 	/* add the item to the list */
 	if (FAILED(list_add(&list->list,item))) {
@@ -67,6 +98,9 @@ errorcode connlist_add(connlist_t *list, connlist_item_t *item) {
 		return ERROR_LIST_ADD;
 	}
 
+	/* a thread may be waiting for this item (see connlist_wait) */
+	pthread_cond_broadcast(&(list->changed));
+
 	/* unlock the mutex */
 	DEBUG(DBG_THREAD,"THREAD:UNLOCKING MUTEX\n");
 	if (pthread_mutex_unlock(&(list->mutex))<0)
@@ -118,36 +152,6 @@ errorcode connlist_find(connlist_t *list, int (*func)(void*,void*), void *arg,
 	return SUCCESS;
 }
 
-int connlist_find_pred_port(void *this_item, void *find_item) {
-
-	/* declare variables */
-	connlist_item_t *cast_item;
-	observed_data_t *cast_data;
-
-	/* error check arguments */
-	CHECK_NOT_NULL(find_item,LIST_FATAL);
-	CHECK_NOT_NULL(this_item,LIST_FATAL);
-
-	/* do function */
-	cast_item = (connlist_item_t*) this_item;
-	cast_data = (observed_data_t*) find_item;
-
-	DEBUG(DBG_PORT_PRED,"PORT_PRED:item %s:%u\n",
-		DBG_IP(cast_item->obs_data.ip),
-		DBG_PORT(cast_item->obs_data.port));
-	DEBUG(DBG_PORT_PRED,"PORT_PRED:data %s:%u\n",
-		DBG_IP(cast_data->ip),DBG_PORT(cast_data->port));
-
-	/* check if the observed data is what is expected */
-	if ( (cast_item->obs_data.ip == cast_data->ip) &&
-		(cast_item->obs_data.port == cast_data->port) )   {
-		DEBUG(DBG_PORT_PRED,"PORT_PRED:matched item\n");
-		return LIST_FOUND;
-	}
-
-	return LIST_NOT_FOUND;
-}
-
 int connlist_find_buddy(void *this_item, void *find_item) {
 
 	/* declare local variables */
@@ -260,3 +264,515 @@ int connlist_count(connlist_t *list) {
 
 	return count;
 }
+
+int connlist_find_unpaired_buddy(void *this_item, void *find_item) {
+
+	/* declare local variables */
+	connlist_item_t *cast_item;
+	connlist_item_t *cast_find;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(find_item,LIST_FATAL);
+	CHECK_NOT_NULL(this_item,LIST_FATAL);
+
+	/* do function */
+	cast_item = (connlist_item_t*) this_item;
+	cast_find = (connlist_item_t*) find_item;
+
+	/* only a peer that said hello and is not paired yet can be paired */
+	if ( (cast_item == cast_find) ||
+	     (cast_item->paired == FLAG_SET) ||
+	     (cast_item->info.peer.set != FLAG_SET) )
+		return LIST_NOT_FOUND;
+
+	/* each must be the buddy the other is looking for */
+	if ( (connlist_find_buddy(cast_item,&cast_find->info.buddy)==LIST_FOUND)
+	  && (connlist_find_buddy(cast_find,&cast_item->info.buddy)==LIST_FOUND))
+		return LIST_FOUND;
+
+	return LIST_NOT_FOUND;
+}
+
+errorcode connlist_notify(connlist_t *list) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+
+	/* do function */
+	/* taking the mutex makes sure a waiter that checked its flag before
+	 * it was changed is already waiting, so it can not miss the wakeup */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+	pthread_cond_broadcast(&(list->changed));
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+errorcode connlist_observe(connlist_t *list, observed_data_t *data) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(data,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	/* the oldest connection is forgotten */
+	list->seen[list->seen_next]    = *data;
+	list->seen_at[list->seen_next] = time(NULL);
+	list->seen_next = (list->seen_next+1) % CONNLIST_SEEN;
+	pthread_cond_broadcast(&(list->changed));
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+errorcode connlist_wait_seen(connlist_t *list, observed_data_t *data,
+			     int window, int timeout) {
+
+	/* declare local variables */
+	struct timespec deadline;
+	time_t oldest;
+	int i;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(data,ERROR_NULL_ARG_2);
+	CHECK_NOT_NEG(window,ERROR_NEG_ARG_3);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_4);
+
+	/* do function */
+	connlist_deadline(timeout,&deadline);
+	oldest = time(NULL) - window;
+
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	while (1) {
+		for(i=0;i<CONNLIST_SEEN;i++) {
+			if ( (list->seen[i].ip == data->ip) &&
+			     (list->seen[i].port == data->port) &&
+			     (list->seen_at[i] >= oldest) )
+				break;
+		}
+		if (i < CONNLIST_SEEN) {
+			/* so a later connection from the same port is not
+			 * matched to this one */
+			list->seen[i].ip = IP_UNKNOWN;
+			break;
+		}
+		if (connlist_wait_until(list,&deadline)!=SUCCESS) {
+			ret = ERROR_TIMEOUT;
+			break;
+		}
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_wait_flag(connlist_t *list, flag_t *check_flag,
+			     flag_t stop_flags, int timeout) {
+
+	/* declare local variables */
+	struct timespec deadline;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(check_flag,ERROR_NULL_ARG_2);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_4);
+
+	/* do function */
+	connlist_deadline(timeout,&deadline);
+
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	while (!((*check_flag)&stop_flags)) {
+		if (list->handover == FLAG_SET)
+			connlist_park_locked(list);
+		if (connlist_wait_until(list,&deadline)!=SUCCESS) {
+			ret = ERROR_TIMEOUT;
+			break;
+		}
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_pair(connlist_t *list, connlist_item_t *item) {
+
+	/* declare local variables */
+	connlist_item_t *buddy;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	/* the second of the two hellos does the pairing.  if the buddy is not
+	 * here yet, its hello will find this item */
+	if ( (item->paired == FLAG_UNSET) &&
+	     (list_find(&list->list,connlist_find_unpaired_buddy,item,
+			(void**)&buddy) == SUCCESS) ) {
+		DEBUG(DBG_BUDDY,"BUDDY:paired with buddy\n");
+		/* each item watches the other until connlist_unpair */
+		item->buddy     = buddy;
+		item->paired    = FLAG_SET;
+		buddy->watchers += 1;
+		buddy->buddy    = item;
+		buddy->paired   = FLAG_SET;
+		item->watchers  += 1;
+		pthread_cond_broadcast(&(list->changed));
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return SUCCESS;
+}
+
+errorcode connlist_wait_buddy(connlist_t *list, connlist_item_t *item,
+			      int timeout, connlist_item_t **found_buddy) {
+
+	/* declare local variables */
+	struct timespec deadline;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_3);
+	CHECK_NOT_NULL(found_buddy,ERROR_NULL_ARG_4);
+
+	/* do function */
+	connlist_deadline(timeout,&deadline);
+
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	while (item->buddy == NULL) {
+		if (list->handover == FLAG_SET)
+			connlist_park_locked(list);
+		if (connlist_wait_until(list,&deadline)!=SUCCESS) {
+			ret = ERROR_NOT_FOUND;
+			break;
+		}
+	}
+	if (ret == SUCCESS)
+		*found_buddy = item->buddy;
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_unpair(connlist_t *list, connlist_item_t *item) {
+
+	/* declare local variables */
+	connlist_item_t *buddy;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	buddy = item->buddy;
+	if (buddy != NULL) {
+		DEBUG(DBG_LIST, "LIST:forgeting about buddy entry\n");
+		item->buddy = NULL;
+		buddy->watchers -= 1;
+		ret = connlist_remove_unwatched(list,buddy);
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_session_begin(connlist_t *list,
+				 connlist_session_t *session) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	if (FAILED(list_add(&list->sessions,session))) {
+		if (pthread_mutex_unlock(&(list->mutex))<0)
+			return ERROR_MUTEX_UNLOCK_1;
+		return ERROR_LIST_ADD;
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_2;
+
+	return SUCCESS;
+}
+
+errorcode connlist_session_end(connlist_t *list, connlist_session_t *session) {
+
+	/* declare local variables */
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	if (FAILED(list_remove(&list->sessions,connlist_item_match,session)))
+		ret = ERROR_LIST_REMOVE;
+	/* a handover may be waiting for this session to stop */
+	pthread_cond_broadcast(&(list->changed));
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+void connlist_session_thread(connlist_session_t *session) {
+
+	/* do function */
+	session->thread = pthread_self();
+	session->parked = FLAG_UNSET;
+}
+
+void connlist_park(connlist_t *list) {
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		pthread_exit(NULL);
+	connlist_park_locked(list);
+}
+
+errorcode connlist_quiesce(connlist_t *list, int timeout) {
+
+	/* declare local variables */
+	struct timespec deadline;
+	char wake;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_2);
+
+	/* do function */
+	connlist_deadline(timeout*1000,&deadline);
+
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = SUCCESS;
+	list->handover = FLAG_SET;
+	/* sessions waiting on their buddy see the flag when woken, sessions
+	 * waiting on their peer see the pipe */
+	wake = 0;
+	if (write(list->wake[1],&wake,1)<0)
+		ret = ERROR_1;
+	pthread_cond_broadcast(&(list->changed));
+
+	while ( (ret == SUCCESS) &&
+		(list->parked < list_count(&list->sessions)) ) {
+		if (connlist_wait_until(list,&deadline)!=SUCCESS)
+			ret = ERROR_TIMEOUT;
+	}
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	DEBUG(DBG_HANDOVER,"HANDOVER:%d sessions parked\n",list->parked);
+
+	return ret;
+}
+
+errorcode connlist_parked(connlist_t *list, connlist_session_t ***sessions,
+			  int *count) {
+
+	/* declare local variables */
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sessions,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(count,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = connlist_collect_parked(list,sessions,count);
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_unquiesce(connlist_t *list, connlist_session_t ***sessions,
+			     int *count) {
+
+	/* declare local variables */
+	connlist_session_t *session;
+	char wake;
+	int i;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sessions,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(count,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (pthread_mutex_lock(&(list->mutex))<0)
+		return ERROR_MUTEX_LOCK;
+
+	/* a session parks only while the flag is set and with the mutex
+	 * held, so collecting them under the same lock that clears the flag
+	 * misses none, even one that parked after a timed out quiesce */
+	ret = connlist_collect_parked(list,sessions,count);
+
+	list->handover = FLAG_UNSET;
+	list->parked   = 0;
+	for(i=0;i<list_count(&list->sessions);i++) {
+		if (!FAILED(list_get(&list->sessions,i,(void**)&session)))
+			session->parked = FLAG_UNSET;
+	}
+	while (read(list->wake[0],&wake,1) > 0);
+
+	if (pthread_mutex_unlock(&(list->mutex))<0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	return ret;
+}
+
+errorcode connlist_collect_parked(connlist_t *list,
+				  connlist_session_t ***sessions, int *count) {
+
+	/* declare local variables */
+	connlist_session_t *session;
+	int i;
+
+	/* do function */
+	*count = 0;
+	/* one more, so nothing is allocated with a size of zero */
+	*sessions = (connlist_session_t**) malloc(
+		(list_count(&list->sessions)+1)*sizeof(connlist_session_t*));
+	if (*sessions == NULL)
+		return ERROR_MALLOC_FAILED;
+
+	for(i=0;i<list_count(&list->sessions);i++) {
+		if (FAILED(list_get(&list->sessions,i,(void**)&session)))
+			return ERROR_LIST_FIND;
+		if (session->parked == FLAG_SET)
+			(*sessions)[(*count)++] = session;
+	}
+
+	return SUCCESS;
+}
+
+void connlist_deadline(int timeout, struct timespec *deadline) {
+
+	/* declare local variables */
+	struct timeval now;
+	long usec;
+
+	/* do function */
+	/* pthread_cond_timedwait measures against the realtime clock */
+	gettimeofday(&now,NULL);
+	usec = now.tv_usec + (timeout%1000)*1000L;
+	deadline->tv_sec  = now.tv_sec + timeout/1000 + usec/1000000;
+	deadline->tv_nsec = (usec%1000000)*1000;
+}
+
+errorcode connlist_wait_until(connlist_t *list, struct timespec *deadline) {
+
+	/* declare local variables */
+	int ret;
+
+	/* do function */
+	do {
+		ret = pthread_cond_timedwait(&(list->changed),&(list->mutex),
+					     deadline);
+	} while (ret == EINTR);
+
+	if (ret == ETIMEDOUT)
+		return -1;
+	return SUCCESS;
+}
+
+errorcode connlist_remove_unwatched(connlist_t *list, connlist_item_t *item) {
+
+	/* do function */
+	if (item->watchers == 0) {
+		if (FAILED(list_remove(&list->list,connlist_item_match,item)))
+			return ERROR_LIST_REMOVE;
+	}
+
+	return SUCCESS;
+}
+
+void connlist_park_locked(connlist_t *list) {
+
+	/* declare local variables */
+	pthread_t self;
+	connlist_session_t *session;
+
+	/* do function */
+	DEBUG(DBG_HANDOVER,"HANDOVER:session parked\n");
+	self = pthread_self();
+	if (list_find(&list->sessions,connlist_session_match,&self,
+			(void**)&session) == SUCCESS)
+		session->parked = FLAG_SET;
+	list->parked++;
+	/* connlist_quiesce waits for this */
+	pthread_cond_broadcast(&(list->changed));
+	pthread_mutex_unlock(&(list->mutex));
+	pthread_exit(NULL);
+}
+
+int connlist_session_match(void *this_item, void *find_item) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(this_item,LIST_FATAL);
+	CHECK_NOT_NULL(find_item,LIST_FATAL);
+
+	/* do function */
+	if (pthread_equal(((connlist_session_t*)this_item)->thread,
+			  *(pthread_t*)find_item))
+		return LIST_FOUND;
+
+	return LIST_NOT_FOUND;
+}
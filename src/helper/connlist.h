@@ -30,6 +30,10 @@
 
 #include "helperdef.h"
 #include "list.h"
+#include "relay.h"
+#include "admit.h"
+#include "trace.h"
+#include "cluster.h"
 
 /** @brief structure for a single connection node */
 struct connlist_item {
@@ -39,17 +43,75 @@ struct connlist_item {
 	observed_data_t obs_data;
 	/** @brief the number of threads accessing this item */
 	long watchers;
+	/** @brief the buddy's item once the two have been paired (see
+	 *  connlist_pair), NULL before and once the pairing is released */
+	struct connlist_item *buddy;
+	/** @brief FLAG_SET once the item has been paired.  it is never unset,
+	 *  so an item is paired at most once */
+	flag_t paired;
+	/** @brief the HELPER_STATE_* the item's thread waits in, so the session
+	 *  can be resumed there */
+	int state;
 } __attribute__((packed));
 
 /** @brief typedef for the connlist_item structure */
 typedef struct connlist_item connlist_item_t;
 
+/** @brief structure for a thread handling one peer connection */
+struct connlist_session {
+	/** @brief the data observed for the connection */
+	observed_data_t obs_data;
+	/** @brief the socket descriptor for the connection */
+	sock_t sd;
+	/** @brief the connection's item, NULL until the peer said hello */
+	connlist_item_t *item;
+	/** @brief the thread running the session */
+	pthread_t thread;
+	/** @brief FLAG_SET once the thread stopped for a handover */
+	flag_t parked;
+} __attribute__((packed));
+
+/** @brief typedef for the connlist_session structure */
+typedef struct connlist_session connlist_session_t;
+
 /** @brief structure for the connlist_t type */
 struct connlist {
 	/** @brief the pre-existing list type */
 	list_t list;
 	/** @brief the mutex to provide thread safety */
 	pthread_mutex_t mutex;
+	/** @brief broadcast whenever an item is added, two items are paired
+	 *  or a thread changed what it knows about its peer (see
+	 *  connlist_notify) */
+	pthread_cond_t changed;
+	/** @brief the relay for peers that can not connect directly, NULL if
+	 *  the helper does not relay */
+	relay_t *relay;
+	/** @brief the admission state sessions report to, NULL if every
+	 *  connection is let in */
+	admit_t *admit;
+	/** @brief the trace the sessions record their messages to, NULL if
+	 *  the helper does not record */
+	trace_t *trace;
+	/** @brief the cluster the helper is a node of, NULL if it runs on its
+	 *  own */
+	cluster_t *cluster;
+	/** @brief the recently accepted connections (see connlist_observe) */
+	observed_data_t seen[CONNLIST_SEEN];
+	/** @brief the time each of the seen connections was accepted */
+	time_t seen_at[CONNLIST_SEEN];
+	/** @brief the slot of seen to fill next */
+	int seen_next;
+	/** @brief the running sessions (see connlist_session_begin) */
+	list_t sessions;
+	/** @brief the number of sessions that stopped for a handover */
+	int parked;
+	/** @brief FLAG_SET while the sessions should stop where they can be
+	 *  resumed (see connlist_quiesce) */
+	flag_t handover;
+	/** @brief a pipe that becomes readable when a handover starts, so a
+	 *  session waiting on its peer wakes up too */
+	int wake[2];
 } __attribute__((packed));
 
 /** @brief typedef for the connlist structure */
@@ -94,17 +156,6 @@ errorcode connlist_add(connlist_t *list, connlist_item_t *item);
 errorcode connlist_find(connlist_t *list, int (*func)(void*,void*), void *arg,
 			connlist_item_t **found_item);
 
-/**
- * @brief the function to find a predictied port match (used as a match
- * function for the list implementation).
- *
- * @param this_item the item from the list to check (a connlist_item_t pointer)
- * @param find_item the values to match on (an observed_data_t pointer)
- *
- * @return LIST_FATAL, LIST_FOUND, LIST_NOT_FOUND, as per requirements
- */
-int connlist_find_pred_port(void *this_item, void *find_item);
-
 
 /**
  * @brief the function to find a buddy match (used as a match function for
@@ -158,5 +209,213 @@ int connlist_item_match(void *this_item, void *find_item);
  */
 int connlist_count(connlist_t *list);
 
+/**
+ * @brief wakes every thread waiting in connlist_wait, connlist_wait_flag or
+ *        connlist_wait_buddy.  call it after changing any item's info that
+ *        another thread may be waiting on.
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_notify(connlist_t *list);
+
+/**
+ * @brief remembers an accepted connection, so it can be found by
+ *        connlist_wait_seen without keeping an item for it
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param data the connection's observed address
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_observe(connlist_t *list, observed_data_t *data);
+
+/**
+ * @brief waits for a connection from an address to have been accepted in
+ *        the last window seconds.  a connection is only found once.
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param data the observed address to look for
+ * @param window how many seconds back an accepted connection counts
+ * @param timeout the most milliseconds to wait
+ *
+ * @return SUCCESS, errorcode on failure or timeout
+ */
+errorcode connlist_wait_seen(connlist_t *list, observed_data_t *data,
+			     int window, int timeout);
+
+/**
+ * @brief waits for a flag in an item to have one of the stop flags set.
+ *        whoever sets the flag must call connlist_notify.
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param check_flag pointer to the flag
+ * @param stop_flags the flags to wait for, or'ed together
+ * @param timeout the most milliseconds to wait
+ *
+ * @return SUCCESS, errorcode on failure or timeout
+ */
+errorcode connlist_wait_flag(connlist_t *list, flag_t *check_flag,
+			     flag_t stop_flags, int timeout);
+
+/**
+ * @brief pairs an item with its buddy's item if the buddy has already said
+ *        hello.  otherwise the buddy's hello pairs them.  each paired item
+ *        is a watcher of the other until connlist_unpair.
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param item the item that just received a hello
+ *
+ * @return SUCCESS (also if the buddy is not here yet), errorcode on failure
+ */
+errorcode connlist_pair(connlist_t *list, connlist_item_t *item);
+
+/**
+ * @brief waits for an item to be paired with its buddy
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param item the item to wait on
+ * @param timeout the most milliseconds to wait
+ * @param found_buddy pointer to fill in with the buddy's item.  it stays
+ *        valid until connlist_unpair is called for item.
+ *
+ * @return SUCCESS, errorcode on failure or timeout
+ */
+errorcode connlist_wait_buddy(connlist_t *list, connlist_item_t *item,
+			      int timeout, connlist_item_t **found_buddy);
+
+/**
+ * @brief releases an item's hold on its buddy's item, if it was paired
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param item the item
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_unpair(connlist_t *list, connlist_item_t *item);
+
+/**
+ * @brief the function to find an item to pair with (used as a match
+ * function for the list implementation).  like connlist_find_buddy, but
+ * only items that said hello and have not been paired match.
+ *
+ * @param this_item the item from the list to check (a connlist_item_t pointer)
+ * @param find_item the item looking for its buddy (a connlist_item_t pointer)
+ *
+ * @return LIST_FATAL, LIST_FOUND, LIST_NOT_FOUND, as per requirements
+ */
+int connlist_find_unpaired_buddy(void *this_item, void *find_item);
+
+/**
+ * @brief registers a session, so a handover knows to wait for it
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param session the session, which must stay allocated until
+ *        connlist_session_end
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_session_begin(connlist_t *list,
+				 connlist_session_t *session);
+
+/**
+ * @brief unregisters a session once its thread is done with it
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param session the session
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_session_end(connlist_t *list, connlist_session_t *session);
+
+/**
+ * @brief tells the list which thread runs a session.  the thread calls this
+ *        before it can park.
+ *
+ * @param session the session
+ *
+ * @return void
+ */
+void connlist_session_thread(connlist_session_t *session);
+
+/**
+ * @brief stops the calling session's thread for a handover.  the session
+ *        stays registered and is resumed from its item's state, by this
+ *        process if the handover is called off or by the new one.
+ *
+ * This function is thread safe.  It does not return.
+ *
+ * @param list pointer to the connlist
+ *
+ * @return does not return
+ */
+void connlist_park(connlist_t *list);
+
+/**
+ * @brief asks every session to park and waits until they all have.  a
+ *        session parks the next time it waits on its peer or buddy.
+ *
+ * This function is thread safe.  No sessions may be started while it runs.
+ *
+ * @param list pointer to the connlist
+ * @param timeout the most seconds to wait
+ *
+ * @return SUCCESS once every session parked, errorcode on failure or timeout
+ *         (some sessions may have parked anyway, see connlist_unquiesce)
+ */
+errorcode connlist_quiesce(connlist_t *list, int timeout);
+
+/**
+ * @brief gets the sessions that parked
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param sessions pointer to fill in with an array of the parked sessions,
+ *        allocated with malloc
+ * @param count pointer to fill in with the number of parked sessions
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_parked(connlist_t *list, connlist_session_t ***sessions,
+			  int *count);
+
+/**
+ * @brief ends a handover, so sessions no longer park, and gets every
+ *        session that parked, which the caller has to resume.  this
+ *        includes sessions that parked after connlist_quiesce timed out
+ *        or after connlist_parked was called.
+ *
+ * This function is thread safe.
+ *
+ * @param list pointer to the connlist
+ * @param sessions pointer to fill in with an array of the parked sessions,
+ *        allocated with malloc (free it even on failure, it may hold some)
+ * @param count pointer to fill in with the number of parked sessions
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_unquiesce(connlist_t *list, connlist_session_t ***sessions,
+			     int *count);
+
 #endif /* __CONNLIST_H__ */
 
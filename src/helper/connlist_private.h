@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file connlist_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the connection list
+ */
+
+#ifndef __CONNLIST_PRIVATE_H__
+#define __CONNLIST_PRIVATE_H__
+
+#include "connlist.h"
+#include <time.h>
+
+/**
+ * @brief turns a timeout into the absolute time pthread_cond_timedwait
+ *        wants
+ *
+ * @param timeout the timeout in milliseconds from now
+ * @param deadline pointer to fill in
+ *
+ * @return void
+ */
+void connlist_deadline(int timeout, struct timespec *deadline);
+
+/**
+ * @brief waits on the list's condition variable until the deadline.  the
+ *        mutex must be held.
+ *
+ * @param list pointer to the connlist
+ * @param deadline the absolute time to give up at
+ *
+ * @return SUCCESS if woken, a negative value once the deadline passed
+ */
+errorcode connlist_wait_until(connlist_t *list, struct timespec *deadline);
+
+/**
+ * @brief removes an item from the list if nobody watches it any more.  the
+ *        mutex must be held.
+ *
+ * @param list pointer to the connlist
+ * @param item the item, with its watchers already decremented
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_remove_unwatched(connlist_t *list, connlist_item_t *item);
+
+/**
+ * @brief gets the sessions that parked.  the mutex must be held.
+ *
+ * @param list pointer to the connlist
+ * @param sessions pointer to fill in with an array of the parked sessions,
+ *        allocated with malloc (free it even on failure, it may hold some)
+ * @param count pointer to fill in with the number of parked sessions
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode connlist_collect_parked(connlist_t *list,
+				  connlist_session_t ***sessions, int *count);
+
+/**
+ * @brief parks the calling session's thread (see connlist_park).  the mutex
+ *        must be held, it is released.
+ *
+ * @param list pointer to the connlist
+ *
+ * @return does not return
+ */
+void connlist_park_locked(connlist_t *list);
+
+/**
+ * @brief matches the session run by a thread (used as a match function for
+ *        the list implementation)
+ *
+ * @param this_item the session from the list to check (a connlist_session_t
+ *        pointer)
+ * @param find_item the thread to match (a pthread_t pointer)
+ *
+ * @return LIST_FATAL, LIST_FOUND, LIST_NOT_FOUND, as per requirements
+ */
+int connlist_session_match(void *this_item, void *find_item);
+
+#endif /* __CONNLIST_PRIVATE_H__ */
@@ -0,0 +1,636 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file handover.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief hands a running helper's listening socket and sessions to a new
+ *        helper process
+ */
+
+#include "handover.h"
+#include "handover_private.h"
+#include "helpercon.h"
+#include "debug.h"
+#include "util.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+errorcode handover_listen(char *path, sock_t *control_sd) {
+
+	/* declare local variables */
+	struct sockaddr_un addr;
+	sock_t sd;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(control_sd,ERROR_NULL_ARG_2);
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return ERROR_ARG_1;
+
+	/* do function */
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+
+	if ( (sd=socket(AF_UNIX,SOCK_SEQPACKET,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+
+	/* the socket of the helper this one took over from is in the way */
+	unlink(path);
+	if ( (bind(sd,(struct sockaddr*)&addr,sizeof(addr)) < 0) ||
+	     (listen(sd,1) < 0) ) {
+		close(sd);
+		return ERROR_BIND;
+	}
+
+	*control_sd = sd;
+
+	return SUCCESS;
+}
+
+errorcode handover_give(connlist_t *list, sock_t listen_sd,
+			sock_t control_sd) {
+
+	/* declare local variables */
+	connlist_session_t **sessions;
+	handover_record_t record;
+	sock_t sd;
+	int count;
+	int fd;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if ( (sd=accept(control_sd,NULL,NULL)) < 0)
+		return ERROR_TCP_CONNECT;
+	DEBUG(DBG_HANDOVER,"HANDOVER:new helper connected\n");
+
+	/* a session that does not stop in time keeps the handover from
+	 * happening, the ones that did stop are resumed here */
+	ret = connlist_quiesce(list,HANDOVER_QUIESCE_TIMEOUT);
+	if (FAILED(connlist_parked(list,&sessions,&count))) {
+		if (sessions != NULL)
+			safe_free(sessions);
+		handover_resume(list,NULL,0,1);
+		close(sd);
+		return ERROR_1;
+	}
+
+	if (!FAILED(ret))
+		ret = handover_snapshot(list,sd,listen_sd,sessions,count);
+
+	/* the new helper owns the sessions once it says so */
+	if (!FAILED(ret)) {
+		if (FAILED(handover_recv(sd,&record,&fd,HANDOVER_ACK_TIMEOUT)))
+			ret = ERROR_NETWORK_READ;
+		else {
+			if (fd >= 0)
+				close(fd);
+			if (record.type != HANDOVER_RECORD_ACK)
+				ret = ERROR_2;
+		}
+	}
+	close(sd);
+
+	if (FAILED(ret)) {
+		DEBUG(DBG_HANDOVER,"HANDOVER:failed, resuming %d sessions\n",
+			count);
+		handover_resume(list,sessions,count,1);
+		safe_free(sessions);
+		return ERROR_3;
+	}
+
+	DEBUG(DBG_HANDOVER,"HANDOVER:handed over, %d sessions parked\n",
+		count);
+	CHECK_FAILED(handover_resume(list,sessions,count,0),ERROR_4);
+	safe_free(sessions);
+
+	return SUCCESS;
+}
+
+errorcode handover_take(connlist_t *list, char *path, sock_t *listen_sd) {
+
+	/* declare local variables */
+	struct sockaddr_un addr;
+	handover_record_t record;
+	connlist_item_t **items;
+	connlist_item_t *item;
+	connlist_session_t **sessions;
+	connlist_session_t *session;
+	int *buddies;
+	int item_count, session_count, items_got, sessions_got;
+	int fd, i;
+	sock_t sd;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(listen_sd,ERROR_NULL_ARG_3);
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return ERROR_ARG_2;
+
+	/* do function */
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+
+	if ( (sd=socket(AF_UNIX,SOCK_SEQPACKET,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+	if (connect(sd,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+		close(sd);
+		return ERROR_TCP_CONNECT;
+	}
+
+	/* the old helper first stops its sessions, which may take a while */
+	if ( FAILED(handover_recv(sd,&record,&fd,HANDOVER_QUIESCE_TIMEOUT+
+			HANDOVER_ACK_TIMEOUT)) ||
+	     (record.type != HANDOVER_RECORD_HEADER) ||
+	     (record.index < 0) || (record.buddy < 0) ) {
+		if (fd >= 0)
+			close(fd);
+		close(sd);
+		return ERROR_NETWORK_READ;
+	}
+	item_count    = record.index;
+	session_count = record.buddy;
+	DEBUG(DBG_HANDOVER,"HANDOVER:taking over %d items, %d sessions\n",
+		item_count,session_count);
+
+	/* one more, so nothing is allocated with a size of zero */
+	items    = (connlist_item_t**) calloc(item_count+1,
+			sizeof(connlist_item_t*));
+	buddies  = (int*) calloc(item_count+1,sizeof(int));
+	sessions = (connlist_session_t**) calloc(session_count+1,
+			sizeof(connlist_session_t*));
+	*listen_sd   = SOCKET_UNKNOWN;
+	items_got    = 0;
+	sessions_got = 0;
+
+	ret = SUCCESS;
+	if ( (items == NULL) || (buddies == NULL) || (sessions == NULL) )
+		ret = ERROR_MALLOC_FAILED_1;
+
+	while (ret == SUCCESS) {
+		if (FAILED(handover_recv(sd,&record,&fd,HANDOVER_ACK_TIMEOUT))) {
+			ret = ERROR_NETWORK_READ;
+			break;
+		}
+		if (record.type == HANDOVER_RECORD_END)
+			break;
+
+		switch (record.type) {
+		case HANDOVER_RECORD_LISTEN:
+			if ( (fd < 0) || (*listen_sd != SOCKET_UNKNOWN) ) {
+				ret = ERROR_1;
+				break;
+			}
+			*listen_sd = fd;
+			fd = -1;
+			break;
+		case HANDOVER_RECORD_SEEN:
+			/* a second connection the old helper accepted may
+			 * still be looked for */
+			if (FAILED(connlist_observe(list,&record.obs_data)))
+				ret = ERROR_2;
+			break;
+		case HANDOVER_RECORD_ITEM:
+			if ( (items_got >= item_count) ||
+			     (record.index != items_got) ||
+			     ( (item=(connlist_item_t*)malloc(
+				sizeof(connlist_item_t))) == NULL) ) {
+				ret = ERROR_3;
+				break;
+			}
+			memset(item,0,sizeof(connlist_item_t));
+			memcpy(&item->info,&record.info,
+				sizeof(helper_conn_info_t));
+			memcpy(&item->obs_data,&record.obs_data,
+				sizeof(observed_data_t));
+			item->state = record.state;
+			/* the socket comes with the item's session */
+			item->info.socks.peer = SOCKET_UNKNOWN;
+			if (FAILED(connlist_add(list,item))) {
+				safe_free(item);
+				ret = ERROR_LIST_ADD;
+				break;
+			}
+			/* the watchers are counted once every item and
+			 * session is known */
+			item->paired       = record.paired;
+			item->watchers     = 0;
+			items[items_got]   = item;
+			buddies[items_got] = record.buddy;
+			items_got++;
+			break;
+		case HANDOVER_RECORD_SESSION:
+			if ( (sessions_got >= session_count) || (fd < 0) ||
+			     (record.index < HANDOVER_NONE) ||
+			     (record.index >= items_got) ||
+			     ( (session=(connlist_session_t*)malloc(
+				sizeof(connlist_session_t))) == NULL) ) {
+				ret = ERROR_4;
+				break;
+			}
+			memset(session,0,sizeof(connlist_session_t));
+			memcpy(&session->obs_data,&record.obs_data,
+				sizeof(observed_data_t));
+			session->sd     = fd;
+			session->item   = (record.index == HANDOVER_NONE) ?
+					  NULL : items[record.index];
+			session->parked = FLAG_UNSET;
+			sessions[sessions_got++] = session;
+			fd = -1;
+			break;
+		default:
+			ret = ERROR_5;
+			break;
+		}
+
+		/* a descriptor sent with a record that takes none */
+		if (fd >= 0)
+			close(fd);
+	}
+
+	if ( (ret == SUCCESS) && ( (items_got != item_count) ||
+	     (sessions_got != session_count) ||
+	     (*listen_sd == SOCKET_UNKNOWN) ) )
+		ret = ERROR_6;
+
+	if (ret == SUCCESS) {
+		/* nothing runs yet, so the items are put back together without
+		 * the list's mutex.  each item is watched by its session and
+		 * by its buddy, like connlist_pair left them */
+		for(i=0;i<items_got;i++) {
+			if ( (buddies[i] >= 0) && (buddies[i] < items_got) ) {
+				items[i]->buddy = items[buddies[i]];
+				items[buddies[i]]->watchers += 1;
+			}
+		}
+		for(i=0;i<sessions_got;i++) {
+			if (sessions[i]->item != NULL) {
+				sessions[i]->item->watchers += 1;
+				sessions[i]->item->info.socks.peer =
+					sessions[i]->sd;
+			}
+		}
+
+		memset(&record,0,sizeof(record));
+		record.type = HANDOVER_RECORD_ACK;
+		if (FAILED(handover_send(sd,&record,-1)))
+			ret = ERROR_NETWORK_SEND;
+	}
+	close(sd);
+
+	if (ret != SUCCESS) {
+		/* the old helper resumes the sessions itself */
+		if (*listen_sd != SOCKET_UNKNOWN)
+			close(*listen_sd);
+		for(i=0;i<sessions_got;i++) {
+			close(sessions[i]->sd);
+			safe_free(sessions[i]);
+		}
+		safe_free(items);
+		safe_free(buddies);
+		safe_free(sessions);
+		return ERROR_CALLED_FUNCTION;
+	}
+
+	/* the sessions are this helper's now */
+	for(i=0;i<sessions_got;i++) {
+		session = sessions[i];
+		if (list->admit != NULL)
+			admit_resume(list->admit);
+		if ( FAILED(connlist_session_begin(list,session)) ||
+		     FAILED(start_handler(list,session)) ) {
+			connlist_session_end(list,session);
+			close(session->sd);
+			safe_free(session);
+			if (list->admit != NULL)
+				admit_release(list->admit);
+		}
+	}
+	DEBUG(DBG_HANDOVER,"HANDOVER:took over %d sessions\n",sessions_got);
+
+	safe_free(items);
+	safe_free(buddies);
+	safe_free(sessions);
+
+	return SUCCESS;
+}
+
+errorcode handover_drain(connlist_t *list) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+
+	/* do function */
+	/* sessions forwarded to another node of a cluster are relayed too */
+	while ( ( (list->relay != NULL) && (relay_count(list->relay) > 0) ) ||
+		( (list->cluster != NULL) &&
+		  (relay_count(&list->cluster->relay) > 0) ) ) {
+		DEBUG(DBG_HANDOVER,"HANDOVER:%d relayed and %d forwarded "
+			"sessions left\n",
+			(list->relay != NULL) ? relay_count(list->relay) : 0,
+			(list->cluster != NULL) ?
+			relay_count(&list->cluster->relay) : 0);
+		sleep(HANDOVER_DRAIN_INTERVAL);
+	}
+
+	return SUCCESS;
+}
+
+errorcode handover_send(sock_t sd, handover_record_t *record, int fd) {
+
+	/* declare local variables */
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	/* error check arguments */
+	CHECK_NOT_NULL(record,ERROR_NULL_ARG_2);
+
+	/* do function */
+	record->magic = HANDOVER_MAGIC;
+	record->size  = sizeof(handover_record_t);
+
+	memset(&msg,0,sizeof(msg));
+	iov.iov_base   = record;
+	iov.iov_len    = sizeof(handover_record_t);
+	msg.msg_iov    = &iov;
+	msg.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		memset(control,0,sizeof(control));
+		msg.msg_control    = control;
+		msg.msg_controllen = sizeof(control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg),&fd,sizeof(int));
+	}
+
+	if (sendmsg(sd,&msg,MSG_NOSIGNAL) != sizeof(handover_record_t))
+		return ERROR_NETWORK_SEND;
+
+	return SUCCESS;
+}
+
+errorcode handover_recv(sock_t sd, handover_record_t *record, int *fd,
+			int timeout) {
+
+	/* declare local variables */
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int))];
+	struct pollfd pfd;
+	int n;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(record,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(fd,ERROR_NULL_ARG_3);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_4);
+
+	/* do function */
+	*fd = -1;
+
+	pfd.fd     = sd;
+	pfd.events = POLLIN;
+	do {
+		n = poll(&pfd,1,timeout*1000);
+	} while ( (n < 0) && (errno == EINTR) );
+	if (n == 0)
+		return ERROR_TIMEOUT;
+	if (n < 0)
+		return ERROR_NETWORK_READ;
+
+	memset(&msg,0,sizeof(msg));
+	iov.iov_base       = record;
+	iov.iov_len        = sizeof(handover_record_t);
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	n = recvmsg(sd,&msg,0);
+
+	for(cmsg=CMSG_FIRSTHDR(&msg);cmsg!=NULL;cmsg=CMSG_NXTHDR(&msg,cmsg)) {
+		if ( (cmsg->cmsg_level == SOL_SOCKET) &&
+		     (cmsg->cmsg_type == SCM_RIGHTS) )
+			memcpy(fd,CMSG_DATA(cmsg),sizeof(int));
+	}
+
+	if ( (n != sizeof(handover_record_t)) ||
+	     (record->magic != HANDOVER_MAGIC) ||
+	     (record->size != sizeof(handover_record_t)) ) {
+		if (*fd >= 0)
+			close(*fd);
+		*fd = -1;
+		return ERROR_NETWORK_READ;
+	}
+
+	return SUCCESS;
+}
+
+errorcode handover_snapshot(connlist_t *list, sock_t sd, sock_t listen_sd,
+			    connlist_session_t **sessions, int count) {
+
+	/* declare local variables */
+	handover_record_t record;
+	connlist_item_t **items;
+	connlist_item_t *item;
+	time_t oldest;
+	int item_count, session_count;
+	int i;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sessions,ERROR_NULL_ARG_4);
+
+	/* do function */
+	/* every item a handed over session uses: its own and its buddy's */
+	if ( (items=(connlist_item_t**)malloc((2*count+1)*
+			sizeof(connlist_item_t*))) == NULL)
+		return ERROR_MALLOC_FAILED;
+	item_count    = 0;
+	session_count = 0;
+	for(i=0;i<count;i++) {
+		if (handover_keeps(sessions[i]))
+			continue;
+		session_count++;
+		item = sessions[i]->item;
+		if ( (item != NULL) &&
+		     (handover_index(items,item_count,item) == HANDOVER_NONE) )
+			items[item_count++] = item;
+		if ( (item != NULL) && (item->buddy != NULL) &&
+		     (handover_index(items,item_count,item->buddy) ==
+		      HANDOVER_NONE) )
+			items[item_count++] = item->buddy;
+	}
+
+	ret = SUCCESS;
+
+	memset(&record,0,sizeof(record));
+	record.type  = HANDOVER_RECORD_HEADER;
+	record.index = item_count;
+	record.buddy = session_count;
+	if (FAILED(handover_send(sd,&record,-1)))
+		ret = ERROR_1;
+
+	memset(&record,0,sizeof(record));
+	record.type = HANDOVER_RECORD_LISTEN;
+	if ( (ret == SUCCESS) && FAILED(handover_send(sd,&record,listen_sd)) )
+		ret = ERROR_2;
+
+	/* only this thread adds to the seen connections, and the sessions
+	 * that take them are parked */
+	oldest = time(NULL) - timeout_ceiling_sec(TIMEOUT_CONN2);
+	for(i=0;(ret==SUCCESS)&&(i<CONNLIST_SEEN);i++) {
+		if ( (list->seen[i].ip == IP_UNKNOWN) ||
+		     (list->seen_at[i] < oldest) )
+			continue;
+		memset(&record,0,sizeof(record));
+		record.type = HANDOVER_RECORD_SEEN;
+		memcpy(&record.obs_data,&list->seen[i],sizeof(observed_data_t));
+		if (FAILED(handover_send(sd,&record,-1)))
+			ret = ERROR_3;
+	}
+
+	for(i=0;(ret==SUCCESS)&&(i<item_count);i++) {
+		memset(&record,0,sizeof(record));
+		record.type   = HANDOVER_RECORD_ITEM;
+		record.index  = i;
+		record.buddy  = handover_index(items,item_count,
+					       items[i]->buddy);
+		record.paired = items[i]->paired;
+		record.state  = items[i]->state;
+		memcpy(&record.obs_data,&items[i]->obs_data,
+			sizeof(observed_data_t));
+		memcpy(&record.info,&items[i]->info,sizeof(helper_conn_info_t));
+		if (FAILED(handover_send(sd,&record,-1)))
+			ret = ERROR_4;
+	}
+
+	for(i=0;(ret==SUCCESS)&&(i<count);i++) {
+		if (handover_keeps(sessions[i]))
+			continue;
+		memset(&record,0,sizeof(record));
+		record.type  = HANDOVER_RECORD_SESSION;
+		record.index = handover_index(items,item_count,
+					      sessions[i]->item);
+		memcpy(&record.obs_data,&sessions[i]->obs_data,
+			sizeof(observed_data_t));
+		if (FAILED(handover_send(sd,&record,sessions[i]->sd)))
+			ret = ERROR_5;
+	}
+
+	memset(&record,0,sizeof(record));
+	record.type = HANDOVER_RECORD_END;
+	if ( (ret == SUCCESS) && FAILED(handover_send(sd,&record,-1)) )
+		ret = ERROR_6;
+
+	safe_free(items);
+
+	return ret;
+}
+
+int handover_index(connlist_item_t **items, int count, connlist_item_t *item) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	if (item == NULL)
+		return HANDOVER_NONE;
+	for(i=0;i<count;i++) {
+		if (items[i] == item)
+			return i;
+	}
+
+	return HANDOVER_NONE;
+}
+
+int handover_keeps(connlist_session_t *session) {
+
+	/* do function */
+	return ( (session->item != NULL) &&
+		 (session->item->info.relay == FLAG_SUCCESS) );
+}
+
+errorcode handover_resume(connlist_t *list, connlist_session_t **sessions,
+			  int count, int all) {
+
+	/* declare local variables */
+	connlist_session_t **parked;
+	int parked_count;
+	int i;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	if ( (!all) && (sessions == NULL) )
+		return ERROR_NULL_ARG_2;
+
+	/* do function */
+	/* the sessions the new helper resumes are done here.  their items are
+	 * left as they are, nothing here looks at them again */
+	for(i=0;(!all)&&(i<count);i++) {
+		if (handover_keeps(sessions[i]))
+			continue;
+		connlist_session_end(list,sessions[i]);
+		close(sessions[i]->sd);
+		safe_free(sessions[i]);
+		sessions[i] = NULL;
+		if (list->admit != NULL)
+			admit_release(list->admit);
+	}
+
+	/* whatever is still parked stays here.  that is taken from the list
+	 * as the handover ends, not from the caller's snapshot, so a session
+	 * that parked after a quiesce timed out is restarted too */
+	ret = connlist_unquiesce(list,&parked,&parked_count);
+
+	for(i=0;i<parked_count;i++) {
+		if (FAILED(start_handler(list,parked[i]))) {
+			connlist_session_end(list,parked[i]);
+			close(parked[i]->sd);
+			safe_free(parked[i]);
+			if (list->admit != NULL)
+				admit_release(list->admit);
+		}
+	}
+	if (parked != NULL)
+		safe_free(parked);
+
+	if (FAILED(ret))
+		return ERROR_1;
+
+	return SUCCESS;
+}
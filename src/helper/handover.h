@@ -0,0 +1,162 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file handover.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief hands a running helper's listening socket and sessions to a new
+ *        helper process, so the helper can be restarted without failing the
+ *        traversals in progress
+ *
+ * The running helper listens on a unix control socket.  A new helper
+ * connects to it and the old one asks every session to stop where it waits
+ * on its peer or buddy (see connlist_quiesce).  The old helper then sends a
+ * record for the listening socket, for each recently accepted connection,
+ * for each item and for each session, followed by an end record.  The
+ * socket descriptors are passed along with their records (SCM_RIGHTS).  The
+ * new helper rebuilds the list, acknowledges, and resumes every session in
+ * the state it stopped in.  If anything goes wrong before the
+ * acknowledgement the old helper resumes the sessions itself.  Relayed
+ * sessions stay with the old helper until they end.
+ */
+
+#ifndef __HANDOVER_H__
+#define __HANDOVER_H__
+
+#include "errorcodes.h"
+#include "connlist.h"
+#include "helperdef.h"
+#include <time.h>
+
+/** @brief the value at the start of every record ("NBH1") */
+#define HANDOVER_MAGIC			0x4e424831
+
+/** @brief time in seconds the sessions get to stop for a handover */
+#define HANDOVER_QUIESCE_TIMEOUT	10
+
+/** @brief time in seconds to wait for the new helper to acknowledge */
+#define HANDOVER_ACK_TIMEOUT		10
+
+/** @brief time in seconds between checks for relayed sessions to end once
+ *  the helper was taken over */
+#define HANDOVER_DRAIN_INTERVAL		1
+
+/** @brief the first record, with the number of items and sessions */
+#define HANDOVER_RECORD_HEADER		1
+
+/** @brief the record with the listening socket */
+#define HANDOVER_RECORD_LISTEN		2
+
+/** @brief a record with a recently accepted connection (see
+ *  connlist_observe) */
+#define HANDOVER_RECORD_SEEN		3
+
+/** @brief a record with an item */
+#define HANDOVER_RECORD_ITEM		4
+
+/** @brief a record with a session and its peer socket */
+#define HANDOVER_RECORD_SESSION		5
+
+/** @brief the record after the last one */
+#define HANDOVER_RECORD_END		6
+
+/** @brief the new helper's acknowledgement, it owns the sessions now */
+#define HANDOVER_RECORD_ACK		7
+
+/** @brief an index that refers to no item */
+#define HANDOVER_NONE			(-1)
+
+/** @brief structure for a record passed over the control socket */
+struct handover_record {
+	/** @brief HANDOVER_MAGIC */
+	unsigned long magic;
+	/** @brief the size of the record, so helpers built differently do not
+	 *  misread each other */
+	int size;
+	/** @brief the HANDOVER_RECORD_* type */
+	int type;
+	/** @brief for an item its index, for a session the index of its item.
+	 *  for the header the number of items */
+	int index;
+	/** @brief for an item the index of its buddy's item.  for the header
+	 *  the number of sessions */
+	int buddy;
+	/** @brief for an item, FLAG_SET if it was paired */
+	flag_t paired;
+	/** @brief for an item, the HELPER_STATE_* to resume in */
+	int state;
+	/** @brief the observed data of an item, a session or a seen
+	 *  connection */
+	observed_data_t obs_data;
+	/** @brief for an item, its connection information.  the socket comes
+	 *  with the item's session */
+	helper_conn_info_t info;
+} __attribute__((__packed__));
+
+/** @brief typedef for the handover_record structure */
+typedef struct handover_record handover_record_t;
+
+/**
+ * @brief creates the control socket a new helper takes over through
+ *
+ * @param path the path of the unix socket, replaced if it exists
+ * @param control_sd pointer to fill in with the listening control socket
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode handover_listen(char *path, sock_t *control_sd);
+
+/**
+ * @brief hands the listening socket and the sessions to the new helper that
+ *        connected to the control socket.  no sessions may be started
+ *        while it runs.
+ *
+ * @param list pointer to the connlist
+ * @param listen_sd the listening socket
+ * @param control_sd the listening control socket
+ *
+ * @return SUCCESS once the new helper took over, errorcode on failure (the
+ *         sessions then carry on in this helper)
+ */
+errorcode handover_give(connlist_t *list, sock_t listen_sd,
+			sock_t control_sd);
+
+/**
+ * @brief takes over the listening socket and the sessions of a running
+ *        helper.  the list must be initialized, with its relay and
+ *        admission state attached.
+ *
+ * @param list pointer to the connlist to resume the sessions in
+ * @param path the running helper's control socket
+ * @param listen_sd pointer to fill in with the listening socket
+ *
+ * @return SUCCESS, errorcode on failure (the running helper keeps going)
+ */
+errorcode handover_take(connlist_t *list, char *path, sock_t *listen_sd);
+
+/**
+ * @brief waits for the relayed sessions, and the sessions forwarded to
+ *        another node of a cluster, to end after the helper was taken over
+ *
+ * @param list pointer to the connlist
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode handover_drain(connlist_t *list);
+
+#endif /* __HANDOVER_H__ */
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file handover_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the helper handover
+ */
+
+#ifndef __HANDOVER_PRIVATE_H__
+#define __HANDOVER_PRIVATE_H__
+
+#include "handover.h"
+
+/**
+ * @brief sends a record, with a socket descriptor attached if one is given
+ *
+ * @param sd the control connection
+ * @param record the record, the magic and size are filled in
+ * @param fd the descriptor to pass along, negative for none
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode handover_send(sock_t sd, handover_record_t *record, int fd);
+
+/**
+ * @brief receives a record and the socket descriptor attached to it
+ *
+ * @param sd the control connection
+ * @param record pointer to fill in with the record
+ * @param fd pointer to fill in with the attached descriptor, negative if
+ *        there is none
+ * @param timeout the most seconds to wait
+ *
+ * @return SUCCESS, errorcode on failure, timeout or a bad record
+ */
+errorcode handover_recv(sock_t sd, handover_record_t *record, int *fd,
+			int timeout);
+
+/**
+ * @brief sends the snapshot of the parked sessions
+ *
+ * @param list pointer to the connlist
+ * @param sd the control connection
+ * @param listen_sd the listening socket
+ * @param sessions the sessions to hand over
+ * @param count the number of sessions
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode handover_snapshot(connlist_t *list, sock_t sd, sock_t listen_sd,
+			    connlist_session_t **sessions, int count);
+
+/**
+ * @brief finds an item in an array
+ *
+ * @param items the array
+ * @param count the number of items in the array
+ * @param item the item to find, may be NULL
+ *
+ * @return the index, or HANDOVER_NONE if it is not there
+ */
+int handover_index(connlist_item_t **items, int count, connlist_item_t *item);
+
+/**
+ * @brief checks if a parked session stays with this helper.  a session
+ *        whose connection was already given to the relay has nothing left
+ *        to do but let go of its item.
+ *
+ * @param session the session
+ *
+ * @return 1 if it stays, 0 if it is handed over
+ */
+int handover_keeps(connlist_session_t *session);
+
+/**
+ * @brief ends a handover in this helper and restarts parked sessions
+ *
+ * @param list pointer to the connlist
+ * @param sessions the sessions that were handed over (may be NULL when all
+ *        is 1)
+ * @param count the number of sessions
+ * @param all 1 to restart every parked session (the handover failed), 0
+ *        to end the handed over sessions the new helper resumes (see
+ *        handover_keeps) and restart every other parked one
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode handover_resume(connlist_t *list, connlist_session_t **sessions,
+			  int count, int all);
+
+#endif /* __HANDOVER_PRIVATE_H__ */
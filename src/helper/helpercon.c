@@ -30,46 +30,87 @@
 #include "debug.h"
 #include "def.h"
 #include "util.h"
+#include "berkeleyapi.h"
+#include "netio.h"
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
 
 errorcode create_new_handler(connlist_t *list, observed_data_t *data,
 			    sock_t sd) {
 
 	/* declare variables */
-	connlist_item_t *item;
-	pthread_t tid;
-	helper_fsm_thread_arg_t *arg;
+	connlist_session_t *session;
+	struct timeval timeout;
+	int nodelay;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
 	CHECK_NOT_NULL(data,ERROR_NULL_ARG_2);
 
 	/* do function */
-	if ( (item=(connlist_item_t*)malloc(sizeof(connlist_item_t))) == NULL)
-		return ERROR_MALLOC_FAILED_1;
+	/* the helper pushes messages back to back without waiting for the
+	 * peer to ask, so don't let the second wait on an ack of the first */
+	nodelay = 1;
+	setsockopt(sd,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+
+	/* a connection that does not say hello soon is not worth a thread */
+	timeout.tv_sec  = ADMIT_HELLO_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+
+	if ( (session = (connlist_session_t*) malloc(
+			sizeof(connlist_session_t))) == NULL) {
+		return ERROR_MALLOC_FAILED_2;
+	}
 
 	/* copy the observed data */
-	memcpy(&item->obs_data,data,sizeof(observed_data_t));
+	memset(session,0,sizeof(connlist_session_t));
+	memcpy(&session->obs_data,data,sizeof(observed_data_t));
+	session->sd     = sd;
+	session->item   = NULL;
+	session->parked = FLAG_UNSET;
+
+	/* a handover has to know about the session before it runs */
+	if (FAILED(connlist_session_begin(list,session))) {
+		safe_free(session);
+		return ERROR_LIST_ADD;
+	}
+
+	if (FAILED(start_handler(list,session))) {
+		connlist_session_end(list,session);
+		safe_free(session);
+		return ERROR_PTHREAD_CREATE_FAILED;
+	}
+
+	return SUCCESS;
+}
+
+errorcode start_handler(connlist_t *list, connlist_session_t *session) {
 
-	/* set the sd for the peer connection */
-	item->info.socks.peer = sd;
+	/* declare variables */
+	pthread_t tid;
+	helper_fsm_thread_arg_t *arg;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
 
-	/* create new thread */
+	/* do function */
 	if ( (arg = (helper_fsm_thread_arg_t*) malloc(
 			sizeof(helper_fsm_thread_arg_t))) == NULL) {
 		return ERROR_MALLOC_FAILED_2;
 	}
-
-	arg->list = list;
-	arg->item = item;
+	arg->list    = list;
+	arg->session = session;
 
 	/* create a thread with the default attributes... */
-	if (pthread_create(&tid,NULL,run_helper_fsm_thread,arg)<0) {
+	if (pthread_create(&tid,NULL,run_helper_fsm_thread,arg)!=0) {
 		safe_free(arg);
 		return ERROR_PTHREAD_CREATE_FAILED;
 	}
-	/* .. and then detach it! */
-	if (pthread_detach(tid)<0)
-		return ERROR_PTHREAD_DETACH_FAILED;
+	/* .. and then detach it!  the thread owns the session either way */
+	pthread_detach(tid);
 
 	return SUCCESS;
 }
@@ -78,28 +119,111 @@ void *run_helper_fsm_thread(void *arg) {
 
 	/* declare variables */
 	helper_fsm_thread_arg_t *cast_arg;
+	connlist_t *list;
+	connlist_session_t *session;
+	errorcode ret;
 
 	/* check arguments */
 	CHECK_NOT_NULL(arg,(void*)ERROR_NULL_ARG_1);
 
 	/* do function */
+	/* the argument is freed right away, since a session that parks for a
+	 * handover never gets back here */
 	cast_arg = (helper_fsm_thread_arg_t*)arg;
+	list     = cast_arg->list;
+	session  = cast_arg->session;
+	safe_free(arg);
 
-	if (FAILED(helper_fsm_start(cast_arg->list, cast_arg->item))) {
-		safe_free(arg);
+	connlist_session_thread(session);
+	ret = helper_fsm_start(list,session);
+
+	connlist_session_end(list,session);
+	safe_free(session);
+
+	/* the session is over, let another one in */
+	if (list->admit != NULL)
+		admit_release(list->admit);
+
+	if (FAILED(ret))
 		return (void*)ERROR_1;
+	return (void*) SUCCESS;
+}
+
+errorcode helper_read_msg(connlist_t *list, sock_t sd, comm_type_t type,
+			  void *buf, int buf_len, int timeout) {
+
+	/* declare local variables */
+	struct pollfd fds[2];
+	int n;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_6);
+
+	/* do function */
+	fds[0].fd     = sd;
+	fds[0].events = POLLIN;
+	fds[1].fd     = list->wake[0];
+	fds[1].events = POLLIN;
+	do {
+		n = poll(fds,2,timeout*1000);
+	} while ( (n < 0) && (errno == EINTR) );
+
+	if (n < 0)
+		return ERROR_NETWORK_READ;
+	if (n == 0) {
+		/* the same as a timed out read */
+		errno = EAGAIN;
+		return ERROR_TIMEOUT;
 	}
 
-	safe_free(arg);
-	return (void*) SUCCESS;
+	/* a message that already arrived is left for whoever resumes the
+	 * session */
+	if (fds[1].revents & POLLIN)
+		connlist_park(list);
+
+	CHECK_FAILED(readMsg(sd,type,buf,buf_len),ERROR_NETWORK_READ);
+	CHECK_FAILED(trace_event(list->trace,sd,TRACE_EVENT_IN,type,buf,
+		buf_len),ERROR_1);
+
+	return SUCCESS;
+}
+
+errorcode helper_send_msg(connlist_t *list, sock_t sd, comm_type_t type,
+			  void *payload, int len) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+
+	/* do function */
+	CHECK_FAILED(sendMsg(sd,type,payload,len),ERROR_NETWORK_SEND);
+	CHECK_FAILED(trace_event(list->trace,sd,TRACE_EVENT_OUT,type,payload,
+		len),ERROR_1);
+
+	return SUCCESS;
+}
+
+void helper_close(connlist_t *list, sock_t sd) {
+
+	/* declare local variables */
+
+	/* do function */
+	/* a connection handed to the relay is not the session's to close */
+	if (sd == SOCKET_UNKNOWN)
+		return;
+	/* recorded first, the descriptor may be reused as soon as it is
+	 * closed */
+	if (list != NULL)
+		trace_event(list->trace,sd,TRACE_EVENT_CLOSE,0,NULL,0);
+	close(sd);
 }
 
 errorcode get_buddy(connlist_t *list, connlist_item_t *item,
 				connlist_item_t **found_buddy) {
 
 	/* declare local varibles */
-	connlist_item_t *local_item;
-	int timer = FIND_BUDDY_TIMEOUT;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
@@ -107,126 +231,122 @@ errorcode get_buddy(connlist_t *list, connlist_item_t *item,
 	CHECK_NOT_NULL(found_buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	/* loop looking for the buddy */
-	do {
-		/* look for the item */
-		DEBUG(DBG_BUDDY,"BUDDY:Finding buddy\n");
-		if (FAILED(connlist_find(list,connlist_find_buddy,
-				&item->info.buddy,&local_item))) {
-			/* if it wasn't found, pause */
-			sleep(1);
-			timer = DEC_UNTIL_ZERO(timer);
-		}
-		else {
-			/* if it was found, break out */
-			break;
-		}
-	} while (timer>0);
-
-	/* if the timer is 0, then the item wasn't found, otherwise it was */
-	if (timer==0) {
-		return ERROR_NOT_FOUND;
-	}
-
-	*found_buddy = local_item;
+	/* the buddy is paired with this item when the second of the two says
+	 * hello, so just wait for that to happen */
+	DEBUG(DBG_BUDDY,"BUDDY:Finding buddy\n");
+	CHECK_FAILED(connlist_wait_buddy(list,item,
+		timeout_ms(TIMEOUT_BUDDY,&item->info.rtt,NULL),found_buddy),
+		ERROR_NOT_FOUND);
 
 	return SUCCESS;
 }
 
-errorcode wait_for_buddy_port_alloc(helper_conn_info_t *buddy) {
+errorcode wait_for_buddy_port_alloc(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy) {
 
 	/* declare local variables */
 
 	/* error check arguments */
-	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	CHECK_FAILED(wait_for_flag(&buddy->port_alloc.method_set, FLAG_SET,
-		WAIT_FOR_BUDDY_PORT_ALLOC_TIMEOUT),ERROR_CALLED_FUNCTION);
+	CHECK_FAILED(connlist_wait_flag(list,&buddy->port_alloc.method_set,FLAG_SET,
+		timeout_ms(TIMEOUT_BUDDY_STEP,&peer->rtt,&buddy->rtt)),
+		ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-errorcode wait_for_buddy_port_known(helper_conn_info_t *buddy) {
+errorcode wait_for_buddy_port_known(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy) {
 
 	/* declare local variables */
 
 	/* error check arguments */
-	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	CHECK_FAILED(wait_for_flag(&buddy->port_alloc.ext_port_set, FLAG_SET,
-		WAIT_FOR_BUDDY_PORT_KNOWN_TIMEOUT),ERROR_CALLED_FUNCTION);
+	CHECK_FAILED(connlist_wait_flag(list,&buddy->port_alloc.ext_port_set,FLAG_SET,
+		timeout_ms(TIMEOUT_BUDDY_STEP,&peer->rtt,&buddy->rtt)),
+		ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-errorcode wait_for_buddy_bday_port(helper_conn_info_t *buddy) {
+errorcode wait_for_buddy_bday_port(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy) {
 
 	/* declare local variables */
 
 	/* error check arguments */
-	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	CHECK_FAILED(wait_for_flag(&buddy->bday.port_set, FLAG_SET,
-		WAIT_FOR_BUDDY_BDAY_PORT_TIMEOUT),ERROR_CALLED_FUNCTION);
+	CHECK_FAILED(connlist_wait_flag(list,&buddy->bday.port_set,FLAG_SET,
+		timeout_ms(TIMEOUT_BUDDY_STEP,&peer->rtt,&buddy->rtt)),
+		ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-errorcode wait_for_buddy_syn_seq_num(helper_conn_info_t *buddy) {
+errorcode wait_for_buddy_syn_seq_num(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy) {
 
 	/* declare local variables */
 
 	/* error check arguments */
-	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	CHECK_FAILED(wait_for_flag(&buddy->buddy_syn.seq_num_set, FLAG_SET,
-		WAIT_FOR_BUDDY_SEQ_NUM_TIMEOUT),ERROR_CALLED_FUNCTION);
+	CHECK_FAILED(connlist_wait_flag(list,&buddy->buddy_syn.seq_num_set,FLAG_SET,
+		timeout_ms(TIMEOUT_BUDDY_STEP,&peer->rtt,&buddy->rtt)),
+		ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-
-errorcode wait_for_buddy_syn_flood(helper_conn_info_t *buddy) {
+errorcode wait_for_buddy_syn_flood(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy) {
 
 	/* declare local variables */
 
 	/* error check arguments */
-	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-	CHECK_FAILED(wait_for_flag(&buddy->bday.seq_num_set, FLAG_SET,
-		WAIT_FOR_BUDDY_SYN_FLOOD_TIMEOUT),ERROR_CALLED_FUNCTION);
+	CHECK_FAILED(connlist_wait_flag(list,&buddy->bday.seq_num_set,FLAG_SET,
+		timeout_ms(TIMEOUT_BUDDY_STEP,&peer->rtt,&buddy->rtt)),
+		ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-errorcode find_conn2(connlist_t *list, observed_data_t *find_data,
-				connlist_item_t **found_item) {
+errorcode find_conn2(connlist_t *list, helper_conn_info_t *peer,
+		     observed_data_t *find_data) {
 
 	/* declare local variables */
-	int timer = FIND_CONN2_TIMEOUT;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
-	CHECK_NOT_NULL(find_data,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(find_data,ERROR_NULL_ARG_3);
 
 	/* do function */
-	do {
-		if (FAILED(connlist_find(list,connlist_find_pred_port,
-			find_data,found_item))) {
-			sleep(1);
-			timer = DEC_UNTIL_ZERO(timer);
-		}
-		else {
-			return SUCCESS;
-		}
-
-	} while (timer>0);
-
-	return ERROR_TIMEOUT;
-}
+	/* the second connection was usually accepted already, otherwise it
+	 * is seen while waiting */
+	CHECK_FAILED(connlist_wait_seen(list,find_data,
+		timeout_ceiling_sec(TIMEOUT_CONN2),
+		timeout_ms(TIMEOUT_CONN2,&peer->rtt,NULL)),ERROR_TIMEOUT);
 
+	return SUCCESS;
+}
@@ -28,14 +28,15 @@
 #include "helperdef.h"
 #include "connlist.h"
 #include "errorcodes.h"
+#include "comm.h"
 #include "def.h"
 
 /** @brief structure to hold data passed into a helper_fsm thread */
 struct helper_fsm_thread_arg {
 	/** @brief the connection list */
 	connlist_t *list;
-	/** @brief the connection info */
-	connlist_item_t *item;
+	/** @brief the session the thread handles, registered with the list */
+	connlist_session_t *session;
 } __attribute__((packed));
 
 /** @brief typedef for the helper_fsm_thread_arg structure */
@@ -47,13 +48,26 @@ typedef struct helper_fsm_thread_arg helper_fsm_thread_arg_t;
  * @param list a pointer to the list to share data with other threads thru
  * @param data a pointer to the observed connection data, a copy of this data
  *        is made.
- * @param sd the socket descriptor for the connection
+ * @param sd the socket descriptor for the connection, owned by the thread
+ *        once it started.  on failure it is left open.
  *
  * @return SUCCESS, errorcode on failure
  */
 errorcode create_new_handler(connlist_t *list, observed_data_t *data,
 			     sock_t sd);
 
+/**
+ * @brief creates a new detached thread for a session that is already
+ *        registered with the list (see connlist_session_begin), either a
+ *        new one or one resumed after a handover
+ *
+ * @param list a pointer to the list the session is registered with
+ * @param session the session, owned by the thread once it started
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode start_handler(connlist_t *list, connlist_session_t *session);
+
 /**
  * @brief a wrapper function for the helper fsm entry point
  *
@@ -62,15 +76,62 @@ errorcode create_new_handler(connlist_t *list, observed_data_t *data,
  *
  * @param arg the sole void * pthread argument.  This arugment will be cast to
  *        a helper_fsm_thread_arg_t in the function.  THIS ARGUMENT MUST BE
- *        ALLOCATED ON THE HEAP WITH MALLOC, AS IT WILL BE FREED.
+ *        ALLOCATED ON THE HEAP WITH MALLOC, AS IT WILL BE FREED.  so is the
+ *        session, unless the session is parked for a handover.
  * @return SUCCESS, errorcode on failure
  */
 void *run_helper_fsm_thread(void *arg);
 
+/**
+ * @brief reads a message from the peer, parking the session instead if a
+ *        handover starts while it waits (see connlist_park).  the message is
+ *        recorded if the helper records its sessions
+ *
+ * @param list pointer to the connlist
+ * @param sd the peer connection
+ * @param type the type of message expected
+ * @param buf the buffer to read the message into
+ * @param buf_len the length of buf
+ * @param timeout the most seconds to wait for the message to start
+ *
+ * @return SUCCESS, errorcode on failure or timeout (errno is EAGAIN then)
+ */
+errorcode helper_read_msg(connlist_t *list, sock_t sd, comm_type_t type,
+			  void *buf, int buf_len, int timeout);
+
+/**
+ * @brief sends a message to the peer, recording it if the helper records
+ *        its sessions
+ *
+ * @param list pointer to the connlist
+ * @param sd the peer connection
+ * @param type the type of the message
+ * @param payload the payload, may be NULL if len is 0
+ * @param len the length of the payload
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_send_msg(connlist_t *list, sock_t sd, comm_type_t type,
+			  void *payload, int len);
+
+/**
+ * @brief closes a peer connection, recording the end of the session if the
+ *        helper records its sessions
+ *
+ * @param list pointer to the connlist, may be NULL
+ * @param sd the peer connection
+ *
+ * @return void
+ */
+void helper_close(connlist_t *list, sock_t sd);
+
 /**
  * @brief finds and returns buddy info from the thread-shared list
  *
- * This function looks for FIND_BUDDY_TIMEOUT seconds, and then gives up
+ * The buddy is found once it has been paired with the item (see
+ * connlist_pair).  This function waits as long as the TIMEOUT_BUDDY wait
+ * allows (see timeout.h), and then gives up.  The buddy info stays valid
+ * until the item is unpaired.
  *
  * @param list pointer to the connlist_t structure to find the buddy in
  * @param item pointer to the item for the looking peer info
@@ -82,68 +143,85 @@ errorcode get_buddy(connlist_t *list, connlist_item_t *item,
 			connlist_item_t **found_buddy);
 /**
  * @brief returns success once the buddy's port allocation method has been
- *        set.  timeouts out after WAIT_FOR_BUDDY_PORT_ALLOC_TIMEOUT
+ *        set.  times out after the TIMEOUT_BUDDY_STEP wait
  *
+ * @param list pointer to the list, notified when the buddy's info changes
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param buddy pointer to the buddy's helper_conn_info_t structure
  *
  * @return SUCCESS when alloc method set, errorcode on error or timeout
  */
-errorcode wait_for_buddy_port_alloc(helper_conn_info_t *buddy);
+errorcode wait_for_buddy_port_alloc(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy);
 
 /**
  * @brief returns success once the buddy's external port has been set.
- *        timeouts out after WAIT_FOR_BUDDY_PORT_KNOWN_TIMEOUT
+ *        times out after the TIMEOUT_BUDDY_STEP wait
  *
+ * @param list pointer to the list, notified when the buddy's info changes
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param buddy pointer to the buddy's helper_conn_info_t structure
  *
  * @return SUCCESS when port known is set, errorcode on error or timeout
  */
-errorcode wait_for_buddy_port_known(helper_conn_info_t *buddy);
+errorcode wait_for_buddy_port_known(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy);
 
 /**
  * @brief returns success once the buddy's external port has been set through
- *        the birthday paradox.  timeouts out after
- *        WAIT_FOR_BUDDY_BDAY_PORT_TIMEOUT
+ *        the birthday paradox.  times out after the
+ *        TIMEOUT_BUDDY_STEP wait
  *
+ * @param list pointer to the list, notified when the buddy's info changes
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param buddy pointer to the buddy's helper_conn_info_t structure
  *
  * @return SUCCESS when port known is set, errorcode on error or timeout
  */
-errorcode wait_for_buddy_bday_port(helper_conn_info_t *buddy);
+errorcode wait_for_buddy_bday_port(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy);
 
 
 /**
  * @brief returns success once the buddy's SYN sequence number has been set.
- *        timeouts out after WAIT_FOR_BUDDY_SEQ_NUM_TIMEOUT
+ *        times out after the TIMEOUT_BUDDY_STEP wait
  *
+ * @param list pointer to the list, notified when the buddy's info changes
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param buddy pointer to the buddy's helper_conn_info_t structure
  *
  * @return SUCCESS when seq num flag is set, errorcode on error or timeout
  */
-errorcode wait_for_buddy_syn_seq_num(helper_conn_info_t *buddy);
+errorcode wait_for_buddy_syn_seq_num(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy);
 
 /**
  * @brief returns success once the buddy's SYN sequence number has been set.
- *        timeouts out after WAIT_FOR_BUDDY_SYN_FLOOD_TIMEOUT
+ *        times out after the TIMEOUT_BUDDY_STEP wait
  *
+ * @param list pointer to the list, notified when the buddy's info changes
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param buddy pointer to the buddy's helper_conn_info_t structure
  *
  * @return SUCCESS when seq num flag is set, errorcode on error or timeout
  */
-errorcode wait_for_buddy_syn_flood(helper_conn_info_t *buddy);
+errorcode wait_for_buddy_syn_flood(connlist_t *list,
+			helper_conn_info_t *peer, helper_conn_info_t *buddy);
 
 /**
  * @brief finds a second connection, timing out if it takes too long
  *
- * timeout id FIND_CONN2_TIMEOUT
+ * the timeout is the TIMEOUT_CONN2 wait for the peer.  the second
+ * connection is matched against the recently accepted connections (see
+ * connlist_observe).
  *
  * @param list pointer to the list to look in
+ * @param peer pointer to the peer's helper_conn_info_t structure
  * @param find_data the data to match on when searching
- * @param found_item pointer to a pointer to set to the found item
  *
  * @return SUCCESS, errorcode on timeout or failure
  */
-errorcode find_conn2(connlist_t *list, observed_data_t *find_data,
-				connlist_item_t **found_item);
+errorcode find_conn2(connlist_t *list, helper_conn_info_t *peer,
+		     observed_data_t *find_data);
 
 #endif /* __HELPERCON_H__ */
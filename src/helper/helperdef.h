@@ -25,33 +25,107 @@
 #define __HELPERDEF_H__
 
 #include "def.h"
+#include "timeout.h"
 
 /**
- * The timeouts specified below are based on experience on how long it really
- * takes for natblaster to succeed.  They are longer than is probably needed.
+ * How long the helper waits on the peer's buddy and on the second
+ * connection follows the round trip times of the two peers, within limits
+ * set at run time (see timeout.h).
  **/
 
-/** @brief the time in seconds to look for buddy info when searching */
-#define FIND_BUDDY_TIMEOUT			20
+/** @brief the most bytes held in a relay pipe for one direction of a
+ *  relayed session */
+#define RELAY_PIPE_SIZE				65536
 
-/** @brief the time in seconds to look for a second connection */
-#define FIND_CONN2_TIMEOUT			5
+/** @brief the relay event loop tick in milliseconds (bandwidth limits are
+ *  refilled each tick) */
+#define RELAY_TICK_MS				100
 
-/** @brief the time in seconds to wait for the buddy port alloc to be set */
-#define WAIT_FOR_BUDDY_PORT_ALLOC_TIMEOUT	20
+/** @brief time in seconds between relay throughput reports */
+#define RELAY_REPORT_INTERVAL			10
 
-/** @brief time in seconds to wait for the buddy's external port to be set */
-#define WAIT_FOR_BUDDY_PORT_KNOWN_TIMEOUT	20
+/** @brief the most events the relay handles per event loop pass */
+#define RELAY_MAX_EVENTS			64
 
-/** @brief time in seconds to wait for the buddy's SYN sequence number */
-#define WAIT_FOR_BUDDY_SEQ_NUM_TIMEOUT		20
+/** @brief time in seconds a new connection has to send its HELLO.  the
+ *  port prediction second connection sends nothing and is closed by the
+ *  peer well before this */
+#define ADMIT_HELLO_TIMEOUT			5
 
-/** @brief time in seconds to wait for the buddy to send SYN a SYN FLOOD */
-#define WAIT_FOR_BUDDY_SYN_FLOOD_TIMEOUT	20
+/** @brief time in seconds a session may wait for the peer's next message
+ *  before it is dropped */
+#define ADMIT_IDLE_TIMEOUT			60
 
-/** @brief time in seconds to wait for the buddy external port to be set
- * through use of the birthday paradox */
-#define WAIT_FOR_BUDDY_BDAY_PORT_TIMEOUT	20
+/** @brief time in seconds, on top of the longest the peer may wait for its
+ *  direct connection (TIMEOUT_DIRECT_CONN), a session waits for the peer's
+ *  GOODBYE before it is dropped */
+#define ADMIT_GOODBYE_MARGIN			10
+
+/** @brief time in seconds between reports of the connections turned away */
+#define ADMIT_REPORT_INTERVAL			10
+
+/** @brief the number of recently accepted connections remembered, so a
+ *  port prediction second connection can be matched without keeping any
+ *  state for it */
+#define CONNLIST_SEEN				256
+
+/**
+ * The states a session can be resumed in after being handed to a new helper
+ * process (see helper_fsm_resume).  Each is a point where the session waits
+ * on the peer or on the buddy, named after the helper_fsm function that
+ * waits there.
+ **/
+
+/** @brief waiting for the peer's HELLO (the session has no item yet) */
+#define HELPER_STATE_HELLO			0
+
+/** @brief waiting for CONNECTED_AGAIN (helper_fsm_conn2) */
+#define HELPER_STATE_CONN2			1
+
+/** @brief waiting for the buddy (helper_fsm_buddy_alloc) */
+#define HELPER_STATE_BUDDY_ALLOC		2
+
+/** @brief waiting for WAITING_FOR_BUDDY_ALLOC (helper_fsm_alloc_waiting) */
+#define HELPER_STATE_ALLOC_WAITING		3
+
+/** @brief waiting for the buddy's port (helper_fsm_buddy_port) */
+#define HELPER_STATE_BUDDY_PORT			4
+
+/** @brief waiting for WAITING_FOR_BUDDY_PORT (helper_fsm_port_waiting) */
+#define HELPER_STATE_PORT_WAITING		5
+
+/** @brief waiting for BUDDY_SYN_SEQ (helper_fsm_start_direct_conn) */
+#define HELPER_STATE_DIRECT_CONN		6
+
+/** @brief waiting for the buddy's SYN sequence numbers
+ *  (helper_fsm_peer_syn_seq) */
+#define HELPER_STATE_PEER_SYN_SEQ		7
+
+/** @brief waiting for GOODBYE (helper_fsm_goodbye) */
+#define HELPER_STATE_GOODBYE			8
+
+/** @brief waiting for SYN_FLOODED (helper_fsm_start_peer_bday) */
+#define HELPER_STATE_PEER_BDAY			9
+
+/** @brief waiting for BDAY_SUCCESS_PORT (helper_fsm_end_peer_bday) */
+#define HELPER_STATE_END_PEER_BDAY		10
+
+/** @brief waiting for the buddy's SYN flood (helper_fsm_start_buddy_bday) */
+#define HELPER_STATE_BUDDY_BDAY			11
+
+/** @brief waiting for WAITING_TO_SYN_ACK_FLOOD
+ *  (helper_fsm_buddy_bday_waiting) */
+#define HELPER_STATE_BUDDY_BDAY_WAITING		12
+
+/** @brief waiting for SYN_ACK_FLOOD_DONE (helper_fsm_end_buddy_bday) */
+#define HELPER_STATE_END_BUDDY_BDAY		13
+
+/** @brief waiting for the buddy's birthday port
+ *  (helper_fsm_buddy_bday_port) */
+#define HELPER_STATE_BUDDY_BDAY_PORT		14
+
+/** @brief waiting for the buddy to be relayed with (helper_fsm_relay) */
+#define HELPER_STATE_RELAY			15
 
 /** @brief a structure to hold information about a bday flood */
 struct bday_helper {
@@ -71,10 +145,12 @@ struct bday_helper {
 typedef struct bday_helper bday_helper_t;
 
 
-/** @brief a structure to hold the sequence number from a SYN packet */
+/** @brief a structure to hold the sequence numbers from the SYN packets */
 struct buddy_syn_seq_num {
-	/** @brief the sequence number to the buddy */
-	seq_num_t seq_num;
+	/** @brief the number of SYNs sent to the buddy */
+	unsigned char count;
+	/** @brief the sequence numbers to the buddy */
+	seq_num_t seq_num[MAX_RACE_WIDTH];
 	/** @brief a flag indicating if the sequence number has been set */
 	flag_t seq_num_set;
 } __attribute__((__packed__));
@@ -105,6 +181,13 @@ struct helper_conn_info {
 	buddy_syn_seq_num_t buddy_syn;
 	/** @brief information about a bday attempt */
 	bday_helper_t bday;
+	/** @brief the state of handing the peer connection to the relay.
+	 *  FLAG_SET once ready to be relayed, then FLAG_SUCCESS or FLAG_FAILED
+	 *  once the relay took (or refused) it */
+	flag_t relay;
+	/** @brief the round trip time to the peer, which sets how long the
+	 *  waits on the peer's buddy last (see timeout.h) */
+	timeout_rtt_t rtt;
 } __attribute__((__packed__));
 
 /** @brief typedef for teh helper_conn_info structure */
@@ -29,19 +29,153 @@
 #include "netio.h"
 #include "debug.h"
 #include "helpercon.h"
+#include "util.h"
+#include "berkeleyapi.h"
 #include <string.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/ioctl.h>
 
-errorcode helper_fsm_start(connlist_t *list, connlist_item_t *item) {
+errorcode helper_fsm_start(connlist_t *list, connlist_session_t *session) {
 
 	/* declare variables */
+	comm_msg_hello_t hello;
+	sock_t sd;
+	int owner;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	/* a session handed over by another helper process carries on where
+	 * it stopped */
+	if (session->item != NULL)
+		return helper_fsm_resume(list,session->item);
+
+	sd = session->sd;
+
+	/* the owner of a session forwarded from here may be waiting for this
+	 * connection, and a connection from another node is not a peer */
+	if (list->cluster != NULL) {
+		cluster_observe(list->cluster,&session->obs_data);
+		if (cluster_is_node(list->cluster,session->obs_data.ip) ==
+		    FLAG_SET)
+			return helper_fsm_cluster(list,session);
+	}
+
+	/* this is a strange case, but it is OK if no acceptable message
+	 * is received on this read.  It was probably a port prediction
+	 * second connection, which the peer closes once it is done with it.
+	 * nothing has been kept for the connection yet, so just close it */
+	errno = 0;
+	if (FAILED(helper_read_msg(list, sd, COMM_MSG_HELLO, &hello,
+			sizeof(hello), ADMIT_HELLO_TIMEOUT))) {
+		if ( ( (errno==EAGAIN) || (errno==EWOULDBLOCK) ) &&
+		     (list->admit != NULL) )
+			admit_idle(list->admit);
+		DEBUG(DBG_PROTOCOL,"PROTOCOL:no hello message\n");
+		helper_close(list,sd);
+		return SUCCESS;
+	}
+
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:received HELLO\n");
+
+	if (admit_hello(list->admit,&hello) != FLAG_SUCCESS) {
+		helper_close(list,sd);
+		return SUCCESS;
+	}
+
+	/* a pair owned by another node of the cluster is handled there */
+	if (list->cluster != NULL) {
+		owner = cluster_owner(list->cluster,&session->obs_data,&hello);
+		if ( (owner != list->cluster->self) &&
+		     (cluster_forward(list->cluster,owner,sd,
+				&session->obs_data,&hello) == SUCCESS) )
+			return SUCCESS;
+	}
+
+	return helper_fsm_begin(list,session,&hello,FLAG_UNSET);
+}
+
+errorcode helper_fsm_cluster(connlist_t *list, connlist_session_t *session) {
+
+	/* declare variables */
+	comm_msg_cluster_t msg;
+	observed_data_t obs;
+	sock_t sd;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	sd = session->sd;
+	if (FAILED(helper_read_msg(list,sd,COMM_MSG_CLUSTER,&msg,sizeof(msg),
+			ADMIT_HELLO_TIMEOUT))) {
+		helper_close(list,sd);
+		return SUCCESS;
+	}
+	obs.ip   = msg.ip;
+	obs.port = msg.port;
+
+	/* a second connection made to another node */
+	if (msg.kind == COMM_CLUSTER_SEEN) {
+		helper_close(list,sd);
+		CHECK_FAILED(connlist_observe(list,&obs),ERROR_1);
+		return SUCCESS;
+	}
+
+	if ( (msg.kind != COMM_CLUSTER_FORWARD) ||
+	     (admit_hello(list->admit,&msg.hello) != FLAG_SUCCESS) ) {
+		helper_close(list,sd);
+		return SUCCESS;
+	}
+
+	/* from here on the connection is the peer's, as the forwarding node
+	 * saw it */
+	DEBUG(DBG_CLUSTER,"CLUSTER:session from %s:%u forwarded here\n",
+		DBG_IP(obs.ip),DBG_PORT(obs.port));
+	memcpy(&session->obs_data,&obs,sizeof(observed_data_t));
+
+	return helper_fsm_begin(list,session,&msg.hello,FLAG_SET);
+}
+
+errorcode helper_fsm_begin(connlist_t *list, connlist_session_t *session,
+			   comm_msg_hello_t *hello, flag_t forwarded) {
+
+	/* declare variables */
+	connlist_item_t *item;
+	struct timeval timeout;
+	sock_t sd;
 	errorcode ret;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
-	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(hello,ERROR_NULL_ARG_3);
 
 	/* do function */
+	sd = session->sd;
+
+	/* a session may now wait longer for each message */
+	timeout.tv_sec  = ADMIT_IDLE_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+
+	if ( (item=(connlist_item_t*)malloc(sizeof(connlist_item_t))) == NULL){
+		helper_close(list,sd);
+		return ERROR_MALLOC_FAILED;
+	}
+
+	/* copy the observed data */
+	memcpy(&item->obs_data,&session->obs_data,sizeof(observed_data_t));
+	item->state = HELPER_STATE_HELLO;
+
+	/* set the sd for the peer connection */
+	item->info.socks.peer = sd;
+
 	/* set initial values */
 	item->info.port_alloc.method        = COMM_PORT_ALLOC_UNKNOWN;
 	item->info.port_alloc.method_set    = FLAG_UNSET;
@@ -56,71 +190,158 @@ errorcode helper_fsm_start(connlist_t *list, connlist_item_t *item) {
 	item->info.buddy.int_port           = PORT_UNKNOWN;
 	item->info.buddy.identifier         = FLAG_UNSET;
 	item->info.buddy.ext_port_set       = FLAG_UNSET;
-	item->info.buddy_syn.seq_num        = SEQ_NUM_UNKNOWN;
+	item->info.buddy_syn.count          = 0;
 	item->info.buddy_syn.seq_num_set    = FLAG_UNSET;
 	item->info.bday.seq_num             = SEQ_NUM_UNKNOWN;
 	item->info.bday.seq_num_set         = FLAG_UNSET;
 	item->info.bday.port                = PORT_UNKNOWN;
 	item->info.bday.port_set            = FLAG_UNSET;
 	item->info.bday.status              = FLAG_UNSET;
+	item->info.relay                    = FLAG_UNSET;
+
+	/* the kernel has timed the peer's connection by now.  a forwarded
+	 * session's socket is the link from another node, so its round trip
+	 * is only learnt from CONNECT_AGAIN */
+	timeout_rtt_init(&item->info.rtt);
+	if (forwarded == FLAG_UNSET)
+		timeout_rtt_socket(&item->info.rtt,sd);
 
 	/* add info to the list */
 	if(FAILED(connlist_add(list,item))) {
 		/* close the socket */
-		close(item->info.socks.peer);
+		helper_close(list,item->info.socks.peer);
 		return ERROR_LIST_ADD;
 	}
 
 	DEBUG(DBG_LIST,"LIST:item Watchers: %d\n",(int)item->watchers);
 
+	/* a handover finds the item through the session from now on */
+	session->item = item;
+
 	/* call next state */
-	ret = helper_fsm_hello(list,item);
+	ret = helper_fsm_hello(list,item,hello);
+
+	return helper_fsm_finish(list,item,ret);
+}
+
+errorcode helper_fsm_resume(connlist_t *list, connlist_item_t *item) {
+
+	/* declare variables */
+	connlist_item_t *buddy;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+
+	/* do function */
+	DEBUG(DBG_HANDOVER,"HANDOVER:resuming session in state %d\n",
+		item->state);
+
+	/* every state after the buddy was found has it paired */
+	buddy = item->buddy;
+
+	switch (item->state) {
+	case HELPER_STATE_CONN2:
+		ret = helper_fsm_conn2(list,item);
+		break;
+	case HELPER_STATE_BUDDY_ALLOC:
+		ret = helper_fsm_buddy_alloc(list,item);
+		break;
+	case HELPER_STATE_ALLOC_WAITING:
+		ret = helper_fsm_alloc_waiting(list,item,buddy);
+		break;
+	case HELPER_STATE_BUDDY_PORT:
+		ret = helper_fsm_buddy_port(list,item,buddy);
+		break;
+	case HELPER_STATE_PORT_WAITING:
+		ret = helper_fsm_port_waiting(list,item,buddy);
+		break;
+	case HELPER_STATE_DIRECT_CONN:
+		ret = helper_fsm_start_direct_conn(list,item,buddy);
+		break;
+	case HELPER_STATE_PEER_SYN_SEQ:
+		ret = helper_fsm_peer_syn_seq(list,item,buddy);
+		break;
+	case HELPER_STATE_GOODBYE:
+		ret = helper_fsm_goodbye(list,item,buddy);
+		break;
+	case HELPER_STATE_PEER_BDAY:
+		ret = helper_fsm_start_peer_bday(list,item,buddy);
+		break;
+	case HELPER_STATE_END_PEER_BDAY:
+		ret = helper_fsm_end_peer_bday(list,item,buddy);
+		break;
+	case HELPER_STATE_BUDDY_BDAY:
+		ret = helper_fsm_start_buddy_bday(list,item,buddy);
+		break;
+	case HELPER_STATE_BUDDY_BDAY_WAITING:
+		ret = helper_fsm_buddy_bday_waiting(list,item,buddy);
+		break;
+	case HELPER_STATE_END_BUDDY_BDAY:
+		ret = helper_fsm_end_buddy_bday(list,item,buddy);
+		break;
+	case HELPER_STATE_BUDDY_BDAY_PORT:
+		ret = helper_fsm_buddy_bday_port(list,item,buddy);
+		break;
+	case HELPER_STATE_RELAY:
+		ret = helper_fsm_relay(list,item,buddy);
+		break;
+	default:
+		ret = ERROR_1;
+		break;
+	}
+
+	return helper_fsm_finish(list,item,ret);
+}
+
+errorcode helper_fsm_finish(connlist_t *list, connlist_item_t *item,
+			    errorcode ret) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+
+	/* do function */
 	if (FAILED(ret)) {
-		if (ret==ERROR_NETWORK_READ){
-			DEBUG(DBG_PROTOCOL,"PROTOCOL:no hello message\n");
-		}
 		/* close the socket */
-		close(item->info.socks.peer);
+		helper_close(list,item->info.socks.peer);
 		/* if the state fails, remove the list item */
+		CHECK_FAILED(connlist_unpair(list,item),ERROR_LIST_REMOVE_3);
 		CHECK_FAILED(connlist_forget(list,connlist_item_match,item),
 			ERROR_LIST_REMOVE_1);
 		return ERROR_CALLED_FUNCTION;
 	}
 
 	/* close the socket */
-	close(item->info.socks.peer);
+	helper_close(list,item->info.socks.peer);
 
+	CHECK_FAILED(connlist_unpair(list,item),ERROR_LIST_REMOVE_4);
 	CHECK_FAILED(connlist_forget(list,connlist_item_match,item),
 			ERROR_LIST_REMOVE_2);
 
 	return SUCCESS;
 }
 
-errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item) {
+errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item,
+			   comm_msg_hello_t *hello) {
 
 	/* declare variables */
-	comm_msg_hello_t hello;
+	int queued;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
 	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(hello,ERROR_NULL_ARG_3);
 
 	/* do function */
-	/* this is a strange case, but it is OK if no acceptable message
-	 * is received on this read.  It was probably a port prediction
-	 * second connection */
-	CHECK_FAILED(readMsg(item->info.socks.peer, COMM_MSG_HELLO,
-				&hello, sizeof(hello)), ERROR_NETWORK_READ);
-
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:received HELLO\n");
-
 	/* save out info from the message */
-	item->info.peer.port         = hello.peer_port;
-	item->info.peer.ip           = hello.peer_ip;
+	item->info.peer.port         = hello->peer_port;
+	item->info.peer.ip           = hello->peer_ip;
 	item->info.peer.set          = FLAG_SET;
-	item->info.buddy.int_ip      = hello.buddy_int_ip;
-	item->info.buddy.int_port    = hello.buddy_int_port;
-	item->info.buddy.ext_ip      = hello.buddy_ext_ip;
+	item->info.buddy.int_ip      = hello->buddy_int_ip;
+	item->info.buddy.int_port    = hello->buddy_int_port;
+	item->info.buddy.ext_ip      = hello->buddy_ext_ip;
 	item->info.buddy.identifier  = FLAG_SET;
 
 	DEBUG(DBG_VERBOSE,"VERBOSE:Information from peer hello\n");
@@ -133,9 +354,30 @@ errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item) {
 	DEBUG(DBG_VERBOSE,"VERBOSE:buddy external...%s\n",
 		DBG_IP(item->info.buddy.ext_ip));
 
+	/* if the buddy already said hello, pair the two now so neither has
+	 * to look for the other later */
+	CHECK_FAILED(connlist_pair(list,item),ERROR_LIST_FIND);
+
+	/* a peer that remembers its port allocation method does not need to
+	 * make the second connection */
+	if ( (hello->port_alloc == COMM_PORT_ALLOC_RAND) ||
+	     ( (hello->port_alloc == COMM_PORT_ALLOC_SEQ) &&
+	       (hello->stride > 0) && (hello->stride <= COMM_MAX_STRIDE) ) ) {
+		CHECK_FAILED(helper_fsm_cached_port_pred(list,item,
+			hello->port_alloc,hello->stride),ERROR_CALLED_FUNCTION_1);
+		return SUCCESS;
+	}
+
+	/* CONNECTED_AGAIN answers CONNECT_AGAIN after the peer's second
+	 * connection, which is two round trips.  a peer that overlaps its
+	 * steps may have sent it already, which would time nothing */
+	if ( (ioctl(item->info.socks.peer,FIONREAD,&queued) == 0) &&
+	     (queued == 0) )
+		timeout_rtt_mark(&item->info.rtt);
+
 	/* send the next message */
-	CHECK_FAILED(sendMsg(item->info.socks.peer, COMM_MSG_CONNECT_AGAIN,
-		NULL, 0),ERROR_NETWORK_SEND);
+	CHECK_FAILED(helper_send_msg(list,item->info.socks.peer,
+		COMM_MSG_CONNECT_AGAIN,NULL,0),ERROR_NETWORK_SEND);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent CONNECT_AGAIN\n");
 
@@ -150,7 +392,6 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 
 	/* declare local variables */
 	observed_data_t find_data;
-	connlist_item_t *port_pred_item = NULL;
 	comm_msg_pred_port_t msg;
 
 	/* error check arguments */
@@ -158,11 +399,14 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
 
 	/* do function */
+	item->state = HELPER_STATE_CONN2;
 
-	CHECK_FAILED(readMsg(item->info.socks.peer, COMM_MSG_CONNECTED_AGAIN,
-			NULL,0),ERROR_NETWORK_READ);
+	CHECK_FAILED(helper_read_msg(list, item->info.socks.peer,
+		COMM_MSG_CONNECTED_AGAIN, NULL, 0, ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:CONNECTED_AGAIN\n");
+	timeout_rtt_measure(&item->info.rtt,2);
 
 	/* look for info about this second connection in the list */
 	/* copy of the observed data */
@@ -171,12 +415,11 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 	 * port */
 	find_data.port = PORT_ADD(find_data.port,1);
 
-	/* wait 2 seconds, to give the second connection time to add
-	 * it's item to the list (this is instead of having a timeout, in
-	 * essence always wait the full timeout) */
+	/* give the second connection time to add it's item to the list.
+	 * the wait follows the peer's round trip time (see TIMEOUT_CONN2) */
 
 	DEBUG((DBG_PORT_PRED|DBG_LIST), "PORT_PRED|LIST:finding 2nd connection entry in list\n");
-	if (FAILED(find_conn2(list,&find_data,&port_pred_item))) {
+	if (FAILED(find_conn2(list,&item->info,&find_data))) {
 
 		DEBUG(DBG_PORT_PRED,"PORT_PRED:couldn't find 2nd connection\n");
 		msg.port_alloc = COMM_PORT_ALLOC_RAND;
@@ -186,6 +429,7 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 		/* set the external port definitively to unknown */
 		item->info.port_alloc.ext_port     = PORT_UNKNOWN;
 		item->info.port_alloc.ext_port_set = FLAG_SET;
+		CHECK_FAILED(connlist_notify(list),ERROR_2);
 	}
 	else {
 		DEBUG(DBG_PORT_PRED,"PORT_PRED:found 2nd connection\n");
@@ -198,11 +442,7 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 		item->info.port_alloc.ext_port     = PORT_ADD(
 			item->obs_data.port,2);
 		item->info.port_alloc.ext_port_set = FLAG_SET;
-
-		/* forget about the port prediction second connection */
-		DEBUG(DBG_LIST, "LIST:forgeting about port pred entry\n");
-		CHECK_FAILED(connlist_forget(list,connlist_item_match,
-			port_pred_item),ERROR_1);
+		CHECK_FAILED(connlist_notify(list),ERROR_3);
 	}
 
 	DEBUG(DBG_PORT_PRED, "PORT_PRED:port alloc method is %s\n",
@@ -210,8 +450,52 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item) {
 		"sequential" : "random" );
 
 	/* tell the peer the port allocation method */
-	CHECK_FAILED(sendMsg(item->info.socks.peer, COMM_MSG_PORT_PRED,
-		&msg,sizeof(msg)),ERROR_NETWORK_SEND);
+	msg.ext_port = item->info.port_alloc.ext_port;
+	msg.obs_port = item->obs_data.port;
+	CHECK_FAILED(helper_send_msg(list,item->info.socks.peer,
+		COMM_MSG_PORT_PRED,&msg,sizeof(msg)),ERROR_NETWORK_SEND);
+
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent PORT PRED\n");
+
+	/* enter next state */
+	CHECK_FAILED(helper_fsm_buddy_alloc(list,item),ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
+errorcode helper_fsm_cached_port_pred(connlist_t *list, connlist_item_t *item,
+				      flag_t port_alloc, unsigned char stride) {
+
+	/* declare local variables */
+	comm_msg_pred_port_t msg;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
+
+	/* do function */
+	DEBUG(DBG_PORT_PRED,"PORT_PRED:peer remembers %s allocation, "
+		"stride %u\n", (port_alloc==COMM_PORT_ALLOC_SEQ) ?
+		"sequential" : "random", stride);
+
+	item->info.port_alloc.method     = port_alloc;
+	item->info.port_alloc.method_set = FLAG_SET;
+	/* there is no second connection in between, so the connection to
+	 * the buddy is the next port the NAT hands out */
+	if (port_alloc == COMM_PORT_ALLOC_SEQ)
+		item->info.port_alloc.ext_port = PORT_ADD(item->obs_data.port,
+							  stride);
+	else
+		item->info.port_alloc.ext_port = PORT_UNKNOWN;
+	item->info.port_alloc.ext_port_set = FLAG_SET;
+	CHECK_FAILED(connlist_notify(list),ERROR_1);
+
+	/* tell the peer the prediction */
+	msg.port_alloc = port_alloc;
+	msg.ext_port   = item->info.port_alloc.ext_port;
+	msg.obs_port   = item->obs_data.port;
+	CHECK_FAILED(helper_send_msg(list,item->info.socks.peer,
+		COMM_MSG_PORT_PRED,&msg,sizeof(msg)),ERROR_NETWORK_SEND);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent PORT PRED\n");
 
@@ -226,23 +510,16 @@ errorcode helper_fsm_buddy_alloc(connlist_t *list, connlist_item_t *item) {
 	/* declare variables */
 	connlist_item_t *found_buddy = NULL;
 	comm_msg_buddy_alloc_t msg;
-	errorcode ret;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
 	CHECK_NOT_NULL(item,ERROR_NULL_ARG_2);
 
 	/* do function */
+	item->state = HELPER_STATE_BUDDY_ALLOC;
 
-	ret = SUCCESS;
-
-	/* receive the waiting message */
-	CHECK_FAILED(readMsg(item->info.socks.peer,
-		COMM_MSG_WAITING_FOR_BUDDY_ALLOC,NULL,0),ERROR_NETWORK_READ);
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_FOR_BUDDY_ALLOC\n");
-
-
-	/* get pointer to buddy's info*/
+	/* get pointer to buddy's info.  it stays valid until this thread
+	 * unpairs on the way out */
 	if (FAILED(get_buddy(list,item,&found_buddy))){
 		DEBUG(DBG_BUDDY,"BUDDY:couldn't find buddy\n");
 		return ERROR_1;
@@ -251,47 +528,71 @@ errorcode helper_fsm_buddy_alloc(connlist_t *list, connlist_item_t *item) {
 	DEBUG(DBG_BUDDY,"BUDDY:found buddy\n");
 	/* check to make sure all buddy's info has been filled in,
 	 * then fill in the message */
-
-	if (FAILED(wait_for_buddy_port_alloc(&(found_buddy->info)))){
-		ret = ERROR_1;
-		goto forget_and_return;
-	}
+	CHECK_FAILED(wait_for_buddy_port_alloc(list,&(item->info),
+		&(found_buddy->info)),ERROR_2);
 
 	msg.buddy_port_alloc = found_buddy->info.port_alloc.method;
 	if ( (found_buddy->info.port_alloc.method == COMM_PORT_ALLOC_RAND) &&
 	     (item->info.port_alloc.method == COMM_PORT_ALLOC_RAND)         )
-		     msg.support = COMM_CONNECTION_UNSUPPORTED;
+		     msg.support = (list->relay == NULL) ?
+			COMM_CONNECTION_UNSUPPORTED : COMM_CONNECTION_RELAYED;
 	else
 		msg.support = COMM_CONNECTION_SUPPORTED;
 
-	/* send out message*/
-	if (FAILED(sendMsg(item->info.socks.peer,COMM_MSG_BUDDY_ALLOC,
-		&msg,sizeof(comm_msg_buddy_alloc_t)))) {
-		ret = ERROR_NETWORK_SEND;
-		DEBUG(DBG_PROTOCOL,
-			"fsm_buddy_alloc:PROTOCOL:sent BUDDY_ALLOC\n");
-		goto forget_and_return;
-	}
+	/* push the message as soon as it is known.  the peer asks for it
+	 * with WAITING_FOR_BUDDY_ALLOC, but that may arrive before or after
+	 * this is sent; either way the peer reads it in order */
+	CHECK_FAILED(helper_send_msg(list,item->info.socks.peer,
+		COMM_MSG_BUDDY_ALLOC,&msg,sizeof(comm_msg_buddy_alloc_t)),
+		ERROR_NETWORK_SEND);
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BUDDY_ALLOC\n");
 
 	if (msg.support == COMM_CONNECTION_UNSUPPORTED) {
 		DEBUG(DBG_VERBOSE, "VERBOSE:connection unsupported!\n");
-		ret = ERROR_2;
-		goto forget_and_return;
+		return ERROR_3;
 	}
 
-
 	/* enter next state */
-	if (FAILED(helper_fsm_buddy_port(list,item,found_buddy))) {
-		ret = ERROR_CALLED_FUNCTION;
-		goto forget_and_return;
+	CHECK_FAILED(helper_fsm_alloc_waiting(list,item,found_buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
+errorcode helper_fsm_alloc_waiting(connlist_t *list, connlist_item_t *peer,
+				   connlist_item_t *buddy) {
+
+	/* declare variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+
+	/* do function */
+	peer->state = HELPER_STATE_ALLOC_WAITING;
+
+	/* receive the waiting message, so it is not relayed to the buddy */
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_WAITING_FOR_BUDDY_ALLOC,NULL,0,ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_FOR_BUDDY_ALLOC\n");
+
+	/* two random peers only get here if the helper relays */
+	if ( (buddy->info.port_alloc.method == COMM_PORT_ALLOC_RAND) &&
+	     (peer->info.port_alloc.method == COMM_PORT_ALLOC_RAND) ) {
+		DEBUG(DBG_VERBOSE, "VERBOSE:connection relayed\n");
+		/* the next state is the last one */
+		CHECK_FAILED(helper_fsm_relay(list,peer,buddy),
+			ERROR_CALLED_FUNCTION_1);
+		return SUCCESS;
 	}
 
-forget_and_return:
-	/* forget the buddy's info */
-	DEBUG(DBG_LIST, "LIST:forgeting about buddy entry\n");
-	CHECK_FAILED(connlist_forget(list,connlist_item_match,found_buddy),
-		ERROR_3);
-	return ret;
+	/* enter next state */
+	CHECK_FAILED(helper_fsm_buddy_port(list,peer,buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
 }
 
 errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
@@ -305,11 +606,7 @@ errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-
-	/* get message from peer */
-	CHECK_FAILED(readMsg(peer->info.socks.peer,
-		COMM_MSG_WAITING_FOR_BUDDY_PORT,NULL,0),ERROR_NETWORK_READ);
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_FOR_BUDDY_PORT\n");
+	peer->state = HELPER_STATE_BUDDY_PORT;
 
 	/* as soon as the buddy's port is known send it to the peer and attach
 	 * a note indicating if the peer should do the birthday paradox so it's
@@ -319,7 +616,8 @@ errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
 	 */
 
 	/* wait for the buddy's port */
-	CHECK_FAILED(wait_for_buddy_port_known(&(buddy->info)),ERROR_1);
+	CHECK_FAILED(wait_for_buddy_port_known(list,&(peer->info),
+		&(buddy->info)),ERROR_1);
 	/* fill in the message */
 	msg.ext_port = buddy->info.port_alloc.ext_port;
 	msg.bday = ( ( (peer->info.port_alloc.method == COMM_PORT_ALLOC_RAND)
@@ -329,10 +627,36 @@ errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
 		   );
 
 	/* send the message */
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,COMM_MSG_BUDDY_PORT,
-		&msg,sizeof(msg)),ERROR_NETWORK_SEND);
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
+		COMM_MSG_BUDDY_PORT,&msg,sizeof(msg)),ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BUDDY_PORT\n");
 
+	/* enter next state */
+	CHECK_FAILED(helper_fsm_port_waiting(list,peer,buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
+errorcode helper_fsm_port_waiting(connlist_t *list, connlist_item_t *peer,
+				  connlist_item_t *buddy) {
+
+	/* declare variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+
+	/* do function */
+	peer->state = HELPER_STATE_PORT_WAITING;
+
+	/* the peer asked for it, maybe after it was already sent */
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_WAITING_FOR_BUDDY_PORT,NULL,0,ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_FOR_BUDDY_PORT\n");
+
 	/* enter next state - it depends on port allocation method */
 	if (peer->info.port_alloc.method==COMM_PORT_ALLOC_RAND) {
 		/* this connections peer is random */
@@ -366,7 +690,7 @@ errorcode helper_fsm_start_direct_conn(connlist_t *list, connlist_item_t *peer,
 
 	/* declare local variables */
 	comm_msg_buddy_syn_seq_t buddy_syn_msg;
-	comm_msg_peer_syn_seq_t peer_syn_msg;
+	int i;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
@@ -374,26 +698,60 @@ errorcode helper_fsm_start_direct_conn(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
+	peer->state = HELPER_STATE_DIRECT_CONN;
 
-	/* get message from peer with buddy seq num */
-	CHECK_FAILED(readMsg(peer->info.socks.peer,COMM_MSG_BUDDY_SYN_SEQ,
-		&buddy_syn_msg,sizeof(buddy_syn_msg)),ERROR_NETWORK_READ);
+	/* get message from peer with buddy seq nums (one per raced port) */
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_BUDDY_SYN_SEQ,&buddy_syn_msg,sizeof(buddy_syn_msg),
+		ADMIT_IDLE_TIMEOUT),ERROR_NETWORK_READ);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received BUDDY_SYN_SEQ\n");
-	DEBUG(DBG_VERBOSE,"VERBOSE:sequence number is %u\n",
-		DBG_SEQ_NUM(buddy_syn_msg.seq_num));
-
-	/* fill in the information about this syn sequence number */
-	peer->info.buddy_syn.seq_num     = buddy_syn_msg.seq_num;
+	if ( (buddy_syn_msg.count < 1) ||
+	     (buddy_syn_msg.count > MAX_RACE_WIDTH) )
+		return ERROR_OUT_OF_BOUNDS;
+	for(i=0;i<buddy_syn_msg.count;i++)
+		DEBUG(DBG_VERBOSE,"VERBOSE:sequence number %d is %u\n",i,
+			DBG_SEQ_NUM(buddy_syn_msg.seq_num[i]));
+
+	/* fill in the information about these syn sequence numbers */
+	peer->info.buddy_syn.count = buddy_syn_msg.count;
+	memcpy(peer->info.buddy_syn.seq_num,buddy_syn_msg.seq_num,
+		sizeof(peer->info.buddy_syn.seq_num));
 	peer->info.buddy_syn.seq_num_set = FLAG_SET;
+	CHECK_FAILED(connlist_notify(list),ERROR_2);
 
-	/* make payload to send in next message. first wait for the seq num
-	 * and then fill it in the payload */
-	CHECK_FAILED(wait_for_buddy_syn_seq_num(&(buddy->info)),ERROR_1);
-	peer_syn_msg.seq_num = buddy->info.buddy_syn.seq_num;
+	/* enter next state */
+	CHECK_FAILED(helper_fsm_peer_syn_seq(list,peer,buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
+errorcode helper_fsm_peer_syn_seq(connlist_t *list, connlist_item_t *peer,
+				  connlist_item_t *buddy) {
+
+	/* declare local variables */
+	comm_msg_peer_syn_seq_t peer_syn_msg;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+
+	/* do function */
+	peer->state = HELPER_STATE_PEER_SYN_SEQ;
+
+	/* make payload to send in next message. first wait for the seq nums
+	 * and then fill them in the payload */
+	CHECK_FAILED(wait_for_buddy_syn_seq_num(list,&(peer->info),
+		&(buddy->info)),ERROR_1);
+	peer_syn_msg.count = buddy->info.buddy_syn.count;
+	memcpy(peer_syn_msg.seq_num,buddy->info.buddy_syn.seq_num,
+		sizeof(peer_syn_msg.seq_num));
 
 	/* send the message */
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,COMM_MSG_PEER_SYN_SEQ,
-		&peer_syn_msg,sizeof(peer_syn_msg)),ERROR_NETWORK_SEND);
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
+		COMM_MSG_PEER_SYN_SEQ,&peer_syn_msg,sizeof(peer_syn_msg)),
+		ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent PEER_SYN_SEQ\n");
 
 	/* enter next state */
@@ -403,11 +761,75 @@ errorcode helper_fsm_start_direct_conn(connlist_t *list, connlist_item_t *peer,
 	return SUCCESS;
 }
 
+errorcode helper_fsm_relay(connlist_t *list, connlist_item_t *peer,
+				connlist_item_t *buddy) {
+
+	/* declare local variables */
+	flag_t leader;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+	CHECK_NOT_NULL(list->relay,ERROR_ARG_1);
+
+	/* do function */
+	peer->state = HELPER_STATE_RELAY;
+
+	/* both peers' threads get here.  the one with the lower observed
+	 * address hands both connections to the relay, once the other one
+	 * says it is ready.  the other just waits to hear it was done. */
+	leader = ( (peer->obs_data.ip < buddy->obs_data.ip) ||
+		   ( (peer->obs_data.ip == buddy->obs_data.ip) &&
+		     (peer->obs_data.port < buddy->obs_data.port) ) ) ?
+		 FLAG_SET : FLAG_UNSET;
+
+	if (leader == FLAG_UNSET) {
+		/* a resumed session may already have been answered */
+		if (peer->info.relay == FLAG_UNSET)
+			peer->info.relay = FLAG_SET;
+		CHECK_FAILED(connlist_notify(list),ERROR_3);
+		/* give the leader time to time out first */
+		CHECK_FAILED(connlist_wait_flag(list,&peer->info.relay,
+			FLAG_SUCCESS|FLAG_FAILED,
+			2*timeout_ms(TIMEOUT_BUDDY_STEP,&peer->info.rtt,
+			&buddy->info.rtt)),ERROR_TIMEOUT);
+	}
+	else {
+		if (FAILED(connlist_wait_flag(list,&buddy->info.relay,FLAG_SET,
+				timeout_ms(TIMEOUT_BUDDY_STEP,&peer->info.rtt,
+				&buddy->info.rtt)))) {
+			buddy->info.relay = FLAG_FAILED;
+			connlist_notify(list);
+			return ERROR_TIMEOUT;
+		}
+		if (FAILED(relay_add(list->relay,peer->info.socks.peer,
+				buddy->info.socks.peer))) {
+			buddy->info.relay = FLAG_FAILED;
+			connlist_notify(list);
+			return ERROR_1;
+		}
+		peer->info.relay  = FLAG_SUCCESS;
+		buddy->info.relay = FLAG_SUCCESS;
+		CHECK_FAILED(connlist_notify(list),ERROR_4);
+	}
+
+	if (peer->info.relay != FLAG_SUCCESS)
+		return ERROR_2;
+
+	/* the relay owns the connection now, so it must not be closed */
+	peer->info.socks.peer = SOCKET_UNKNOWN;
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:connection handed to the relay\n");
+
+	return SUCCESS;
+}
+
 errorcode helper_fsm_goodbye(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy) {
 
 	/* declare local variables */
 	comm_msg_goodbye_t goodbye;
+	int wait;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
@@ -415,10 +837,18 @@ errorcode helper_fsm_goodbye(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_2);
 
 	/* do function */
+	peer->state = HELPER_STATE_GOODBYE;
+
+	/* the peer only says goodbye once its direct connection is made or
+	 * given up on, which may take as long as the wait is allowed to */
+	wait = timeout_ceiling_sec(TIMEOUT_DIRECT_CONN);
+	CHECK_NOT_NEG(wait,ERROR_1);
+	wait += ADMIT_GOODBYE_MARGIN;
 
 	/* receive the message */
-	CHECK_FAILED(readMsg(peer->info.socks.peer,COMM_MSG_GOODBYE, &goodbye,
-		sizeof(goodbye)),ERROR_NETWORK_READ);
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_GOODBYE,&goodbye,sizeof(goodbye),wait),
+		ERROR_NETWORK_READ);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received GOODBYE\n");
 
@@ -440,19 +870,22 @@ errorcode helper_fsm_start_peer_bday(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
+	peer->state = HELPER_STATE_PEER_BDAY;
 
 	/* receive message indicating that the flood happened */
-	CHECK_FAILED(readMsg(peer->info.socks.peer,COMM_MSG_SYN_FLOODED,
-		&msg,sizeof(msg)),ERROR_NETWORK_READ);
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_SYN_FLOODED,&msg,sizeof(msg),ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received SYN_FLOODED\n");
 
 	/* set the value for the sequence number in the peer's info */
 	peer->info.bday.seq_num = msg.seq_num;
 	peer->info.bday.seq_num_set = FLAG_SET;
+	CHECK_FAILED(connlist_notify(list),ERROR_2);
 
 	/* send message indicating the buddy is about to commence sending the
 	 * SYN/ACKs */
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
 		COMM_MSG_BUDDY_SYN_ACK_FLOODED,NULL,0),ERROR_NETWORK_SEND);
 
 	/* enter next state */
@@ -475,10 +908,13 @@ errorcode helper_fsm_end_peer_bday(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
+	peer->state = HELPER_STATE_END_PEER_BDAY;
 
-	if (FAILED(readMsg(peer->info.socks.peer,COMM_MSG_BDAY_SUCCESS_PORT,
-		&receive_msg,sizeof(receive_msg)))) {
+	if (FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_BDAY_SUCCESS_PORT,&receive_msg,sizeof(receive_msg),
+		ADMIT_IDLE_TIMEOUT))) {
 		peer->info.bday.status = FLAG_FAILED;
+		connlist_notify(list);
 		return ERROR_NETWORK_READ;
 	}
 
@@ -491,6 +927,7 @@ errorcode helper_fsm_end_peer_bday(connlist_t *list, connlist_item_t *peer,
 	 * somewhere else in the code and look at it */
 	peer->info.port_alloc.ext_port     = receive_msg.port;
 	peer->info.port_alloc.ext_port_set = FLAG_SET;
+	CHECK_FAILED(connlist_notify(list),ERROR_1);
 
 	/* send a message with the buddy's port, to go back to the buddy port
 	 * state.  there is no need to wait for the port value to be set, it
@@ -498,8 +935,9 @@ errorcode helper_fsm_end_peer_bday(connlist_t *list, connlist_item_t *peer,
 	send_msg.ext_port = buddy->info.port_alloc.ext_port;
 	send_msg.bday     =  COMM_BDAY_NOT_NEEDED;
 
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,COMM_MSG_BUDDY_PORT,
-		&send_msg,sizeof(send_msg)),ERROR_NETWORK_SEND);
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
+		COMM_MSG_BUDDY_PORT,&send_msg,sizeof(send_msg)),
+		ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BUDDY_PORT...again\n");
 
 	/* go to the start direct conncetion state now that all ports are
@@ -523,35 +961,58 @@ errorcode helper_fsm_start_buddy_bday(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
-
-	CHECK_FAILED(readMsg(peer->info.socks.peer,
-		COMM_MSG_WAITING_TO_SYN_ACK_FLOOD,NULL,0),ERROR_NETWORK_READ);
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_TO_SYN_ACK_FLOOD\n");
+	peer->state = HELPER_STATE_BUDDY_BDAY;
 
 	/* as soon as the bday.seq_num_set flag is set, it is time for this
 	 * peer to flood synacks */
-	CHECK_FAILED(wait_for_buddy_syn_flood(&buddy->info),ERROR_1);
+	CHECK_FAILED(wait_for_buddy_syn_flood(list,&peer->info,&buddy->info),
+		ERROR_1);
 
 	/* make the message... */
 	msg.seq_num = buddy->info.bday.seq_num;
 	/* ...and sent it */
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
 		COMM_MSG_SYN_ACK_FLOOD_SEQ_NUM,&msg,sizeof(msg)),
 		ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent SYN_ACK_FLOOD_SEQ_NUM\n");
 
 	/* enter the next state */
-	CHECK_FAILED(helper_fsm_end_buddy_bday(list,peer,buddy),
+	CHECK_FAILED(helper_fsm_buddy_bday_waiting(list,peer,buddy),
 		ERROR_CALLED_FUNCTION);
 
 	return ERROR_1;
 }
 
+errorcode helper_fsm_buddy_bday_waiting(connlist_t *list,
+				connlist_item_t *peer, connlist_item_t *buddy) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+
+	/* do function */
+	peer->state = HELPER_STATE_BUDDY_BDAY_WAITING;
+
+	/* the peer asked for it, maybe after it was already sent */
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_WAITING_TO_SYN_ACK_FLOOD,NULL,0,ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:received WAITING_TO_SYN_ACK_FLOOD\n");
+
+	/* enter the next state */
+	CHECK_FAILED(helper_fsm_end_buddy_bday(list,peer,buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
 errorcode helper_fsm_end_buddy_bday(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy) {
 
 	/* declare local variables */
-	comm_msg_buddy_port_t msg;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
@@ -559,14 +1020,38 @@ errorcode helper_fsm_end_buddy_bday(connlist_t *list, connlist_item_t *peer,
 	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
 
 	/* do function */
+	peer->state = HELPER_STATE_END_BUDDY_BDAY;
 
 	/* receive the message indicating the synack flood was done */
-	CHECK_FAILED(readMsg(peer->info.socks.peer,COMM_MSG_SYN_ACK_FLOOD_DONE,
-		NULL,0),ERROR_NETWORK_READ);
+	CHECK_FAILED(helper_read_msg(list,peer->info.socks.peer,
+		COMM_MSG_SYN_ACK_FLOOD_DONE,NULL,0,ADMIT_IDLE_TIMEOUT),
+		ERROR_NETWORK_READ);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received SYN_ACK_FLOOD_DONE\n");
 
+	/* enter the next state */
+	CHECK_FAILED(helper_fsm_buddy_bday_port(list,peer,buddy),
+		ERROR_CALLED_FUNCTION);
+
+	return SUCCESS;
+}
+
+errorcode helper_fsm_buddy_bday_port(connlist_t *list, connlist_item_t *peer,
+				connlist_item_t *buddy) {
+
+	/* declare local variables */
+	comm_msg_buddy_port_t msg;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(peer,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(buddy,ERROR_NULL_ARG_3);
+
+	/* do function */
+	peer->state = HELPER_STATE_BUDDY_BDAY_PORT;
+
 	/* wait for the buddy to set the external port */
-	CHECK_FAILED(wait_for_buddy_bday_port(&(buddy->info)),ERROR_1);
+	CHECK_FAILED(wait_for_buddy_bday_port(list,&(peer->info),
+		&(buddy->info)),ERROR_1);
 
 	/* now, resend the COMM_MSG_BUDDY_PORT message, but this time mark
 	 * the bday flag as unneeded
@@ -575,8 +1060,8 @@ errorcode helper_fsm_end_buddy_bday(connlist_t *list, connlist_item_t *peer,
 	msg.bday     = COMM_BDAY_NOT_NEEDED;
 
 	/* now send the message */
-	CHECK_FAILED(sendMsg(peer->info.socks.peer,COMM_MSG_BUDDY_PORT,
-		&msg,sizeof(msg)),ERROR_NETWORK_SEND);
+	CHECK_FAILED(helper_send_msg(list,peer->info.socks.peer,
+		COMM_MSG_BUDDY_PORT,&msg,sizeof(msg)),ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BUDDY_PORT...again\n");
 
 	/* go to the start direct conncetion state now that all ports are
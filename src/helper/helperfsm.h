@@ -34,13 +34,19 @@
 #include "helperdef.h"
 
 /**
- * @brief entry point for helper fsm
+ * @brief entry point for helper fsm.  nothing is kept for the connection
+ *        until it sent a sane HELLO.  the socket is closed on return, unless
+ *        the session was forwarded to the node of the cluster owning its
+ *        pair (see cluster.h).  a session that already has an item was
+ *        handed over by another helper process and is resumed in its item's
+ *        state (see helper_fsm_resume).
  *
  * @param list pointer to the list of connection data
- * @param item pointer to the connection information item
- * @return SUCCESS, errorcode on failure
+ * @param session the session, with the observed connection data and the
+ *        socket descriptor for the connection
+ * @return SUCCESS (also when no HELLO came), errorcode on failure
  */
-errorcode helper_fsm_start(connlist_t *list, connlist_item_t *item);
+errorcode helper_fsm_start(connlist_t *list, connlist_session_t *session);
 
 #endif /* __HELPERFSM_H__ */
 
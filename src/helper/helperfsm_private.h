@@ -30,10 +30,64 @@
  *
  * @param list a pointer to the connection info list
  * @param item a pointer to the connection info item for this connection
+ * @param hello the hello message, already read and checked
  *
  * @return SUCCESS, errorcode on failure
  */
-errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item);
+errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item,
+			   comm_msg_hello_t *hello);
+
+/**
+ * @brief handles a connection from another node of the cluster, either a
+ *        session forwarded here or a report of a second connection made to
+ *        that node.  the socket is closed on return.
+ *
+ * @param list a pointer to the connection info list
+ * @param session the session for the connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_cluster(connlist_t *list, connlist_session_t *session);
+
+/**
+ * @brief keeps an item for a session that sent a sane HELLO and runs the
+ *        session.  the socket is closed on return.
+ *
+ * @param list a pointer to the connection info list
+ * @param session the session, with the peer's observed connection data
+ * @param hello the peer's HELLO
+ * @param forwarded FLAG_SET if the session was forwarded by another node of
+ *        the cluster, so the socket is not the peer's own connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_begin(connlist_t *list, connlist_session_t *session,
+			   comm_msg_hello_t *hello, flag_t forwarded);
+
+/**
+ * @brief resumes a session that was handed over by another helper process
+ *        in the state its item was left in, then cleans up like
+ *        helper_fsm_start
+ *
+ * @param list a pointer to the connection info list
+ * @param item a pointer to the item for this connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_resume(connlist_t *list, connlist_item_t *item);
+
+/**
+ * @brief closes the peer connection and lets go of the item once the
+ *        session is over
+ *
+ * @param list a pointer to the connection info list
+ * @param item a pointer to the item for this connection
+ * @param ret what the session's states returned
+ *
+ * @return SUCCESS, errorcode if the session or the clean up failed
+ */
+errorcode helper_fsm_finish(connlist_t *list, connlist_item_t *item,
+			    errorcode ret);
 
 /**
  * @brief handles the second connection state
@@ -46,7 +100,24 @@ errorcode helper_fsm_hello(connlist_t *list, connlist_item_t *item);
 errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item);
 
 /**
- * @brief handles sending a message with buddy info to peers
+ * @brief takes the port allocation method a peer remembered from an earlier
+ *        connection in place of the second connection state
+ *
+ * @param list a pointer to the connection list
+ * @param item a pointer to the item for this connection
+ * @param port_alloc the remembered port allocation method
+ * @param stride the remembered distance to the peer's next external port
+ *        (see comm_msg_hello_t)
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_cached_port_pred(connlist_t *list, connlist_item_t *item,
+				      flag_t port_alloc, unsigned char stride);
+
+/**
+ * @brief handles sending a message with buddy info to peers.  the message
+ *        is pushed as soon as the buddy's info is known, before the peer's
+ *        request for it is read.
  *
  * @param list a pointer to the connection list
  * @param item a pointer to the item for this connection
@@ -55,6 +126,19 @@ errorcode helper_fsm_conn2(connlist_t *list, connlist_item_t *item);
  */
 errorcode helper_fsm_buddy_alloc(connlist_t *list, connlist_item_t *item);
 
+/**
+ * @brief waits for the peer to ask for the buddy's allocation method, which
+ *        was already sent, then moves on to the buddy port or the relay
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the item for this connection
+ * @param buddy a pointer to the item for the buddy connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_alloc_waiting(connlist_t *list, connlist_item_t *peer,
+				   connlist_item_t *buddy);
+
 /**
  * @brief handles sending a message with buddy port to peers, or determing
  * port through birthday paradox
@@ -68,6 +152,19 @@ errorcode helper_fsm_buddy_alloc(connlist_t *list, connlist_item_t *item);
 errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy);
 
+/**
+ * @brief waits for the peer to ask for the buddy's port, which was already
+ *        sent, then starts the connection
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the item for this connection
+ * @param buddy a pointer to the item for the buddy connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_port_waiting(connlist_t *list, connlist_item_t *peer,
+				  connlist_item_t *buddy);
+
 /**
  * @brief handles starting direct connection
  *
@@ -80,6 +177,18 @@ errorcode helper_fsm_buddy_port(connlist_t *list, connlist_item_t *peer,
 errorcode helper_fsm_start_direct_conn(connlist_t *list, connlist_item_t *peer,
 					connlist_item_t *buddy);
 
+/**
+ * @brief sends the peer the buddy's SYN sequence numbers once they are known
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the item for this connection
+ * @param buddy a pointer to the item for the buddy connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_peer_syn_seq(connlist_t *list, connlist_item_t *peer,
+				  connlist_item_t *buddy);
+
 /**
  * @brief final state to recieve the peer's goodbye message
  *
@@ -92,6 +201,22 @@ errorcode helper_fsm_start_direct_conn(connlist_t *list, connlist_item_t *peer,
 errorcode helper_fsm_goodbye(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy);
 
+/**
+ * @brief final state when neither peer can make a direct connection, hands
+ *        the two peers' connections to the relay
+ *
+ * Both peers' threads enter this state.  Only one of them adds the relayed
+ * session, and on success both give up ownership of their peer socket.
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the peer item for this connection
+ * @param buddy a pointer to the buddy item for this connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_relay(connlist_t *list, connlist_item_t *peer,
+				connlist_item_t *buddy);
+
 /**
  * @brief optional state that handles starting birthday paradox when the peer
  *        is the random one.
@@ -132,6 +257,19 @@ errorcode helper_fsm_end_peer_bday(connlist_t *list, connlist_item_t *peer,
 errorcode helper_fsm_start_buddy_bday(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy);
 
+/**
+ * @brief waits for the peer to ask for the SYN flood sequence number, which
+ *        was already sent
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the item for this connection
+ * @param buddy a pointer to the item for the buddy connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_buddy_bday_waiting(connlist_t *list,
+				connlist_item_t *peer, connlist_item_t *buddy);
+
 /**
  * @brief optional state that handles ending birthday paradox when the buddy is
  *        the random one.
@@ -145,5 +283,18 @@ errorcode helper_fsm_start_buddy_bday(connlist_t *list, connlist_item_t *peer,
 errorcode helper_fsm_end_buddy_bday(connlist_t *list, connlist_item_t *peer,
 				connlist_item_t *buddy);
 
+/**
+ * @brief sends the peer the buddy's port found by the birthday paradox once
+ *        it is known
+ *
+ * @param list a pointer to the connection list
+ * @param peer a pointer to the item for this connection
+ * @param buddy a pointer to the item for the buddy connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode helper_fsm_buddy_bday_port(connlist_t *list, connlist_item_t *peer,
+				connlist_item_t *buddy);
+
 #endif /* __HELPERFSM_PRIVATE_H__ */
 
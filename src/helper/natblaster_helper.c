@@ -30,42 +30,146 @@
 #include "berkeleyapi.h"
 #include "nethelp.h"
 #include "helpercon.h"
+#include "admit.h"
+#include "handover.h"
+#include "trace.h"
+#include "cluster.h"
+#include "timeout.h"
+#include <unistd.h>
+#include <poll.h>
 
-int natblaster_server(port_t listen_port) {
+int natblaster_server(port_t listen_port, helper_opts_t *opts) {
 
 	sock_t listen_sd;
+	sock_t control_sd;
 	connlist_t list;
+	relay_t relay;
+	admit_t admit;
+	trace_t trace;
+	cluster_t cluster;
 	observed_data_t data;
 	sock_t this_sd;
 	struct sockaddr_in peer_con;
 	int peer_con_size;
+	struct pollfd fds[2];
 
 	/* The return type is "int" and the return codes are "errorcodes".  Even
 	 * though there aren't strictly the same type, I know they are, and using
 	 * the errorcodes makes the code more readable and debug-able. */
 
-	CHECK_FAILED(bindSocket(listen_port,&listen_sd),ERROR_BIND);
-
 	/* initalize the list for connection information */
 	CHECK_FAILED(connlist_init(&list),ERROR_INIT);
 
-	if (listen(listen_sd,5)!=0)
-		return ERROR_TCP_LISTEN;
+	/* start the relay for peers that can't connect directly */
+	if ( (opts != NULL) && (opts->relay == FLAG_SET) ) {
+		CHECK_FAILED(relay_init(&relay,opts->relay_rate),ERROR_INIT);
+		list.relay = &relay;
+	}
+
+	/* the limits of every wait of the protocol */
+	if ( (opts != NULL) && (opts->timeouts != NULL) )
+		CHECK_FAILED(timeout_config_load(opts->timeouts),ERROR_INIT);
+
+	/* limit who gets a session */
+	if (opts != NULL) {
+		CHECK_FAILED(admit_init(&admit,opts->max_sessions,
+			opts->source_rate),ERROR_INIT);
+	}
+	else {
+		CHECK_FAILED(admit_init(&admit,HELPER_DEFAULT_MAX_SESSIONS,
+			HELPER_DEFAULT_SOURCE_RATE),ERROR_INIT);
+	}
+	list.admit = &admit;
+
+	/* share the pairs with the other helpers of a cluster */
+	if ( (opts != NULL) && (opts->cluster != NULL) ) {
+		CHECK_FAILED(cluster_init(&cluster,opts->cluster,
+			opts->cluster_self),ERROR_INIT);
+		list.cluster = &cluster;
+	}
+
+	/* record the sessions for trace_replay */
+	if ( (opts != NULL) && (opts->trace != NULL) ) {
+		CHECK_FAILED(trace_open(&trace,opts->trace),ERROR_INIT);
+		list.trace = &trace;
+	}
+
+	/* a helper taking over gets the listening socket, already listening,
+	 * along with the sessions */
+	if ( (opts != NULL) && (opts->takeover != NULL) ) {
+		CHECK_FAILED(handover_take(&list,opts->takeover,&listen_sd),
+			ERROR_INIT);
+	}
+	else {
+		CHECK_FAILED(bindSocket(listen_port,&listen_sd),ERROR_BIND);
+		if (listen(listen_sd,5)!=0)
+			return ERROR_TCP_LISTEN;
+	}
+
+	/* let a later helper take over from this one */
+	control_sd = SOCKET_UNKNOWN;
+	if ( (opts != NULL) && (opts->control != NULL) ) {
+		CHECK_FAILED(handover_listen(opts->control,&control_sd),
+			ERROR_INIT);
+	}
 
 	peer_con_size = sizeof(peer_con);
-	/* loop forever */
+	/* loop until taken over */
 	while (1) {
+		if (control_sd != SOCKET_UNKNOWN) {
+			fds[0].fd     = listen_sd;
+			fds[0].events = POLLIN;
+			fds[1].fd     = control_sd;
+			fds[1].events = POLLIN;
+			if (poll(fds,2,-1) <= 0)
+				continue;
+			if ( (fds[1].revents & POLLIN) &&
+			     (handover_give(&list,listen_sd,control_sd) ==
+			      SUCCESS) )
+				break;
+			if (!(fds[0].revents & POLLIN))
+				continue;
+		}
 		this_sd = accept(listen_sd,(struct sockaddr*)&peer_con,
 				 &peer_con_size);
+		if (this_sd < 0)
+			continue;
 		data.ip   = peer_con.sin_addr.s_addr;
 		data.port = peer_con.sin_port;
 		DEBUG(DBG_NETWORK,"NETWORK:recieved a connection!\n");
+		trace_event(list.trace,this_sd,TRACE_EVENT_ACCEPT,0,&data,
+			sizeof(data));
+
+		/* another node of the cluster was let in by its own admission
+		 * already, so it is only counted.  any other connection is
+		 * turned away before anything is spent on it */
+		if (cluster_is_node(list.cluster,data.ip) == FLAG_SET)
+			admit_resume(&admit);
+		else if (admit_connection(&admit,data.ip) != FLAG_SUCCESS) {
+			helper_close(&list,this_sd);
+			continue;
+		}
+
 		DEBUG(DBG_LIST, "LIST:list size: %d\n",
 			connlist_count(&list));
-		CHECK_FAILED(create_new_handler(&list,&data,this_sd),ERROR_1);
+		/* a port prediction second connection is matched by its
+		 * address alone */
+		CHECK_FAILED(connlist_observe(&list,&data),ERROR_2);
+		if (FAILED(create_new_handler(&list,&data,this_sd))) {
+			/* out of threads, the helper itself carries on */
+			helper_close(&list,this_sd);
+			admit_release(&admit);
+		}
 
 	}
 
-	/* should never happen */
-	return ERROR_1;
+	/* the new helper accepts from now on.  the relayed sessions can not
+	 * be handed over, so they are finished here */
+	close(listen_sd);
+	close(control_sd);
+	CHECK_FAILED(handover_drain(&list),ERROR_1);
+	if (list.trace != NULL)
+		CHECK_FAILED(trace_close(list.trace),ERROR_2);
+
+	return SUCCESS;
 }
@@ -30,13 +30,19 @@
 /**
  * @brief the single function to start a helper application
  *
- * Does not return on success!
+ * Does not return on success, unless a new helper process took over through
+ * the control socket (see handover.h).
  *
- * @param listen_port the port to act as a thrid party server on
+ * @param listen_port the port to act as a thrid party server on (unused
+ *        when taking over from a running helper)
+ * @param opts optional settings for the helper (see helper_opts_t), if NULL
+ *        the defaults are used (no relaying, no trace, no cluster,
+ *        HELPER_DEFAULT_MAX_SESSIONS and HELPER_DEFAULT_SOURCE_RATE)
  *
- * @return Never returns on success, errorcode on failure.
+ * @return Never returns on success, SUCCESS once the helper was taken over
+ *         and its relayed sessions ended, errorcode on failure.
  */
-int natblaster_server(port_t listen_port);
+int natblaster_server(port_t listen_port, helper_opts_t *opts);
 
 #endif /* __NATBLASTER_HELPER_H__ */
 
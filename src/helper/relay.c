@@ -0,0 +1,421 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file relay.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief relays the traffic of two peers that could not connect directly
+ */
+
+/* splice() is a linux extension */
+#define _GNU_SOURCE
+
+#include "relay.h"
+#include "relay_private.h"
+#include "berkeleyapi.h"
+#include "debug.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+/** @brief the flags used for every splice() call */
+#define RELAY_SPLICE_FLAGS (SPLICE_F_MOVE | SPLICE_F_NONBLOCK)
+
+errorcode relay_init(relay_t *relay, unsigned long rate) {
+
+	/* declare local variables */
+	pthread_t tid;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+
+	/* do function */
+	relay->rate    = rate;
+	relay->next_id = 0;
+
+	if ( (relay->epfd = epoll_create(RELAY_MAX_EVENTS)) < 0)
+		return ERROR_INIT;
+	CHECK_FAILED(list_init(&relay->sessions),ERROR_INIT);
+	if (pthread_mutex_init(&relay->mutex,NULL)!=0)
+		return ERROR_INIT;
+
+	/* start the event loop thread... */
+	if (pthread_create(&tid,NULL,run_relay_loop,relay)!=0)
+		return ERROR_PTHREAD_CREATE_FAILED;
+	/* ...and detach it */
+	if (pthread_detach(tid)!=0)
+		return ERROR_PTHREAD_DETACH_FAILED;
+
+	DEBUG(DBG_RELAY,"RELAY:relay started, %lu bytes/sec per session%s\n",
+		rate, (rate==0 ? " (unlimited)" : ""));
+
+	return SUCCESS;
+}
+
+errorcode relay_add(relay_t *relay, sock_t sd_a, sock_t sd_b) {
+
+	/* declare local variables */
+	relay_session_t *session;
+	struct epoll_event ev;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd_a,ERROR_NEG_ARG_2);
+	CHECK_NOT_NEG(sd_b,ERROR_NEG_ARG_3);
+
+	/* do function */
+	if ( (session=(relay_session_t*)malloc(sizeof(relay_session_t)))
+			== NULL)
+		return ERROR_MALLOC_FAILED;
+	memset(session,0,sizeof(relay_session_t));
+
+	session->sd[0] = sd_a;
+	session->sd[1] = sd_b;
+	for(i=0;i<2;i++) {
+		if (pipe(session->pipe[i])<0) {
+			if (i==1) {
+				close(session->pipe[0][0]);
+				close(session->pipe[0][1]);
+			}
+			safe_free(session);
+			return ERROR_1;
+		}
+		/* the event loop must never block on a socket */
+		fcntl(session->sd[i],F_SETFL,
+			fcntl(session->sd[i],F_GETFL,0)|O_NONBLOCK);
+		session->eof[i]         = FLAG_UNSET;
+		session->shut[i]        = FLAG_UNSET;
+		session->end[i].session = session;
+		session->end[i].side    = i;
+	}
+	session->tokens = relay->rate;
+	session->start  = time(NULL);
+	gettimeofday(&session->refill,NULL);
+
+	if (pthread_mutex_lock(&relay->mutex)!=0) {
+		relay_discard(session,0);
+		return ERROR_MUTEX_LOCK_1;
+	}
+	session->id = relay->next_id++;
+	if (FAILED(list_add(&relay->sessions,session))) {
+		pthread_mutex_unlock(&relay->mutex);
+		relay_discard(session,0);
+		return ERROR_LIST_ADD;
+	}
+
+	/* only now let the event loop see the session */
+	for(i=0;i<2;i++) {
+		ev.events   = EPOLLIN;
+		ev.data.ptr = &session->end[i];
+		if (epoll_ctl(relay->epfd,EPOLL_CTL_ADD,session->sd[i],&ev)<0){
+			list_remove(&relay->sessions,relay_session_match,
+				session);
+			pthread_mutex_unlock(&relay->mutex);
+			if (i==1)
+				epoll_ctl(relay->epfd,EPOLL_CTL_DEL,
+					session->sd[0],&ev);
+			relay_discard(session,0);
+			return ERROR_2;
+		}
+	}
+	if (pthread_mutex_unlock(&relay->mutex)!=0)
+		return ERROR_MUTEX_UNLOCK_1;
+
+	DEBUG(DBG_RELAY,"RELAY:session %lu started\n",session->id);
+
+	return SUCCESS;
+}
+
+int relay_count(relay_t *relay) {
+
+	/* declare local variables */
+	int count;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,-2);
+
+	/* do function */
+	if (pthread_mutex_lock(&relay->mutex)!=0)
+		return -3;
+	count = list_count(&relay->sessions);
+	if (pthread_mutex_unlock(&relay->mutex)!=0)
+		return -4;
+
+	return count;
+}
+
+void *run_relay_loop(void *arg) {
+
+	/* declare local variables */
+	relay_t *relay;
+	relay_session_t *session;
+	relay_end_t *end;
+	struct epoll_event events[RELAY_MAX_EVENTS];
+	struct timeval now;
+	time_t last_report;
+	unsigned long long total;
+	int i, n, report;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(arg,(void*)ERROR_NULL_ARG_1);
+
+	/* do function */
+	relay = (relay_t*)arg;
+	last_report = time(NULL);
+
+	while (1) {
+		n = epoll_wait(relay->epfd,events,RELAY_MAX_EVENTS,
+			RELAY_TICK_MS);
+		if ( (n < 0) && (errno != EINTR) ) {
+			DEBUG(DBG_RELAY,"RELAY:epoll_wait failed\n");
+			return (void*)ERROR_1;
+		}
+
+		/* move the bytes for every side that is ready.  a session is
+		 * only marked dead here, since a later event in this pass may
+		 * still point at it */
+		for(i=0;i<n;i++) {
+			end = (relay_end_t*)events[i].data.ptr;
+			session = end->session;
+			if (session->dead == FLAG_SET)
+				continue;
+			if (FAILED(relay_pump(relay,session,0)) ||
+			    FAILED(relay_pump(relay,session,1)) ||
+			    (events[i].events & (EPOLLHUP|EPOLLERR)) ||
+			    ( (session->shut[0] == FLAG_SET) &&
+			      (session->shut[1] == FLAG_SET) )) {
+				session->dead = FLAG_SET;
+				continue;
+			}
+			relay_arm(relay,session);
+		}
+
+		/* once a tick refill the bandwidth, report throughput and
+		 * clean up dead sessions */
+		gettimeofday(&now,NULL);
+		report = (now.tv_sec - last_report >= RELAY_REPORT_INTERVAL);
+		if (report)
+			last_report = now.tv_sec;
+
+		if (pthread_mutex_lock(&relay->mutex)!=0)
+			continue;
+		for(i=0;i<list_count(&relay->sessions);i++) {
+			if (FAILED(list_get(&relay->sessions,i,
+					(void**)&session)))
+				break;
+			if (session->dead == FLAG_SET) {
+				relay_close(relay,session);
+				/* the list shifted, look at this index again */
+				i--;
+				continue;
+			}
+			if (relay->rate != 0) {
+				relay_refill(relay,session,&now);
+				relay_arm(relay,session);
+			}
+			if (report) {
+				total = session->bytes[0] + session->bytes[1];
+				DEBUG(DBG_RELAY,"RELAY:session %lu: %llu/%llu "
+					"bytes, %llu bytes/sec\n", session->id,
+					session->bytes[0], session->bytes[1],
+					(total - session->reported) /
+					RELAY_REPORT_INTERVAL);
+				session->reported = total;
+			}
+		}
+		pthread_mutex_unlock(&relay->mutex);
+	}
+
+	/* should never happen */
+	return (void*)ERROR_2;
+}
+
+errorcode relay_pump(relay_t *relay, relay_session_t *session, int side) {
+
+	/* declare local variables */
+	int other;
+	long room;
+	ssize_t n;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	other = 1 - side;
+
+	/* fill this side's pipe from its socket, as far as the pipe and the
+	 * bandwidth limit allow */
+	if (session->eof[side] == FLAG_UNSET) {
+		room = RELAY_PIPE_SIZE - session->pending[side];
+		if ( (relay->rate != 0) && (room > session->tokens) )
+			room = session->tokens;
+		if (room > 0) {
+			n = splice(session->sd[side],NULL,
+				session->pipe[side][1],NULL,room,
+				RELAY_SPLICE_FLAGS);
+			if (n == 0)
+				session->eof[side] = FLAG_SET;
+			else if (n > 0) {
+				session->pending[side] += n;
+				session->bytes[side]   += n;
+				session->tokens        -= n;
+			}
+			else if (errno != EAGAIN)
+				return ERROR_NETWORK_READ;
+		}
+	}
+
+	/* drain the pipe into the other side's socket */
+	if (session->pending[side] > 0) {
+		n = splice(session->pipe[side][0],NULL,session->sd[other],NULL,
+			session->pending[side],RELAY_SPLICE_FLAGS);
+		if (n > 0)
+			session->pending[side] -= n;
+		else if ( (n < 0) && (errno != EAGAIN) )
+			return ERROR_NETWORK_SEND;
+	}
+
+	/* once everything this side sent is through, pass its eof on */
+	if ( (session->eof[side] == FLAG_SET) &&
+	     (session->pending[side] == 0) &&
+	     (session->shut[side] == FLAG_UNSET) ) {
+		shutdown(session->sd[other],SHUT_WR);
+		session->shut[side] = FLAG_SET;
+	}
+
+	return SUCCESS;
+}
+
+errorcode relay_arm(relay_t *relay, relay_session_t *session) {
+
+	/* declare local variables */
+	struct epoll_event ev;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	for(i=0;i<2;i++) {
+		ev.events   = 0;
+		ev.data.ptr = &session->end[i];
+		/* read while there is room and bandwidth left... */
+		if ( (session->eof[i] == FLAG_UNSET) &&
+		     (session->pending[i] < RELAY_PIPE_SIZE) &&
+		     ( (relay->rate == 0) || (session->tokens > 0) ) )
+			ev.events |= EPOLLIN;
+		/* ...and write while the other side has bytes waiting */
+		if (session->pending[1-i] > 0)
+			ev.events |= EPOLLOUT;
+		if (epoll_ctl(relay->epfd,EPOLL_CTL_MOD,session->sd[i],&ev)<0)
+			return ERROR_1;
+	}
+
+	return SUCCESS;
+}
+
+errorcode relay_refill(relay_t *relay, relay_session_t *session,
+			struct timeval *now) {
+
+	/* declare local variables */
+	long long usec;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(now,ERROR_NULL_ARG_3);
+
+	/* do function */
+	usec = (long long)(now->tv_sec - session->refill.tv_sec) * 1000000 +
+		(now->tv_usec - session->refill.tv_usec);
+	if (usec <= 0)
+		return SUCCESS;
+
+	/* never bank more than one second worth of bytes */
+	session->tokens += (long)(relay->rate * usec / 1000000);
+	if (session->tokens > (long)relay->rate)
+		session->tokens = relay->rate;
+	session->refill = *now;
+
+	return SUCCESS;
+}
+
+errorcode relay_close(relay_t *relay, relay_session_t *session) {
+
+	/* declare local variables */
+	time_t secs;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(relay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	secs = time(NULL) - session->start;
+	DEBUG(DBG_RELAY,"RELAY:session %lu ended: %llu/%llu bytes in %lu "
+		"sec\n", session->id, session->bytes[0], session->bytes[1],
+		(unsigned long)secs);
+
+	list_remove(&relay->sessions,relay_session_match,session);
+	/* closing the sockets takes them out of the epoll set too */
+	relay_discard(session,1);
+
+	return SUCCESS;
+}
+
+errorcode relay_discard(relay_session_t *session, int close_socks) {
+
+	/* declare local variables */
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_1);
+
+	/* do function */
+	for(i=0;i<2;i++) {
+		if (close_socks)
+			close(session->sd[i]);
+		close(session->pipe[i][0]);
+		close(session->pipe[i][1]);
+	}
+	safe_free(session);
+
+	return SUCCESS;
+}
+
+int relay_session_match(void *this_item, void *find_item) {
+
+	/* declare variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(this_item,LIST_FATAL);
+	CHECK_NOT_NULL(find_item,LIST_FATAL);
+
+	/* just match pointers */
+	if (this_item == find_item)
+		return LIST_FOUND;
+
+	return LIST_NOT_FOUND;
+}
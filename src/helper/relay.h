@@ -0,0 +1,140 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file relay.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief relays the traffic of two peers that could not connect directly
+ *
+ * Both peers keep using their connection to the helper, and the helper
+ * forwards the bytes between them.  The bytes are moved with splice()
+ * through a pipe per direction so they never get copied into the helper's
+ * memory.  One event loop thread runs every relayed session.
+ */
+
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "helperdef.h"
+#include "list.h"
+#include <pthread.h>
+#include <sys/time.h>
+
+/** @brief structure for one end of a relayed session (used as the epoll
+ *  event data, so the event loop knows which socket woke it up) */
+struct relay_end {
+	/** @brief the session this end belongs to */
+	struct relay_session *session;
+	/** @brief which side of the session this end is (0 or 1) */
+	int side;
+} __attribute__((packed));
+
+/** @brief typedef for the relay_end structure */
+typedef struct relay_end relay_end_t;
+
+/** @brief structure for a single relayed session between two peers */
+struct relay_session {
+	/** @brief the two peers' helper connections */
+	sock_t sd[2];
+	/** @brief a pipe per direction.  pipe[i] holds the bytes read from
+	 *  sd[i] that still have to be written to the other side */
+	int pipe[2][2];
+	/** @brief the number of bytes in each pipe */
+	unsigned long pending[2];
+	/** @brief FLAG_SET once a side has closed its sending direction */
+	flag_t eof[2];
+	/** @brief FLAG_SET once the eof has been passed to the other side */
+	flag_t shut[2];
+	/** @brief the epoll data for each side */
+	relay_end_t end[2];
+	/** @brief the bytes that can still be forwarded before the next
+	 *  refill, when the bandwidth is limited */
+	long tokens;
+	/** @brief the time the tokens were last refilled */
+	struct timeval refill;
+	/** @brief the bytes forwarded from each side */
+	unsigned long long bytes[2];
+	/** @brief the bytes forwarded at the last throughput report */
+	unsigned long long reported;
+	/** @brief the time the session started */
+	time_t start;
+	/** @brief a number to tell sessions apart in debug output */
+	unsigned long id;
+	/** @brief FLAG_SET once the session should be closed */
+	flag_t dead;
+} __attribute__((packed));
+
+/** @brief typedef for the relay_session structure */
+typedef struct relay_session relay_session_t;
+
+/** @brief structure for the relay */
+struct relay {
+	/** @brief the epoll descriptor the event loop waits on */
+	int epfd;
+	/** @brief the most bytes per second a session may forward, 0 for no
+	 *  limit */
+	unsigned long rate;
+	/** @brief the running sessions */
+	list_t sessions;
+	/** @brief the mutex to protect the sessions list */
+	pthread_mutex_t mutex;
+	/** @brief the id to give the next session */
+	unsigned long next_id;
+} __attribute__((packed));
+
+/** @brief typedef for the relay structure */
+typedef struct relay relay_t;
+
+/**
+ * @brief initializes the relay and starts its event loop thread
+ *
+ * @param relay pointer to an allocated relay_t
+ * @param rate the most bytes per second a single session may forward (both
+ *        directions together), 0 for no limit
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_init(relay_t *relay, unsigned long rate);
+
+/**
+ * @brief starts relaying the traffic between two connected sockets
+ *
+ * This function is thread safe.  The relay owns both sockets after this call
+ * returns successfully and closes them when the session ends.  On failure
+ * the sockets are left open.
+ *
+ * @param relay pointer to the relay
+ * @param sd_a one peer's helper connection
+ * @param sd_b the other peer's helper connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_add(relay_t *relay, sock_t sd_a, sock_t sd_b);
+
+/**
+ * @brief gets the number of sessions still being relayed
+ *
+ * This function is thread safe.
+ *
+ * @param relay pointer to the relay
+ *
+ * @return the number of sessions, negative on error
+ */
+int relay_count(relay_t *relay);
+
+#endif /* __RELAY_H__ */
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file relay_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief contains prototypes of functions private to the relay
+ */
+
+#ifndef __RELAY_PRIVATE_H__
+#define __RELAY_PRIVATE_H__
+
+#include "relay.h"
+
+/**
+ * @brief the entry point for the relay event loop thread
+ *
+ * @param arg a pointer to the relay_t.  Never freed.
+ *
+ * @return never returns on success, errorcode on failure
+ */
+void *run_relay_loop(void *arg);
+
+/**
+ * @brief moves as many bytes as it can from one side of a session to the
+ *        other
+ *
+ * @param relay pointer to the relay
+ * @param session pointer to the session
+ * @param side the side to read from (the other side is written to)
+ *
+ * @return SUCCESS, errorcode on failure (the session should be closed)
+ */
+errorcode relay_pump(relay_t *relay, relay_session_t *session, int side);
+
+/**
+ * @brief sets the events epoll reports for both sides of a session, based on
+ *        what each side is waiting for
+ *
+ * @param relay pointer to the relay
+ * @param session pointer to the session
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_arm(relay_t *relay, relay_session_t *session);
+
+/**
+ * @brief refills the bandwidth tokens of a session
+ *
+ * @param relay pointer to the relay
+ * @param session pointer to the session
+ * @param now the current time
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_refill(relay_t *relay, relay_session_t *session,
+			struct timeval *now);
+
+/**
+ * @brief ends a session, closing its sockets and pipes, and freeing it
+ *
+ * Must be called with the relay mutex held.
+ *
+ * @param relay pointer to the relay
+ * @param session pointer to the session
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_close(relay_t *relay, relay_session_t *session);
+
+/**
+ * @brief closes a session's pipes and frees it
+ *
+ * @param session pointer to the session (no longer in the sessions list)
+ * @param close_socks non-zero to close the session's sockets as well
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode relay_discard(relay_session_t *session, int close_socks);
+
+/**
+ * @brief the matching function for a session in the sessions list
+ *
+ * @param this_item the session in the list
+ * @param find_item the session to find
+ *
+ * @return LIST_FATAL, LIST_FOUND, LIST_NOT_FOUND as list.h requires
+ */
+int relay_session_match(void *this_item, void *find_item);
+
+#endif /* __RELAY_PRIVATE_H__ */
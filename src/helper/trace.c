@@ -0,0 +1,353 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file trace.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief records the helper's sessions to a trace file and reads them back
+ */
+
+#include "trace.h"
+#include "trace_private.h"
+#include "debug.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+errorcode trace_open(trace_t *trace, char *path) {
+
+	/* declare local variables */
+	trace_start_t start;
+	struct timeval wall;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(trace,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_2);
+
+	/* do function */
+	memset(trace,0,sizeof(trace_t));
+	/* a trace is only ever added to */
+	trace->fd = open(path,O_WRONLY|O_CREAT|O_APPEND,0644);
+	if (trace->fd < 0)
+		return ERROR_FILE_OPEN_APPEND;
+	if ( (trace->buf=(unsigned char*)malloc(TRACE_BUFFER_SIZE)) == NULL) {
+		close(trace->fd);
+		return ERROR_MALLOC_FAILED;
+	}
+	trace->stop = FLAG_UNSET;
+	trace->failed = FLAG_UNSET;
+	clock_gettime(CLOCK_MONOTONIC,&trace->start);
+	if (pthread_mutex_init(&trace->mutex,NULL)!=0) {
+		safe_free(trace->buf);
+		close(trace->fd);
+		return ERROR_INIT;
+	}
+	if (pthread_cond_init(&trace->work,NULL)!=0) {
+		pthread_mutex_destroy(&trace->mutex);
+		safe_free(trace->buf);
+		close(trace->fd);
+		return ERROR_INIT;
+	}
+
+	/* the run starts with the wall clock time it was recorded at */
+	gettimeofday(&wall,NULL);
+	start.magic = TRACE_MAGIC;
+	start.wall  = (unsigned long long)wall.tv_sec*1000000 + wall.tv_usec;
+	if (FAILED(trace_event(trace,SOCKET_UNKNOWN,TRACE_EVENT_START,0,
+			&start,sizeof(start)))) {
+		trace_release(trace);
+		return ERROR_1;
+	}
+
+	if (pthread_create(&trace->writer,NULL,run_trace_writer,trace)!=0) {
+		trace_release(trace);
+		return ERROR_PTHREAD_CREATE_FAILED;
+	}
+
+	DEBUG(DBG_TRACE,"TRACE:recording sessions to %s\n",path);
+
+	return SUCCESS;
+}
+
+errorcode trace_close(trace_t *trace) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(trace,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&trace->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	trace->stop = FLAG_SET;
+	pthread_cond_signal(&trace->work);
+	pthread_mutex_unlock(&trace->mutex);
+
+	/* the writer flushes everything before it ends */
+	if (pthread_join(trace->writer,NULL)!=0)
+		return ERROR_PTHREAD_JOIN;
+
+	/* the trace is missing records, whatever the debug level */
+	if (trace->dropped != 0) {
+		fprintf(stderr,"TRACE:%lu records dropped, %s\n",
+			trace->dropped,(trace->failed == FLAG_SET) ?
+			"writing the trace failed" : "the buffer was full");
+	}
+
+	trace_release(trace);
+
+	if (trace->failed == FLAG_SET)
+		return ERROR_OUTPUT;
+
+	return SUCCESS;
+}
+
+errorcode trace_event(trace_t *trace, sock_t sd, unsigned char event,
+		      comm_type_t type, void *payload, int len) {
+
+	/* declare local variables */
+	trace_record_t record;
+	int size;
+
+	/* error check arguments */
+	if (trace == NULL)
+		return SUCCESS;
+	CHECK_NOT_NEG(len,ERROR_NEG_ARG_6);
+	if ( (payload == NULL) && (len != 0) )
+		return ERROR_NULL_ARG_5;
+
+	/* do function */
+	if (len > TRACE_PAYLOAD_MAX)
+		len = TRACE_PAYLOAD_MAX;
+	record.time    = trace_now(trace);
+	record.session = sd;
+	record.event   = event;
+	record.type    = (unsigned int)type;
+	record.len     = (unsigned short)len;
+	size = sizeof(record) + len;
+
+	if (pthread_mutex_lock(&trace->mutex)!=0)
+		return ERROR_MUTEX_LOCK;
+	if ( (trace->failed == FLAG_SET) ||
+	     (trace->count + size > TRACE_BUFFER_SIZE) ) {
+		/* never make a session wait on the disk, nor keep records
+		 * nothing will write */
+		trace->dropped++;
+	}
+	else {
+		trace_put(trace,&record,sizeof(record));
+		if (len != 0)
+			trace_put(trace,payload,len);
+		/* wake the writer only once a good sized write is waiting */
+		if ( (trace->count >= TRACE_FLUSH_SIZE) &&
+		     (trace->count - size < TRACE_FLUSH_SIZE) )
+			pthread_cond_signal(&trace->work);
+	}
+	pthread_mutex_unlock(&trace->mutex);
+
+	return SUCCESS;
+}
+
+errorcode trace_reader_open(trace_reader_t *reader, char *path) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(reader,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if ( (reader->file=fopen(path,"r")) == NULL)
+		return ERROR_FILE_OPEN;
+
+	return SUCCESS;
+}
+
+int trace_read(trace_reader_t *reader, trace_record_t *record,
+	       void *payload) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(reader,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(record,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(payload,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (fread(record,sizeof(trace_record_t),1,reader->file) != 1)
+		return 0;
+	if (record->len > TRACE_PAYLOAD_MAX)
+		return ERROR_BUF_SIZE;
+	if ( (record->len != 0) &&
+	     (fread(payload,record->len,1,reader->file) != 1) )
+		return 0;
+
+	return 1;
+}
+
+errorcode trace_reader_close(trace_reader_t *reader) {
+
+	/* declare local variables */
+
+	/* error check arguments */
+	CHECK_NOT_NULL(reader,ERROR_NULL_ARG_1);
+
+	/* do function */
+	fclose(reader->file);
+
+	return SUCCESS;
+}
+
+void *run_trace_writer(void *arg) {
+
+	/* declare local variables */
+	trace_t *trace;
+	struct timespec deadline;
+	struct timeval now;
+
+	/* error check arguments */
+	if (arg == NULL)
+		return NULL;
+
+	/* do function */
+	trace = (trace_t*)arg;
+	if (pthread_mutex_lock(&trace->mutex)!=0)
+		return NULL;
+	while (1) {
+		if ( (trace->count < TRACE_FLUSH_SIZE) &&
+		     (trace->stop != FLAG_SET) ) {
+			/* pthread_cond_timedwait measures against the
+			 * realtime clock */
+			gettimeofday(&now,NULL);
+			deadline.tv_sec  = now.tv_sec;
+			deadline.tv_nsec = now.tv_usec*1000 +
+				TRACE_FLUSH_INTERVAL*1000000L;
+			if (deadline.tv_nsec >= 1000000000L) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&trace->work,&trace->mutex,
+					       &deadline);
+		}
+		if (FAILED(trace_flush(trace))) {
+			/* the operator has to know the trace is cut short,
+			 * whatever the debug level */
+			trace->failed = FLAG_SET;
+			fprintf(stderr,"TRACE:writing the trace failed (%s), "
+				"recording stopped\n",(trace->error != 0) ?
+				strerror(trace->error) : "short write");
+			break;
+		}
+		if (trace->stop == FLAG_SET)
+			break;
+	}
+	pthread_mutex_unlock(&trace->mutex);
+
+	return NULL;
+}
+
+void trace_release(trace_t *trace) {
+
+	/* do function */
+	close(trace->fd);
+	trace->fd = -1;
+	safe_free(trace->buf);
+	trace->buf = NULL;
+	pthread_mutex_destroy(&trace->mutex);
+	pthread_cond_destroy(&trace->work);
+
+	return;
+}
+
+void trace_put(trace_t *trace, void *buf, int len) {
+
+	/* declare local variables */
+	unsigned int tail;
+	int part;
+
+	/* do function */
+	tail = (trace->head + trace->count) % TRACE_BUFFER_SIZE;
+	part = TRACE_BUFFER_SIZE - tail;
+	if (part > len)
+		part = len;
+	memcpy(trace->buf+tail,buf,part);
+	memcpy(trace->buf,(unsigned char*)buf+part,len-part);
+	trace->count += len;
+}
+
+errorcode trace_flush(trace_t *trace) {
+
+	/* declare local variables */
+	struct iovec iov[2];
+	unsigned int head, count;
+	int iovcnt, err;
+	ssize_t n;
+
+	/* do function */
+	head  = trace->head;
+	count = trace->count;
+	if (count == 0)
+		return SUCCESS;
+
+	/* the bytes taken here stay put while the mutex is let go, sessions
+	 * only add after them */
+	iov[0].iov_base = trace->buf + head;
+	iov[0].iov_len  = count;
+	iovcnt = 1;
+	if (head + count > TRACE_BUFFER_SIZE) {
+		/* the waiting bytes wrap around the end of the buffer */
+		iov[0].iov_len  = TRACE_BUFFER_SIZE - head;
+		iov[1].iov_base = trace->buf;
+		iov[1].iov_len  = count - iov[0].iov_len;
+		iovcnt = 2;
+	}
+	pthread_mutex_unlock(&trace->mutex);
+	do {
+		n = writev(trace->fd,iov,iovcnt);
+	} while ( (n < 0) && (errno == EINTR) );
+	err = (n < 0) ? errno : 0;
+	pthread_mutex_lock(&trace->mutex);
+
+	if (n != (ssize_t)count) {
+		trace->error = err;
+		return ERROR_OUTPUT;
+	}
+	trace->head   = (head + count) % TRACE_BUFFER_SIZE;
+	trace->count -= count;
+
+	return SUCCESS;
+}
+
+unsigned long long trace_now(trace_t *trace) {
+
+	/* declare local variables */
+	struct timespec now;
+
+	/* do function */
+	/* the monotonic clock, so a clock change does not bend the gaps
+	 * between records */
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (unsigned long long)(now.tv_sec - trace->start.tv_sec)*1000000
+		+ (now.tv_nsec - trace->start.tv_nsec)/1000;
+}
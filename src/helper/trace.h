@@ -0,0 +1,228 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file trace.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief records every message the helper exchanges with its peers to a
+ *        file, so a real workload can be replayed against a helper later
+ *
+ * A trace is a sequence of records, each a trace_record_t followed by its
+ * payload.  A run of the helper starts with a TRACE_EVENT_START record, so
+ * one file may hold several runs, one after the other.  Every record
+ * carries the time since the start of the run (monotonic clock) and the
+ * socket descriptor of the session it belongs to.  A session is the records
+ * between its TRACE_EVENT_ACCEPT and TRACE_EVENT_CLOSE; a descriptor is
+ * only reused after its close is recorded, except for a connection handed
+ * to the relay, which has no close.  A helper taking over from another
+ * should record to a file of its own, the records of two helpers running at
+ * once would be mixed up.  The sessions it took over carry on in its trace
+ * without an accept.
+ *
+ * Sessions only copy their record into a buffer.  A writer thread appends
+ * the buffer to the file every TRACE_FLUSH_INTERVAL milliseconds, or sooner
+ * once TRACE_FLUSH_SIZE bytes are waiting, so recording never waits on the
+ * disk.  If the buffer is full the record is dropped and counted.  If
+ * writing the file fails the writer says why on stderr and stops, since a
+ * record cut short would spoil the rest of the file; every later record is
+ * dropped and counted, and trace_close fails.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "errorcodes.h"
+#include "helperdef.h"
+#include "comm.h"
+#include <stdio.h>
+#include <pthread.h>
+
+/** @brief the value in the payload of a start record ("NBT1") */
+#define TRACE_MAGIC		0x4e425431
+
+/** @brief the size in bytes of the buffer records wait in */
+#define TRACE_BUFFER_SIZE	(1024*1024)
+
+/** @brief the bytes waiting that make the writer flush right away */
+#define TRACE_FLUSH_SIZE	(64*1024)
+
+/** @brief the longest time in milliseconds a record waits to be written */
+#define TRACE_FLUSH_INTERVAL	100
+
+/** @brief the most payload bytes kept per record.  no comm message has a
+ *  longer payload */
+#define TRACE_PAYLOAD_MAX	COMM_MAX_LEN
+
+/** @brief the first record of a run (payload: trace_start_t, session -1) */
+#define TRACE_EVENT_START	1
+
+/** @brief a connection was accepted (payload: observed_data_t) */
+#define TRACE_EVENT_ACCEPT	2
+
+/** @brief a message was read from the peer (payload: the message's) */
+#define TRACE_EVENT_IN		3
+
+/** @brief a message was sent to the peer (payload: the message's) */
+#define TRACE_EVENT_OUT		4
+
+/** @brief the helper closed the connection (no payload) */
+#define TRACE_EVENT_CLOSE	5
+
+/** @brief the header of every record */
+struct trace_record {
+	/** @brief microseconds since the start of the run */
+	unsigned long long time;
+	/** @brief the socket descriptor of the session */
+	int session;
+	/** @brief what happened, one of the TRACE_EVENT_* values */
+	unsigned char event;
+	/** @brief the comm type of the message (TRACE_EVENT_IN and
+	 *  TRACE_EVENT_OUT only) */
+	unsigned int type;
+	/** @brief the number of payload bytes after the header */
+	unsigned short len;
+} __attribute__((__packed__));
+
+/** @brief typedef for the trace_record structure */
+typedef struct trace_record trace_record_t;
+
+/** @brief the payload of a start record */
+struct trace_start {
+	/** @brief TRACE_MAGIC */
+	unsigned int magic;
+	/** @brief the wall clock time the run started, in microseconds since
+	 *  the epoch */
+	unsigned long long wall;
+} __attribute__((__packed__));
+
+/** @brief typedef for the trace_start structure */
+typedef struct trace_start trace_start_t;
+
+/** @brief structure for a trace being recorded */
+struct trace {
+	/** @brief the trace file, opened for appending */
+	int fd;
+	/** @brief the circular buffer records wait in */
+	unsigned char *buf;
+	/** @brief the index of the first byte waiting */
+	unsigned int head;
+	/** @brief the number of bytes waiting */
+	unsigned int count;
+	/** @brief the monotonic time the run started */
+	struct timespec start;
+	/** @brief the records dropped because the buffer was full */
+	unsigned long dropped;
+	/** @brief FLAG_SET once the writer should flush and stop */
+	flag_t stop;
+	/** @brief FLAG_SET once writing the file failed and the writer
+	 *  stopped */
+	flag_t failed;
+	/** @brief the errno of the failed write, 0 if the write was cut
+	 *  short */
+	int error;
+	/** @brief protects everything above */
+	pthread_mutex_t mutex;
+	/** @brief signalled when the writer should flush */
+	pthread_cond_t work;
+	/** @brief the writer thread */
+	pthread_t writer;
+};
+
+/** @brief typedef for the trace structure */
+typedef struct trace trace_t;
+
+/** @brief structure for reading a trace back */
+struct trace_reader {
+	/** @brief the trace file */
+	FILE *file;
+};
+
+/** @brief typedef for the trace_reader structure */
+typedef struct trace_reader trace_reader_t;
+
+/**
+ * @brief starts recording to a trace file, appending a new run if the file
+ *        already exists
+ *
+ * @param trace pointer to the trace to start
+ * @param path the trace file
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode trace_open(trace_t *trace, char *path);
+
+/**
+ * @brief writes out every record still waiting and stops recording
+ *
+ * @param trace pointer to the trace
+ *
+ * @return SUCCESS, errorcode on failure or if the writer stopped early
+ */
+errorcode trace_close(trace_t *trace);
+
+/**
+ * @brief records an event of a session
+ *
+ * This function is thread safe and does not wait on the disk.
+ *
+ * @param trace pointer to the trace, NULL if the helper does not record
+ * @param sd the socket descriptor of the session
+ * @param event one of the TRACE_EVENT_* values
+ * @param type the comm type of the message, 0 if the event is not a message
+ * @param payload the payload, may be NULL if len is 0
+ * @param len the number of payload bytes
+ *
+ * @return SUCCESS, errorcode on failure (a dropped record is not a failure)
+ */
+errorcode trace_event(trace_t *trace, sock_t sd, unsigned char event,
+		      comm_type_t type, void *payload, int len);
+
+/**
+ * @brief opens a trace file for reading
+ *
+ * @param reader pointer to the reader to open
+ * @param path the trace file
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode trace_reader_open(trace_reader_t *reader, char *path);
+
+/**
+ * @brief reads the next record of a trace
+ *
+ * @param reader pointer to the reader
+ * @param record pointer to fill in with the record header
+ * @param payload buffer of TRACE_PAYLOAD_MAX bytes to fill in with the
+ *        payload
+ *
+ * @return 1 if a record was read, 0 at the end of the trace (a record cut
+ *         short by a crash counts as the end), errorcode on failure
+ */
+int trace_read(trace_reader_t *reader, trace_record_t *record,
+	       void *payload);
+
+/**
+ * @brief closes a reader opened by trace_reader_open
+ *
+ * @param reader pointer to the reader
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode trace_reader_close(trace_reader_t *reader);
+
+#endif /* __TRACE_H__ */
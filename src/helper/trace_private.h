@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file trace_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the session trace recorder
+ */
+
+#ifndef __TRACE_PRIVATE_H__
+#define __TRACE_PRIVATE_H__
+
+#include "trace.h"
+
+/**
+ * @brief the entry point of the thread writing the buffer to the file
+ *
+ * @param arg the trace
+ *
+ * @return NULL
+ */
+void *run_trace_writer(void *arg);
+
+/**
+ * @brief lets go of what trace_open took: closes the file, frees the buffer
+ *        and destroys the mutex and condition.  no writer may be running.
+ *
+ * @param trace pointer to the trace
+ *
+ * @return void
+ */
+void trace_release(trace_t *trace);
+
+/**
+ * @brief copies bytes to the end of the buffer.  the mutex must be held and
+ *        there must be room.
+ *
+ * @param trace pointer to the trace
+ * @param buf the bytes
+ * @param len the number of bytes
+ *
+ * @return void
+ */
+void trace_put(trace_t *trace, void *buf, int len);
+
+/**
+ * @brief writes out the bytes waiting in the buffer.  the mutex must be
+ *        held; it is let go while writing.
+ *
+ * @param trace pointer to the trace
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode trace_flush(trace_t *trace);
+
+/**
+ * @brief finds the time since the start of the run
+ *
+ * @param trace pointer to the trace
+ *
+ * @return the time in microseconds
+ */
+unsigned long long trace_now(trace_t *trace);
+
+#endif /* __TRACE_PRIVATE_H__ */
@@ -0,0 +1,406 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file agent.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a long running peer agent that makes natblaster connections for
+ *        local applications and passes them the connected sockets
+ */
+
+/* for struct ucred */
+#define _GNU_SOURCE
+
+#include "natblaster_peer.h"
+#include "agent.h"
+#include "agent_private.h"
+#include "debug.h"
+#include "netio.h"
+#include "nethelp.h"
+#include "berkeleyapi.h"
+#include "util.h"
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+int natblaster_agent(char *path, char *device, char *backend, char *cache,
+		     int mode, int group) {
+
+	agent_t agent;
+	agent_client_t *client;
+	sock_t this_sd;
+	pthread_t tid;
+	int i;
+
+	/* like natblaster_server, the return codes are "errorcodes" */
+
+	if (path == NULL)
+		path = AGENT_SOCKET_DEFAULT;
+
+	agent.cache = cache;
+	agent.uid   = geteuid();
+	agent.gid   = (group < 0) ? getegid() : (gid_t)group;
+
+	/* open the packet engines once, every connection reuses one.  fewer
+	 * than asked for only means fewer attempts at once */
+	agent.workers = 0;
+	for(i=0;i<AGENT_WORKERS;i++) {
+		if (FAILED(pktio_open(&agent.io[agent.workers],backend,
+				device)))
+			break;
+		agent.busy[agent.workers++] = FLAG_UNSET;
+	}
+	if (agent.workers == 0)
+		return ERROR_NO_DEV_FOUND;
+
+	if ( (pthread_mutex_init(&agent.mutex,NULL) != 0) ||
+	     (pthread_cond_init(&agent.idle,NULL) != 0) )
+		return ERROR_INIT;
+
+	CHECK_FAILED(agent_listen(path,mode,agent.gid,&agent.sd),ERROR_BIND);
+
+	DEBUG(DBG_AGENT,"AGENT:listening on %s using device %s (%s), %d "
+		"attempt(s) at once\n",path,agent.io[0].device,
+		agent.io[0].ops->name,agent.workers);
+
+	/* loop forever */
+	while (1) {
+		if ( (this_sd=accept(agent.sd,NULL,NULL)) < 0)
+			continue;
+
+		if ( (client=(agent_client_t*)malloc(
+				sizeof(agent_client_t))) == NULL) {
+			close(this_sd);
+			continue;
+		}
+		client->agent = &agent;
+		client->sd    = this_sd;
+
+		/* create a thread with the default attributes... */
+		if (pthread_create(&tid,NULL,run_agent_client,client) != 0) {
+			close(this_sd);
+			safe_free(client);
+			continue;
+		}
+		/* .. and then detach it! */
+		if (pthread_detach(tid) != 0)
+			return ERROR_PTHREAD_DETACH_FAILED;
+	}
+
+	/* should never happen */
+	return ERROR_1;
+}
+
+errorcode agent_listen(char *path, int mode, gid_t group, sock_t *sd) {
+
+	/* declare local variables */
+	struct sockaddr_un addr;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sd,ERROR_NULL_ARG_3);
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return ERROR_ARG_1;
+
+	/* do function */
+	if ( (*sd=socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+
+	/* a socket file left by an agent that died can't be bound again */
+	unlink(path);
+
+	if (bind(*sd,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+		close(*sd);
+		return ERROR_BIND;
+	}
+
+	/* the socket file's permissions keep others from connecting at all,
+	 * agent_authorized decides who of the rest may use the agent */
+	if ( (chown(path,-1,group) < 0) || (chmod(path,mode) < 0) ) {
+		close(*sd);
+		return ERROR_1;
+	}
+
+	if (listen(*sd,AGENT_BACKLOG) != 0) {
+		close(*sd);
+		return ERROR_TCP_LISTEN;
+	}
+
+	return SUCCESS;
+}
+
+void *run_agent_client(void *arg) {
+
+	/* declare local variables */
+	agent_client_t client;
+	agent_msg_connect_t req;
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+
+	/* error check arguments */
+	if (arg == NULL)
+		return NULL;
+
+	/* do function */
+	memcpy(&client,arg,sizeof(client));
+	safe_free(arg);
+
+	if ( (getsockopt(client.sd,SOL_SOCKET,SO_PEERCRED,&cred,
+			 &cred_len) != 0) ||
+	     (agent_authorized(client.agent,&cred) != FLAG_SET) ) {
+		DEBUG(DBG_AGENT,"AGENT:refused application pid %d uid %d\n",
+			(int)cred.pid,(int)cred.uid);
+		close(client.sd);
+		return NULL;
+	}
+	DEBUG(DBG_AGENT,"AGENT:application pid %d uid %d connected\n",
+		(int)cred.pid,(int)cred.uid);
+
+	/* serve requests until the application hangs up */
+	while (!FAILED(readMsg(client.sd,AGENT_MSG_CONNECT,&req,sizeof(req))))
+		if (FAILED(agent_connect(client.agent,client.sd,&req)))
+			break;
+
+	DEBUG(DBG_AGENT,"AGENT:application hung up\n");
+
+	close(client.sd);
+
+	return NULL;
+}
+
+errorcode agent_connect(agent_t *agent, sock_t sd, agent_msg_connect_t *req) {
+
+	/* declare local variables */
+	agent_msg_connected_t reply;
+	peer_opts_t opts;
+	int buddy_sd, engine;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(agent,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_2);
+	CHECK_NOT_NULL(req,ERROR_NULL_ARG_3);
+
+	/* do function */
+
+	/* a refused request is answered like a failed one */
+	if (FAILED(reply.result=agent_check_request(req))) {
+		DEBUG(DBG_AGENT,"AGENT:refused request to %s\n",
+			DBG_IP(req->buddy_ext_ip));
+		CHECK_FAILED(sendMsg(sd,AGENT_MSG_CONNECTED,&reply,
+			sizeof(reply)),ERROR_NETWORK_SEND);
+		return SUCCESS;
+	}
+
+	/* a request that can't get an engine in time is answered like a
+	 * failed one, rather than left waiting for ever */
+	if (FAILED(reply.result=agent_take(agent,&engine))) {
+		DEBUG(DBG_AGENT,"AGENT:no packet engine free for %s\n",
+			DBG_IP(req->buddy_ext_ip));
+		CHECK_FAILED(sendMsg(sd,AGENT_MSG_CONNECTED,&reply,
+			sizeof(reply)),ERROR_NETWORK_SEND);
+		return SUCCESS;
+	}
+
+	opts.race_width = req->race_width;
+	opts.pktio      = &agent->io[engine];
+	opts.cache      = agent->cache;
+	opts.overlap    = FLAG_SET;
+	opts.syn_ttl    = 0;
+
+	DEBUG(DBG_AGENT,"AGENT:connecting to %s\n",DBG_IP(req->buddy_ext_ip));
+
+	/* attempts on other engines go on at the same time.  each engine
+	 * captures every tcp packet on the device, and each attempt only
+	 * looks for its own */
+	buddy_sd = natblaster_connect(req->helper_ip,req->helper_port,
+		req->peer_ip,req->peer_port,req->buddy_ext_ip,req->buddy_int_ip,
+		req->buddy_int_port,NULL,req->random,&opts);
+	agent_give(agent,engine);
+
+	reply.result = (buddy_sd < 0) ? buddy_sd : SUCCESS;
+	if (FAILED(sendMsg(sd,AGENT_MSG_CONNECTED,&reply,sizeof(reply)))) {
+		if (buddy_sd >= 0)
+			close(buddy_sd);
+		return ERROR_NETWORK_SEND;
+	}
+
+	if (buddy_sd < 0)
+		return SUCCESS;
+
+	/* the application gets its own copy of the socket */
+	if (FAILED(sendFd(sd,buddy_sd))) {
+		close(buddy_sd);
+		return ERROR_NETWORK_SEND;
+	}
+	close(buddy_sd);
+
+	DEBUG(DBG_AGENT,"AGENT:passed connection to application\n");
+
+	return SUCCESS;
+}
+
+errorcode agent_take(agent_t *agent, int *engine) {
+
+	/* declare local variables */
+	struct timeval now;
+	struct timespec deadline;
+	int i, ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(agent,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(engine,ERROR_NULL_ARG_2);
+
+	/* do function */
+	gettimeofday(&now,NULL);
+	deadline.tv_sec  = now.tv_sec + AGENT_WAIT_TIMEOUT;
+	deadline.tv_nsec = now.tv_usec*1000;
+
+	if (pthread_mutex_lock(&agent->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = 0;
+	*engine = -1;
+	while (*engine < 0) {
+		for(i=0;i<agent->workers;i++) {
+			if (agent->busy[i] != FLAG_SET) {
+				agent->busy[i] = FLAG_SET;
+				*engine = i;
+				break;
+			}
+		}
+		if ( (*engine >= 0) || (ret == ETIMEDOUT) )
+			break;
+		ret = pthread_cond_timedwait(&agent->idle,&agent->mutex,
+					     &deadline);
+	}
+
+	if (pthread_mutex_unlock(&agent->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	if (*engine < 0)
+		return ERROR_TIMEOUT;
+
+	return SUCCESS;
+}
+
+void agent_give(agent_t *agent, int engine) {
+
+	/* do function */
+	pthread_mutex_lock(&agent->mutex);
+	agent->busy[engine] = FLAG_UNSET;
+	pthread_cond_signal(&agent->idle);
+	pthread_mutex_unlock(&agent->mutex);
+}
+
+flag_t agent_authorized(agent_t *agent, struct ucred *cred) {
+
+	/* declare local variables */
+	struct passwd pw, *pw_found;
+	char buf[1024];
+	gid_t groups[AGENT_MAX_GROUPS];
+	int count, i;
+
+	/* error check arguments */
+	if ( (agent == NULL) || (cred == NULL) )
+		return FLAG_UNSET;
+
+	/* do function */
+	if ( (cred->uid == 0) || (cred->uid == agent->uid) ||
+	     (cred->gid == agent->gid) )
+		return FLAG_SET;
+
+	/* SO_PEERCRED only gives the primary group, the others come from the
+	 * group database */
+	if ( (getpwuid_r(cred->uid,&pw,buf,sizeof(buf),&pw_found) != 0) ||
+	     (pw_found == NULL) )
+		return FLAG_UNSET;
+	count = AGENT_MAX_GROUPS;
+	if (getgrouplist(pw.pw_name,pw.pw_gid,groups,&count) < 0)
+		return FLAG_UNSET;
+	for(i=0;i<count;i++)
+		if (groups[i] == agent->gid)
+			return FLAG_SET;
+
+	return FLAG_UNSET;
+}
+
+errorcode agent_check_request(agent_msg_connect_t *req) {
+
+	/* declare local variables */
+	struct sockaddr_in addr;
+	sock_t sd;
+	int ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(req,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* the agent runs as root, so it could bind ports the application
+	 * could not.  the helper connections are bound to the ports just
+	 * below the peer port, and none of them may be privileged either */
+	if ( (PORT_2HBO(req->peer_port) == 0) ||
+	     ((int)PORT_2HBO(req->peer_port) - AGENT_PORTS_BELOW <
+			IPPORT_RESERVED) )
+		return ERROR_ARG_4;
+
+	if (agent_unicast(req->helper_ip) != FLAG_SET)
+		return ERROR_ARG_1;
+	if (agent_unicast(req->buddy_ext_ip) != FLAG_SET)
+		return ERROR_ARG_5;
+
+	/* packets are forged from the peer ip, which must be this host's.
+	 * only a local address can be bound */
+	if ( (sd=socket(AF_INET,SOCK_DGRAM,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = req->peer_ip;
+	addr.sin_port        = 0;
+	ret = bind(sd,(struct sockaddr*)&addr,sizeof(addr));
+	close(sd);
+	if ( (req->peer_ip == IP_UNKNOWN) || (ret < 0) )
+		return ERROR_ARG_3;
+
+	return SUCCESS;
+}
+
+flag_t agent_unicast(ip_t ip) {
+
+	/* declare local variables */
+	unsigned long host = ntohl(ip);
+
+	/* do function */
+	if ( (host == INADDR_ANY) || (host == INADDR_BROADCAST) ||
+	     IN_MULTICAST(host) || IN_BADCLASS(host) ||
+	     ((host >> IN_CLASSA_NSHIFT) == IN_LOOPBACKNET) )
+		return FLAG_UNSET;
+
+	return FLAG_SET;
+}
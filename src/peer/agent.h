@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file agent.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a long running peer agent that makes natblaster connections for
+ *        local applications and passes them the connected sockets over a
+ *        unix domain socket
+ *
+ * The agent runs as root and keeps a packet engine (see pktio.h) open, so an
+ * application does not need root privledge and a connection does not pay for
+ * finding a device and opening pcap/libnet.  Applications use the messages
+ * below, framed like the helper protocol (see comm.h):
+ *
+ *   application -> agent : AGENT_MSG_CONNECT
+ *   agent -> application : AGENT_MSG_CONNECTED
+ *   agent -> application : the connected socket (see sendFd), only if the
+ *                          result is SUCCESS
+ *
+ * Several connections can be requested over one unix socket connection.
+ */
+
+#ifndef __AGENT_H__
+#define __AGENT_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include "pktio.h"
+#include <pthread.h>
+#include <sys/types.h>
+
+/** @brief message asking the agent to make a connection.
+ *  payload: agent_msg_connect_t */
+#define AGENT_MSG_CONNECT	0x4001
+
+/** @brief message with the result of a connection request.
+ *  payload: agent_msg_connected_t */
+#define AGENT_MSG_CONNECTED	0x4002
+
+/** @brief the number of pending application connections the agent allows */
+#define AGENT_BACKLOG		5
+
+/** @brief the most connection attempts the agent makes at once.  each one
+ *  has a packet engine of its own, since an engine hands every packet it
+ *  captures to a single reader and a new attempt flushes what its engine
+ *  already captured */
+#define AGENT_WORKERS		4
+
+/** @brief the most seconds a request waits for a packet engine to come
+ *  free before it is refused */
+#define AGENT_WAIT_TIMEOUT	30
+
+/** @brief the number of ports just below the peer port a connection binds
+ *  as well, for its helper connections (see natblaster_connect) */
+#define AGENT_PORTS_BELOW	3
+
+/** @brief the most groups of an application's user looked at when
+ *  deciding whether it may use the agent */
+#define AGENT_MAX_GROUPS	64
+
+/** @brief structure to hold payload for a AGENT_MSG_CONNECT message.  the
+ *  fields are the arguments of natblaster_connect */
+struct agent_msg_connect {
+	/** @brief the helper's ip */
+	ip_t helper_ip;
+	/** @brief the helper's port */
+	port_t helper_port;
+	/** @brief the peer's internal ip */
+	ip_t peer_ip;
+	/** @brief the port to connect to the buddy from */
+	port_t peer_port;
+	/** @brief the buddy's external ip */
+	ip_t buddy_ext_ip;
+	/** @brief the buddy's internal ip */
+	ip_t buddy_int_ip;
+	/** @brief the buddy's internal port */
+	port_t buddy_int_port;
+	/** @brief FLAG_SET to pretend to have random port allocation */
+	flag_t random;
+	/** @brief the number of predicted buddy ports to race */
+	unsigned char race_width;
+} __attribute__((__packed__));
+
+/** @brief typedef for the AGENT_MSG_CONNECT payload structure */
+typedef struct agent_msg_connect agent_msg_connect_t;
+
+/** @brief structure to hold payload for a AGENT_MSG_CONNECTED message */
+struct agent_msg_connected {
+	/** @brief SUCCESS if a socket follows, otherwise the errorcode
+	 *  natblaster_connect failed with */
+	long result;
+} __attribute__((__packed__));
+
+/** @brief typedef for the AGENT_MSG_CONNECTED payload structure */
+typedef struct agent_msg_connected agent_msg_connected_t;
+
+/** @brief structure holding the state of a running agent */
+struct agent {
+	/** @brief the packet engines, each used by one connection attempt at
+	 *  a time and reused by the next */
+	pktio_t io[AGENT_WORKERS];
+	/** @brief FLAG_SET for each engine an attempt is using */
+	flag_t busy[AGENT_WORKERS];
+	/** @brief the number of engines that opened */
+	int workers;
+	/** @brief protects busy */
+	pthread_mutex_t mutex;
+	/** @brief signalled when an engine comes free */
+	pthread_cond_t idle;
+	/** @brief the listening unix domain socket */
+	sock_t sd;
+	/** @brief the peer cache file (see peercache.h), or NULL */
+	char *cache;
+	/** @brief the user running the agent, who may always use it */
+	uid_t uid;
+	/** @brief the group of the socket file, whose members may use the
+	 *  agent */
+	gid_t gid;
+};
+
+/** @brief typedef for the agent structure */
+typedef struct agent agent_t;
+
+/** @brief the argument handed to a thread serving one application */
+struct agent_client {
+	/** @brief the agent the application is connected to */
+	agent_t *agent;
+	/** @brief the unix domain socket to the application */
+	sock_t sd;
+};
+
+/** @brief typedef for the agent_client structure */
+typedef struct agent_client agent_client_t;
+
+#endif /* __AGENT_H__ */
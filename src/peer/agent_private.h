@@ -0,0 +1,122 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file agent_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the peer agent
+ */
+
+#ifndef __AGENT_PRIVATE_H__
+#define __AGENT_PRIVATE_H__
+
+#include "agent.h"
+#include <sys/socket.h>
+
+/**
+ * @brief creates the listening unix domain socket, replacing a stale socket
+ *        file left by an earlier agent
+ *
+ * @param path the path of the socket file
+ * @param mode the permissions to give the socket file
+ * @param group the group to give the socket file
+ * @param sd pointer to fill in with the listening socket
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode agent_listen(char *path, int mode, gid_t group, sock_t *sd);
+
+/**
+ * @brief takes a free packet engine, waiting for one if all are busy
+ *
+ * @param agent pointer to the agent
+ * @param engine pointer to fill in with the index of the engine taken
+ *
+ * @return SUCCESS, ERROR_TIMEOUT if none came free in AGENT_WAIT_TIMEOUT
+ *         seconds, errorcode on other failures
+ */
+errorcode agent_take(agent_t *agent, int *engine);
+
+/**
+ * @brief gives back a packet engine taken with agent_take
+ *
+ * @param agent pointer to the agent
+ * @param engine the index of the engine
+ *
+ * @return void
+ */
+void agent_give(agent_t *agent, int engine);
+
+/**
+ * @brief decides whether an application may use the agent: root, the user
+ *        running the agent and members of the socket's group may
+ *
+ * @param agent pointer to the agent
+ * @param cred the application's credentials (from SO_PEERCRED)
+ *
+ * @return FLAG_SET if the application may, FLAG_UNSET if not
+ */
+flag_t agent_authorized(agent_t *agent, struct ucred *cred);
+
+/**
+ * @brief checks a request asks for nothing an application could not do
+ *        itself: the peer port and the AGENT_PORTS_BELOW ports below it
+ *        must not be privileged, the peer ip must be one of this host's
+ *        and the helper and buddy must be ordinary unicast addresses
+ *
+ * @param req the application's request
+ *
+ * @return SUCCESS if the request may be served, errorcode saying why not
+ */
+errorcode agent_check_request(agent_msg_connect_t *req);
+
+/**
+ * @brief checks an ip is an ordinary unicast address: not zero, broadcast,
+ *        multicast, reserved or loopback
+ *
+ * @param ip the ip to check
+ *
+ * @return FLAG_SET if it is, FLAG_UNSET if not
+ */
+flag_t agent_unicast(ip_t ip);
+
+/**
+ * @brief the entry point for the thread serving one application.  it makes
+ *        a connection for every AGENT_MSG_CONNECT until the application
+ *        hangs up.
+ *
+ * @param arg the single pthread arg (should be a malloc'd agent_client_t,
+ *        which the thread frees)
+ *
+ * @return NULL
+ */
+void *run_agent_client(void *arg);
+
+/**
+ * @brief makes one connection for an application and replies with the result
+ *        and the socket
+ *
+ * @param agent pointer to the agent
+ * @param sd the unix domain socket to the application
+ * @param req the application's request
+ *
+ * @return SUCCESS, errorcode on failure to reply
+ */
+errorcode agent_connect(agent_t *agent, sock_t sd, agent_msg_connect_t *req);
+
+#endif /* __AGENT_PRIVATE_H__ */
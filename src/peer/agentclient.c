@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file agentclient.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief lets an application get natblaster connections from a peer agent,
+ *        without root privledge
+ */
+
+#include "natblaster_peer.h"
+#include "agent.h"
+#include "debug.h"
+#include "netio.h"
+#include "nethelp.h"
+#include "berkeleyapi.h"
+#include <sys/un.h>
+#include <string.h>
+#include <unistd.h>
+
+int natblaster_agent_connect(char *path, ip_t helper_ip, port_t helper_port,
+			     ip_t peer_ip, port_t peer_port,
+			     ip_t buddy_ext_ip, ip_t buddy_int_ip,
+			     port_t buddy_int_port, flag_t random,
+			     peer_opts_t *opts) {
+
+	struct sockaddr_un addr;
+	agent_msg_connect_t req;
+	agent_msg_connected_t reply;
+	sock_t agent_sd;
+	int buddy_sd;
+
+	/* like natblaster_connect, the return codes are "errorcodes" */
+
+	if (path == NULL)
+		path = AGENT_SOCKET_DEFAULT;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return ERROR_ARG_1;
+
+	/* the agent opens its own packet engine, so only the race width is
+	 * passed on */
+	memset(&req,0,sizeof(req));
+	req.helper_ip      = helper_ip;
+	req.helper_port    = helper_port;
+	req.peer_ip        = peer_ip;
+	req.peer_port      = peer_port;
+	req.buddy_ext_ip   = buddy_ext_ip;
+	req.buddy_int_ip   = buddy_int_ip;
+	req.buddy_int_port = buddy_int_port;
+	req.random         = random;
+	req.race_width     = (opts==NULL) ? RACE_WIDTH_DEFAULT :
+						opts->race_width;
+
+	/* connect to the agent */
+	if ( (agent_sd=socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+
+	if (connect(agent_sd,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+		DEBUG(DBG_AGENT,"AGENT:no agent is listening on %s\n",path);
+		close(agent_sd);
+		return ERROR_TCP_CONNECT;
+	}
+
+	if (FAILED(sendMsg(agent_sd,AGENT_MSG_CONNECT,&req,sizeof(req)))) {
+		close(agent_sd);
+		return ERROR_NETWORK_SEND;
+	}
+
+	/* the agent replies once the connection attempt is over */
+	if (FAILED(readMsg(agent_sd,AGENT_MSG_CONNECTED,&reply,
+			sizeof(reply)))) {
+		close(agent_sd);
+		return ERROR_NETWORK_READ;
+	}
+
+	if (FAILED(reply.result)) {
+		close(agent_sd);
+		return reply.result;
+	}
+
+	/* and then passes the socket */
+	if (FAILED(readFd(agent_sd,&buddy_sd))) {
+		close(agent_sd);
+		return ERROR_NETWORK_READ;
+	}
+
+	close(agent_sd);
+
+	return buddy_sd;
+}
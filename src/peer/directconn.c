@@ -29,7 +29,11 @@
 #include "util.h"
 #include "debug.h"
 #include "berkeleyapi.h"
+#include "nethelp.h"
+#include "timeout.h"
+#include "pktio.h"
 #include <unistd.h>
+#include <fcntl.h>
 
 errorcode start_direct_conn(peer_conn_info_t *info) {
 
@@ -39,20 +43,40 @@ errorcode start_direct_conn(peer_conn_info_t *info) {
 
 	/* error check arguments */
 	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
+	if ( (info->race.width < 1) || (info->race.width > MAX_RACE_WIDTH) )
+		return ERROR_ARG_1;
 
 	/* do function */
 
+	if (info->race.armed != FLAG_SET)
+		CHECK_FAILED(prepare_direct_conn(info),ERROR_CALLED_FUNCTION);
+	info->race.winner = -1;
+
+	/* the connects are started here rather than in the thread, so the
+	 * caller knows how many SYNs to look for before it looks */
+	if (start_candidates(info) == 0) {
+		release_direct_conn(info);
+		return ERROR_TCP_CONNECT;
+	}
+
 	/* create argument */
 	if ( (arg = (direct_conn_connect_arg_t*) malloc (
-			sizeof(direct_conn_connect_arg_t))) == NULL)
+			sizeof(direct_conn_connect_arg_t))) == NULL) {
+		release_direct_conn(info);
 		return ERROR_1;
+	}
 	arg->info = info;
 
 	/* start the direct connection thread... */
 	if (pthread_create(&tid,NULL,run_direct_conn_connect,arg)<0) {
 		safe_free(arg);
+		release_direct_conn(info);
 		return ERROR_PTHREAD_CREATE_FAILED;
 	}
+
+	/* the thread owns the candidate sockets now... */
+	info->race.armed = FLAG_UNSET;
+
 	/* ...and the detach it! */
 	if (pthread_detach(tid)<0)
 		return ERROR_PTHREAD_DETACH_FAILED;
@@ -60,52 +84,153 @@ errorcode start_direct_conn(peer_conn_info_t *info) {
 	return SUCCESS;
 }
 
+errorcode prepare_direct_conn(peer_conn_info_t *info) {
+
+	/* declare local variables */
+	int i, ttl, flags;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
+	if ( (info->race.width < 1) || (info->race.width > MAX_RACE_WIDTH) )
+		return ERROR_ARG_1;
+
+	/* do function */
+
+	/* the first candidate is the already bound buddy socket, the rest
+	 * share its port so they present the same mapping to the NAT */
+	info->race.socks[0] = info->socks.buddy;
+	for(i=1;i<info->race.width;i++) {
+		if (FAILED(bindSocketShared(info->peer.port,
+				&info->race.socks[i]))) {
+			while (--i > 0)
+				close(info->race.socks[i]);
+			return ERROR_BIND;
+		}
+	}
+
+	/* every candidate connects with a TTL too low to reach the buddy and
+	 * without blocking, so they can all be in flight at once */
+	for(i=0;i<info->race.width;i++) {
+		ttl = info->syn_ttl;
+		setsockopt(info->race.socks[i], IPPROTO_IP, IP_TTL, &ttl,
+			sizeof(ttl));
+		flags = fcntl(info->race.socks[i], F_GETFL, 0);
+		fcntl(info->race.socks[i], F_SETFL, flags|O_NONBLOCK);
+	}
+
+	info->race.armed = FLAG_SET;
+
+	DEBUG(DBG_DIR_CONN,"DIR_CONN:readied %d candidate socket(s)\n",
+		info->race.width);
+
+	return SUCCESS;
+}
+
+void release_direct_conn(peer_conn_info_t *info) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	if ( (info == NULL) || (info->race.armed != FLAG_SET) )
+		return;
+
+	for(i=1;i<info->race.width;i++)
+		close(info->race.socks[i]);
+	info->race.armed = FLAG_UNSET;
+
+	return;
+}
+
 void *run_direct_conn_connect(void *arg) {
 
 	/* declare local variables */
 	direct_conn_connect_arg_t *cast_arg;
-	struct sockaddr_in server;
-	int ttl;
+	race_peer_t *race;
+	sock_t sds[MAX_RACE_WIDTH];
+	int i, ttl, flags, wait;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(arg,(void*)ERROR_NULL_ARG_1);
 
 	/* do function */
-
-	sleep(1);/* HACK!!! to slow things down */
-
 	cast_arg = (direct_conn_connect_arg_t*)arg;
+	race = &cast_arg->info->race;
 
-	DEBUG(DBG_DIR_CONN,"DIR_CONN:starting connection\n");
+	/* wait on the candidates start_direct_conn started */
+	for(i=0;i<race->width;i++)
+		sds[i] = (race->started[i] == FLAG_SET) ? race->socks[i] : -1;
 
-	/* put the server info in the sockaddr_in struct */
-	server.sin_family      = AF_INET;
-	server.sin_port        = cast_arg->info->buddy.ext_port;
-	server.sin_addr.s_addr = cast_arg->info->buddy.ext_ip;
+	/* the first candidate to finish the handshake wins */
+	wait = timeout_ms(TIMEOUT_DIRECT_CONN,&cast_arg->info->rtt,NULL);
+	if (FAILED(pktio_wait(cast_arg->info->pktio,sds,race->width,wait,
+			&race->winner)))
+		race->winner = -1;
 
-	/* set the TTL too low */
-	ttl = TTL_TOO_LOW;
-	setsockopt(cast_arg->info->socks.buddy, IPPROTO_IP, IP_TTL,
-			&ttl, sizeof(ttl));
+	/* tear down the losers.  on failure candidate 0 is left open, since
+	 * it is still the buddy socket the caller will close */
+	for(i=1;i<race->width;i++)
+		if (i != race->winner)
+			close(race->socks[i]);
 
-	/* connect to the server */
-	if( connect(cast_arg->info->socks.buddy, (struct sockaddr *)&server,
-			sizeof(server)) < 0) {
+	if (race->winner < 0) {
 		cast_arg->info->direct_conn_status = FLAG_FAILED;
 		safe_free(arg);
 		DEBUG(DBG_DIR_CONN,"DIR_CONN:Direction connection failed\n");
 		return (void*)ERROR_TCP_CONNECT;
 	}
-
-	/* set the TTL back high */
+	/* make the winner the buddy socket: blocking, with the TTL set back
+	 * high.  the buddy socket is replaced before candidate 0 is closed,
+	 * so it never names a closed descriptor */
+	cast_arg->info->socks.buddy = race->socks[race->winner];
+	if (race->winner != 0)
+		close(race->socks[0]);
+	flags = fcntl(cast_arg->info->socks.buddy, F_GETFL, 0);
+	fcntl(cast_arg->info->socks.buddy, F_SETFL, flags&~O_NONBLOCK);
 	ttl = TTL_OK;
 	setsockopt(cast_arg->info->socks.buddy, IPPROTO_IP, IP_TTL,
 			&ttl, sizeof(ttl));
 
-	DEBUG(DBG_DIR_CONN,"DIR_CONN:direct connection made!\n");
+	DEBUG(DBG_DIR_CONN,"DIR_CONN:direct connection made to port %u!\n",
+		DBG_PORT(PORT_ADD(cast_arg->info->buddy.ext_port,
+		race->winner)));
 
 	cast_arg->info->direct_conn_status = FLAG_SUCCESS;
 	safe_free(arg);
 	return (void*)SUCCESS;
 }
 
+int start_candidates(peer_conn_info_t *info) {
+
+	/* declare local variables */
+	race_peer_t *race = &info->race;
+	int i;
+
+	/* do function */
+
+	/* there is no need to wait for the SYNs to be looked for.  the packet
+	 * engine was flushed before this was called and queues what it
+	 * captures from then on */
+
+	/* start a non-blocking connect with a TTL too low from every
+	 * candidate (see prepare_direct_conn), candidate i goes to the
+	 * predicted port plus i */
+	race->live = 0;
+	for(i=0;i<race->width;i++) {
+		race->started[i] = FLAG_UNSET;
+		if (FAILED(pktio_connect(info->pktio,race->socks[i],
+				info->buddy.ext_ip,
+				PORT_ADD(info->buddy.ext_port,i)))) {
+			DEBUG(DBG_DIR_CONN,"DIR_CONN:candidate %d failed to "
+				"start\n",i);
+			continue;
+		}
+		race->started[i] = FLAG_SET;
+		race->live++;
+	}
+
+	DEBUG(DBG_DIR_CONN,"DIR_CONN:started %d of %d connection(s)\n",
+		race->live,race->width);
+
+	return race->live;
+}
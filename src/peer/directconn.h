@@ -42,7 +42,12 @@ typedef struct direct_conn_connect_arg direct_conn_connect_arg_t;
  *        to make the connection
  *
  * Allocates a direct_conn_arg_t structure that it expects the started thread
- * to free.
+ * to free.  The candidate sockets are readied by prepare_direct_conn, here
+ * if that was not done earlier, and the thread connects each one to a
+ * successive predicted buddy port.  The connects are started before this
+ * returns, info->race.started and info->race.live say which ones did (only
+ * those send a SYN).  The first to connect replaces info->socks.buddy and
+ * the others are closed.
  *
  * @param info pointer to the peer_conn_info_t structure will all the info
  *
@@ -50,5 +55,29 @@ typedef struct direct_conn_connect_arg direct_conn_connect_arg_t;
  */
 errorcode start_direct_conn(peer_conn_info_t *info);
 
+/**
+ * @brief readies the candidate sockets for a direct connection: binds the
+ *        extra ones when racing (info->race.width greater than 1) and gives
+ *        all of them the low TTL and non-blocking mode the connect needs.
+ *        it only needs the peer's port, so it can be done while waiting
+ *        for the helper.
+ *
+ * @param info pointer to the peer_conn_info_t structure will all the info
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode prepare_direct_conn(peer_conn_info_t *info);
+
+/**
+ * @brief closes the extra candidate sockets bound by prepare_direct_conn if
+ *        no direct connection was started with them.  the buddy socket
+ *        (candidate 0) is left open.
+ *
+ * @param info pointer to the peer_conn_info_t structure will all the info
+ *
+ * @return void
+ */
+void release_direct_conn(peer_conn_info_t *info);
+
 #endif /* __DIRECTCONN_H__ */
 
@@ -36,5 +36,15 @@
  */
 void *run_direct_conn_connect(void *arg);
 
+/**
+ * @brief starts a non-blocking connect from every candidate socket and
+ *        marks the ones that started in info->race.started
+ *
+ * @param info pointer to the peer_conn_info_t structure will all the info
+ *
+ * @return the number of candidates that started
+ */
+int start_candidates(peer_conn_info_t *info);
+
 #endif /* __DIRECTCONN_PRIVATE_H__ */
 
@@ -0,0 +1,664 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file mux.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief carries many independent byte streams over one buddy connection
+ */
+
+#include "mux.h"
+#include "mux_private.h"
+#include "debug.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+
+errorcode mux_start(mux_t *mux, sock_t sd) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_2);
+
+	/* do function */
+	memset(mux,0,sizeof(mux_t));
+	mux->sd      = sd;
+	mux->next_id = 1;
+	mux->dead    = FLAG_UNSET;
+
+	if (pthread_mutex_init(&mux->mutex,NULL) != 0)
+		return ERROR_INIT;
+	if (pthread_cond_init(&mux->work,NULL) != 0) {
+		pthread_mutex_destroy(&mux->mutex);
+		return ERROR_INIT;
+	}
+	if (pthread_cond_init(&mux->ready,NULL) != 0) {
+		pthread_cond_destroy(&mux->work);
+		pthread_mutex_destroy(&mux->mutex);
+		return ERROR_INIT;
+	}
+
+	if (pthread_create(&mux->writer,NULL,run_mux_writer,mux) != 0) {
+		pthread_cond_destroy(&mux->ready);
+		pthread_cond_destroy(&mux->work);
+		pthread_mutex_destroy(&mux->mutex);
+		return ERROR_PTHREAD_CREATE_FAILED;
+	}
+	if (pthread_create(&mux->reader,NULL,run_mux_reader,mux) != 0) {
+		/* let the writer see the mux is dead and exit */
+		pthread_mutex_lock(&mux->mutex);
+		mux->dead = FLAG_SET;
+		pthread_cond_broadcast(&mux->work);
+		pthread_mutex_unlock(&mux->mutex);
+		pthread_join(mux->writer,NULL);
+		pthread_cond_destroy(&mux->ready);
+		pthread_cond_destroy(&mux->work);
+		pthread_mutex_destroy(&mux->mutex);
+		return ERROR_PTHREAD_CREATE_FAILED;
+	}
+
+	DEBUG(DBG_MUX,"MUX:started on socket %d\n",sd);
+
+	return SUCCESS;
+}
+
+errorcode mux_stop(mux_t *mux) {
+
+	/* declare local variables */
+	int i, pending;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	/* let the writer send what the application already handed over */
+	while (mux->dead != FLAG_SET) {
+		pending = 0;
+		for(i=0;i<MUX_MAX_STREAMS;i++) {
+			if ( (mux->streams[i].state == MUX_STREAM_OPEN) &&
+			     ( (mux->streams[i].tx.count > 0) ||
+			       (mux->streams[i].send_open == FLAG_SET) ||
+			       ( (mux->streams[i].closed == FLAG_SET) &&
+				 (mux->streams[i].close_sent != FLAG_SET) ) ) )
+				pending = 1;
+		}
+		if (!pending)
+			break;
+		pthread_cond_wait(&mux->ready,&mux->mutex);
+	}
+
+	mux->dead = FLAG_SET;
+	pthread_cond_broadcast(&mux->work);
+	pthread_cond_broadcast(&mux->ready);
+	pthread_mutex_unlock(&mux->mutex);
+
+	/* wake the reader out of its read */
+	shutdown(mux->sd,SHUT_RDWR);
+	pthread_join(mux->reader,NULL);
+	pthread_join(mux->writer,NULL);
+
+	close(mux->sd);
+	pthread_cond_destroy(&mux->ready);
+	pthread_cond_destroy(&mux->work);
+	pthread_mutex_destroy(&mux->mutex);
+
+	DEBUG(DBG_MUX,"MUX:stopped\n");
+
+	return SUCCESS;
+}
+
+errorcode mux_open(mux_t *mux, int *stream) {
+
+	/* declare local variables */
+	int h;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(stream,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	if (mux->dead == FLAG_SET) {
+		pthread_mutex_unlock(&mux->mutex);
+		return ERROR_TCP_CLOSED;
+	}
+
+	/* the ids grow, so a late frame for a finished stream is not taken
+	 * for a newer one until the 31 bit id wraps.  after a wrap, skip 0
+	 * and the ids of streams still open, which are at most
+	 * MUX_MAX_STREAMS.  this is done before the slot is taken, so its
+	 * stale id is not counted */
+	while ( (mux->next_id == 0) ||
+		(mux_find(mux,mux->next_id | MUX_ID_REMOTE) >= 0) )
+		mux->next_id = (mux->next_id + 1) & ~MUX_ID_REMOTE;
+
+	if ((h=mux_alloc(mux)) < 0) {
+		pthread_mutex_unlock(&mux->mutex);
+		return ERROR_OUT_OF_BOUNDS;
+	}
+
+	mux->streams[h].id        = mux->next_id;
+	mux->streams[h].remote    = FLAG_UNSET;
+	mux->streams[h].send_open = FLAG_SET;
+	mux->next_id = (mux->next_id + 1) & ~MUX_ID_REMOTE;
+
+	pthread_cond_signal(&mux->work);
+	pthread_mutex_unlock(&mux->mutex);
+
+	DEBUG(DBG_MUX,"MUX:opened stream %u\n",mux->streams[h].id);
+
+	*stream = h;
+
+	return SUCCESS;
+}
+
+errorcode mux_accept(mux_t *mux, int *stream) {
+
+	/* declare local variables */
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(stream,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	while ( (mux->accept_count == 0) && (mux->dead != FLAG_SET) )
+		pthread_cond_wait(&mux->ready,&mux->mutex);
+
+	if (mux->accept_count > 0) {
+		*stream = mux->accept[0];
+		mux->accept_count--;
+		memmove(&mux->accept[0],&mux->accept[1],
+			mux->accept_count*sizeof(int));
+		mux->streams[*stream].queued = FLAG_UNSET;
+		ret = SUCCESS;
+	}
+	else
+		ret = ERROR_TCP_CLOSED;
+
+	pthread_mutex_unlock(&mux->mutex);
+
+	return ret;
+}
+
+int mux_send(mux_t *mux, int stream, void *buf, int len) {
+
+	/* declare local variables */
+	mux_stream_t *s;
+	int sent, n;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(buf,ERROR_NULL_ARG_3);
+	CHECK_NOT_NEG(len,ERROR_NEG_ARG_4);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	if (FAILED(mux_check(mux,stream))) {
+		pthread_mutex_unlock(&mux->mutex);
+		return ERROR_ARG_2;
+	}
+	s = &mux->streams[stream];
+
+	sent = 0;
+	while ( (sent < len) && (mux->dead != FLAG_SET) ) {
+		n = mux_ring_put(&s->tx,(unsigned char*)buf+sent,len-sent);
+		if (n > 0) {
+			sent += n;
+			pthread_cond_signal(&mux->work);
+			continue;
+		}
+		/* wait for the writer to make room */
+		pthread_cond_wait(&mux->ready,&mux->mutex);
+	}
+
+	pthread_mutex_unlock(&mux->mutex);
+
+	if (sent < len)
+		return ERROR_TCP_SEND;
+
+	return sent;
+}
+
+int mux_recv(mux_t *mux, int stream, void *buf, int len) {
+
+	/* declare local variables */
+	mux_stream_t *s;
+	int n;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(buf,ERROR_NULL_ARG_3);
+	CHECK_NOT_NEG(len,ERROR_NEG_ARG_4);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	if (FAILED(mux_check(mux,stream))) {
+		pthread_mutex_unlock(&mux->mutex);
+		return ERROR_ARG_2;
+	}
+	s = &mux->streams[stream];
+
+	while ( (s->rx.count == 0) && (s->remote_closed != FLAG_SET) &&
+		(mux->dead != FLAG_SET) )
+		pthread_cond_wait(&mux->ready,&mux->mutex);
+
+	if (s->rx.count > 0) {
+		n = mux_ring_get(&s->rx,(unsigned char*)buf,len);
+		/* give the window back in large pieces, not a frame per read */
+		s->unacked += n;
+		if (s->unacked >= MUX_WINDOW/2)
+			pthread_cond_signal(&mux->work);
+	}
+	else if (s->remote_closed == FLAG_SET)
+		n = 0;
+	else
+		n = ERROR_TCP_RECEIVE;
+
+	pthread_mutex_unlock(&mux->mutex);
+
+	return n;
+}
+
+errorcode mux_close(mux_t *mux, int stream) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&mux->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	if (FAILED(mux_check(mux,stream))) {
+		pthread_mutex_unlock(&mux->mutex);
+		return ERROR_ARG_2;
+	}
+
+	mux->streams[stream].closed = FLAG_SET;
+	/* bytes the application will never read must not hold up the buddy */
+	mux->streams[stream].unacked += mux->streams[stream].rx.count;
+	mux->streams[stream].rx.count = 0;
+	pthread_cond_signal(&mux->work);
+
+	pthread_mutex_unlock(&mux->mutex);
+
+	return SUCCESS;
+}
+
+void *run_mux_reader(void *arg) {
+
+	/* declare local variables */
+	mux_t *mux = (mux_t*)arg;
+	mux_header_t hdr;
+	unsigned char payload[MUX_FRAME_MAX];
+	errorcode ret;
+
+	/* do function */
+	while (1) {
+		if (FAILED(mux_read_full(mux->sd,(unsigned char*)&hdr,
+					 MUX_HEADER_LEN)))
+			break;
+		hdr.id  = ntohl(hdr.id);
+		hdr.len = ntohs(hdr.len);
+		if (hdr.len > MUX_FRAME_MAX) {
+			DEBUG(DBG_MUX,"MUX:frame of %u bytes is too long\n",
+				hdr.len);
+			break;
+		}
+		if ( (hdr.len > 0) &&
+		     FAILED(mux_read_full(mux->sd,payload,hdr.len)) )
+			break;
+
+		pthread_mutex_lock(&mux->mutex);
+		ret = mux_handle_frame(mux,&hdr,payload);
+		pthread_mutex_unlock(&mux->mutex);
+		if (FAILED(ret))
+			break;
+	}
+
+	/* the connection is gone, wake everybody up to find out */
+	pthread_mutex_lock(&mux->mutex);
+	if (mux->dead != FLAG_SET)
+		DEBUG(DBG_MUX,"MUX:connection to buddy lost\n");
+	mux->dead = FLAG_SET;
+	pthread_cond_broadcast(&mux->work);
+	pthread_cond_broadcast(&mux->ready);
+	pthread_mutex_unlock(&mux->mutex);
+
+	return NULL;
+}
+
+void *run_mux_writer(void *arg) {
+
+	/* declare local variables */
+	mux_t *mux = (mux_t*)arg;
+	unsigned char frame[MUX_HEADER_LEN+MUX_FRAME_MAX];
+	int len, off, n;
+
+	/* do function */
+	pthread_mutex_lock(&mux->mutex);
+	while (1) {
+		while ( (mux->dead != FLAG_SET) &&
+			((len=mux_next_frame(mux,frame)) == 0) )
+			pthread_cond_wait(&mux->work,&mux->mutex);
+		if (mux->dead == FLAG_SET)
+			break;
+
+		/* taking the frame made room in a send buffer */
+		pthread_cond_broadcast(&mux->ready);
+
+		/* write without the lock, the application keeps going */
+		pthread_mutex_unlock(&mux->mutex);
+		for(off=0;off<len;off+=n) {
+			if ((n=write(mux->sd,frame+off,len-off)) <= 0)
+				break;
+		}
+		pthread_mutex_lock(&mux->mutex);
+
+		if (off < len) {
+			DEBUG(DBG_MUX,"MUX:couldn't write to buddy\n");
+			mux->dead = FLAG_SET;
+			pthread_cond_broadcast(&mux->ready);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mux->mutex);
+
+	return NULL;
+}
+
+int mux_next_frame(mux_t *mux, unsigned char *frame) {
+
+	/* declare local variables */
+	mux_header_t hdr;
+	mux_stream_t *s;
+	unsigned int grant;
+	int i, h, n;
+
+	/* do function */
+	for(i=0;i<MUX_MAX_STREAMS;i++) {
+		h = (mux->turn + i) % MUX_MAX_STREAMS;
+		s = &mux->streams[h];
+		if (s->state != MUX_STREAM_OPEN)
+			continue;
+
+		n = 0;
+		if (s->send_open == FLAG_SET) {
+			hdr.type = MUX_FRAME_OPEN;
+			s->send_open = FLAG_UNSET;
+		}
+		else if ( (s->unacked >= MUX_WINDOW/2) ||
+			  ( (s->unacked > 0) && (s->closed == FLAG_SET) ) ) {
+			hdr.type = MUX_FRAME_WINDOW;
+			grant = htonl(s->unacked);
+			memcpy(frame+MUX_HEADER_LEN,&grant,sizeof(grant));
+			n = sizeof(grant);
+			s->unacked = 0;
+		}
+		else if ( (s->tx.count > 0) && (s->send_window > 0) ) {
+			hdr.type = MUX_FRAME_DATA;
+			n = (s->tx.count < s->send_window) ? s->tx.count :
+							     s->send_window;
+			if (n > MUX_FRAME_MAX)
+				n = MUX_FRAME_MAX;
+			mux_ring_get(&s->tx,frame+MUX_HEADER_LEN,n);
+			s->send_window -= n;
+		}
+		else if ( (s->closed == FLAG_SET) && (s->tx.count == 0) &&
+			  (s->close_sent != FLAG_SET) ) {
+			hdr.type = MUX_FRAME_CLOSE;
+			s->close_sent = FLAG_SET;
+		}
+		else
+			continue;
+
+		hdr.id  = htonl( (s->remote == FLAG_SET) ?
+				 (s->id | MUX_ID_REMOTE) : s->id );
+		hdr.len = htons(n);
+		memcpy(frame,&hdr,MUX_HEADER_LEN);
+
+		/* the next turn goes to the next stream */
+		mux->turn = (h + 1) % MUX_MAX_STREAMS;
+
+		/* a closed stream may have been waiting on either one: its
+		 * CLOSE, or the WINDOW giving back data that came after it */
+		if ( (hdr.type == MUX_FRAME_CLOSE) ||
+		     (hdr.type == MUX_FRAME_WINDOW) )
+			mux_release(mux,h);
+
+		return MUX_HEADER_LEN + n;
+	}
+
+	return 0;
+}
+
+errorcode mux_handle_frame(mux_t *mux, mux_header_t *hdr,
+			   unsigned char *payload) {
+
+	/* declare local variables */
+	mux_stream_t *s;
+	unsigned int grant;
+	int h;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(mux,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(hdr,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(payload,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (hdr->type == MUX_FRAME_OPEN) {
+		if ( (hdr->id & MUX_ID_REMOTE) || (mux_find(mux,hdr->id) >= 0) )
+			return ERROR_1;
+		if ((h=mux_alloc(mux)) < 0) {
+			/* the buddy opened more streams than fit */
+			DEBUG(DBG_MUX,"MUX:no room for stream %u\n",hdr->id);
+			return ERROR_2;
+		}
+		mux->streams[h].id     = hdr->id;
+		mux->streams[h].remote = FLAG_SET;
+		mux->streams[h].queued = FLAG_SET;
+		mux->accept[mux->accept_count++] = h;
+		pthread_cond_broadcast(&mux->ready);
+		DEBUG(DBG_MUX,"MUX:buddy opened stream %u\n",hdr->id);
+		return SUCCESS;
+	}
+
+	/* every other frame is for an existing stream.  frames for a stream
+	 * that is already gone are late and harmless */
+	if ((h=mux_find(mux,hdr->id)) < 0)
+		return SUCCESS;
+	s = &mux->streams[h];
+
+	switch (hdr->type) {
+		case MUX_FRAME_DATA :
+			if ( (s->remote_closed == FLAG_SET) ||
+			     (s->rx.count + hdr->len > MUX_WINDOW) ) {
+				DEBUG(DBG_MUX,"MUX:buddy overran stream %u\n",
+					s->id);
+				return ERROR_3;
+			}
+			if (s->closed == FLAG_SET) {
+				/* nobody will read it, give the window back */
+				s->unacked += hdr->len;
+				pthread_cond_signal(&mux->work);
+			}
+			else {
+				mux_ring_put(&s->rx,payload,hdr->len);
+				pthread_cond_broadcast(&mux->ready);
+			}
+			break;
+		case MUX_FRAME_WINDOW :
+			if (hdr->len != sizeof(grant))
+				return ERROR_4;
+			memcpy(&grant,payload,sizeof(grant));
+			s->send_window += ntohl(grant);
+			if (s->send_window > MUX_WINDOW)
+				return ERROR_5;
+			pthread_cond_signal(&mux->work);
+			break;
+		case MUX_FRAME_CLOSE :
+			s->remote_closed = FLAG_SET;
+			pthread_cond_broadcast(&mux->ready);
+			mux_release(mux,h);
+			break;
+		default :
+			return ERROR_6;
+	}
+
+	return SUCCESS;
+}
+
+int mux_find(mux_t *mux, unsigned int id) {
+
+	/* declare local variables */
+	flag_t remote;
+	int i;
+
+	/* do function */
+	/* the bit is set when the stream is this side's, so a stream the
+	 * buddy opened arrives without it */
+	remote = (id & MUX_ID_REMOTE) ? FLAG_UNSET : FLAG_SET;
+	id &= ~MUX_ID_REMOTE;
+
+	for(i=0;i<MUX_MAX_STREAMS;i++) {
+		if ( (mux->streams[i].state == MUX_STREAM_OPEN) &&
+		     (mux->streams[i].id == id) &&
+		     (mux->streams[i].remote == remote) )
+			return i;
+	}
+
+	return -1;
+}
+
+int mux_alloc(mux_t *mux) {
+
+	/* declare local variables */
+	mux_stream_t *s;
+	int i;
+
+	/* do function */
+	for(i=0;i<MUX_MAX_STREAMS;i++) {
+		s = &mux->streams[i];
+		if (s->state != MUX_STREAM_FREE)
+			continue;
+		s->state         = MUX_STREAM_OPEN;
+		s->send_open     = FLAG_UNSET;
+		s->tx.head       = s->tx.count = 0;
+		s->rx.head       = s->rx.count = 0;
+		s->send_window   = MUX_WINDOW;
+		s->unacked       = 0;
+		s->closed        = FLAG_UNSET;
+		s->close_sent    = FLAG_UNSET;
+		s->remote_closed = FLAG_UNSET;
+		s->queued        = FLAG_UNSET;
+		return i;
+	}
+
+	return -1;
+}
+
+void mux_release(mux_t *mux, int stream) {
+
+	/* declare local variables */
+	mux_stream_t *s = &mux->streams[stream];
+
+	/* do function */
+	if ( (s->closed == FLAG_SET) && (s->close_sent == FLAG_SET) &&
+	     (s->remote_closed == FLAG_SET) && (s->unacked == 0) ) {
+		DEBUG(DBG_MUX,"MUX:stream %u finished\n",s->id);
+		s->state = MUX_STREAM_FREE;
+	}
+}
+
+errorcode mux_check(mux_t *mux, int stream) {
+
+	/* do function */
+	if ( (stream < 0) || (stream >= MUX_MAX_STREAMS) ||
+	     (mux->streams[stream].state != MUX_STREAM_OPEN) ||
+	     (mux->streams[stream].closed == FLAG_SET) ||
+	     (mux->streams[stream].queued == FLAG_SET) )
+		return ERROR_1;
+
+	return SUCCESS;
+}
+
+int mux_ring_put(mux_ring_t *ring, unsigned char *buf, int len) {
+
+	/* declare local variables */
+	unsigned int tail, n, first;
+
+	/* do function */
+	n = MUX_WINDOW - ring->count;
+	if ((unsigned int)len < n)
+		n = len;
+
+	/* the free space may wrap around the end of the buffer */
+	tail  = (ring->head + ring->count) % MUX_WINDOW;
+	first = (MUX_WINDOW - tail < n) ? MUX_WINDOW - tail : n;
+	memcpy(ring->data+tail,buf,first);
+	memcpy(ring->data,buf+first,n-first);
+	ring->count += n;
+
+	return n;
+}
+
+int mux_ring_get(mux_ring_t *ring, unsigned char *buf, int len) {
+
+	/* declare local variables */
+	unsigned int n, first;
+
+	/* do function */
+	n = ring->count;
+	if ((unsigned int)len < n)
+		n = len;
+
+	first = (MUX_WINDOW - ring->head < n) ? MUX_WINDOW - ring->head : n;
+	memcpy(buf,ring->data+ring->head,first);
+	memcpy(buf+first,ring->data,n-first);
+	ring->head   = (ring->head + n) % MUX_WINDOW;
+	ring->count -= n;
+
+	return n;
+}
+
+errorcode mux_read_full(sock_t sd, unsigned char *buf, int len) {
+
+	/* declare local variables */
+	int off, n;
+
+	/* do function */
+	for(off=0;off<len;off+=n) {
+		if ((n=read(sd,buf+off,len-off)) <= 0)
+			return ERROR_TCP_READ;
+	}
+
+	return SUCCESS;
+}
@@ -0,0 +1,262 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file mux.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief carries many independent byte streams over the single connection
+ *        natblaster_connect returns, so opening another stream to the same
+ *        buddy costs no NAT traversal
+ *
+ * Both sides run a mux over their end of the connection.  Every stream is
+ * sent as frames:
+ *
+ *   stream id   [4 bytes, network order, MUX_ID_REMOTE set if the receiver
+ *                opened the stream]
+ *   frame type  [1 byte]
+ *   length      [2 bytes, network order, payload bytes]
+ *   payload     [length bytes]
+ *
+ * Each side numbers the streams it opens itself, so no agreement on who
+ * opens what is needed.  A sender may have at most MUX_WINDOW unread bytes
+ * outstanding on a stream; the receiver hands out more with MUX_FRAME_WINDOW
+ * frames as the application reads.  A writer thread sends one frame per
+ * stream in turn, so a busy stream can not starve the others, and a reader
+ * thread sorts incoming frames into the streams.
+ */
+
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include <pthread.h>
+
+/** @brief the most streams open at once on one mux */
+#define MUX_MAX_STREAMS		32
+
+/** @brief the bytes a stream may have in flight and unread, and the size of
+ *  each stream's send and receive buffers */
+#define MUX_WINDOW		65536
+
+/** @brief the most payload bytes in one frame.  smaller frames let the
+ *  writer move between streams more often */
+#define MUX_FRAME_MAX		16384
+
+/** @brief the length of a frame header */
+#define MUX_HEADER_LEN		7
+
+/** @brief a frame opening a stream (no payload) */
+#define MUX_FRAME_OPEN		1
+
+/** @brief a frame with stream data */
+#define MUX_FRAME_DATA		2
+
+/** @brief a frame granting more window (payload: 4 byte increment in
+ *  network order) */
+#define MUX_FRAME_WINDOW	3
+
+/** @brief a frame saying the sender will send no more data on the stream
+ *  (no payload) */
+#define MUX_FRAME_CLOSE		4
+
+/** @brief set in a frame's stream id when the stream was opened by the
+ *  side receiving the frame */
+#define MUX_ID_REMOTE		0x80000000
+
+/** @brief a stream slot that is not in use */
+#define MUX_STREAM_FREE		0
+
+/** @brief a stream slot that is in use */
+#define MUX_STREAM_OPEN		1
+
+/** @brief structure for the header of a frame */
+struct mux_header {
+	/** @brief the stream id (see MUX_ID_REMOTE) */
+	unsigned int id;
+	/** @brief the frame type */
+	unsigned char type;
+	/** @brief the payload length */
+	unsigned short len;
+} __attribute__((__packed__));
+
+/** @brief typedef for the mux_header structure */
+typedef struct mux_header mux_header_t;
+
+/** @brief a circular byte buffer */
+struct mux_ring {
+	/** @brief the bytes */
+	unsigned char data[MUX_WINDOW];
+	/** @brief the index of the first byte held */
+	unsigned int head;
+	/** @brief the number of bytes held */
+	unsigned int count;
+};
+
+/** @brief typedef for the mux_ring structure */
+typedef struct mux_ring mux_ring_t;
+
+/** @brief structure for one stream */
+struct mux_stream {
+	/** @brief MUX_STREAM_FREE or MUX_STREAM_OPEN */
+	int state;
+	/** @brief the id the opening side gave the stream */
+	unsigned int id;
+	/** @brief FLAG_SET if the buddy opened the stream */
+	flag_t remote;
+	/** @brief FLAG_SET until the OPEN frame has been sent (streams this
+	 *  side opens only) */
+	flag_t send_open;
+	/** @brief bytes the application wrote that are still to be sent */
+	mux_ring_t tx;
+	/** @brief bytes received that the application has not read yet */
+	mux_ring_t rx;
+	/** @brief the bytes that may still be sent before the buddy grants
+	 *  more window */
+	unsigned int send_window;
+	/** @brief the bytes read by the application that have not been
+	 *  granted back to the buddy yet */
+	unsigned int unacked;
+	/** @brief FLAG_SET once the application closed the stream */
+	flag_t closed;
+	/** @brief FLAG_SET once the CLOSE frame has been sent */
+	flag_t close_sent;
+	/** @brief FLAG_SET once the buddy's CLOSE frame has been received */
+	flag_t remote_closed;
+	/** @brief FLAG_SET once the stream is in the accept queue */
+	flag_t queued;
+};
+
+/** @brief typedef for the mux_stream structure */
+typedef struct mux_stream mux_stream_t;
+
+/** @brief structure for a mux over one connection.  it holds every
+ *  stream's buffers (a few megabytes), so allocate it rather than putting
+ *  it on the stack */
+struct mux {
+	/** @brief the connection to the buddy */
+	sock_t sd;
+	/** @brief the streams, a stream handle is an index into this array */
+	mux_stream_t streams[MUX_MAX_STREAMS];
+	/** @brief the handles of streams the buddy opened that have not been
+	 *  accepted yet, in the order they were opened */
+	int accept[MUX_MAX_STREAMS];
+	/** @brief the number of handles in the accept queue */
+	int accept_count;
+	/** @brief the id to give the next stream this side opens.  it wraps
+	 *  within the bits below MUX_ID_REMOTE (see mux_open) */
+	unsigned int next_id;
+	/** @brief the stream the writer gives the next turn to */
+	int turn;
+	/** @brief FLAG_SET once the connection failed or the mux is being
+	 *  stopped */
+	flag_t dead;
+	/** @brief protects everything above */
+	pthread_mutex_t mutex;
+	/** @brief signalled when the writer may have something to send */
+	pthread_cond_t work;
+	/** @brief signalled when a stream got data, window, a close or when
+	 *  a new stream can be accepted */
+	pthread_cond_t ready;
+	/** @brief the reader thread */
+	pthread_t reader;
+	/** @brief the writer thread */
+	pthread_t writer;
+};
+
+/** @brief typedef for the mux structure */
+typedef struct mux mux_t;
+
+/**
+ * @brief starts a mux over a connected socket.  the mux owns the socket
+ *        until mux_stop.
+ *
+ * @param mux pointer to the mux to start
+ * @param sd the connection to the buddy (as returned by natblaster_connect)
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode mux_start(mux_t *mux, sock_t sd);
+
+/**
+ * @brief stops a mux, closing the connection and every stream
+ *
+ * @param mux pointer to the mux
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode mux_stop(mux_t *mux);
+
+/**
+ * @brief opens a new stream to the buddy
+ *
+ * @param mux pointer to the mux
+ * @param stream pointer to fill in with the stream handle
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode mux_open(mux_t *mux, int *stream);
+
+/**
+ * @brief waits for the buddy to open a stream
+ *
+ * @param mux pointer to the mux
+ * @param stream pointer to fill in with the stream handle
+ *
+ * @return SUCCESS, errorcode on failure (the connection was lost)
+ */
+errorcode mux_accept(mux_t *mux, int *stream);
+
+/**
+ * @brief sends bytes on a stream, waiting while the stream's send buffer is
+ *        full
+ *
+ * @param mux pointer to the mux
+ * @param stream the stream handle
+ * @param buf the bytes to send
+ * @param len the number of bytes
+ *
+ * @return the number of bytes sent (all of them), errorcode on failure
+ */
+int mux_send(mux_t *mux, int stream, void *buf, int len);
+
+/**
+ * @brief receives bytes from a stream, waiting until some arrive
+ *
+ * @param mux pointer to the mux
+ * @param stream the stream handle
+ * @param buf the buffer to receive into
+ * @param len the size of the buffer
+ *
+ * @return the number of bytes received, 0 once the buddy closed the stream,
+ *         errorcode on failure
+ */
+int mux_recv(mux_t *mux, int stream, void *buf, int len);
+
+/**
+ * @brief closes a stream.  bytes already sent are still delivered; the
+ *        handle must not be used afterwards.
+ *
+ * @param mux pointer to the mux
+ * @param stream the stream handle
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode mux_close(mux_t *mux, int stream);
+
+#endif /* __MUX_H__ */
@@ -0,0 +1,144 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file mux_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the stream multiplexer.  unless noted, they
+ *        are called with the mux mutex held.
+ */
+
+#ifndef __MUX_PRIVATE_H__
+#define __MUX_PRIVATE_H__
+
+#include "mux.h"
+
+/**
+ * @brief the entry point of the thread reading frames from the connection
+ *
+ * @param arg the mux (the mutex is not held)
+ *
+ * @return NULL
+ */
+void *run_mux_reader(void *arg);
+
+/**
+ * @brief the entry point of the thread writing frames to the connection
+ *
+ * @param arg the mux (the mutex is not held)
+ *
+ * @return NULL
+ */
+void *run_mux_writer(void *arg);
+
+/**
+ * @brief picks the next frame to send, giving each stream a turn
+ *
+ * @param mux pointer to the mux
+ * @param frame buffer of MUX_HEADER_LEN+MUX_FRAME_MAX bytes to build the
+ *        frame in
+ *
+ * @return the length of the frame, 0 if there is nothing to send
+ */
+int mux_next_frame(mux_t *mux, unsigned char *frame);
+
+/**
+ * @brief handles a frame received from the buddy
+ *
+ * @param mux pointer to the mux
+ * @param hdr the frame header (host byte order)
+ * @param payload the frame payload
+ *
+ * @return SUCCESS, errorcode if the buddy broke the protocol
+ */
+errorcode mux_handle_frame(mux_t *mux, mux_header_t *hdr,
+			   unsigned char *payload);
+
+/**
+ * @brief finds the stream a frame is for
+ *
+ * @param mux pointer to the mux
+ * @param id the id from the frame (with MUX_ID_REMOTE)
+ *
+ * @return the stream handle, or a negative value if there is no such stream
+ */
+int mux_find(mux_t *mux, unsigned int id);
+
+/**
+ * @brief takes a free stream slot
+ *
+ * @param mux pointer to the mux
+ *
+ * @return the stream handle, or a negative value if all slots are in use
+ */
+int mux_alloc(mux_t *mux);
+
+/**
+ * @brief frees a stream's slot once both sides have closed it
+ *
+ * @param mux pointer to the mux
+ * @param stream the stream handle
+ *
+ * @return void
+ */
+void mux_release(mux_t *mux, int stream);
+
+/**
+ * @brief checks a stream handle passed in by the application
+ *
+ * @param mux pointer to the mux
+ * @param stream the stream handle
+ *
+ * @return SUCCESS, errorcode if the handle is not an open stream
+ */
+errorcode mux_check(mux_t *mux, int stream);
+
+/**
+ * @brief copies bytes into a ring, as many as fit
+ *
+ * @param ring pointer to the ring
+ * @param buf the bytes
+ * @param len the number of bytes
+ *
+ * @return the number of bytes copied
+ */
+int mux_ring_put(mux_ring_t *ring, unsigned char *buf, int len);
+
+/**
+ * @brief copies bytes out of a ring, as many as are held
+ *
+ * @param ring pointer to the ring
+ * @param buf the buffer to copy into
+ * @param len the size of the buffer
+ *
+ * @return the number of bytes copied
+ */
+int mux_ring_get(mux_ring_t *ring, unsigned char *buf, int len);
+
+/**
+ * @brief reads exactly len bytes from a socket (the mutex is not held)
+ *
+ * @param sd the socket
+ * @param buf the buffer to read into
+ * @param len the number of bytes
+ *
+ * @return SUCCESS, errorcode on failure or end of file
+ */
+errorcode mux_read_full(sock_t sd, unsigned char *buf, int len);
+
+#endif /* __MUX_PRIVATE_H__ */
@@ -29,21 +29,28 @@
 #include "nethelp.h"
 #include "peerdef.h"
 #include "peerfsm.h"
+#include "directconn.h"
 #include "peercon.h"
+#include "pktio.h"
+#include "peercache.h"
+#include "ttlcal.h"
+#include "comm.h"
 
 int natblaster_connect(ip_t helper_ip, port_t helper_port, ip_t peer_ip,
 		       port_t peer_port, ip_t buddy_ext_ip, ip_t buddy_int_ip,
-		       port_t buddy_int_port, char *device, flag_t random) {
+		       port_t buddy_int_port, char *device, flag_t random,
+		       peer_opts_t *opts) {
 
 	peer_conn_info_t info;
+	pktio_t own_io;
+	peercache_t cache, *cachep = NULL;
+	flag_t calibrated;
 
 	/* the return type is "int", but I return "errorcode"s because I know that
 	 * they are the same real type and that all the errorcodes are negative.
 	 * This makes debugging easier. */
 
-	/* first find a device if needed */
-	if (device==NULL)
-		CHECK_FAILED(findDevice(&device),ERROR_NO_DEV_FOUND);
+	DBG_TIME("time at start of connect");
 
 	DEBUG(DBG_VERBOSE, "VERBOSE:connecting to Buddy....%s:%uint\n",
 		DBG_IP(buddy_int_ip), DBG_PORT(buddy_int_port));
@@ -52,8 +59,6 @@ int natblaster_connect(ip_t helper_ip, port_t helper_port, ip_t peer_ip,
 		DBG_IP(peer_ip), DBG_PORT(peer_port));
 	DEBUG(DBG_VERBOSE, "VERBOSE:with helper............%s:%u\n",
 		DBG_IP(helper_ip), DBG_PORT(helper_port));
-	DEBUG(DBG_VERBOSE, "VERBOSE:using Device...........%s\n",
-		device);
 	DEBUG(DBG_VERBOSE, "VERBOSE: this peer is %srandom\n",
 		(random==FLAG_SET ? "" : "not "));
 
@@ -72,13 +77,37 @@ int natblaster_connect(ip_t helper_ip, port_t helper_port, ip_t peer_ip,
 	info.socks.helper             = SOCKET_UNKNOWN;
 	info.socks.helper_pred        = SOCKET_UNKNOWN;
 	info.socks.buddy              = SOCKET_UNKNOWN;
-	info.device                   = device;
+	info.pktio                    = (opts==NULL) ? NULL : opts->pktio;
 	info.direct_conn_status       = FLAG_UNSET;
+	info.relayed                  = FLAG_UNSET;
 	info.bday.stop_synack_find    = FLAG_UNSET;
+	info.race.width               = (opts==NULL) ? RACE_WIDTH_DEFAULT :
+						opts->race_width;
+	info.race.armed               = FLAG_UNSET;
+	info.overlap                  = (opts==NULL) ? FLAG_SET :
+						opts->overlap;
+	info.cache.method             = COMM_PORT_ALLOC_UNKNOWN;
+	info.cache.stride             = 0;
+	info.cache.obs_port           = PORT_UNKNOWN;
+	info.cache.buddy_method       = COMM_PORT_ALLOC_UNKNOWN;
+	info.syn_ttl                  = (opts==NULL) ? 0 : opts->syn_ttl;
+	timeout_rtt_init(&info.rtt);
 	/* buddy sock gets filled in below */
 
-	/* bind the desired port for a connection to buddy */
-	CHECK_FAILED(bindSocket(info.peer.port,&info.socks.buddy),ERROR_1);
+	if ( (info.race.width < 1) || (info.race.width > MAX_RACE_WIDTH) )
+		return ERROR_ARG_10;
+
+	DEBUG(DBG_VERBOSE, "VERBOSE:racing %u buddy port(s)\n",
+		info.race.width);
+
+	/* bind the desired port for a connection to buddy.  when racing, the
+	 * port is shared with the other candidate sockets */
+	if (info.race.width == 1)
+		CHECK_FAILED(bindSocket(info.peer.port,&info.socks.buddy),
+			ERROR_1);
+	else
+		CHECK_FAILED(bindSocketShared(info.peer.port,
+			&info.socks.buddy),ERROR_1);
 
 
 	/* bind socket for helper connection (2 before buddy port); */
@@ -94,17 +123,87 @@ int natblaster_connect(ip_t helper_ip, port_t helper_port, ip_t peer_ip,
 	CHECK_FAILED(bindSocket(info.helper_conn.prediction_port,
 				&info.socks.helper_pred),ERROR_3);
 
+	/* open a packet engine for just this connection if the caller does
+	 * not have a warm one to reuse */
+	if (info.pktio == NULL) {
+		if (FAILED(pktio_open(&own_io,NULL,device))) {
+			closeSocket(&info.socks.helper);
+			closeSocket(&info.socks.helper_pred);
+			closeSocket(&info.socks.buddy);
+			return ERROR_NO_DEV_FOUND;
+		}
+		info.pktio = &own_io;
+	}
+
+	DEBUG(DBG_VERBOSE, "VERBOSE:using Device...........%s\n",
+		info.pktio->device);
+
+	/* take what an earlier connection to this buddy learned.  a cache
+	 * that can not be used only costs the shortcut */
+	if ( (opts != NULL) && (opts->cache != NULL) ) {
+		if (FAILED(peercache_open(&cache,opts->cache))) {
+			DEBUG(DBG_CACHE,"CACHE:couldn't open %s\n",opts->cache);
+		}
+		else if (FAILED(peercache_use(&cache,&info)))
+			peercache_close(&cache);
+		else
+			cachep = &cache;
+	}
+
+	/* the SYNs must get past every NAT in front of the peer, and no
+	 * further.  a TTL the caller does not give is found once per device
+	 * and gateway */
+	calibrated = FLAG_UNSET;
+	if (info.syn_ttl == 0) {
+		if (FAILED(ttlcal_get(info.pktio->device,info.helper.ip,cachep,
+				&info.syn_ttl)))
+			info.syn_ttl = TTL_TOO_LOW;
+		else
+			calibrated = FLAG_SET;
+	}
+	DEBUG(DBG_VERBOSE, "VERBOSE:SYN TTL................%u\n",
+		info.syn_ttl);
+
 	if (FAILED(peer_fsm_start(&info))) {
+		/* a TTL that was found may be what failed, find it again */
+		if (calibrated == FLAG_SET)
+			ttlcal_forget(info.pktio->device,cachep);
 		/* close the sockets */
-		close(info.socks.helper);
-		close(info.socks.helper_pred);
-		close(info.socks.buddy);
+		release_direct_conn(&info);
+		closeSocket(&info.socks.helper);
+		closeSocket(&info.socks.helper_pred);
+		closeSocket(&info.socks.buddy);
+		if (info.pktio == &own_io)
+			pktio_close(&own_io);
+		if (cachep != NULL) {
+			peercache_learn(cachep,&info,FLAG_FAILED);
+			peercache_close(cachep);
+		}
 		return ERROR_4;
 	}
 
+	if (info.pktio == &own_io)
+		pktio_close(&own_io);
+
+	if (cachep != NULL) {
+		peercache_learn(cachep,&info,FLAG_SUCCESS);
+		peercache_close(cachep);
+	}
+
+	/* a relayed connection is carried on the helper connection */
+	if (info.relayed == FLAG_SET) {
+		DEBUG(DBG_VERBOSE, "VERBOSE:helper is relaying connection\n");
+		closeSocket(&info.socks.helper_pred);
+		closeSocket(&info.socks.buddy);
+		DBG_TIME("time at end of connect");
+		return info.socks.helper;
+	}
+
 	/* close helper sockets */
-	close(info.socks.helper);
-	close(info.socks.helper_pred);
+	closeSocket(&info.socks.helper);
+	closeSocket(&info.socks.helper_pred);
+
+	DBG_TIME("time at end of connect");
 
 	return info.socks.buddy;
 }
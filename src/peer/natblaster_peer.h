@@ -43,12 +43,67 @@
  * @param random FLAG_SET to indicate the peer wants to have random port
  *        allocation. This is only for development testing, and should always
  *        be FLAG_UNSET in normal use.
+ * @param opts optional settings for the connection attempt (see peer_opts_t),
+ *        if NULL the defaults are used
  *
- * @return the TCP socket, negative if failure
+ * @return the TCP socket, negative if failure.  If neither peer could make a
+ *         direct connection and the helper relays, this is the connection to
+ *         the helper, which carries the buddy's traffic.
  */
 int natblaster_connect(ip_t helper_ip, port_t helper_port, ip_t peer_ip,
 		       port_t peer_port, ip_t buddy_ext_ip, ip_t buddy_int_ip,
-		       port_t buddy_int_port, char *device, flag_t random);
+		       port_t buddy_int_port, char *device, flag_t random,
+		       peer_opts_t *opts);
+
+/**
+ * @brief runs a peer agent, which makes natblaster connections for local
+ *        applications (see natblaster_agent_connect).  requires root
+ *        privledge, and never returns unless there is an error.
+ *
+ * @param path the path of the unix socket to listen on (if NULL
+ *        AGENT_SOCKET_DEFAULT is used)
+ * @param device the network device to use (if NULL it is auto detected)
+ * @param backend the packet engine backend to use (see pktio.h), if NULL
+ *        the default is used
+ * @param cache the peer cache file every connection uses (see peercache.h),
+ *        if NULL the port allocation method is always discovered
+ * @param mode the permissions of the socket file
+ * @param group the group given the socket file, negative for the agent's
+ *        own group.  only root, the user running the agent and members of
+ *        this group may use the agent, whatever the mode allows
+ *
+ * @return negative errorcode on failure
+ */
+int natblaster_agent(char *path, char *device, char *backend, char *cache,
+		     int mode, int group);
+
+/**
+ * @brief asks a peer agent to create a natblaster TCP connection.  takes the
+ *        same arguments as natblaster_connect except for the device (the
+ *        agent's is used), and does not require root privledge.
+ *
+ * @param path the path of the agent's unix socket (if NULL
+ *        AGENT_SOCKET_DEFAULT is used)
+ * @param helper_ip the helper's IP
+ * @param helper_port the helper's port
+ * @param peer_ip the peer's IP
+ * @param peer_port the port the peer wants to get a TCP connection to buddy on
+ * @param buddy_ext_ip the external IP address of the buddy
+ * @param buddy_int_ip the internal IP address of the buddy
+ * @param buddy_int_port the internal port the buddy will create a TCP
+ *        connection from
+ * @param random FLAG_SET to indicate the peer wants to have random port
+ *        allocation (development testing only)
+ * @param opts optional settings for the connection attempt (see peer_opts_t),
+ *        if NULL the defaults are used.  the pktio field is ignored.
+ *
+ * @return the TCP socket, negative if failure
+ */
+int natblaster_agent_connect(char *path, ip_t helper_ip, port_t helper_port,
+			     ip_t peer_ip, port_t peer_port,
+			     ip_t buddy_ext_ip, ip_t buddy_int_ip,
+			     port_t buddy_int_port, flag_t random,
+			     peer_opts_t *opts);
 
 #endif /* __NATBLASTER_PEER_H__ */
 
@@ -0,0 +1,423 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file peercache.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a persistent cache of what earlier connections learned about the
+ *        peer's NAT and the buddy's
+ */
+
+#include "peercache.h"
+#include "peercache_private.h"
+#include "comm.h"
+#include "debug.h"
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+
+errorcode peercache_open(peercache_t *cache, char *path) {
+
+	/* declare local variables */
+	struct stat st;
+	void *map;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if ((cache->fd=open(path,O_RDWR|O_CREAT,PEERCACHE_FILE_MODE)) < 0)
+		return ERROR_FILE_OPEN;
+
+	if (FAILED(peercache_lock(cache,LOCK_EX))) {
+		close(cache->fd);
+		return ERROR_1;
+	}
+
+	/* a new (or truncated) file is grown to size and set up below */
+	if ( (fstat(cache->fd,&st) < 0) ||
+	     ( (st.st_size != sizeof(peercache_file_t)) &&
+	       (ftruncate(cache->fd,sizeof(peercache_file_t)) < 0) ) ) {
+		close(cache->fd);
+		return ERROR_2;
+	}
+
+	map = mmap(NULL,sizeof(peercache_file_t),PROT_READ|PROT_WRITE,
+		   MAP_SHARED,cache->fd,0);
+	if (map == MAP_FAILED) {
+		close(cache->fd);
+		return ERROR_3;
+	}
+	cache->file = (peercache_file_t*)map;
+
+	if (cache->file->magic != PEERCACHE_MAGIC) {
+		DEBUG(DBG_CACHE,"CACHE:initializing cache file %s\n",path);
+		memset(cache->file,0,sizeof(peercache_file_t));
+		cache->file->magic = PEERCACHE_MAGIC;
+	}
+
+	peercache_lock(cache,LOCK_UN);
+
+	return SUCCESS;
+}
+
+errorcode peercache_close(peercache_t *cache) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+
+	/* do function */
+	munmap(cache->file,sizeof(peercache_file_t));
+	close(cache->fd);
+
+	return SUCCESS;
+}
+
+errorcode peercache_lookup(peercache_t *cache, peercache_entry_t *key,
+			   peercache_entry_t *entry) {
+
+	/* declare local variables */
+	int i;
+	unsigned long age;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(entry,ERROR_NULL_ARG_3);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+	if ((i=peercache_find(cache,key)) >= 0)
+		memcpy(entry,&cache->file->entries[i],sizeof(peercache_entry_t));
+	peercache_lock(cache,LOCK_UN);
+
+	if (i < 0)
+		return ERROR_NOT_FOUND;
+
+	age = (unsigned long)time(NULL) - entry->observed;
+	DEBUG(DBG_CACHE,"CACHE:entry is %lu seconds old\n",age);
+	if (age > PEERCACHE_MAX_AGE)
+		return ERROR_TIMEOUT;
+
+	return SUCCESS;
+}
+
+errorcode peercache_store(peercache_t *cache, peercache_entry_t *entry) {
+
+	/* declare local variables */
+	int i, oldest;
+	peercache_entry_t *slot;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(entry,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+
+	/* reuse the pair's entry, else a free one, else the oldest */
+	if ((i=peercache_find(cache,entry)) < 0) {
+		oldest = 0;
+		for(i=0;i<PEERCACHE_ENTRIES;i++) {
+			slot = &cache->file->entries[i];
+			if (slot->used != FLAG_SET)
+				break;
+			if (slot->observed <
+			    cache->file->entries[oldest].observed)
+				oldest = i;
+		}
+		if (i == PEERCACHE_ENTRIES)
+			i = oldest;
+	}
+
+	slot = &cache->file->entries[i];
+	memcpy(slot,entry,sizeof(peercache_entry_t));
+	slot->used = FLAG_SET;
+	slot->observed = (unsigned long)time(NULL);
+
+	peercache_lock(cache,LOCK_UN);
+
+	DEBUG(DBG_CACHE,"CACHE:stored entry %d\n",i);
+
+	return SUCCESS;
+}
+
+errorcode peercache_forget(peercache_t *cache, peercache_entry_t *key) {
+
+	/* declare local variables */
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+	if ((i=peercache_find(cache,key)) >= 0) {
+		memset(&cache->file->entries[i],0,sizeof(peercache_entry_t));
+		DEBUG(DBG_CACHE,"CACHE:forgot entry %d\n",i);
+	}
+	peercache_lock(cache,LOCK_UN);
+
+	return SUCCESS;
+}
+
+errorcode peercache_use(peercache_t *cache, peer_conn_info_t *info) {
+
+	/* declare local variables */
+	peercache_entry_t key, entry;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(info,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_key(info,&key),ERROR_1);
+
+	if (FAILED(peercache_lookup(cache,&key,&entry))) {
+		DEBUG(DBG_CACHE,"CACHE:miss, discovering port allocation\n");
+		return SUCCESS;
+	}
+
+	/* only take what the helper will accept (see helper_fsm_hello) */
+	if ( (entry.method == COMM_PORT_ALLOC_RAND) ||
+	     ( (entry.method == COMM_PORT_ALLOC_SEQ) && (entry.stride > 0) &&
+	       (entry.stride <= COMM_MAX_STRIDE) ) ) {
+		info->cache.method = entry.method;
+		info->cache.stride = entry.stride;
+		DEBUG(DBG_CACHE,"CACHE:hit, %s allocation (stride %u), "
+			"buddy was %s on port %u\n",
+			(entry.method==COMM_PORT_ALLOC_SEQ) ?
+				"sequential" : "random", entry.stride,
+			(entry.buddy_method==COMM_PORT_ALLOC_SEQ) ?
+				"sequential" : "random",
+			DBG_PORT(entry.buddy_ext_port));
+	}
+
+	return SUCCESS;
+}
+
+errorcode peercache_learn(peercache_t *cache, peer_conn_info_t *info,
+			  flag_t result) {
+
+	/* declare local variables */
+	peercache_entry_t entry;
+	int obs, ext;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(info,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_key(info,&entry),ERROR_1);
+
+	if (result != FLAG_SUCCESS) {
+		/* what was remembered did not work, discover it again */
+		if (info->cache.method != COMM_PORT_ALLOC_UNKNOWN)
+			CHECK_FAILED(peercache_forget(cache,&entry),ERROR_2);
+		return SUCCESS;
+	}
+
+	entry.method         = info->port_alloc.method;
+	entry.ext_port       = info->port_alloc.ext_port;
+	entry.buddy_method   = info->cache.buddy_method;
+	entry.buddy_ext_port = info->buddy.ext_port;
+	entry.stride         = info->cache.stride;
+
+	obs = ntohs(info->cache.obs_port);
+	ext = ntohs(info->port_alloc.ext_port);
+	if (info->port_alloc.method == COMM_PORT_ALLOC_SEQ) {
+		if (obs == ntohs(info->helper_conn.persistent_port))
+			/* the NAT keeps the internal ports */
+			entry.stride = ntohs(info->peer.port) - obs;
+		else if (info->cache.method == COMM_PORT_ALLOC_UNKNOWN)
+			/* the prediction was two allocations past the helper
+			 * connection, one went to the second connection */
+			entry.stride = (ext - obs) / 2;
+	}
+
+	CHECK_FAILED(peercache_store(cache,&entry),ERROR_3);
+
+	return SUCCESS;
+}
+
+errorcode peercache_hops_lookup(peercache_t *cache, peercache_hops_t *key,
+				peercache_hops_t *hops) {
+
+	/* declare local variables */
+	int i;
+	unsigned long age;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(hops,ERROR_NULL_ARG_3);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+	if ((i=peercache_hops_find(cache,key)) >= 0)
+		memcpy(hops,&cache->file->hops[i],sizeof(peercache_hops_t));
+	peercache_lock(cache,LOCK_UN);
+
+	if (i < 0)
+		return ERROR_NOT_FOUND;
+
+	age = (unsigned long)time(NULL) - hops->observed;
+	DEBUG(DBG_CACHE,"CACHE:hop count is %lu seconds old\n",age);
+	if (age > PEERCACHE_HOPS_AGE_LIMIT(hops))
+		return ERROR_TIMEOUT;
+
+	return SUCCESS;
+}
+
+errorcode peercache_hops_store(peercache_t *cache, peercache_hops_t *hops) {
+
+	/* declare local variables */
+	int i, oldest;
+	peercache_hops_t *slot;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(hops,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+
+	/* reuse the device's entry, else a free one, else the oldest */
+	if ((i=peercache_hops_find(cache,hops)) < 0) {
+		oldest = 0;
+		for(i=0;i<PEERCACHE_HOPS;i++) {
+			slot = &cache->file->hops[i];
+			if (slot->used != FLAG_SET)
+				break;
+			if (slot->observed < cache->file->hops[oldest].observed)
+				oldest = i;
+		}
+		if (i == PEERCACHE_HOPS)
+			i = oldest;
+	}
+
+	slot = &cache->file->hops[i];
+	memcpy(slot,hops,sizeof(peercache_hops_t));
+	slot->device[PEERCACHE_DEVICE_LEN-1] = '\0';
+	slot->used = FLAG_SET;
+	slot->observed = (unsigned long)time(NULL);
+
+	peercache_lock(cache,LOCK_UN);
+
+	DEBUG(DBG_CACHE,"CACHE:stored hop count %d\n",i);
+
+	return SUCCESS;
+}
+
+errorcode peercache_hops_forget(peercache_t *cache, peercache_hops_t *key) {
+
+	/* declare local variables */
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(peercache_lock(cache,LOCK_EX),ERROR_1);
+	if ((i=peercache_hops_find(cache,key)) >= 0) {
+		memset(&cache->file->hops[i],0,sizeof(peercache_hops_t));
+		DEBUG(DBG_CACHE,"CACHE:forgot hop count %d\n",i);
+	}
+	peercache_lock(cache,LOCK_UN);
+
+	return SUCCESS;
+}
+
+errorcode peercache_key(peer_conn_info_t *info, peercache_entry_t *key) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+
+	/* do function */
+	memset(key,0,sizeof(peercache_entry_t));
+	key->helper_ip      = info->helper.ip;
+	key->peer_ip        = info->peer.ip;
+	key->buddy_ext_ip   = info->buddy.ext_ip;
+	key->buddy_int_ip   = info->buddy.int_ip;
+	key->buddy_int_port = info->buddy.int_port;
+
+	return SUCCESS;
+}
+
+int peercache_match(peercache_entry_t *a, peercache_entry_t *b) {
+
+	return ( (a->helper_ip == b->helper_ip) &&
+		 (a->peer_ip == b->peer_ip) &&
+		 (a->buddy_ext_ip == b->buddy_ext_ip) &&
+		 (a->buddy_int_ip == b->buddy_int_ip) &&
+		 (a->buddy_int_port == b->buddy_int_port) );
+}
+
+int peercache_find(peercache_t *cache, peercache_entry_t *key) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	for(i=0;i<PEERCACHE_ENTRIES;i++) {
+		if ( (cache->file->entries[i].used == FLAG_SET) &&
+		     peercache_match(&cache->file->entries[i],key) )
+			return i;
+	}
+
+	return -1;
+}
+
+int peercache_hops_find(peercache_t *cache, peercache_hops_t *key) {
+
+	/* declare local variables */
+	int i;
+	peercache_hops_t *slot;
+
+	/* do function */
+	for(i=0;i<PEERCACHE_HOPS;i++) {
+		slot = &cache->file->hops[i];
+		if ( (slot->used == FLAG_SET) &&
+		     (slot->gateway == key->gateway) &&
+		     (strncmp(slot->device,key->device,
+				PEERCACHE_DEVICE_LEN) == 0) )
+			return i;
+	}
+
+	return -1;
+}
+
+errorcode peercache_lock(peercache_t *cache, int op) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(cache,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (flock(cache->fd,op) < 0)
+		return ERROR_1;
+
+	return SUCCESS;
+}
@@ -0,0 +1,273 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file peercache.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a persistent cache of what earlier connections learned about the
+ *        peer's NAT and the buddy's, so a reconnect can skip port
+ *        allocation discovery
+ *
+ * The cache is a small file mapped into memory and shared by every process
+ * using it.  An entry is kept per helper, local address and buddy.  When a
+ * fresh entry is found the peer hands its cached allocation method to the
+ * helper in the HELLO message and the helper answers with a port prediction
+ * right away instead of asking for a second connection.  If a connection
+ * made that way fails its entry is forgotten, so the next connection does
+ * the full discovery again.
+ *
+ * The file also keeps how many hops away the peer's NAT is (see ttlcal.h),
+ * per device and gateway, which does not depend on the buddy.
+ */
+
+#ifndef __PEERCACHE_H__
+#define __PEERCACHE_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include "peerdef.h"
+#include <time.h>
+
+/** @brief the value at the start of a valid cache file ("NBC2") */
+#define PEERCACHE_MAGIC		0x4e424332
+
+/** @brief the number of entries a cache file holds.  when full, the oldest
+ *  entry is replaced */
+#define PEERCACHE_ENTRIES	64
+
+/** @brief the age in seconds after which an entry is not trusted.  NATs
+ *  expire idle mappings in minutes, and a port allocation method seen
+ *  long ago may belong to a network the peer has since left */
+#define PEERCACHE_MAX_AGE	600
+
+/** @brief the permissions given to a newly created cache file */
+#define PEERCACHE_FILE_MODE	0600
+
+/** @brief the number of NAT hop counts a cache file holds.  when full, the
+ *  oldest is replaced */
+#define PEERCACHE_HOPS		16
+
+/** @brief the age in seconds after which a NAT hop count is measured
+ *  again.  the NATs in front of a device and gateway rarely change */
+#define PEERCACHE_HOPS_MAX_AGE	86400
+
+/** @brief the age in seconds after which a calibration that found no NAT
+ *  is tried again.  probes lost to a busy or filtering router look the
+ *  same as no NAT, so this is kept shorter */
+#define PEERCACHE_HOPS_NONE_MAX_AGE	300
+
+/** @brief the age in seconds after which a NAT hop count x (a pointer to
+ *  a peercache_hops_t) is not trusted */
+#define PEERCACHE_HOPS_AGE_LIMIT(x) (((x)->ttl == 0) ? \
+	PEERCACHE_HOPS_NONE_MAX_AGE : PEERCACHE_HOPS_MAX_AGE)
+
+/** @brief the longest device name a NAT hop count is kept for */
+#define PEERCACHE_DEVICE_LEN	16
+
+/** @brief structure with what is known about one peer/buddy pair */
+struct peercache_entry {
+	/** @brief FLAG_SET if the entry is in use */
+	flag_t used;
+	/** @brief the helper's ip */
+	ip_t helper_ip;
+	/** @brief the peer's internal ip */
+	ip_t peer_ip;
+	/** @brief the buddy's external ip */
+	ip_t buddy_ext_ip;
+	/** @brief the buddy's internal ip */
+	ip_t buddy_int_ip;
+	/** @brief the buddy's internal port */
+	port_t buddy_int_port;
+	/** @brief the peer's NAT port allocation method */
+	flag_t method;
+	/** @brief how far the external port of the connection to the buddy
+	 *  is from the external port of the helper connection made just
+	 *  before it (see comm_msg_hello_t) */
+	unsigned char stride;
+	/** @brief the peer's external port for the last connection to the
+	 *  buddy, as predicted by the helper */
+	port_t ext_port;
+	/** @brief the buddy's NAT port allocation method */
+	flag_t buddy_method;
+	/** @brief the buddy's external port for the last connection */
+	port_t buddy_ext_port;
+	/** @brief the time the entry was stored */
+	unsigned long observed;
+} __attribute__((__packed__));
+
+/** @brief typedef for the peercache_entry structure */
+typedef struct peercache_entry peercache_entry_t;
+
+/** @brief structure with the NAT hop count measured on one device and
+ *  gateway */
+struct peercache_hops {
+	/** @brief FLAG_SET if the entry is in use */
+	flag_t used;
+	/** @brief the network device, nul terminated */
+	char device[PEERCACHE_DEVICE_LEN];
+	/** @brief the device's default gateway, IP_UNKNOWN if it has none */
+	ip_t gateway;
+	/** @brief the TTL that gets a SYN past the peer's NAT and no further
+	 *  (see ttlcal.h), 0 if calibration found no NAT */
+	unsigned char ttl;
+	/** @brief the time the entry was stored */
+	unsigned long observed;
+} __attribute__((__packed__));
+
+/** @brief typedef for the peercache_hops structure */
+typedef struct peercache_hops peercache_hops_t;
+
+/** @brief the layout of a cache file */
+struct peercache_file {
+	/** @brief PEERCACHE_MAGIC once the file has been initialized */
+	unsigned long magic;
+	/** @brief the entries */
+	peercache_entry_t entries[PEERCACHE_ENTRIES];
+	/** @brief the NAT hop counts */
+	peercache_hops_t hops[PEERCACHE_HOPS];
+} __attribute__((__packed__));
+
+/** @brief typedef for the peercache_file structure */
+typedef struct peercache_file peercache_file_t;
+
+/** @brief structure holding an open cache */
+struct peercache {
+	/** @brief the descriptor of the cache file, locked while the mapping
+	 *  is read or changed */
+	int fd;
+	/** @brief the cache file mapped into memory */
+	peercache_file_t *file;
+};
+
+/** @brief typedef for the peercache structure */
+typedef struct peercache peercache_t;
+
+/**
+ * @brief opens a cache file, creating and initializing it if needed
+ *
+ * @param cache pointer to the cache to open
+ * @param path the cache file
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_open(peercache_t *cache, char *path);
+
+/**
+ * @brief closes a cache opened by peercache_open
+ *
+ * @param cache pointer to the cache
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_close(peercache_t *cache);
+
+/**
+ * @brief finds a fresh entry for a peer/buddy pair
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the helper, peer and buddy fields filled in
+ * @param entry pointer to copy the found entry into
+ *
+ * @return SUCCESS, errorcode if no entry younger than PEERCACHE_MAX_AGE
+ *         is found
+ */
+errorcode peercache_lookup(peercache_t *cache, peercache_entry_t *key,
+			   peercache_entry_t *entry);
+
+/**
+ * @brief stores an entry, replacing the entry for the same pair if there is
+ *        one.  the observed time is set to now.
+ *
+ * @param cache pointer to the cache
+ * @param entry the entry to store
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_store(peercache_t *cache, peercache_entry_t *entry);
+
+/**
+ * @brief removes the entry for a peer/buddy pair, if there is one
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the helper, peer and buddy fields filled in
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_forget(peercache_t *cache, peercache_entry_t *key);
+
+/**
+ * @brief sets up a connection from the cache.  if a fresh entry for the
+ *        connection's peer/buddy pair is found, the connection skips the
+ *        discovery of the peer's port allocation method.
+ *
+ * @param cache pointer to the cache
+ * @param info the connection, with the helper, peer and buddy filled in
+ *
+ * @return SUCCESS, errorcode on failure (a cache miss is not a failure)
+ */
+errorcode peercache_use(peercache_t *cache, peer_conn_info_t *info);
+
+/**
+ * @brief updates the cache with the outcome of a connection.  a successful
+ *        connection is remembered, a failed one that used the cache is
+ *        forgotten so the next one discovers again.
+ *
+ * @param cache pointer to the cache
+ * @param info the finished connection
+ * @param result FLAG_SUCCESS or FLAG_FAILED
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_learn(peercache_t *cache, peer_conn_info_t *info,
+			  flag_t result);
+
+/**
+ * @brief finds a fresh NAT hop count for a device and gateway
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the device and gateway filled in
+ * @param hops pointer to copy the found entry into
+ *
+ * @return SUCCESS, errorcode if no entry younger than its
+ *         PEERCACHE_HOPS_AGE_LIMIT is found
+ */
+errorcode peercache_hops_lookup(peercache_t *cache, peercache_hops_t *key,
+				peercache_hops_t *hops);
+
+/**
+ * @brief stores a NAT hop count, replacing the one for the same device and
+ *        gateway if there is one.  the observed time is set to now.
+ *
+ * @param cache pointer to the cache
+ * @param hops the entry to store
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_hops_store(peercache_t *cache, peercache_hops_t *hops);
+
+/**
+ * @brief removes the NAT hop count for a device and gateway, if there is one
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the device and gateway filled in
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_hops_forget(peercache_t *cache, peercache_hops_t *key);
+
+#endif /* __PEERCACHE_H__ */
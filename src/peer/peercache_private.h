@@ -0,0 +1,83 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file peercache_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the peer cache
+ */
+
+#ifndef __PEERCACHE_PRIVATE_H__
+#define __PEERCACHE_PRIVATE_H__
+
+#include "peercache.h"
+
+/**
+ * @brief checks if two entries are for the same peer/buddy pair
+ *
+ * @param a an entry
+ * @param b another entry
+ *
+ * @return 1 if they are, 0 otherwise
+ */
+int peercache_match(peercache_entry_t *a, peercache_entry_t *b);
+
+/**
+ * @brief finds the index of the entry for a peer/buddy pair.  the cache
+ *        must be locked.
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the helper, peer and buddy fields filled in
+ *
+ * @return the index, or a negative value if there is no entry for the pair
+ */
+int peercache_find(peercache_t *cache, peercache_entry_t *key);
+
+/**
+ * @brief fills in the helper, peer and buddy fields of an entry from a
+ *        connection
+ *
+ * @param info the connection
+ * @param key pointer to the entry to fill in (the rest is zeroed)
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_key(peer_conn_info_t *info, peercache_entry_t *key);
+
+/**
+ * @brief finds the index of the NAT hop count for a device and gateway.
+ *        the cache must be locked.
+ *
+ * @param cache pointer to the cache
+ * @param key an entry with the device and gateway filled in
+ *
+ * @return the index, or a negative value if there is no entry for them
+ */
+int peercache_hops_find(peercache_t *cache, peercache_hops_t *key);
+
+/**
+ * @brief locks or unlocks the cache file against other processes
+ *
+ * @param cache pointer to the cache
+ * @param op LOCK_EX or LOCK_UN
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peercache_lock(peercache_t *cache, int op);
+
+#endif /* __PEERCACHE_PRIVATE_H__ */
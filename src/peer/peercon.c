@@ -30,17 +30,19 @@
 #include "spoof.h"
 #include "sniff.h"
 #include "debug.h"
+#include "timeout.h"
 
-errorcode wait_for_direct_conn(flag_t *check_flag) {
+errorcode wait_for_direct_conn(flag_t *check_flag, int timeout) {
 
 	/* declare local variables */
 
 	/* error check arguments */
 	CHECK_NOT_NULL(check_flag,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_2);
 
 	/* do function */
 	CHECK_FAILED(wait_for_flag(check_flag,FLAG_FAILED|FLAG_SUCCESS,
-		DIRECT_CONNECTION_TIMEOUT),ERROR_1);
+		timeout),ERROR_1);
 
 	return SUCCESS;
 }
@@ -62,13 +64,14 @@ errorcode findDevice(char **dev) {
 	return SUCCESS;
 }
 
-errorcode flood_syns(tcp_packet_info_t tcp_skeleton, char *device) {
+errorcode flood_syns(tcp_packet_info_t tcp_skeleton, pktio_t *io,
+		     unsigned char ttl) {
 
 	/* declare local variables */
 	int i;
 
 	/* error check arguments */
-	CHECK_NOT_NULL(device,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_2);
 
 	/* do function */
 
@@ -85,7 +88,7 @@ errorcode flood_syns(tcp_packet_info_t tcp_skeleton, char *device) {
 
 	for (i=0;i<SYN_FLOOD_COUNT;i++) {
 		tcp_skeleton.s_port = (port_t)rand();
-		CHECK_FAILED(spoof(&tcp_skeleton,device,NULL,0,TTL_TOO_LOW),
+		CHECK_FAILED(spoof(&tcp_skeleton,io,NULL,0,ttl),
 			ERROR_CALLED_FUNCTION);
 	}
 
@@ -144,7 +147,7 @@ errorcode wait_and_join_find_synack(peer_conn_info_t *info) {
 	DBG_TIME("waiting for SYNACK flood listening thread to finished");
 	/* wait for the find synack thread to finish */
 	wait_ret = wait_for_flag(&info->bday.find_synack_done,FLAG_SET,
-		FIND_SYN_ACK_TIMEOUT);
+		timeout_ms(TIMEOUT_SYN_ACK,&info->rtt,NULL));
 
 	/* force the thread to finish even if it wasn't done */
 	info->bday.stop_synack_find = FLAG_SET;
@@ -191,7 +194,7 @@ errorcode synack_flood(peer_conn_info_t *info, seq_num_t seq_num) {
 	/* do the flood */
 	for (i=0;i<SYN_ACK_FLOOD_COUNT;i++) {
 		skeleton.d_port = port = (port_t)rand();
-		CHECK_FAILED(spoof(&skeleton, info->device,&port,sizeof(port),
+		CHECK_FAILED(spoof(&skeleton, info->pktio,&port,sizeof(port),
 			TTL_OK),ERROR_1);
 	}
 
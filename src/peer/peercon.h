@@ -28,16 +28,18 @@
 #include "errorcodes.h"
 #include "def.h"
 #include "peerdef.h"
+#include "pktio.h"
 
 /**
  * @brief waits until the direct connection flag is set to FLAG_SUCCESS or
   *       FLAG_FAILED
   *
   * @param check_flag pointer to the flag to wait on
+  * @param timeout the most milliseconds to wait
   *
   * @return SUCCESS, errorcode on failure
   */
-errorcode wait_for_direct_conn(flag_t *check_flag);
+errorcode wait_for_direct_conn(flag_t *check_flag, int timeout);
 
 /**
  * @brief finds a network devide (requires root privledge)
@@ -59,11 +61,14 @@ errorcode findDevice(char **dev);
  * @param tcp_skeleton a skeleton tcp_packet_info_t to base SYN's on.  The
  *         d_addr, d_port, s_addr, and seq_num fields will be inspected.
  *
- * @param device the device to forge SYNs on
+ * @param io the packet engine to forge SYNs with
+ *
+ * @param ttl the TTL of the SYNs (see ttlcal.h)
  *
  * @return SUCCESS, errorcode on failure
  */
-errorcode flood_syns(tcp_packet_info_t tcp_skeleton, char *device);
+errorcode flood_syns(tcp_packet_info_t tcp_skeleton, pktio_t *io,
+		     unsigned char ttl);
 
 /**
  * @brief a function to spawn a thread to look for a SYN/ACK with
@@ -25,36 +25,34 @@
 #define __PEERDEF_H__
 
 #include "def.h"
+#include "timeout.h"
 #include <pcap.h>
 #include <pthread.h>
 
-/** @brief macro for the TTL value that is too low to reach the buddy.  In a
- * complete implementation this value would be auto-detected.  Here it is set
- * to a known OK value. */
+/** @brief macro for the TTL value that is too low to reach the buddy when
+ * the NAT is the first hop.  It is used when calibration (see ttlcal.h)
+ * finds no NAT. */
 #define TTL_TOO_LOW		2
 
 /** @brief macro for the TTL value that is high enough to reach the buddy */
 #define TTL_OK			64
 
-/** @brief timeout time in seconds to wait for a direct connection flag */
-#define DIRECT_CONNECTION_TIMEOUT	180
-
 /** @brief the number of SYNs to send in a SYN flood */
 #define SYN_FLOOD_COUNT			502
 
 /** @brief the number of SYN/ACKs to send in a SYN/ACK flood */
 #define SYN_ACK_FLOOD_COUNT		502
 
-/** @brief time in seconds to timeout looking for a SYN/ACK flooded packet */
-#define FIND_SYN_ACK_TIMEOUT		20
-
 /** @brief struture to hold information pertaining to the birthday paradox */
 struct bday_peer {
 	/** @brief a flag to indicate whether or not to stop looking for
 	 *  a synack */
 	flag_t stop_synack_find;
-	/** @brief the port that the synack came in on */
+	/** @brief the port that the synack came in on, as the buddy saw it
+	 *  (the external port it was sent to) */
 	port_t port;
+	/** @brief the internal port the NAT delivered the synack to */
+	port_t int_port;
 	/** @brief indicates if the port has been set */
 	flag_t port_set;
 	/** @brief the synack has been found, or an error occured */
@@ -66,6 +64,59 @@ struct bday_peer {
 /** @brief typedef for the bday structure */
 typedef struct bday_peer bday_peer_t;
 
+/** @brief structure to hold the direct connection attempts raced over a
+ *  window of predicted buddy ports.  A symmetric sequential NAT allocates
+ *  the next external port for every new destination, so other connections
+ *  through the buddy's NAT may have taken the predicted port by the time
+ *  the buddy connects.  Candidate i connects to the predicted port plus i
+ *  (see start_candidates), and every candidate socket is bound to the same
+ *  peer port (see prepare_direct_conn). */
+struct race_peer {
+	/** @brief the number of candidate buddy ports being raced */
+	unsigned char width;
+	/** @brief a socket per candidate, candidate k connects to the buddy's
+	 *  predicted port plus k.  candidate 0 is the buddy socket bound by
+	 *  natblaster_connect */
+	sock_t socks[MAX_RACE_WIDTH];
+	/** @brief FLAG_SET for each candidate whose connect started.  the
+	 *  others send no SYN and are left out of the race */
+	flag_t started[MAX_RACE_WIDTH];
+	/** @brief the number of candidates whose connect started */
+	unsigned char live;
+	/** @brief the SYN captured for each candidate */
+	tcp_packet_info_t syn[MAX_RACE_WIDTH];
+	/** @brief the SYN/ACK to forge for each candidate, filled in from its
+	 *  SYN while the helper collects the buddy's sequence numbers.  only
+	 *  the ack number is left to fill in. */
+	tcp_packet_info_t synack[MAX_RACE_WIDTH];
+	/** @brief the candidate whose connection completed first */
+	int winner;
+	/** @brief FLAG_SET once the candidate sockets are bound and set up to
+	 *  connect (see prepare_direct_conn) */
+	flag_t armed;
+} __attribute__((__packed__));
+
+/** @brief typedef for the race_peer structure */
+typedef struct race_peer race_peer_t;
+
+/** @brief structure with what a connection takes from, and learns for, the
+ *  peer cache (see peercache.h) */
+struct cache_peer {
+	/** @brief the port allocation method remembered for the peer's NAT,
+	 *  COMM_PORT_ALLOC_UNKNOWN to have the helper discover it */
+	flag_t method;
+	/** @brief the remembered stride (see comm_msg_hello_t) */
+	unsigned char stride;
+	/** @brief the external port the helper saw for the helper
+	 *  connection */
+	port_t obs_port;
+	/** @brief the buddy's port allocation method */
+	flag_t buddy_method;
+} __attribute__((__packed__));
+
+/** @brief typedef for the cache_peer structure */
+typedef struct cache_peer cache_peer_t;
+
 /** @brief structure with helper connection info */
 struct helper_conn {
 	/** @brief the port used for the persistent helper connection */
@@ -104,15 +155,28 @@ struct peer_conn_info {
 	helper_conn_t helper_conn;
 	/** @brief the port allocation type */
 	port_alloc_t port_alloc;
-	/** @brief the device to connect on (used for libpcap/libnet) */
-	char *device;
-	/** @brief the syn sent to the buddy */
-	tcp_packet_info_t buddy_syn;
+	/** @brief what the peer cache knows and learns */
+	cache_peer_t cache;
+	/** @brief the packet engine to capture and spoof with (see pktio.h) */
+	struct pktio *pktio;
+	/** @brief the syns sent to the buddy and the sockets that sent them */
+	race_peer_t race;
+	/** @brief the TTL of the SYNs that must get past the peer's NAT but
+	 *  not reach the buddy's (see ttlcal.h) */
+	unsigned char syn_ttl;
 	/** @brief the syn/ack to send to the buddy */
 	tcp_packet_info_t buddy_syn_ack;
 	/** @brief a flag to indicate if the connection attempt to the buddy
 	 *  has failed */
 	flag_t direct_conn_status;
+	/** @brief FLAG_SET if the helper relays the connection to the buddy
+	 *  (no direct connection is made) */
+	flag_t relayed;
+	/** @brief FLAG_SET to overlap the connection steps (see peer_opts_t) */
+	flag_t overlap;
+	/** @brief the round trip time to the helper, which sets how long the
+	 *  waits last (see timeout.h) */
+	timeout_rtt_t rtt;
 	/** @brief information about the birthday paradox SYN and SYN/ACK
 	 * floods */
 	bday_peer_t bday;
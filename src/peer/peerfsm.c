@@ -37,7 +37,9 @@
 #include "debug.h"
 #include "sniff.h"
 #include "spoof.h"
+#include "timeout.h"
 #include <time.h>
+#include <string.h>
 #include <stdlib.h>
 
 errorcode peer_fsm_start(peer_conn_info_t *info) {
@@ -47,8 +49,8 @@ errorcode peer_fsm_start(peer_conn_info_t *info) {
 	DBG_TIME("time at start of fsm");
 
 	/* create the tcp connection to the helper */
-	CHECK_FAILED(tcp_connect(info->helper.ip,info->helper.port,
-	                         &(info->socks.helper)),ERROR_TCP_CONNECT);
+	CHECK_FAILED(pktio_connect(info->pktio,info->socks.helper,
+		info->helper.ip,info->helper.port),ERROR_TCP_CONNECT);
 
 
 	/* move into the hello state */
@@ -78,24 +80,82 @@ errorcode peer_fsm_hello(peer_conn_info_t *info) {
 	msg.buddy_int_ip    = info->buddy.int_ip;
 	msg.buddy_int_port  = info->buddy.int_port;
 	msg.buddy_ext_ip    = info->buddy.ext_ip;
+	msg.port_alloc      = info->cache.method;
+	msg.stride          = info->cache.stride;
 
 	DEBUG(DBG_BDAY,"BDAY: peer internal port: %u\n",
 		DBG_PORT(info->peer.port));
 
+	/* time the helper's answer, unless more is sent before it is read */
+	if (info->overlap != FLAG_SET)
+		timeout_rtt_mark(&info->rtt);
+
 	/* ...and send it */
 	CHECK_FAILED(sendMsg(info->socks.helper,COMM_MSG_HELLO,&msg,
 			     sizeof(msg)),ERROR_NETWORK_SEND);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent HELLO\n");
 
-	/* call next state */
-	CHECK_FAILED(peer_fsm_conn_again(info),ERROR_CALLED_FUNCTION);
+	if (info->overlap == FLAG_SET)
+		CHECK_FAILED(peer_fsm_send_ahead(info),ERROR_CALLED_FUNCTION_2);
+
+	/* call next state.  with a remembered port allocation method the
+	 * helper predicts without a second connection */
+	if (info->cache.method != COMM_PORT_ALLOC_UNKNOWN)
+		CHECK_FAILED(peer_fsm_check_port_pred(info),
+			ERROR_CALLED_FUNCTION_1);
+	else
+		CHECK_FAILED(peer_fsm_conn_again(info),ERROR_CALLED_FUNCTION);
+
+	DBG_TIME("time at end of function");
+
+	return SUCCESS;
+}
+
+errorcode peer_fsm_send_ahead(peer_conn_info_t *info) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
+
+	/* do function */
+	DBG_TIME("time at start of function");
+
+	/* the helper asks for the second connection unless it was told the
+	 * port allocation method, so make it now.  it still follows the
+	 * first connection, and sooner than it would after the helper's
+	 * request, so the NAT is less likely to hand a port out in between */
+	if (info->cache.method == COMM_PORT_ALLOC_UNKNOWN) {
+		CHECK_FAILED(pktio_connect(info->pktio,
+				info->socks.helper_pred,info->helper.ip,
+				info->helper.port),ERROR_TCP_CONNECT);
+		CHECK_FAILED(sendMsg(info->socks.helper,
+			COMM_MSG_CONNECTED_AGAIN,NULL,0),ERROR_NETWORK_SEND);
+		DEBUG(DBG_PROTOCOL,"PROTOCOL:sent CONNECTED_AGAIN early\n");
+	}
+
+	/* the helper reads this after the port prediction whatever it is */
+	CHECK_FAILED(sendMsg(info->socks.helper,
+		COMM_MSG_WAITING_FOR_BUDDY_ALLOC, NULL, 0),ERROR_NETWORK_SEND);
+	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent WAITING_FOR_BUDDY_ALLOC early\n");
+
+	/* the sockets only need the peer's port, ready them while the
+	 * helper answers.  if it fails they are readied when used */
+	if (FAILED(prepare_direct_conn(info))) {
+		DEBUG(DBG_DIR_CONN,"DIR_CONN:couldn't ready sockets early\n");
+	}
 
 	DBG_TIME("time at end of function");
 
 	return SUCCESS;
 }
 
+void peer_fsm_rtt(peer_conn_info_t *info) {
+
+	/* do function */
+	timeout_rtt_measure(&info->rtt,1);
+	timeout_rtt_socket(&info->rtt,info->socks.helper);
+}
+
 errorcode peer_fsm_conn_again(peer_conn_info_t *info) {
 
 	/* declare variables */
@@ -111,27 +171,32 @@ errorcode peer_fsm_conn_again(peer_conn_info_t *info) {
 		ERROR_NETWORK_READ);
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received CONNECT_AGAIN\n");
+	peer_fsm_rtt(info);
 
-	/* open a second connection */
-	CHECK_FAILED(tcp_connect(info->helper.ip,info->helper.port,
-			&(info->socks.helper_pred)),ERROR_TCP_CONNECT);
+	/* overlapped, the second connection was already made */
+	if (info->overlap != FLAG_SET) {
+		/* open a second connection */
+		CHECK_FAILED(pktio_connect(info->pktio,
+				info->socks.helper_pred,info->helper.ip,
+				info->helper.port),ERROR_TCP_CONNECT);
 
-	/* send a message indicating that the second connection has
-	 * been made */
-	CHECK_FAILED(sendMsg(info->socks.helper,COMM_MSG_CONNECTED_AGAIN,
-			NULL,0),ERROR_NETWORK_SEND);
+		/* send a message indicating that the second connection has
+		 * been made */
+		CHECK_FAILED(sendMsg(info->socks.helper,
+			COMM_MSG_CONNECTED_AGAIN,NULL,0),ERROR_NETWORK_SEND);
 
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent CONNECTED_AGAIN\n");
+		DEBUG(DBG_PROTOCOL,"PROTOCOL:sent CONNECTED_AGAIN\n");
+	}
 
 	/* enter next state */
 	if (FAILED(peer_fsm_check_port_pred(info))) {
 		/* close the second connection socket */
-		close(info->socks.helper_pred);
+		closeSocket(&info->socks.helper_pred);
 		return ERROR_CALLED_FUNCTION;
 	}
 
 	/* close the second connection */
-	close(info->socks.helper_pred);
+	closeSocket(&info->socks.helper_pred);
 
 	DBG_TIME("time at end of function");
 
@@ -153,18 +218,28 @@ errorcode peer_fsm_check_port_pred(peer_conn_info_t *info) {
 	CHECK_FAILED(readMsg(info->socks.helper,COMM_MSG_PORT_PRED,
 			&msg,sizeof(comm_msg_pred_port_t)),ERROR_NETWORK_READ);
 
+	/* with a remembered port allocation method this is the helper's
+	 * first answer */
+	if (info->cache.method != COMM_PORT_ALLOC_UNKNOWN)
+		peer_fsm_rtt(info);
+
 	info->port_alloc.method = msg.port_alloc;
+	info->port_alloc.ext_port = msg.ext_port;
+	info->cache.obs_port = msg.obs_port;
 
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received PORT_PRED\n");
 	DEBUG(DBG_VERBOSE,"VERBOSE:alloc method = %s\n",
 		(info->port_alloc.method==COMM_PORT_ALLOC_SEQ) ?
 		"sequential" : "random" );
 
-	/* send message saying waiting for buddy information from helper  */
-	CHECK_FAILED(sendMsg(info->socks.helper,
-		COMM_MSG_WAITING_FOR_BUDDY_ALLOC, NULL, 0),ERROR_NETWORK_SEND);
-
-	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent WAITING_FOR_BUDDY_ALLOC\n");
+	/* send message saying waiting for buddy information from helper
+	 * (overlapped, it was sent with the hello) */
+	if (info->overlap != FLAG_SET) {
+		CHECK_FAILED(sendMsg(info->socks.helper,
+			COMM_MSG_WAITING_FOR_BUDDY_ALLOC, NULL, 0),
+			ERROR_NETWORK_SEND);
+		DEBUG(DBG_PROTOCOL,"PROTOCOL:sent WAITING_FOR_BUDDY_ALLOC\n");
+	}
 	/* enter next state */
 	CHECK_FAILED(peer_fsm_buddy_alloc(info),ERROR_CALLED_FUNCTION);
 
@@ -193,9 +268,27 @@ errorcode peer_fsm_buddy_alloc(peer_conn_info_t *info) {
 	DEBUG(DBG_VERBOSE,"VERBOSE:buddy alloc method: %s\n",
 		(buddy.buddy_port_alloc==COMM_PORT_ALLOC_SEQ
 			? "sequential" : "random" ));
-	DEBUG(DBG_VERBOSE,"VERBOSE:connection is %ssupported\n",
-		(buddy.support==COMM_CONNECTION_SUPPORTED ? "" : "not "));
+	DEBUG(DBG_VERBOSE,"VERBOSE:connection is %s\n",
+		(buddy.support==COMM_CONNECTION_SUPPORTED ? "supported" :
+		(buddy.support==COMM_CONNECTION_RELAYED ? "relayed" :
+							  "not supported")));
+
+	info->cache.buddy_method = buddy.buddy_port_alloc;
 
+	/* no direct connection will be made with the readied sockets */
+	if (buddy.support != COMM_CONNECTION_SUPPORTED)
+		release_direct_conn(info);
+
+	if (buddy.support == COMM_CONNECTION_UNSUPPORTED)
+		return ERROR_1;
+
+	/* the helper relays from here on, the helper connection is the
+	 * connection to the buddy */
+	if (buddy.support == COMM_CONNECTION_RELAYED) {
+		info->relayed = FLAG_SET;
+		DBG_TIME("time at end of function");
+		return SUCCESS;
+	}
 
 	/* send a message asking for the buddy's external port */
 	CHECK_FAILED(sendMsg(info->socks.helper,COMM_MSG_WAITING_FOR_BUDDY_PORT,
@@ -267,6 +360,7 @@ errorcode peer_fsm_start_direct_conn(peer_conn_info_t *info) {
 
 	/* declare local variables */
 	comm_msg_buddy_syn_seq_t msg;
+	int i;
 
 	/* error check arguments */
 	CHECK_FAILED(info,ERROR_NULL_ARG_1);
@@ -274,20 +368,46 @@ errorcode peer_fsm_start_direct_conn(peer_conn_info_t *info) {
 	/* do function */
 	DBG_TIME("time at start of function");
 
+	/* the engine may have been used before, so drop what it already
+	 * captured.  this has to happen before the SYNs can go out. */
+	CHECK_FAILED(pktio_flush(info->pktio),ERROR_CALLED_FUNCTION_1);
+
 	CHECK_FAILED(start_direct_conn(info),ERROR_CALLED_FUNCTION_1);
 	DEBUG(DBG_BDAY,"BDAY:started direct connection\n");
 	CHECK_FAILED(capture_peer_to_buddy_syn(info),ERROR_CALLED_FUNCTION_2);
 
-	/* the syn has been found, send it to the helper */
-	msg.seq_num = info->buddy_syn.seq_num;
-	DEBUG(DBG_VERBOSE,"VERBOSE:sequence number of buddy syn is %u\n",
-		DBG_SEQ_NUM(msg.seq_num));
+	/* the syns have been found, send them to the helper.  candidates
+	 * that did not start sent no syn and are left out */
+	memset(&msg,0,sizeof(msg));
+	msg.count = 0;
+	for(i=0;i<info->race.width;i++) {
+		if (info->race.started[i] != FLAG_SET)
+			continue;
+		msg.seq_num[msg.count] = info->race.syn[i].seq_num;
+		DEBUG(DBG_VERBOSE,"VERBOSE:sequence number of buddy syn %d "
+			"is %u\n",i,DBG_SEQ_NUM(msg.seq_num[msg.count]));
+		msg.count++;
+	}
 
 	/* send message */
 	CHECK_FAILED(sendMsg(info->socks.helper,COMM_MSG_BUDDY_SYN_SEQ,
 		&msg,sizeof(msg)),ERROR_NETWORK_SEND);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BUDDY_SYN_SEQ message\n");
 
+	/* while the helper collects the buddy's sequence numbers, build the
+	 * SYN/ACKs to forge - almost a straight copy of the captured syns,
+	 * just with the ACK flag set.  the ack numbers come from the buddy */
+	for(i=0;i<info->race.width;i++) {
+		info->race.synack[i].d_addr   = info->race.syn[i].d_addr;
+		info->race.synack[i].s_addr   = info->race.syn[i].s_addr;
+		info->race.synack[i].d_port   = info->race.syn[i].d_port;
+		info->race.synack[i].s_port   = info->race.syn[i].s_port;
+		info->race.synack[i].seq_num  = info->race.syn[i].seq_num;
+		info->race.synack[i].window   = info->race.syn[i].window;
+		info->race.synack[i].ack_flag = FLAG_SET;
+		info->race.synack[i].syn_flag = FLAG_SET;
+	}
+
 	/* enter the next state */
 	CHECK_FAILED(peer_fsm_forge_syn_ack(info),ERROR_CALLED_FUNCTION_3);
 
@@ -301,6 +421,7 @@ errorcode peer_fsm_forge_syn_ack(peer_conn_info_t *info) {
 	/* declare local variables */
 	comm_msg_peer_syn_seq_t peer_syn_msg;
 	comm_msg_goodbye_t goodbye;
+	int i, j;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
@@ -308,31 +429,38 @@ errorcode peer_fsm_forge_syn_ack(peer_conn_info_t *info) {
 	/* do function */
 	DBG_TIME("time at start of function");
 
-	/* receive the sequence number to base SYN/ACK on */
+	/* receive the sequence numbers to base SYN/ACKs on */
 	CHECK_FAILED(readMsg(info->socks.helper,COMM_MSG_PEER_SYN_SEQ,
 		&peer_syn_msg,sizeof(peer_syn_msg)),ERROR_NETWORK_READ);
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:received PEER_SYN_SEQ\n");
-
-	/* fill in info about syn/ack to forge - almost a straight copy of
-	 * previous captured syn - just set ACK flag and fill in ack num */
-	info->buddy_syn_ack.d_addr   = info->buddy_syn.d_addr;
-	info->buddy_syn_ack.s_addr   = info->buddy_syn.s_addr;
-	info->buddy_syn_ack.d_port   = info->buddy_syn.d_port;
-	info->buddy_syn_ack.s_port   = info->buddy_syn.s_port;
-	info->buddy_syn_ack.seq_num  = info->buddy_syn.seq_num;
-	info->buddy_syn_ack.ack_num  = SEQ_NUM_ADD(peer_syn_msg.seq_num,1);
-	info->buddy_syn_ack.window   = info->buddy_syn.window;
-	info->buddy_syn_ack.ack_flag = FLAG_SET;
-	info->buddy_syn_ack.syn_flag = FLAG_SET;
-
-	/* forge the SYN/ACK */
-	CHECK_FAILED(spoof(&info->buddy_syn_ack,info->device,NULL,0,TTL_OK),
-		ERROR_CALLED_FUNCTION);
-	DEBUG(DBG_VERBOSE,"VERBOSE:forged SYN/ACK to buddy\n");
+	if ( (peer_syn_msg.count < 1) || (peer_syn_msg.count > MAX_RACE_WIDTH) )
+		return ERROR_OUT_OF_BOUNDS;
+
+	/* forge a SYN/ACK from every candidate for every buddy SYN.  which of
+	 * the buddy's SYNs came from the port this peer's NAT really mapped
+	 * to is unknown, but the buddy drops the SYN/ACKs that don't match */
+	for(i=0;i<info->race.width;i++) {
+		if (info->race.started[i] != FLAG_SET)
+			continue;
+		/* the syn/ack was built while waiting, only the ack number is
+		 * left */
+		info->buddy_syn_ack = info->race.synack[i];
+
+		for(j=0;j<peer_syn_msg.count;j++) {
+			info->buddy_syn_ack.ack_num =
+				SEQ_NUM_ADD(peer_syn_msg.seq_num[j],1);
+
+			/* forge the SYN/ACK */
+			CHECK_FAILED(spoof(&info->buddy_syn_ack,info->pktio,
+				NULL,0,TTL_OK),ERROR_CALLED_FUNCTION);
+		}
+	}
+	DEBUG(DBG_VERBOSE,"VERBOSE:forged %d SYN/ACK(s) to buddy\n",
+		info->race.live*peer_syn_msg.count);
 
 	/* now just wait to success (hopefully) */
-	CHECK_FAILED(wait_for_direct_conn(&info->direct_conn_status),
-		ERROR_1);
+	CHECK_FAILED(wait_for_direct_conn(&info->direct_conn_status,
+		timeout_ms(TIMEOUT_DIRECT_CONN,&info->rtt,NULL)),ERROR_1);
 
 	DEBUG(DBG_VERBOSE,"VERBOSE:connection attempt was %ssuccessful\n",
 		((info->direct_conn_status==FLAG_SUCCESS) ? "" : "not "));
@@ -363,6 +491,10 @@ errorcode peer_fsm_start_bday(peer_conn_info_t *info) {
 
 	/* do function */
 
+	/* the bday paradox finds the exact port, so there is nothing to race */
+	release_direct_conn(info);
+	info->race.width = 1;
+
 	DBG_TIME("time at start of function");
 
 	/* seed random sequence number */
@@ -378,7 +510,7 @@ errorcode peer_fsm_start_bday(peer_conn_info_t *info) {
 
 	/* do flooding */
 	DBG_TIME("starting SYN flood");
-	CHECK_FAILED(flood_syns(skeleton,info->device),ERROR_1);
+	CHECK_FAILED(flood_syns(skeleton,info->pktio,info->syn_ttl),ERROR_1);
 	DBG_TIME("finished SYN flood");
 
 	/* start looking for the SYN/ACK */
@@ -433,8 +565,9 @@ errorcode peer_fsm_end_bday(peer_conn_info_t *info) {
 	DEBUG(DBG_PROTOCOL,"PROTOCOL:sent BDAY_SUCCESS_PORT\n");
 
 	/* fill in the peer internal port location with the new internal port
-	 * since the direct connection needs to know what it is */
-	info->peer.port = info->bday.port;
+	 * since the direct connection needs to know what it is.  the port sent
+	 * above is the external one, which the NAT maps to this one */
+	info->peer.port = info->bday.int_port;
 
 	/* enter the next state */
 	/* the next state is recursive, go back and receive another message
@@ -455,6 +588,11 @@ errorcode peer_fsm_reply_bday(peer_conn_info_t *info) {
 	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
 
 	/* do function */
+
+	/* the bday paradox finds the exact port, so there is nothing to race */
+	release_direct_conn(info);
+	info->race.width = 1;
+
 	DBG_TIME("time at start of function");
 
 	CHECK_FAILED(sendMsg(info->socks.helper,
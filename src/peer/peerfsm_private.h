@@ -34,6 +34,29 @@
  */
 errorcode peer_fsm_hello(peer_conn_info_t *info);
 
+/**
+ * @brief sends, right after the hello, the replies the helper is sure to ask
+ *        for (making the port prediction second connection if it is needed)
+ *        and readies the buddy sockets while the helper answers.  only used
+ *        when the connection steps are overlapped.
+ *
+ * @param info a pointer to the connection information
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode peer_fsm_send_ahead(peer_conn_info_t *info);
+
+/**
+ * @brief takes the round trip time to the helper from the helper's first
+ *        answer: the time since the hello was sent (if nothing was sent
+ *        ahead of the answer) and the kernel's estimate
+ *
+ * @param info a pointer to the connection information
+ *
+ * @return void
+ */
+void peer_fsm_rtt(peer_conn_info_t *info);
+
 /**
  * @brief handles a connect again message
  *
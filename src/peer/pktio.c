@@ -0,0 +1,356 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a packet engine that injects and captures the tcp packets a peer
+ *        forges and sniffs, in front of a choice of backends
+ */
+
+#include "pktio.h"
+#include "pktio_private.h"
+#include "debug.h"
+#include "peercon.h"
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/time.h>
+
+/** @brief the backends that can be opened by name */
+static pktio_ops_t *pktio_backends[] = {
+	&pktio_pcap_ops,
+	&pktio_packet_ops,
+	NULL
+};
+
+errorcode pktio_open(pktio_t *io, char *backend, char *device) {
+
+	/* declare local variables */
+	pktio_ops_t *ops;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (backend == NULL)
+		backend = PKTIO_BACKEND_DEFAULT;
+	CHECK_FAILED(pktio_find_ops(backend,&ops),ERROR_ARG_2);
+
+	/* first find a device if needed */
+	if (device==NULL)
+		CHECK_FAILED(findDevice(&device),ERROR_NO_DEV_FOUND);
+
+	CHECK_FAILED(pktio_open_ops(io,ops,device,NULL),ERROR_1);
+
+	return SUCCESS;
+}
+
+errorcode pktio_open_ops(pktio_t *io, pktio_ops_t *ops, char *device,
+			 void *state) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(ops,ERROR_NULL_ARG_2);
+
+	/* do function */
+	io->ops    = ops;
+	io->device = device;
+	io->state  = state;
+
+	if (pthread_mutex_init(&io->mutex,NULL) != 0)
+		return ERROR_INIT;
+
+	if (FAILED(ops->open(io))) {
+		DEBUG(DBG_SNIFF,"SNIFF:couldn't open %s backend on %s\n",
+			ops->name,(device==NULL) ? "no device" : device);
+		pthread_mutex_destroy(&io->mutex);
+		return ERROR_1;
+	}
+
+	return SUCCESS;
+}
+
+errorcode pktio_close(pktio_t *io) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+	io->ops->close(io);
+	pthread_mutex_destroy(&io->mutex);
+
+	return SUCCESS;
+}
+
+errorcode pktio_send(pktio_t *io, tcp_packet_info_t *tcp_hdr, void *payload,
+		     unsigned long payload_len, short ttl) {
+
+	/* declare local variables */
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(tcp_hdr,ERROR_NULL_ARG_2);
+	if ( (payload==NULL) && (payload_len!=0))
+		return ERROR_ARG_3;
+
+	/* do function */
+	if (pthread_mutex_lock(&io->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = io->ops->send(io,tcp_hdr,payload,payload_len,ttl);
+
+	if (pthread_mutex_unlock(&io->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return ret;
+}
+
+errorcode pktio_next(pktio_t *io, unsigned char **frame) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	return io->ops->next(io,frame);
+}
+
+errorcode pktio_flush(pktio_t *io) {
+
+	/* declare local variables */
+	unsigned char *frame;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* captures are non-blocking, so this stops once the packets
+	 * already buffered are used up */
+	do {
+		CHECK_FAILED(io->ops->next(io,&frame),ERROR_1);
+	} while (frame != NULL);
+
+	return SUCCESS;
+}
+
+errorcode pktio_connect(pktio_t *io, sock_t sd, ip_t ip, port_t port) {
+
+	/* declare local variables */
+	struct sockaddr_in server;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_2);
+
+	/* do function */
+	if (io->ops->connect != NULL)
+		return io->ops->connect(io,sd,ip,port);
+
+	memset(&server,0,sizeof(server));
+	server.sin_family      = AF_INET;
+	server.sin_addr.s_addr = ip;
+	server.sin_port        = port;
+
+	if ( (connect(sd,(struct sockaddr*)&server,sizeof(server)) < 0) &&
+	     (errno != EINPROGRESS) )
+		return ERROR_TCP_CONNECT;
+
+	return SUCCESS;
+}
+
+errorcode pktio_wait(pktio_t *io, sock_t *sds, int count, int timeout,
+		     int *winner) {
+
+	/* declare local variables */
+	struct pollfd fds[MAX_RACE_WIDTH];
+	struct timeval start, now;
+	int i, live, err, left, ready;
+	socklen_t err_len;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sds,ERROR_NULL_ARG_2);
+	if ( (count < 1) || (count > MAX_RACE_WIDTH) )
+		return ERROR_ARG_3;
+	CHECK_NOT_NULL(winner,ERROR_NULL_ARG_5);
+
+	/* do function */
+	*winner = -1;
+	if (io->ops->wait != NULL)
+		return io->ops->wait(io,sds,count,timeout,winner);
+
+	/* poll() ignores negative fds */
+	live = 0;
+	for(i=0;i<count;i++) {
+		fds[i].fd     = sds[i];
+		fds[i].events = POLLOUT;
+		if (sds[i] >= 0)
+			live++;
+	}
+
+	gettimeofday(&start,NULL);
+	left = timeout;
+	while ( (live > 0) && (*winner < 0) && (left > 0) ) {
+		ready = poll(fds,count,left);
+		gettimeofday(&now,NULL);
+		left = timeout - ((now.tv_sec - start.tv_sec)*1000 +
+				  (now.tv_usec - start.tv_usec)/1000);
+		if (ready <= 0)
+			continue;
+		for(i=0;i<count;i++) {
+			if ( (fds[i].fd < 0) || (fds[i].revents == 0) )
+				continue;
+			err = 0;
+			err_len = sizeof(err);
+			getsockopt(fds[i].fd,SOL_SOCKET,SO_ERROR,&err,&err_len);
+			if (err == 0) {
+				*winner = i;
+				break;
+			}
+			DEBUG(DBG_DIR_CONN,"DIR_CONN:candidate %d failed\n",
+				i);
+			fds[i].fd = -1;
+			live--;
+		}
+	}
+
+	return SUCCESS;
+}
+
+errorcode pktio_find_ops(char *name, pktio_ops_t **ops) {
+
+	/* declare local variables */
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(name,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(ops,ERROR_NULL_ARG_2);
+
+	/* do function */
+	for (i=0;pktio_backends[i]!=NULL;i++) {
+		if (strcmp(pktio_backends[i]->name,name) == 0) {
+			*ops = pktio_backends[i];
+			return SUCCESS;
+		}
+	}
+
+	return ERROR_NOT_FOUND;
+}
+
+errorcode pktio_build_frame(unsigned char *frame, unsigned long frame_len,
+			    tcp_packet_info_t *tcp_hdr, void *payload,
+			    unsigned long payload_len, short ttl,
+			    unsigned long *len) {
+
+	/* declare local variables */
+	struct ether_header *ether;
+	struct iphdr *ip;
+	struct tcphdr *tcp;
+	unsigned long sum;
+	/* the pseudo header the tcp checksum covers */
+	struct {
+		u_int32_t s_addr;
+		u_int32_t d_addr;
+		u_int8_t zero;
+		u_int8_t protocol;
+		u_int16_t length;
+	} __attribute__((__packed__)) pseudo;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(tcp_hdr,ERROR_NULL_ARG_3);
+	if ( (payload==NULL) && (payload_len!=0))
+		return ERROR_ARG_4;
+	CHECK_NOT_NULL(len,ERROR_NULL_ARG_7);
+
+	/* do function */
+	*len = sizeof(struct ether_header) + sizeof(struct iphdr) +
+		sizeof(struct tcphdr) + payload_len;
+	if (*len > frame_len)
+		return ERROR_OUT_OF_BOUNDS;
+	memset(frame,0,*len);
+
+	ether = (struct ether_header*) frame;
+	ip    = (struct iphdr*) (frame + sizeof(struct ether_header));
+	tcp   = (struct tcphdr*) ((unsigned char*)ip + sizeof(struct iphdr));
+
+	ether->ether_type = htons(ETHERTYPE_IP);
+
+	/* the fields in tcp_hdr are already in network byte order */
+	tcp->th_sport = tcp_hdr->s_port;
+	tcp->th_dport = tcp_hdr->d_port;
+	tcp->th_seq   = tcp_hdr->seq_num;
+	tcp->th_ack   = tcp_hdr->ack_num;
+	tcp->th_off   = sizeof(struct tcphdr) / 4;
+	tcp->th_flags = ( (tcp_hdr->syn_flag==FLAG_SET) ? TH_SYN : 0) |
+			( (tcp_hdr->ack_flag==FLAG_SET) ? TH_ACK : 0);
+	tcp->th_win   = tcp_hdr->window;
+	if (payload_len != 0)
+		memcpy((unsigned char*)tcp + sizeof(struct tcphdr),payload,
+			payload_len);
+
+	pseudo.s_addr   = tcp_hdr->s_addr;
+	pseudo.d_addr   = tcp_hdr->d_addr;
+	pseudo.zero     = 0;
+	pseudo.protocol = IPPROTO_TCP;
+	pseudo.length   = htons(sizeof(struct tcphdr) + payload_len);
+	sum = pktio_cksum_add(0,&pseudo,sizeof(pseudo));
+	sum = pktio_cksum_add(sum,tcp,sizeof(struct tcphdr) + payload_len);
+	tcp->th_sum = PKTIO_CKSUM_FOLD(sum);
+
+	ip->version  = 4;
+	ip->ihl      = sizeof(struct iphdr) / 4;
+	ip->tot_len  = htons(sizeof(struct iphdr) + sizeof(struct tcphdr) +
+				payload_len);
+	ip->id       = htons(242);
+	ip->ttl      = ttl;
+	ip->protocol = IPPROTO_TCP;
+	ip->saddr    = tcp_hdr->s_addr;
+	ip->daddr    = tcp_hdr->d_addr;
+	ip->check    = PKTIO_CKSUM_FOLD(pktio_cksum_add(0,ip,
+				sizeof(struct iphdr)));
+
+	return SUCCESS;
+}
+
+unsigned long pktio_cksum_add(unsigned long sum, void *buf, unsigned long len) {
+
+	/* declare local variables */
+	unsigned char *p = (unsigned char*) buf;
+	u_int16_t word;
+
+	/* do function */
+	while (len > 1) {
+		memcpy(&word,p,sizeof(word));
+		sum += word;
+		p   += sizeof(word);
+		len -= sizeof(word);
+	}
+
+	/* an odd byte is padded with a zero byte */
+	if (len == 1) {
+		word = 0;
+		memcpy(&word,p,1);
+		sum += word;
+	}
+
+	return sum;
+}
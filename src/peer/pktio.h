@@ -0,0 +1,201 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief a packet engine that injects and captures the tcp packets a peer
+ *        forges and sniffs, so they can be opened once and reused across
+ *        connections
+ *
+ * The engine is a front for one of several backends (see pktio_ops):
+ *   "pcap"   - libnet injection and libpcap capture (the default)
+ *   "packet" - a raw IP socket for injection and an AF_PACKET socket for
+ *              capture, needing neither libnet nor libpcap
+ *   sim      - an in-process simulated network (see simnet.h), opened with
+ *              simnet_open_pktio rather than by name
+ */
+
+#ifndef __PKTIO_H__
+#define __PKTIO_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include <pthread.h>
+
+/** @brief the backend an engine uses when none is named */
+#define PKTIO_BACKEND_DEFAULT	"pcap"
+
+/** @brief the timeout in ms a capture waits for packets before returning */
+#define PKTIO_CAPTURE_TIMEOUT	1000
+
+/** @brief the longest frame an engine builds or captures */
+#define PKTIO_FRAME_LEN		1518
+
+struct pktio;
+
+/** @brief the functions a packet engine backend provides */
+struct pktio_ops {
+	/** @brief the name the backend is opened by */
+	char *name;
+	/** @brief opens the backend on io->device, filling in io->state */
+	errorcode (*open)(struct pktio *io);
+	/** @brief releases everything open filled in */
+	errorcode (*close)(struct pktio *io);
+	/** @brief injects a tcp packet (called with io->mutex held) */
+	errorcode (*send)(struct pktio *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl);
+	/** @brief points *frame at the next captured ethernet frame holding
+	 *  a tcp packet, or at NULL if none is waiting.  the frame is valid
+	 *  until the next call. */
+	errorcode (*next)(struct pktio *io, unsigned char **frame);
+	/** @brief stands in for connect() from a bound socket (see
+	 *  pktio_connect), NULL to leave it to the kernel */
+	errorcode (*connect)(struct pktio *io, sock_t sd, ip_t ip,
+		port_t port);
+	/** @brief stands in for waiting on the non-blocking connects (see
+	 *  pktio_wait), NULL to poll() the kernel's */
+	errorcode (*wait)(struct pktio *io, sock_t *sds, int count,
+		int timeout, int *winner);
+};
+
+/** @brief typedef for the pktio_ops structure */
+typedef struct pktio_ops pktio_ops_t;
+
+/** @brief structure holding an open packet engine */
+struct pktio {
+	/** @brief the backend the engine uses */
+	pktio_ops_t *ops;
+	/** @brief the network device the engine is open on */
+	char *device;
+	/** @brief the backend's own state */
+	void *state;
+	/** @brief serializes injection, since a backend may build the packet
+	 *  in shared state */
+	pthread_mutex_t mutex;
+};
+
+/** @brief typedef for the pktio structure */
+typedef struct pktio pktio_t;
+
+/**
+ * @brief opens a packet engine on a device (the "pcap" and "packet"
+ *        backends require root privledge)
+ *
+ * @param io pointer to the engine to open
+ * @param backend the name of the backend to use (if NULL
+ *        PKTIO_BACKEND_DEFAULT is used)
+ * @param device the network device to use (if NULL it is auto detected)
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_open(pktio_t *io, char *backend, char *device);
+
+/**
+ * @brief opens a packet engine on a backend that is not looked up by name
+ *
+ * @param io pointer to the engine to open
+ * @param ops the backend to use
+ * @param device the device name to record (not looked up)
+ * @param state the backend's state, handed to its open function in
+ *        io->state
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_open_ops(pktio_t *io, pktio_ops_t *ops, char *device,
+			 void *state);
+
+/**
+ * @brief closes an engine opened with pktio_open or pktio_open_ops
+ *
+ * @param io pointer to the engine to close
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_close(pktio_t *io);
+
+/**
+ * @brief injects a tcp packet
+ *
+ * @param io pointer to the engine
+ * @param tcp_hdr the addresses, ports, flags, sequence and acknowledgement
+ *        numbers and window of the packet (network byte order)
+ * @param payload pointer to the payload of the packet. if NULL then no payload
+ * @param payload_len the length of the payload
+ * @param ttl the TTL to send the packet with
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_send(pktio_t *io, tcp_packet_info_t *tcp_hdr, void *payload,
+		     unsigned long payload_len, short ttl);
+
+/**
+ * @brief gets the next captured tcp packet
+ *
+ * @param io pointer to the engine
+ * @param frame pointer to point at the captured ethernet frame, or at NULL
+ *        if no packet is waiting.  the frame is valid until the next call.
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_next(pktio_t *io, unsigned char **frame);
+
+/**
+ * @brief throws away any packets already captured, so a new capture on a
+ *        reused engine only sees packets that arrive after this call
+ *
+ * @param io pointer to the engine to flush
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_flush(pktio_t *io);
+
+/**
+ * @brief connects a bound socket.  the kernel does it unless the backend
+ *        stands in for it, the way the simulated network has to for hosts
+ *        that only exist inside it.
+ *
+ * @param io pointer to the engine
+ * @param sd the bound socket.  a blocking socket is connected on return, a
+ *        non-blocking one has its connect started (see pktio_wait)
+ * @param ip the ip to connect to
+ * @param port the port to connect to
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_connect(pktio_t *io, sock_t sd, ip_t ip, port_t port);
+
+/**
+ * @brief waits for the first of several non-blocking connects started with
+ *        pktio_connect to complete
+ *
+ * @param io pointer to the engine
+ * @param sds the sockets the connects were started from.  a negative entry
+ *        is skipped.
+ * @param count the number of entries in sds
+ * @param timeout the most time to wait in ms
+ * @param winner pointer to fill in with the index in sds of the connect
+ *        that completed, -1 if none did before every one failed or the
+ *        time ran out
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_wait(pktio_t *io, sock_t *sds, int count, int timeout,
+		     int *winner);
+
+#endif /* __PKTIO_H__ */
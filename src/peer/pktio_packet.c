@@ -0,0 +1,191 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio_packet.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief the packet engine backend that injects on a raw ip socket and
+ *        captures on an AF_PACKET socket, without libnet or libpcap
+ */
+
+#include "pktio.h"
+#include "pktio_private.h"
+#include "debug.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+
+pktio_ops_t pktio_packet_ops = {
+	"packet",
+	pktio_packet_open,
+	pktio_packet_close,
+	pktio_packet_send,
+	pktio_packet_next
+};
+
+errorcode pktio_packet_open(pktio_t *io) {
+
+	/* declare local variables */
+	pktio_packet_state_t *state;
+	struct sockaddr_ll addr;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(io->device,ERROR_ARG_1);
+
+	/* do function */
+	if ( (state=(pktio_packet_state_t*)malloc(
+			sizeof(pktio_packet_state_t))) == NULL)
+		return ERROR_MALLOC_FAILED;
+
+	/* injected packets carry their own ip header (IPPROTO_RAW implies
+	 * IP_HDRINCL).  Root priviledges are required. */
+	if ( (state->raw=socket(AF_INET,SOCK_RAW,IPPROTO_RAW)) < 0) {
+		DEBUG(DBG_SPOOF,"SPOOF:can't open raw socket\n");
+		safe_free(state);
+		return ERROR_SOCKET_CREATE;
+	}
+	if (setsockopt(state->raw,SOL_SOCKET,SO_BINDTODEVICE,io->device,
+			strlen(io->device)+1) < 0) {
+		close(state->raw);
+		safe_free(state);
+		return ERROR_1;
+	}
+
+	/* only ETH_P_ALL sockets see the packets this host sends, which is
+	 * where the peer's own SYNs are captured from */
+	if ( (state->capture=socket(AF_PACKET,SOCK_RAW,htons(ETH_P_ALL))) < 0) {
+		DEBUG(DBG_SNIFF,
+			"SNIFF:did you forget to run this program as root?\n");
+		close(state->raw);
+		safe_free(state);
+		return ERROR_SOCKET_CREATE;
+	}
+
+	memset(&addr,0,sizeof(addr));
+	addr.sll_family   = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex  = if_nametoindex(io->device);
+	if ( (addr.sll_ifindex == 0) ||
+	     (bind(state->capture,(struct sockaddr*)&addr,sizeof(addr)) < 0) ||
+	     (fcntl(state->capture,F_SETFL,O_NONBLOCK) < 0) ) {
+		close(state->capture);
+		close(state->raw);
+		safe_free(state);
+		return ERROR_2;
+	}
+
+	io->state = state;
+
+	return SUCCESS;
+}
+
+errorcode pktio_packet_close(pktio_t *io) {
+
+	/* declare local variables */
+	pktio_packet_state_t *state;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+	state = (pktio_packet_state_t*) io->state;
+	close(state->capture);
+	close(state->raw);
+	safe_free(state);
+	io->state = NULL;
+
+	return SUCCESS;
+}
+
+errorcode pktio_packet_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl) {
+
+	/* declare local variables */
+	pktio_packet_state_t *state;
+	struct sockaddr_in dst;
+	unsigned long len;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(tcp_hdr,ERROR_NULL_ARG_2);
+
+	/* do function */
+	state = (pktio_packet_state_t*) io->state;
+
+	CHECK_FAILED(pktio_build_frame(state->tx,sizeof(state->tx),tcp_hdr,
+		payload,payload_len,ttl,&len),ERROR_1);
+
+	memset(&dst,0,sizeof(dst));
+	dst.sin_family      = AF_INET;
+	dst.sin_addr.s_addr = tcp_hdr->d_addr;
+
+	/* the kernel adds the link layer header, so skip the blank one */
+	len -= sizeof(struct ether_header);
+	if (sendto(state->raw,state->tx + sizeof(struct ether_header),len,0,
+			(struct sockaddr*)&dst,sizeof(dst)) != len) {
+		DEBUG(DBG_SPOOF,"SPOOF:write error\n");
+		return ERROR_4;
+	}
+
+	return SUCCESS;
+}
+
+errorcode pktio_packet_next(pktio_t *io, unsigned char **frame) {
+
+	/* declare local variables */
+	pktio_packet_state_t *state;
+	struct ether_header *ether;
+	struct iphdr *ip;
+	int len;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	state = (pktio_packet_state_t*) io->state;
+	*frame = NULL;
+
+	/* there is no kernel filter, so skip everything that isn't tcp */
+	while (1) {
+		if ( (len=recv(state->capture,state->rx,sizeof(state->rx),
+				0)) < 0) {
+			if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+				return SUCCESS;
+			return ERROR_NETWORK_READ;
+		}
+		if (len < sizeof(struct ether_header) + sizeof(struct iphdr) +
+				sizeof(struct tcphdr))
+			continue;
+
+		ether = (struct ether_header*) state->rx;
+		ip    = (struct iphdr*) (state->rx +
+				sizeof(struct ether_header));
+		if ( (ether->ether_type == htons(ETHERTYPE_IP)) &&
+		     (ip->protocol == IPPROTO_TCP) ) {
+			*frame = state->rx;
+			return SUCCESS;
+		}
+	}
+}
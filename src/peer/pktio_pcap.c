@@ -0,0 +1,255 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio_pcap.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief the packet engine backend that injects with libnet and captures
+ *        with libpcap
+ */
+
+#include "pktio.h"
+#include "pktio_private.h"
+#include "debug.h"
+#include "util.h"
+#include <stdlib.h>
+
+pktio_ops_t pktio_pcap_ops = {
+	"pcap",
+	pktio_pcap_open,
+	pktio_pcap_close,
+	pktio_pcap_send,
+	pktio_pcap_next
+};
+
+errorcode pktio_pcap_open(pktio_t *io) {
+
+	/* declare local variables */
+	pktio_pcap_state_t *state;
+	char errbuf[PCAP_ERRBUF_SIZE];
+	char lib_errbuf[LIBNET_ERRBUF_SIZE];
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(io->device,ERROR_ARG_1);
+
+	/* do function */
+	if ( (state=(pktio_pcap_state_t*)malloc(
+			sizeof(pktio_pcap_state_t))) == NULL)
+		return ERROR_MALLOC_FAILED;
+
+	if (FAILED(init_packet_capture(&state->pcap,io->device,
+			PKTIO_CAPTURE_TIMEOUT,errbuf,PCAP_ERRBUF_SIZE))) {
+		safe_free(state);
+		return ERROR_1;
+	}
+
+	/* Initialize the library.  Root priviledges are required. */
+	state->lib = libnet_init(
+		LIBNET_RAW4,                 /* injection type */
+		io->device,                  /* network interface */
+		lib_errbuf);                 /* errbuf */
+
+	if (state->lib == NULL) {
+		DEBUG(DBG_SPOOF,"SPOOF:libnet_init() failed\n");
+		pcap_close(state->pcap);
+		safe_free(state);
+		return ERROR_2;
+	}
+
+	io->state = state;
+
+	return SUCCESS;
+}
+
+errorcode pktio_pcap_close(pktio_t *io) {
+
+	/* declare local variables */
+	pktio_pcap_state_t *state;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+	state = (pktio_pcap_state_t*) io->state;
+	libnet_destroy(state->lib);
+	pcap_close(state->pcap);
+	safe_free(state);
+	io->state = NULL;
+
+	return SUCCESS;
+}
+
+errorcode pktio_pcap_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl) {
+
+	/* declare local variables */
+	pktio_pcap_state_t *state;
+	libnet_t *lib;
+	libnet_ptag_t t;
+	unsigned char tcp_flags;
+	int c;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(tcp_hdr,ERROR_NULL_ARG_2);
+
+	/* do function */
+	state = (pktio_pcap_state_t*) io->state;
+	lib = state->lib;
+
+	/* set the tcp_flags */
+	tcp_flags = 0;
+	tcp_flags |= ( (tcp_hdr->syn_flag==FLAG_SET) ? TH_SYN : 0);
+	tcp_flags |= ( (tcp_hdr->ack_flag==FLAG_SET) ? TH_ACK : 0);
+
+	/* make sure to put ports, seq_num, ack_num and window in host byte
+	 * order because libnet doesn't want them in network byte order. */
+	t = libnet_build_tcp(
+		PORT_2HBO(tcp_hdr->s_port),     /* source port */
+		PORT_2HBO(tcp_hdr->d_port),     /* destination port */
+		SEQ_NUM_2HBO(tcp_hdr->seq_num), /* sequence number */
+		SEQ_NUM_2HBO(tcp_hdr->ack_num), /* acknowledgement number */
+		tcp_flags,                      /* control flags */
+		WINDOW_2HBO(tcp_hdr->window),   /* window size */
+		0,                              /* checksum */
+		0,                              /* urgent pointer */
+		LIBNET_TCP_H + payload_len,     /* TCP packet size */
+		payload,                        /* payload */
+		payload_len,                    /* payload size */
+		lib,                            /* libnet handle */
+		0                               /* libnet id */
+	    );
+
+	if (t == -1) {
+		DEBUG(DBG_SPOOF,"SPOOF:can't build TCP header\n");
+		libnet_clear_packet(lib);
+		return ERROR_2;
+	}
+
+	t = libnet_build_ipv4(
+		LIBNET_IPV4_H+LIBNET_TCP_H+payload_len,  /* length */
+		0,                                       /* TOS */
+		242,                                     /* IP ID */
+		0,                                       /* IP Frag */
+		ttl,                                      /* TTL */
+		IPPROTO_TCP,                             /* protocol */
+		0,                                       /* checksum */
+		tcp_hdr->s_addr,                         /* source IP */
+		tcp_hdr->d_addr,                         /* destination IP */
+		NULL,                                    /* payload */
+		0,                                       /* payload size */
+		lib,                                     /* libnet handle */
+		0                                        /* libnet id */
+	    );
+
+	if (t == -1) {
+		DEBUG(DBG_SPOOF,"SPOOF:can't build IP header\n");
+		libnet_clear_packet(lib);
+		return ERROR_3;
+	}
+
+	/* Write it to the wire. */
+	c = libnet_write(lib);
+
+	/* start the next packet from scratch, reusing the context */
+	libnet_clear_packet(lib);
+
+	if (c == -1) {
+		DEBUG(DBG_SPOOF,"SPOOF:write error\n");
+		return ERROR_4;
+	}
+
+	return SUCCESS;
+}
+
+errorcode pktio_pcap_next(pktio_t *io, unsigned char **frame) {
+
+	/* declare local variables */
+	pktio_pcap_state_t *state;
+	struct pcap_pkthdr hdr;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	state = (pktio_pcap_state_t*) io->state;
+
+	/* the descriptor is non-blocking, so this is NULL when nothing is
+	 * waiting */
+	*frame = (unsigned char*) pcap_next(state->pcap,&hdr);
+
+	return SUCCESS;
+}
+
+errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
+				char *errbuf, long errbuf_len) {
+
+	/* declare local variables */
+	char *filter = "tcp";
+	struct bpf_program fp;
+	bpf_u_int32 maskp;
+	bpf_u_int32 netp;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(pcap_desc,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(device,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(errbuf,ERROR_NULL_ARG_4);
+	CHECK_GREATER_THAN(errbuf_len,PCAP_ERRBUF_SIZE-1,ERROR_ARG_5);
+
+	/* do function */
+	if ( pcap_lookupnet(device,&netp,&maskp,errbuf) < 0 ) {
+		DEBUG(DBG_SNIFF,
+			"SNIFF:did you forget to run this program as root?\n");
+		return ERROR_1;
+	}
+
+	if  ( (*pcap_desc=pcap_open_live(device,BUFSIZ,0,
+					timeout,errbuf)) == NULL )
+		return ERROR_2;
+
+	/* make sure the user is on ethernet (that is the only supported
+	 * data link layer right now */
+	if ( pcap_datalink(*pcap_desc) != DLT_EN10MB) {
+		pcap_close(*pcap_desc);
+		return ERROR_2;
+	}
+
+	/* compile the filter */
+	if ( pcap_compile(*pcap_desc,&fp,filter,0,netp) < 0 ) {
+		pcap_close(*pcap_desc);
+		return ERROR_4;
+	}
+
+	/* set the filter */
+	if ( pcap_setfilter(*pcap_desc,&fp) == -1 ) {
+		pcap_freecode(&fp);
+		pcap_close(*pcap_desc);
+		return ERROR_5;
+	}
+	pcap_freecode(&fp);
+
+	/* set pcap_next to be non-blocking */
+	if ( pcap_setnonblock(*pcap_desc,1,errbuf) < 0 ) {
+		pcap_close(*pcap_desc);
+		return ERROR_6;
+	}
+
+	return SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the packet engine and its backends
+ */
+
+#ifndef __PKTIO_PRIVATE_H__
+#define __PKTIO_PRIVATE_H__
+
+#include "pktio.h"
+#include <pcap.h>
+#include <libnet.h>
+
+/** @brief the state of the libnet/libpcap backend */
+struct pktio_pcap_state {
+	/** @brief the capture descriptor (filtered to tcp, non-blocking) */
+	pcap_t *pcap;
+	/** @brief the libnet context packets are forged with */
+	libnet_t *lib;
+};
+
+/** @brief typedef for the pktio_pcap_state structure */
+typedef struct pktio_pcap_state pktio_pcap_state_t;
+
+/** @brief the state of the raw socket/AF_PACKET backend */
+struct pktio_packet_state {
+	/** @brief the raw ip socket packets are injected on */
+	sock_t raw;
+	/** @brief the non-blocking AF_PACKET socket packets are captured on */
+	sock_t capture;
+	/** @brief the buffer injected packets are built in */
+	unsigned char tx[PKTIO_FRAME_LEN];
+	/** @brief the buffer frames are captured in */
+	unsigned char rx[PKTIO_FRAME_LEN];
+};
+
+/** @brief typedef for the pktio_packet_state structure */
+typedef struct pktio_packet_state pktio_packet_state_t;
+
+/** @brief the libnet/libpcap backend */
+extern pktio_ops_t pktio_pcap_ops;
+
+/** @brief the raw socket/AF_PACKET backend */
+extern pktio_ops_t pktio_packet_ops;
+
+/**
+ * @brief finds a backend by name
+ *
+ * @param name the name of the backend
+ * @param ops pointer to fill in with the backend
+ *
+ * @return SUCCESS, ERROR_NOT_FOUND if there is no such backend
+ */
+errorcode pktio_find_ops(char *name, pktio_ops_t **ops);
+
+/**
+ * @brief builds an ethernet frame holding a tcp packet, with the ip and tcp
+ *        checksums filled in.  the ethernet addresses are left zero.
+ *
+ * @param frame the buffer to build the frame in
+ * @param frame_len the size of the buffer
+ * @param tcp_hdr the tcp packet information (network byte order)
+ * @param payload pointer to the payload of the packet. if NULL then no payload
+ * @param payload_len the length of the payload
+ * @param ttl the TTL to put in the ip header
+ * @param len pointer to fill in with the length of the frame
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode pktio_build_frame(unsigned char *frame, unsigned long frame_len,
+			    tcp_packet_info_t *tcp_hdr, void *payload,
+			    unsigned long payload_len, short ttl,
+			    unsigned long *len);
+
+/**
+ * @brief computes the internet checksum of a buffer
+ *
+ * @param sum the running sum to add the buffer to (0 to start)
+ * @param buf the buffer
+ * @param len the length of the buffer
+ *
+ * @return the running sum, fold it with PKTIO_CKSUM_FOLD
+ */
+unsigned long pktio_cksum_add(unsigned long sum, void *buf, unsigned long len);
+
+/** @brief folds a running sum from pktio_cksum_add into a checksum */
+#define PKTIO_CKSUM_FOLD(sum) ({ \
+	unsigned long _s = (sum); \
+	_s = (_s >> 16) + (_s & 0xffff); \
+	_s += (_s >> 16); \
+	(unsigned short) ~_s; })
+
+/**
+ * @brief initializes the pcap functions
+ *
+ * @param pcap_desc pointer pointer to fill in with the pcap descriptor
+ * @param device the network device to capture on
+ * @param timeout timeout in ms to use when capturing packets, -1 = no timeout
+ * @param errbuf the pcap error buffer to use
+ * @param errbuf_len the length of the error buffer
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
+				char *errbuf, long errbuf_len );
+
+/** @brief opens the libnet/libpcap backend (see pktio_ops_t) */
+errorcode pktio_pcap_open(pktio_t *io);
+
+/** @brief closes the libnet/libpcap backend (see pktio_ops_t) */
+errorcode pktio_pcap_close(pktio_t *io);
+
+/** @brief injects a packet with libnet (see pktio_ops_t) */
+errorcode pktio_pcap_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl);
+
+/** @brief captures a packet with libpcap (see pktio_ops_t) */
+errorcode pktio_pcap_next(pktio_t *io, unsigned char **frame);
+
+/** @brief opens the raw socket/AF_PACKET backend (see pktio_ops_t) */
+errorcode pktio_packet_open(pktio_t *io);
+
+/** @brief closes the raw socket/AF_PACKET backend (see pktio_ops_t) */
+errorcode pktio_packet_close(pktio_t *io);
+
+/** @brief injects a packet on a raw ip socket (see pktio_ops_t) */
+errorcode pktio_packet_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl);
+
+/** @brief captures a packet on an AF_PACKET socket (see pktio_ops_t) */
+errorcode pktio_packet_next(pktio_t *io, unsigned char **frame);
+
+#endif /* __PKTIO_PRIVATE_H__ */
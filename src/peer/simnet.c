@@ -0,0 +1,944 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file simnet.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief an in-process simulated network of hosts behind NATs, and the
+ *        packet engine backend that sends and captures on it
+ */
+
+#include "simnet.h"
+#include "simnet_private.h"
+#include "pktio_private.h"
+#include "peerdef.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+
+pktio_ops_t simnet_pktio_ops = {
+	"sim",
+	simnet_pktio_open,
+	simnet_pktio_close,
+	simnet_pktio_send,
+	simnet_pktio_next,
+	simnet_pktio_connect,
+	simnet_pktio_wait
+};
+
+errorcode simnet_init(simnet_t *net) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(net,ERROR_NULL_ARG_1);
+
+	/* do function */
+	memset(net,0,sizeof(simnet_t));
+	net->syn_to = NULL;
+	net->seed   = 1;
+
+	if (pthread_mutex_init(&net->mutex,NULL) != 0)
+		return ERROR_INIT;
+	if (pthread_cond_init(&net->changed,NULL) != 0) {
+		pthread_mutex_destroy(&net->mutex);
+		return ERROR_INIT;
+	}
+
+	return SUCCESS;
+}
+
+errorcode simnet_destroy(simnet_t *net) {
+
+	/* declare local variables */
+	simnet_host_t *host;
+	int i, j;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(net,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* the ends no socket took over are the network's */
+	for (i=0;i<net->host_count;i++) {
+		host = net->hosts[i];
+		for (j=0;j<host->connect_count;j++)
+			if (host->connects[j].pair != SOCKET_UNKNOWN)
+				close(host->connects[j].pair);
+		for (j=0;j<host->accept_count;j++)
+			close(host->accepts[j].sd);
+		host->connect_count = 0;
+		host->accept_count  = 0;
+		free(host->queue);
+		host->queue = NULL;
+	}
+
+	pthread_cond_destroy(&net->changed);
+	pthread_mutex_destroy(&net->mutex);
+
+	return SUCCESS;
+}
+
+errorcode simnet_nat_init(simnet_nat_t *nat, ip_t ext_ip, flag_t port_alloc,
+			  flag_t mapping, port_t first_port, unsigned int seed,
+			  flag_t icmp_kills_mapping) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(nat,ERROR_NULL_ARG_1);
+	if ( (port_alloc != COMM_PORT_ALLOC_SEQ) &&
+	     (port_alloc != COMM_PORT_ALLOC_RAND) )
+		return ERROR_ARG_3;
+	if ( (mapping != SIMNET_MAP_PER_DEST) &&
+	     (mapping != SIMNET_MAP_PER_PORT) )
+		return ERROR_ARG_4;
+
+	/* do function */
+	memset(nat,0,sizeof(simnet_nat_t));
+	nat->ext_ip             = ext_ip;
+	nat->port_alloc         = port_alloc;
+	nat->mapping            = mapping;
+	nat->next_port          = PORT_2HBO(first_port);
+	nat->seed               = seed;
+	nat->icmp_kills_mapping = icmp_kills_mapping;
+
+	return SUCCESS;
+}
+
+errorcode simnet_add_host(simnet_t *net, simnet_host_t *host, ip_t ip,
+			  simnet_nat_t *nat) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(net,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (net->host_count == SIMNET_MAX_HOSTS)
+		return ERROR_OUT_OF_BOUNDS;
+
+	memset(host,0,sizeof(simnet_host_t));
+	host->ip          = ip;
+	host->nat         = nat;
+	host->net         = net;
+	host->listen_port = PORT_UNKNOWN;
+
+	/* the queue is too big to be part of the host, and most of it is
+	 * only touched by a birthday flood */
+	if ( (host->queue=malloc(SIMNET_QUEUE_LEN*PKTIO_FRAME_LEN)) == NULL)
+		return ERROR_MALLOC_FAILED;
+
+	net->hosts[net->host_count++] = host;
+
+	return SUCCESS;
+}
+
+errorcode simnet_open_pktio(simnet_host_t *host, pktio_t *io) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_2);
+
+	/* do function */
+	CHECK_FAILED(pktio_open_ops(io,&simnet_pktio_ops,"sim",host),ERROR_1);
+
+	return SUCCESS;
+}
+
+errorcode simnet_connect(simnet_host_t *host, port_t local_port,
+			 ip_t remote_ip, port_t remote_port, seq_num_t seq_num,
+			 short ttl, port_t *ext_port) {
+
+	/* declare local variables */
+	simnet_connect_t *conn;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if (pthread_mutex_lock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = simnet_start_connect(host,local_port,remote_ip,remote_port,
+		seq_num,ttl,&conn);
+	if (ext_port != NULL)
+		*ext_port = FAILED(ret) ? PORT_UNKNOWN : conn->ext_port;
+
+	if (pthread_mutex_unlock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return ret;
+}
+
+errorcode simnet_start_connect(simnet_host_t *host, port_t local_port,
+			       ip_t remote_ip, port_t remote_port,
+			       seq_num_t seq_num, short ttl,
+			       simnet_connect_t **conn) {
+
+	/* declare local variables */
+	tcp_packet_info_t syn;
+	unsigned char frame[PKTIO_FRAME_LEN];
+	unsigned long len;
+	port_t ext_port;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(conn,ERROR_NULL_ARG_7);
+
+	/* do function */
+	syn.s_addr   = host->ip;
+	syn.s_port   = local_port;
+	syn.d_addr   = remote_ip;
+	syn.d_port   = remote_port;
+	syn.seq_num  = seq_num;
+	syn.ack_num  = SEQ_NUM_UNKNOWN;
+	syn.window   = WINDOW_DEFAULT;
+	syn.syn_flag = FLAG_SET;
+	syn.ack_flag = FLAG_UNSET;
+	CHECK_FAILED(pktio_build_frame(frame,sizeof(frame),&syn,NULL,0,ttl,
+		&len),ERROR_1);
+
+	/* a new connect between the same ports replaces the old one, like a
+	 * socket that is closed and bound again */
+	*conn = NULL;
+	for (i=0;i<host->connect_count;i++)
+		if ( (host->connects[i].local_port == local_port) &&
+		     (host->connects[i].remote_ip == remote_ip) &&
+		     (host->connects[i].remote_port == remote_port) )
+			*conn = &host->connects[i];
+	if (*conn == NULL) {
+		if (host->connect_count == SIMNET_MAX_CONNECTS)
+			return ERROR_OUT_OF_BOUNDS;
+		*conn = &host->connects[host->connect_count++];
+	}
+	else if ((*conn)->pair != SOCKET_UNKNOWN) {
+		close((*conn)->pair);
+	}
+
+	(*conn)->local_port  = local_port;
+	(*conn)->remote_ip   = remote_ip;
+	(*conn)->remote_port = remote_port;
+	(*conn)->seq_num     = seq_num;
+	(*conn)->established = FLAG_UNSET;
+	(*conn)->sd          = SOCKET_UNKNOWN;
+	(*conn)->pair        = SOCKET_UNKNOWN;
+
+	CHECK_FAILED(simnet_route(host,frame,len,&ext_port),ERROR_2);
+	(*conn)->ext_port = ext_port;
+
+	return SUCCESS;
+}
+
+errorcode simnet_established(simnet_host_t *host, port_t local_port,
+			     flag_t *established) {
+
+	/* declare local variables */
+	flag_t found = FLAG_UNSET;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(established,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (pthread_mutex_lock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	/* raced connects share a local port, any one of them will do */
+	*established = FLAG_UNSET;
+	for (i=0;i<host->connect_count;i++) {
+		if (host->connects[i].local_port == local_port) {
+			if (host->connects[i].established == FLAG_SET)
+				*established = FLAG_SET;
+			found = FLAG_SET;
+		}
+	}
+
+	if (pthread_mutex_unlock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	if (found == FLAG_UNSET)
+		return ERROR_NOT_FOUND;
+
+	return SUCCESS;
+}
+
+errorcode simnet_listen(simnet_host_t *host, port_t port) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	if (port == PORT_UNKNOWN)
+		return ERROR_ARG_2;
+
+	/* do function */
+	if (pthread_mutex_lock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	host->listen_port = port;
+
+	if (pthread_mutex_unlock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return SUCCESS;
+}
+
+errorcode simnet_accept(simnet_host_t *host, int timeout,
+			simnet_accept_t *accepted) {
+
+	/* declare local variables */
+	simnet_t *net;
+	struct timespec deadline;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_2);
+	CHECK_NOT_NULL(accepted,ERROR_NULL_ARG_3);
+
+	/* do function */
+	net = host->net;
+	simnet_deadline(timeout,&deadline);
+	accepted->sd = SOCKET_UNKNOWN;
+
+	if (pthread_mutex_lock(&net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	while (host->accept_count == 0) {
+		if (pthread_cond_timedwait(&net->changed,&net->mutex,
+				&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	if (host->accept_count > 0) {
+		*accepted = host->accepts[0];
+		host->accept_count--;
+		memmove(&host->accepts[0],&host->accepts[1],
+			host->accept_count*sizeof(simnet_accept_t));
+	}
+
+	if (pthread_mutex_unlock(&net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return SUCCESS;
+}
+
+errorcode simnet_route(simnet_host_t *host, unsigned char *frame,
+		       unsigned long len, port_t *ext_port) {
+
+	/* declare local variables */
+	simnet_t *net;
+	simnet_nat_t *nat;
+	simnet_mapping_t *mapping;
+	simnet_host_t *dest;
+	struct iphdr *ip;
+	struct tcphdr *tcp;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	net = host->net;
+	ip  = (struct iphdr*) (frame + sizeof(struct ether_header));
+	tcp = (struct tcphdr*) ((unsigned char*)ip + 4*ip->ihl);
+
+	if (ext_port != NULL)
+		*ext_port = PORT_UNKNOWN;
+
+	/* the sender captures its own packets */
+	CHECK_FAILED(simnet_queue(host,frame,len),ERROR_1);
+
+	/* cross the sender's NAT */
+	nat = host->nat;
+	if (nat != NULL) {
+		if (--ip->ttl == 0) {
+			/* the ICMP comes from the NAT itself, before any
+			 * mapping is made */
+			net->stats.ttl_expired++;
+			return SUCCESS;
+		}
+		CHECK_FAILED(simnet_nat_map(nat,ip->saddr,tcp->th_sport,
+			ip->daddr,tcp->th_dport,&mapping),ERROR_2);
+		ip->saddr     = nat->ext_ip;
+		tcp->th_sport = mapping->ext_port;
+		if (ext_port != NULL)
+			*ext_port = mapping->ext_port;
+	}
+
+	/* cross the routers in between */
+	if (ip->ttl <= SIMNET_CORE_HOPS) {
+		net->stats.ttl_expired++;
+		return simnet_icmp(net,nat,tcp->th_sport,ip->daddr,
+			tcp->th_dport);
+	}
+	ip->ttl -= SIMNET_CORE_HOPS;
+
+	/* a public host takes the packet as it is */
+	for (i=0;i<net->host_count;i++) {
+		dest = net->hosts[i];
+		if ( (dest->nat == NULL) && (dest->ip == ip->daddr) )
+			return simnet_deliver(dest,frame,len);
+	}
+
+	/* otherwise it has to get in through the destination's NAT */
+	for (i=0;i<net->host_count;i++) {
+		nat = net->hosts[i]->nat;
+		if ( (nat != NULL) && (nat->ext_ip == ip->daddr) )
+			break;
+	}
+	if (i == net->host_count) {
+		net->stats.filtered++;
+		return SUCCESS;
+	}
+
+	if (--ip->ttl == 0) {
+		net->stats.ttl_expired++;
+		return simnet_icmp(net,host->nat,tcp->th_sport,ip->daddr,
+			tcp->th_dport);
+	}
+	if (FAILED(simnet_nat_lookup(nat,tcp->th_dport,ip->saddr,
+			tcp->th_sport,&mapping))) {
+		net->stats.filtered++;
+		return SUCCESS;
+	}
+	ip->daddr     = mapping->int_ip;
+	tcp->th_dport = mapping->int_port;
+
+	for (i=0;i<net->host_count;i++) {
+		dest = net->hosts[i];
+		if ( (dest->nat == nat) && (dest->ip == ip->daddr) )
+			return simnet_deliver(dest,frame,len);
+	}
+
+	net->stats.filtered++;
+	return SUCCESS;
+}
+
+errorcode simnet_nat_map(simnet_nat_t *nat, ip_t int_ip, port_t int_port,
+			 ip_t remote_ip, port_t remote_port,
+			 simnet_mapping_t **mapping) {
+
+	/* declare local variables */
+	simnet_mapping_t *m;
+	unsigned long i, used;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(nat,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(mapping,ERROR_NULL_ARG_6);
+
+	/* do function */
+	used = (nat->mapping_count < SIMNET_MAX_MAPPINGS) ?
+		nat->mapping_count : SIMNET_MAX_MAPPINGS;
+	for (i=0;i<used;i++) {
+		m = &nat->mappings[i];
+		if ( (m->ext_port != PORT_UNKNOWN) && (m->int_ip == int_ip) &&
+		     (m->int_port == int_port) && (m->remote_ip == remote_ip) &&
+		     (m->remote_port == remote_port) ) {
+			*mapping = m;
+			return SUCCESS;
+		}
+	}
+
+	/* make a new mapping over the oldest one */
+	m = &nat->mappings[nat->mapping_count % SIMNET_MAX_MAPPINGS];
+	nat->mapping_count++;
+
+	m->int_ip      = int_ip;
+	m->int_port    = int_port;
+	m->remote_ip   = remote_ip;
+	m->remote_port = remote_port;
+	m->ext_port    = PORT_UNKNOWN;
+
+	/* a per port NAT reuses the internal port's external port, the new
+	 * mapping only lets the new remote address in */
+	if (nat->mapping == SIMNET_MAP_PER_PORT) {
+		for (i=0;i<used;i++) {
+			if ( (&nat->mappings[i] != m) &&
+			     (nat->mappings[i].ext_port != PORT_UNKNOWN) &&
+			     (nat->mappings[i].int_ip == int_ip) &&
+			     (nat->mappings[i].int_port == int_port) ) {
+				m->ext_port = nat->mappings[i].ext_port;
+				*mapping = m;
+				return SUCCESS;
+			}
+		}
+	}
+
+	if (nat->port_alloc == COMM_PORT_ALLOC_SEQ) {
+		m->ext_port = htons(nat->next_port++);
+		if (nat->next_port == 0)
+			nat->next_port = SIMNET_RAND_PORT_MIN;
+	}
+	else {
+		m->ext_port = htons(SIMNET_RAND_PORT_MIN + rand_r(&nat->seed) %
+			(0x10000 - SIMNET_RAND_PORT_MIN));
+	}
+
+	*mapping = m;
+
+	return SUCCESS;
+}
+
+errorcode simnet_nat_lookup(simnet_nat_t *nat, port_t ext_port,
+			    ip_t remote_ip, port_t remote_port,
+			    simnet_mapping_t **mapping) {
+
+	/* declare local variables */
+	simnet_mapping_t *m;
+	unsigned long i, used;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(nat,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(mapping,ERROR_NULL_ARG_5);
+
+	/* do function */
+	used = (nat->mapping_count < SIMNET_MAX_MAPPINGS) ?
+		nat->mapping_count : SIMNET_MAX_MAPPINGS;
+	for (i=0;i<used;i++) {
+		m = &nat->mappings[i];
+		if ( (m->ext_port == ext_port) && (ext_port != PORT_UNKNOWN) &&
+		     (m->remote_ip == remote_ip) &&
+		     (m->remote_port == remote_port) ) {
+			*mapping = m;
+			return SUCCESS;
+		}
+	}
+
+	return ERROR_NOT_FOUND;
+}
+
+errorcode simnet_icmp(simnet_t *net, simnet_nat_t *nat, port_t ext_port,
+		      ip_t remote_ip, port_t remote_port) {
+
+	/* declare local variables */
+	simnet_mapping_t *mapping;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(net,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* the ICMP quotes the translated header, which is what the NAT
+	 * matches it to a mapping with.  the host's capture only takes tcp,
+	 * so the ICMP itself is never seen there. */
+	if (nat == NULL)
+		return SUCCESS;
+	net->stats.icmp++;
+
+	if (FAILED(simnet_nat_lookup(nat,ext_port,remote_ip,remote_port,
+			&mapping)))
+		return SUCCESS;
+
+	if (nat->icmp_kills_mapping == FLAG_SET) {
+		mapping->ext_port = PORT_UNKNOWN;
+		net->stats.icmp_killed++;
+	}
+
+	return SUCCESS;
+}
+
+errorcode simnet_deliver(simnet_host_t *host, unsigned char *frame,
+			 unsigned long len) {
+
+	/* declare local variables */
+	simnet_connect_t *conn;
+	struct iphdr *ip;
+	struct tcphdr *tcp;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	host->net->stats.delivered++;
+	CHECK_FAILED(simnet_queue(host,frame,len),ERROR_1);
+
+	ip  = (struct iphdr*) (frame + sizeof(struct ether_header));
+	tcp = (struct tcphdr*) ((unsigned char*)ip + 4*ip->ihl);
+
+	/* a SYN to a listening port is answered at once, the connect that
+	 * sent it picks that up (see simnet_pktio_connect) */
+	if ( (tcp->th_flags & TH_SYN) && !(tcp->th_flags & TH_ACK) &&
+	     (host->listen_port != PORT_UNKNOWN) &&
+	     (host->listen_port == tcp->th_dport) ) {
+		host->net->syn_to        = host;
+		host->net->syn_from.sd   = SOCKET_UNKNOWN;
+		host->net->syn_from.ip   = ip->saddr;
+		host->net->syn_from.port = tcp->th_sport;
+		return SUCCESS;
+	}
+
+	if ( !(tcp->th_flags & TH_SYN) || !(tcp->th_flags & TH_ACK) )
+		return SUCCESS;
+
+	/* a SYN/ACK completes the connect it acknowledges */
+	for (i=0;i<host->connect_count;i++) {
+		conn = &host->connects[i];
+		if ( (conn->local_port == tcp->th_dport) &&
+		     (conn->remote_ip == ip->saddr) &&
+		     (conn->remote_port == tcp->th_sport) &&
+		     (SEQ_NUM_ADD(conn->seq_num,1) == tcp->th_ack) ) {
+			conn->established = FLAG_SET;
+			pthread_cond_broadcast(&host->net->changed);
+		}
+	}
+
+	return SUCCESS;
+}
+
+errorcode simnet_queue(simnet_host_t *host, unsigned char *frame,
+		       unsigned long len) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+	if (len > PKTIO_FRAME_LEN)
+		return ERROR_ARG_3;
+
+	/* do function */
+	if (host->count == SIMNET_QUEUE_LEN) {
+		host->net->stats.overrun++;
+		return SUCCESS;
+	}
+
+	memcpy(host->queue[(host->head + host->count) % SIMNET_QUEUE_LEN],
+		frame,len);
+	host->count++;
+
+	return SUCCESS;
+}
+
+errorcode simnet_pktio_open(pktio_t *io) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* the host was handed in by simnet_open_pktio */
+	if (io->state == NULL)
+		return ERROR_ARG_1;
+
+	return SUCCESS;
+}
+
+errorcode simnet_pktio_close(pktio_t *io) {
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+
+	/* do function */
+
+	/* the host belongs to the caller */
+	io->state = NULL;
+
+	return SUCCESS;
+}
+
+errorcode simnet_pktio_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl) {
+
+	/* declare local variables */
+	simnet_host_t *host;
+	unsigned char frame[PKTIO_FRAME_LEN];
+	unsigned long len;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(tcp_hdr,ERROR_NULL_ARG_2);
+
+	/* do function */
+	host = (simnet_host_t*) io->state;
+
+	CHECK_FAILED(pktio_build_frame(frame,sizeof(frame),tcp_hdr,payload,
+		payload_len,ttl,&len),ERROR_1);
+
+	if (pthread_mutex_lock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	ret = simnet_route(host,frame,len,NULL);
+
+	if (pthread_mutex_unlock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return ret;
+}
+
+errorcode simnet_pktio_next(pktio_t *io, unsigned char **frame) {
+
+	/* declare local variables */
+	simnet_host_t *host;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(frame,ERROR_NULL_ARG_2);
+
+	/* do function */
+	host = (simnet_host_t*) io->state;
+
+	if (pthread_mutex_lock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	if (host->count == 0) {
+		*frame = NULL;
+	}
+	else {
+		memcpy(host->rx,host->queue[host->head],PKTIO_FRAME_LEN);
+		host->head = (host->head + 1) % SIMNET_QUEUE_LEN;
+		host->count--;
+		*frame = host->rx;
+	}
+
+	if (pthread_mutex_unlock(&host->net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return SUCCESS;
+}
+
+errorcode simnet_pktio_connect(pktio_t *io, sock_t sd, ip_t ip, port_t port) {
+
+	/* declare local variables */
+	simnet_host_t *host;
+	simnet_t *net;
+	simnet_connect_t *conn;
+	struct sockaddr_in local;
+	socklen_t len;
+	int ttl, flags;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_2);
+
+	/* do function */
+	host = (simnet_host_t*) io->state;
+	net  = host->net;
+
+	/* the SYN comes from the port the socket is bound to, with the TTL
+	 * set on it */
+	len = sizeof(local);
+	if (getsockname(sd,(struct sockaddr*)&local,&len) != 0)
+		return ERROR_TCP_CONNECT;
+	len = sizeof(ttl);
+	if (getsockopt(sd,IPPROTO_IP,IP_TTL,&ttl,&len) != 0)
+		ttl = TTL_OK;
+	flags = fcntl(sd,F_GETFL,0);
+
+	if (pthread_mutex_lock(&net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	net->syn_to = NULL;
+	ret = simnet_start_connect(host,local.sin_port,ip,port,
+		htonl(rand_r(&net->seed)),ttl,&conn);
+
+	if (FAILED(ret)) {
+		/* nothing was sent */
+	}
+	else if (net->syn_to != NULL) {
+		/* a listener got the SYN, the connection is made */
+		ret = simnet_pair(sd,&net->syn_from.sd);
+		if ( (ret == SUCCESS) &&
+		     (net->syn_to->accept_count == SIMNET_MAX_ACCEPTS) ) {
+			close(net->syn_from.sd);
+			ret = ERROR_TCP_CONNECT;
+		}
+		if (ret == SUCCESS) {
+			net->syn_to->accepts[net->syn_to->accept_count++] =
+				net->syn_from;
+			conn->established = FLAG_SET;
+			pthread_cond_broadcast(&net->changed);
+		}
+	}
+	else if ( (flags < 0) || !(flags & O_NONBLOCK) ) {
+		/* a blocking connect has nothing to wait for */
+		ret = ERROR_TCP_CONNECT;
+	}
+	else {
+		/* a SYN/ACK may complete it later (see simnet_pktio_wait) */
+		conn->sd = sd;
+	}
+
+	if (pthread_mutex_unlock(&net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return ret;
+}
+
+errorcode simnet_pktio_wait(pktio_t *io, sock_t *sds, int count,
+			    int timeout, int *winner) {
+
+	/* declare local variables */
+	simnet_host_t *host;
+	simnet_t *net;
+	simnet_connect_t *conn;
+	struct timespec deadline;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(sds,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(winner,ERROR_NULL_ARG_5);
+
+	/* do function */
+	host = (simnet_host_t*) io->state;
+	net  = host->net;
+	simnet_deadline(timeout,&deadline);
+	*winner = -1;
+
+	if (pthread_mutex_lock(&net->mutex) != 0)
+		return ERROR_MUTEX_LOCK;
+
+	while (1) {
+		/* the first completed connect that joins its buddy's wins */
+		for (i=0;i<count;i++) {
+			if (sds[i] < 0)
+				continue;
+			conn = simnet_find_socket(host,sds[i]);
+			if ( (conn != NULL) &&
+			     (conn->established == FLAG_SET) &&
+			     (simnet_join(host,conn) == SUCCESS) ) {
+				*winner = i;
+				break;
+			}
+		}
+		if (*winner >= 0)
+			break;
+		if (pthread_cond_timedwait(&net->changed,&net->mutex,
+				&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	if (pthread_mutex_unlock(&net->mutex) != 0)
+		return ERROR_MUTEX_UNLOCK;
+
+	return SUCCESS;
+}
+
+simnet_connect_t *simnet_find_socket(simnet_host_t *host, sock_t sd) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+
+	/* the newest connect from a socket number is the one it is making
+	 * now, older ones were from sockets closed since */
+	for (i=host->connect_count-1;i>=0;i--)
+		if (host->connects[i].sd == sd)
+			return &host->connects[i];
+
+	return NULL;
+}
+
+errorcode simnet_join(simnet_host_t *host, simnet_connect_t *conn) {
+
+	/* declare local variables */
+	simnet_t *net;
+	simnet_host_t *other;
+	simnet_connect_t *buddy;
+	int i, j;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(host,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(conn,ERROR_NULL_ARG_2);
+
+	/* do function */
+	net = host->net;
+
+	/* the buddy's connect was completed first and left an end */
+	if (conn->pair != SOCKET_UNKNOWN) {
+		if (dup2(conn->pair,conn->sd) < 0)
+			return ERROR_1;
+		close(conn->pair);
+		conn->pair = SOCKET_UNKNOWN;
+		conn->sd   = SOCKET_UNKNOWN;
+		return SUCCESS;
+	}
+
+	/* otherwise find the connect this one met: it went out of the port
+	 * this one went to, to the port this one went out of */
+	for (i=0;i<net->host_count;i++) {
+		other = net->hosts[i];
+		if ( (other == host) ||
+		     (simnet_ext_ip(other) != conn->remote_ip) )
+			continue;
+		for (j=0;j<other->connect_count;j++) {
+			buddy = &other->connects[j];
+			if ( (buddy->sd != SOCKET_UNKNOWN) &&
+			     (buddy->pair == SOCKET_UNKNOWN) &&
+			     (buddy->ext_port == conn->remote_port) &&
+			     (buddy->remote_ip == simnet_ext_ip(host)) &&
+			     (buddy->remote_port == conn->ext_port) ) {
+				CHECK_FAILED(simnet_pair(conn->sd,&buddy->pair),
+					ERROR_2);
+				conn->sd = SOCKET_UNKNOWN;
+				return SUCCESS;
+			}
+		}
+	}
+
+	return ERROR_NOT_FOUND;
+}
+
+errorcode simnet_pair(sock_t sd, sock_t *other) {
+
+	/* declare local variables */
+	int sv[2];
+
+	/* error check arguments */
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_1);
+	CHECK_NOT_NULL(other,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (socketpair(AF_UNIX,SOCK_STREAM,0,sv) != 0)
+		return ERROR_1;
+	if (dup2(sv[0],sd) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return ERROR_2;
+	}
+	close(sv[0]);
+	*other = sv[1];
+
+	return SUCCESS;
+}
+
+ip_t simnet_ext_ip(simnet_host_t *host) {
+
+	/* do function */
+	return (host->nat == NULL) ? host->ip : host->nat->ext_ip;
+}
+
+void simnet_deadline(int timeout, struct timespec *deadline) {
+
+	/* declare local variables */
+	struct timeval now;
+
+	/* do function */
+	gettimeofday(&now,NULL);
+	deadline->tv_sec  = now.tv_sec + timeout/1000;
+	deadline->tv_nsec = now.tv_usec*1000 + (timeout%1000)*1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
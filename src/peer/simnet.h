@@ -0,0 +1,378 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file simnet.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief an in-process simulated network of hosts behind NATs, with a packet
+ *        engine backend (see pktio.h) so the sniffing and spoofing code can
+ *        run against it without root privledge or real NATs
+ *
+ * A packet from a host behind a NAT crosses its NAT, SIMNET_CORE_HOPS
+ * routers, and the destination's NAT (if any) before reaching the
+ * destination host.  The TTL is decremented at every NAT and router, and
+ * when it runs out an ICMP time exceeded is sent back toward the source.
+ *
+ * A NAT gives a new external port, either the next in sequence or a random
+ * one, to every (internal address, remote address) pair, or to every
+ * internal address (see SIMNET_MAP_PER_DEST/PORT).  Either way only a remote
+ * address the internal address has sent to may send in.
+ *
+ * Hosts have no tcp stack.  simnet_connect stands in for the kernel's SYN
+ * on connect(), and a SYN/ACK that completes such a connect marks it
+ * established.  Every packet a host sends or receives is queued for its
+ * packet engine to capture, like pcap would see it.
+ *
+ * So the real peer code can run on a host, the packet engine also stands in
+ * for connect() on the peer's sockets (see pktio_connect).  A connect that
+ * reaches a port a host listens on (see simnet_listen) is accepted right
+ * away, and a connect completed by a SYN/ACK is joined to the buddy's
+ * connect it met.  Either way the socket is replaced by one end of a unix
+ * socketpair, and the other end goes to the listener (see simnet_accept) or
+ * the buddy's socket, so whatever is written after that really arrives.
+ */
+
+#ifndef __SIMNET_H__
+#define __SIMNET_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include "comm.h"
+#include "pktio.h"
+#include "peerdef.h"
+#include <pthread.h>
+
+/** @brief the number of routers between two NATs */
+#define SIMNET_CORE_HOPS	2
+
+/** @brief room for the packets and mappings of a connection that are not
+ *  part of a birthday flood */
+#define SIMNET_SLACK		64
+
+/** @brief the most mappings a NAT holds, the oldest is reused after that.
+ *  every SYN of a birthday flood and every SYN/ACK answering it may make
+ *  a mapping, and all of them must last until the flood is over */
+#define SIMNET_MAX_MAPPINGS	(SYN_FLOOD_COUNT + SYN_ACK_FLOOD_COUNT + \
+				 SIMNET_SLACK)
+
+/** @brief the most packets waiting to be captured by a host, enough for a
+ *  host to see both birthday floods before its engine reads any of them */
+#define SIMNET_QUEUE_LEN	(SYN_FLOOD_COUNT + SYN_ACK_FLOOD_COUNT + \
+				 SIMNET_SLACK)
+
+/** @brief the most outstanding connects a host tracks */
+#define SIMNET_MAX_CONNECTS	16
+
+/** @brief the most accepted connections waiting for simnet_accept on a
+ *  host */
+#define SIMNET_MAX_ACCEPTS	16
+
+/** @brief the most hosts in a network */
+#define SIMNET_MAX_HOSTS	8
+
+/** @brief the lowest port a NAT allocates randomly */
+#define SIMNET_RAND_PORT_MIN	1024
+
+/** @brief a NAT that gives every remote address its own external port
+ *  (a symmetric NAT) */
+#define SIMNET_MAP_PER_DEST	1
+
+/** @brief a NAT that gives an internal port one external port whatever the
+ *  remote address is, but still only lets in the remote addresses it has
+ *  sent to */
+#define SIMNET_MAP_PER_PORT	2
+
+/** @brief structure for one NAT mapping */
+struct simnet_mapping {
+	/** @brief the internal ip */
+	ip_t int_ip;
+	/** @brief the internal port */
+	port_t int_port;
+	/** @brief the external port given to the mapping */
+	port_t ext_port;
+	/** @brief the remote ip the mapping was made for */
+	ip_t remote_ip;
+	/** @brief the remote port the mapping was made for */
+	port_t remote_port;
+} __attribute__((__packed__));
+
+/** @brief typedef for the simnet_mapping structure */
+typedef struct simnet_mapping simnet_mapping_t;
+
+/** @brief structure for a simulated NAT */
+struct simnet_nat {
+	/** @brief the NAT's external ip */
+	ip_t ext_ip;
+	/** @brief COMM_PORT_ALLOC_SEQ or COMM_PORT_ALLOC_RAND */
+	flag_t port_alloc;
+	/** @brief SIMNET_MAP_PER_DEST or SIMNET_MAP_PER_PORT */
+	flag_t mapping;
+	/** @brief the next port a sequential NAT allocates (host order) */
+	unsigned short next_port;
+	/** @brief the random state of a random NAT */
+	unsigned int seed;
+	/** @brief FLAG_SET if an ICMP error for a mapping removes it */
+	flag_t icmp_kills_mapping;
+	/** @brief the mappings */
+	simnet_mapping_t mappings[SIMNET_MAX_MAPPINGS];
+	/** @brief the number of mappings made so far */
+	unsigned long mapping_count;
+};
+
+/** @brief typedef for the simnet_nat structure */
+typedef struct simnet_nat simnet_nat_t;
+
+/** @brief structure for a connect a simulated host has outstanding */
+struct simnet_connect {
+	/** @brief the local port */
+	port_t local_port;
+	/** @brief the remote ip connected to */
+	ip_t remote_ip;
+	/** @brief the remote port connected to */
+	port_t remote_port;
+	/** @brief the sequence number of the SYN */
+	seq_num_t seq_num;
+	/** @brief FLAG_SET once a matching SYN/ACK arrived */
+	flag_t established;
+	/** @brief the port the SYN left the host's NAT with */
+	port_t ext_port;
+	/** @brief the socket the connect was made from with pktio_connect,
+	 *  SOCKET_UNKNOWN for simnet_connect */
+	sock_t sd;
+	/** @brief the end of a socketpair the buddy's connect left for this
+	 *  one's socket, SOCKET_UNKNOWN until then */
+	sock_t pair;
+} __attribute__((__packed__));
+
+/** @brief typedef for the simnet_connect structure */
+typedef struct simnet_connect simnet_connect_t;
+
+/** @brief structure for a connection accepted by a listening host */
+struct simnet_accept {
+	/** @brief the listener's end of the connection */
+	sock_t sd;
+	/** @brief the ip the connection came from, as seen past the NATs */
+	ip_t ip;
+	/** @brief the port the connection came from, as seen past the NATs */
+	port_t port;
+} __attribute__((__packed__));
+
+/** @brief typedef for the simnet_accept structure */
+typedef struct simnet_accept simnet_accept_t;
+
+struct simnet;
+
+/** @brief structure for a simulated host */
+struct simnet_host {
+	/** @brief the host's ip (internal if it is behind a NAT) */
+	ip_t ip;
+	/** @brief the NAT the host is behind, NULL if it is public */
+	simnet_nat_t *nat;
+	/** @brief the network the host is on */
+	struct simnet *net;
+	/** @brief the packets waiting to be captured, SIMNET_QUEUE_LEN
+	 *  frames allocated by simnet_add_host */
+	unsigned char (*queue)[PKTIO_FRAME_LEN];
+	/** @brief the index of the oldest waiting packet */
+	unsigned int head;
+	/** @brief the number of waiting packets */
+	unsigned int count;
+	/** @brief the last captured packet, handed out by the engine */
+	unsigned char rx[PKTIO_FRAME_LEN];
+	/** @brief the outstanding connects */
+	simnet_connect_t connects[SIMNET_MAX_CONNECTS];
+	/** @brief the number of outstanding connects */
+	int connect_count;
+	/** @brief the port the host accepts connections on, PORT_UNKNOWN if
+	 *  it does not listen */
+	port_t listen_port;
+	/** @brief the accepted connections, oldest first */
+	simnet_accept_t accepts[SIMNET_MAX_ACCEPTS];
+	/** @brief the number of accepted connections */
+	int accept_count;
+};
+
+/** @brief typedef for the simnet_host structure */
+typedef struct simnet_host simnet_host_t;
+
+/** @brief counters of what happened to packets in a network */
+struct simnet_stats {
+	/** @brief packets delivered to a host */
+	unsigned long delivered;
+	/** @brief packets whose TTL ran out */
+	unsigned long ttl_expired;
+	/** @brief ICMP time exceeded messages that reached a NAT */
+	unsigned long icmp;
+	/** @brief mappings removed because of an ICMP error */
+	unsigned long icmp_killed;
+	/** @brief packets a NAT dropped for lack of a mapping */
+	unsigned long filtered;
+	/** @brief packets dropped because a capture queue was full */
+	unsigned long overrun;
+};
+
+/** @brief typedef for the simnet_stats structure */
+typedef struct simnet_stats simnet_stats_t;
+
+/** @brief structure for a simulated network */
+struct simnet {
+	/** @brief the hosts on the network */
+	simnet_host_t *hosts[SIMNET_MAX_HOSTS];
+	/** @brief the number of hosts */
+	int host_count;
+	/** @brief what happened to the packets sent so far */
+	simnet_stats_t stats;
+	/** @brief serializes packets through the network */
+	pthread_mutex_t mutex;
+	/** @brief broadcast when a connect is completed or accepted */
+	pthread_cond_t changed;
+	/** @brief the listening host the last SYN routed reached, NULL if it
+	 *  reached none */
+	struct simnet_host *syn_to;
+	/** @brief where that SYN came from, as seen past the NATs */
+	simnet_accept_t syn_from;
+	/** @brief the random state used for sequence numbers */
+	unsigned int seed;
+};
+
+/** @brief typedef for the simnet structure */
+typedef struct simnet simnet_t;
+
+/** @brief the simulated network backend */
+extern pktio_ops_t simnet_pktio_ops;
+
+/**
+ * @brief initializes an empty network
+ *
+ * @param net pointer to the network
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_init(simnet_t *net);
+
+/**
+ * @brief releases a network, closing the connection ends it still holds
+ *        and freeing the hosts' queues.  the hosts and NATs belong to the
+ *        caller.
+ *
+ * @param net pointer to the network
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_destroy(simnet_t *net);
+
+/**
+ * @brief initializes a NAT
+ *
+ * @param nat pointer to the NAT
+ * @param ext_ip the NAT's external ip
+ * @param port_alloc COMM_PORT_ALLOC_SEQ or COMM_PORT_ALLOC_RAND
+ * @param mapping SIMNET_MAP_PER_DEST or SIMNET_MAP_PER_PORT
+ * @param first_port the first port a sequential NAT allocates
+ * @param seed the random seed of a random NAT
+ * @param icmp_kills_mapping FLAG_SET if an ICMP error removes the mapping
+ *        it is for
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_nat_init(simnet_nat_t *nat, ip_t ext_ip, flag_t port_alloc,
+			  flag_t mapping, port_t first_port, unsigned int seed,
+			  flag_t icmp_kills_mapping);
+
+/**
+ * @brief adds a host to a network
+ *
+ * @param net pointer to the network
+ * @param host pointer to the host to add
+ * @param ip the host's ip
+ * @param nat the NAT the host is behind, NULL if it is public
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_add_host(simnet_t *net, simnet_host_t *host, ip_t ip,
+			  simnet_nat_t *nat);
+
+/**
+ * @brief opens a packet engine on a simulated host
+ *
+ * @param host the host
+ * @param io pointer to the engine to open
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_open_pktio(simnet_host_t *host, pktio_t *io);
+
+/**
+ * @brief sends the SYN of a connect() from a simulated host, and tracks
+ *        the connect until a SYN/ACK completes it
+ *
+ * @param host the host
+ * @param local_port the port to connect from
+ * @param remote_ip the ip to connect to
+ * @param remote_port the port to connect to
+ * @param seq_num the sequence number of the SYN
+ * @param ttl the TTL of the SYN
+ * @param ext_port pointer to fill in with the port the SYN left the host's
+ *        NAT with (the port a helper would observe), or PORT_UNKNOWN if it
+ *        never left.  May be NULL.
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_connect(simnet_host_t *host, port_t local_port,
+			 ip_t remote_ip, port_t remote_port, seq_num_t seq_num,
+			 short ttl, port_t *ext_port);
+
+/**
+ * @brief checks if a connect made with simnet_connect was completed
+ *
+ * @param host the host
+ * @param local_port the port the connect was made from
+ * @param established pointer to fill in with FLAG_SET if it (or any other
+ *        connect from the same port) was completed
+ *
+ * @return SUCCESS, ERROR_NOT_FOUND if there is no such connect
+ */
+errorcode simnet_established(simnet_host_t *host, port_t local_port,
+			     flag_t *established);
+
+/**
+ * @brief makes a host accept the connects made to a port with
+ *        pktio_connect
+ *
+ * @param host the host
+ * @param port the port to listen on
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_listen(simnet_host_t *host, port_t port);
+
+/**
+ * @brief takes the oldest connection a listening host accepted
+ *
+ * @param host the host
+ * @param timeout the most time to wait for one in ms
+ * @param accepted pointer to fill in with the connection.  its socket
+ *        belongs to the caller from then on, and is SOCKET_UNKNOWN if none
+ *        was accepted in time.
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_accept(simnet_host_t *host, int timeout,
+			simnet_accept_t *accepted);
+
+#endif /* __SIMNET_H__ */
@@ -0,0 +1,206 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file simnet_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the simulated network
+ */
+
+#ifndef __SIMNET_PRIVATE_H__
+#define __SIMNET_PRIVATE_H__
+
+#include "simnet.h"
+
+/**
+ * @brief sends the SYN of a connect and tracks the connect (called with the
+ *        network mutex held)
+ *
+ * @param host the host
+ * @param local_port the port to connect from
+ * @param remote_ip the ip to connect to
+ * @param remote_port the port to connect to
+ * @param seq_num the sequence number of the SYN
+ * @param ttl the TTL of the SYN
+ * @param conn pointer to point at the tracked connect
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_start_connect(simnet_host_t *host, port_t local_port,
+			       ip_t remote_ip, port_t remote_port,
+			       seq_num_t seq_num, short ttl,
+			       simnet_connect_t **conn);
+
+/**
+ * @brief carries a frame from a host through the network (called with the
+ *        network mutex held)
+ *
+ * @param host the sending host
+ * @param frame the frame, which is rewritten as it is translated
+ * @param len the length of the frame
+ * @param ext_port pointer to fill in with the port the packet left the
+ *        sender's NAT with (PORT_UNKNOWN if it didn't), may be NULL
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_route(simnet_host_t *host, unsigned char *frame,
+		       unsigned long len, port_t *ext_port);
+
+/**
+ * @brief finds or makes a NAT's mapping for an outgoing packet
+ *
+ * @param nat the NAT
+ * @param int_ip the internal ip
+ * @param int_port the internal port
+ * @param remote_ip the remote ip
+ * @param remote_port the remote port
+ * @param mapping pointer to point at the mapping
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_nat_map(simnet_nat_t *nat, ip_t int_ip, port_t int_port,
+			 ip_t remote_ip, port_t remote_port,
+			 simnet_mapping_t **mapping);
+
+/**
+ * @brief finds a NAT's mapping for an incoming packet
+ *
+ * @param nat the NAT
+ * @param ext_port the external port the packet arrived on
+ * @param remote_ip the ip the packet came from
+ * @param remote_port the port the packet came from
+ * @param mapping pointer to point at the mapping
+ *
+ * @return SUCCESS, ERROR_NOT_FOUND if the packet is not let in
+ */
+errorcode simnet_nat_lookup(simnet_nat_t *nat, port_t ext_port,
+			    ip_t remote_ip, port_t remote_port,
+			    simnet_mapping_t **mapping);
+
+/**
+ * @brief models the ICMP time exceeded sent back when a packet's TTL runs
+ *        out after it left its NAT
+ *
+ * @param net the network
+ * @param nat the sender's NAT (NULL for a public sender)
+ * @param ext_port the port the packet left the NAT with
+ * @param remote_ip the packet's destination ip
+ * @param remote_port the packet's destination port
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_icmp(simnet_t *net, simnet_nat_t *nat, port_t ext_port,
+		      ip_t remote_ip, port_t remote_port);
+
+/**
+ * @brief hands a frame to a host: queues it for capture and completes a
+ *        connect if it is the SYN/ACK for one
+ *
+ * @param host the receiving host
+ * @param frame the frame
+ * @param len the length of the frame
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_deliver(simnet_host_t *host, unsigned char *frame,
+			 unsigned long len);
+
+/**
+ * @brief queues a frame for a host's packet engine to capture
+ *
+ * @param host the host
+ * @param frame the frame
+ * @param len the length of the frame
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_queue(simnet_host_t *host, unsigned char *frame,
+		       unsigned long len);
+
+/** @brief opens the simulated backend (see pktio_ops_t) */
+errorcode simnet_pktio_open(pktio_t *io);
+
+/** @brief closes the simulated backend (see pktio_ops_t) */
+errorcode simnet_pktio_close(pktio_t *io);
+
+/** @brief sends a packet into the simulated network (see pktio_ops_t) */
+errorcode simnet_pktio_send(pktio_t *io, tcp_packet_info_t *tcp_hdr,
+		void *payload, unsigned long payload_len, short ttl);
+
+/** @brief captures a packet from a simulated host (see pktio_ops_t) */
+errorcode simnet_pktio_next(pktio_t *io, unsigned char **frame);
+
+/** @brief connects a socket on a simulated host (see pktio_ops_t) */
+errorcode simnet_pktio_connect(pktio_t *io, sock_t sd, ip_t ip, port_t port);
+
+/** @brief waits for connects on a simulated host (see pktio_ops_t) */
+errorcode simnet_pktio_wait(pktio_t *io, sock_t *sds, int count,
+			    int timeout, int *winner);
+
+/**
+ * @brief finds the connect a socket is making (called with the network
+ *        mutex held)
+ *
+ * @param host the host
+ * @param sd the socket
+ *
+ * @return the connect, NULL if the socket is making none
+ */
+simnet_connect_t *simnet_find_socket(simnet_host_t *host, sock_t sd);
+
+/**
+ * @brief gives a completed connect's socket its end of the connection to
+ *        the buddy's connect it met (called with the network mutex held)
+ *
+ * @param host the host
+ * @param conn the completed connect
+ *
+ * @return SUCCESS, ERROR_NOT_FOUND if the buddy made no such connect
+ */
+errorcode simnet_join(simnet_host_t *host, simnet_connect_t *conn);
+
+/**
+ * @brief replaces a socket with one end of a new socketpair
+ *
+ * @param sd the socket to replace
+ * @param other pointer to fill in with the other end
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode simnet_pair(sock_t sd, sock_t *other);
+
+/**
+ * @brief gets the ip a host's packets are seen with past its NAT
+ *
+ * @param host the host
+ *
+ * @return the ip
+ */
+ip_t simnet_ext_ip(simnet_host_t *host);
+
+/**
+ * @brief turns a timeout into the time it runs out at
+ *
+ * @param timeout the timeout in ms
+ * @param deadline pointer to fill in
+ *
+ * @return void
+ */
+void simnet_deadline(int timeout, struct timespec *deadline);
+
+#endif /* __SIMNET_PRIVATE_H__ */
@@ -28,33 +28,51 @@
 #include "util.h"
 #include <string.h>
 #include "nethelp.h"
+#include "pktio.h"
 
 errorcode capture_peer_to_buddy_syn(peer_conn_info_t *info) {
 
 	/* declare local variables */
-	char errbuf[PCAP_ERRBUF_SIZE]; /* pcap error string buffer */
-	pcap_t *pcap_desc = NULL; /* pcap capture descriptor */
+	tcp_packet_info_t skeleton;
+	flag_t found[MAX_RACE_WIDTH];
+	int found_count = 0;
+	port_t offset;
 
 	/* error check arguments */
 	CHECK_NOT_NULL(info,ERROR_NULL_ARG_1);
 
 	/* do function */
 
-	/* initalize the pcap functions */
-	CHECK_FAILED(init_packet_capture(&pcap_desc,info->device,1000,
-		errbuf,	PCAP_ERRBUF_SIZE),ERROR_1);
-
-	/* fill in the syn info to look for */
-	info->buddy_syn.d_addr    = info->buddy.ext_ip;
-	info->buddy_syn.d_port    = info->buddy.ext_port;
-	info->buddy_syn.s_addr    = info->peer.ip;
-	info->buddy_syn.s_port    = info->peer.port;
-	info->buddy_syn.syn_flag  = FLAG_SET;
-	info->buddy_syn.ack_flag  = FLAG_UNSET;
-
-	/* now loop, checking packets for the desired SYN */
-	CHECK_FAILED(find_tcp_packet(pcap_desc, &info->buddy_syn,
-		&info->direct_conn_status,NULL,NULL),ERROR_1);
+	memset(found,FLAG_UNSET,sizeof(found));
+
+	/* loop until the SYN to every raced buddy port is found.  they are
+	 * all caught with one capture (the destination port is left unknown)
+	 * since they may be sent in any order.  a candidate whose connect
+	 * did not start sends none, so only the started ones are counted */
+	while (found_count < info->race.live) {
+		/* fill in the syn info to look for */
+		skeleton.d_addr    = info->buddy.ext_ip;
+		skeleton.d_port    = PORT_UNKNOWN;
+		skeleton.s_addr    = info->peer.ip;
+		skeleton.s_port    = info->peer.port;
+		skeleton.syn_flag  = FLAG_SET;
+		skeleton.ack_flag  = FLAG_UNSET;
+
+		/* now loop, checking packets for the desired SYN */
+		CHECK_FAILED(find_tcp_packet(info->pktio, &skeleton,
+			&info->direct_conn_status,NULL,NULL),ERROR_1);
+
+		/* match it to its candidate, ignoring retransmissions */
+		offset = PORT_2HBO(skeleton.d_port) -
+			 PORT_2HBO(info->buddy.ext_port);
+		if ( (offset >= info->race.width) ||
+		     (info->race.started[offset] != FLAG_SET) ||
+		     (found[offset] == FLAG_SET) )
+			continue;
+		info->race.syn[offset] = skeleton;
+		found[offset] = FLAG_SET;
+		found_count++;
+	}
 
 	return SUCCESS;
 }
@@ -62,8 +80,6 @@ errorcode capture_peer_to_buddy_syn(peer_conn_info_t *info) {
 errorcode capture_flooded_synack(peer_conn_info_t *info) {
 
 	/* declare local variables */
-	char errbuf[PCAP_ERRBUF_SIZE];
-	pcap_t *pcap_desc = NULL;
 	tcp_packet_info_t skeleton;
 	unsigned char *payload = NULL;
 	unsigned long payload_len = 0;
@@ -73,8 +89,7 @@ errorcode capture_flooded_synack(peer_conn_info_t *info) {
 
 	/* do function */
 
-	CHECK_FAILED(init_packet_capture(&pcap_desc,info->device,1000,
-		errbuf, PCAP_ERRBUF_SIZE), ERROR_1);
+	CHECK_FAILED(pktio_flush(info->pktio),ERROR_1);
 
 	/* fill in the syn ack info */
 	skeleton.d_addr   = info->peer.ip;
@@ -85,7 +100,7 @@ errorcode capture_flooded_synack(peer_conn_info_t *info) {
 	skeleton.syn_flag = FLAG_SET;
 
 	/* now loop checking packets for the desired SYN/ACK */
-	CHECK_FAILED(find_tcp_packet(pcap_desc, &skeleton,
+	CHECK_FAILED(find_tcp_packet(info->pktio, &skeleton,
 		&info->bday.stop_synack_find,&payload,&payload_len), ERROR_1);
 
 	DEBUG(DBG_BDAY,"DBAY:payload size is %u\n",(unsigned int)payload_len);
@@ -97,72 +112,31 @@ errorcode capture_flooded_synack(peer_conn_info_t *info) {
 
 	/* set the port value */
 	memcpy(&info->bday.port,payload,sizeof(info->bday.port));
+	info->bday.int_port = skeleton.d_port;
 	info->bday.port_set = FLAG_SET;
 
-	/* rebind the buddy socket to the new internal port */
-	close(info->socks.buddy);
-	CHECK_FAILED(bindSocket(skeleton.d_port,&info->socks.buddy),
-		ERROR_CALLED_FUNCTION);
-
-	return SUCCESS;
-}
-
-errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
-				char *errbuf, long errbuf_len) {
-
-	/* declare local variables */
-	char *filter = "tcp";
-	struct bpf_program fp;
-	bpf_u_int32 maskp;
-	bpf_u_int32 netp;
-
-	/* error check arguments */
-	CHECK_NOT_NULL(pcap_desc,ERROR_NULL_ARG_1);
-	CHECK_NOT_NULL(device,ERROR_NULL_ARG_2);
-	CHECK_NOT_NULL(errbuf,ERROR_NULL_ARG_4);
-	CHECK_GREATER_THAN(errbuf_len,PCAP_ERRBUF_SIZE-1,ERROR_ARG_5);
-
-	/* do function */
-	if ( pcap_lookupnet(device,&netp,&maskp,errbuf) < 0 ) {
-		DEBUG(DBG_SNIFF,
-			"SNIFF:did you forget to run this program as root?\n");
-		return ERROR_1;
-	}
-
-	if  ( (*pcap_desc=pcap_open_live(device,BUFSIZ,0,
-					timeout,errbuf)) == NULL )
-		return ERROR_2;
-
-	/* make sure the user is on ethernet (that is the only supported
-	 * data link layer right now */
-	if ( pcap_datalink(*pcap_desc) != DLT_EN10MB)
-		return ERROR_2;
-
-	/* compile the filter */
-	if ( pcap_compile(*pcap_desc,&fp,filter,0,netp) < 0 )
-		return ERROR_4;
-
-	/* set the filter */
-	if ( pcap_setfilter(*pcap_desc,&fp) == -1 )
-		return ERROR_5;
-
-	/* set pcap_next to be non-blocking */
-	if ( pcap_setnonblock(*pcap_desc,1,errbuf) < 0 )
-		return ERROR_6;
+	/* rebind the buddy socket to the new internal port.  when racing, the
+	 * port is shared with the other candidate sockets */
+	closeSocket(&info->socks.buddy);
+	if (info->race.width == 1)
+		CHECK_FAILED(bindSocket(skeleton.d_port,&info->socks.buddy),
+			ERROR_CALLED_FUNCTION);
+	else
+		CHECK_FAILED(bindSocketShared(skeleton.d_port,
+			&info->socks.buddy),ERROR_CALLED_FUNCTION);
 
 	return SUCCESS;
 }
 
-errorcode find_tcp_packet(pcap_t *pcap_desc, tcp_packet_info_t *tcp_skeleton,
+errorcode find_tcp_packet(pktio_t *io, tcp_packet_info_t *tcp_skeleton,
 			flag_t *break_flag, unsigned char **payload,
 			unsigned long *payload_len) {
 
 	/* declare local variables */
-	struct pcap_pkthdr hdr;
-	const u_char *packet;
+	unsigned char *packet;
 
 	/* error check arguments */
-	CHECK_NOT_NULL(pcap_desc,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(io,ERROR_NULL_ARG_1);
 	CHECK_NOT_NULL(tcp_skeleton,ERROR_NULL_ARG_2);
 	CHECK_NOT_NULL(break_flag,ERROR_NULL_ARG_3);
 
@@ -172,7 +146,8 @@ errorcode find_tcp_packet(pcap_t *pcap_desc, tcp_packet_info_t *tcp_skeleton,
 	while ( *break_flag == FLAG_UNSET) {
 		/* capture the next packet, if timeout occurs, then result is
 		 * NULL */
-		if ( (packet=pcap_next(pcap_desc,&hdr)) != NULL) {
+		CHECK_FAILED(pktio_next(io,&packet),ERROR_1);
+		if (packet != NULL) {
 			/* proces the packet, and if it is "the one" then
 			 * return success */
 			if (!(FAILED(process_packet((unsigned char*) packet,
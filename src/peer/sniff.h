@@ -29,8 +29,10 @@
 #include "peerdef.h"
 
 /**
- * @brief finds a syn sent from the peer to the buddy, and puts it into the
- *        correct location in the peer_conn_info_t structure
+ * @brief finds the syn sent from the peer to each raced buddy port, and puts
+ *        them into the correct location in the peer_conn_info_t structure.
+ *        the packet engine is not flushed first, so the caller flushes it
+ *        before the SYNs are sent.
  *
  * @param info pointer to the peer_conn_info_t structure
  *
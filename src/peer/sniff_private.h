@@ -25,22 +25,7 @@
 #ifndef __SNIFF_PRIVATE_H__
 #define __SNIFF_PRIVATE_H__
 
-#include <pcap.h>
-
-/**
- * @brief initializes the pcap functions
- *
- * @param pcap_desc pointer pointer to fill in with the pcap descriptor
- * @param device the network device to capture on
- * @param timeout timeout in ms to use when capturing packets, -1 = no timeout
- * @param errbuf the pcap error buffer to use
- * @param errbuf_len the length of the error buffer
- *
- * @return SUCCESS, errorcode on failure
- */
-
-errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
-				char *errbuf, long errbuf_len );
+#include "pktio.h"
 
 /**
  * @brief finds a tcp packet, looping over all captured packets until the
@@ -49,7 +34,7 @@ errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
  * If the passed in flag takes on any value other than FLAG_UNSET then this
  * function will return early
  *
- * @param pcap_desc the pcap descriptor
+ * @param io the packet engine to capture with
  * @param tcp_skeleton the tcp skeleton to look for.  source and destination
  *        ip/port pairs as well as SYN/ACK flags will be matched on, and the
  *        skeleton will have the seq_num, ack_num fields filled in if there is
@@ -63,7 +48,7 @@ errorcode init_packet_capture(pcap_t **pcap_desc, char *device, int timeout,
  *
  * @return SUCCESS, errorcode on failure
  */
-errorcode find_tcp_packet(pcap_t *pcap_desc, tcp_packet_info_t *tcp_skeleton,
+errorcode find_tcp_packet(pktio_t *io, tcp_packet_info_t *tcp_skeleton,
 				flag_t *break_flag, unsigned char **payload,
 				unsigned long *payload_len);
 /**
@@ -27,19 +27,20 @@
 
 #include "errorcodes.h"
 #include "def.h"
+#include "pktio.h"
 
 /**
  * @brief spoofs a tcp packet
  *
  * @param tcp_hdr the tcp_packet_info_t with the essential information to spoof  *        a tcp packet based on.
- * @param device the device to spoof on
+ * @param io the packet engine to spoof with
  * @param payload pointer to the payload of the packet. if NULL then no payload
  * @param payload_len the length of the payload
  * @param ttl the TTL to use on the spoofed packets
  *
  * @return SUCCESS, errorcode on failure
  */
-errorcode spoof(tcp_packet_info_t *tcp_hdr, char *device, void *payload,
+errorcode spoof(tcp_packet_info_t *tcp_hdr, pktio_t *io, void *payload,
 					unsigned long payload_len, short ttl);
 
 #endif /* __SPOOF_H__ */
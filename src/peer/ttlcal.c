@@ -0,0 +1,386 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file ttlcal.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief finds the TTL that gets a SYN past the peer's own NAT but not to
+ *        the buddy's
+ */
+
+#include "ttlcal.h"
+#include "ttlcal_private.h"
+#include "peerdef.h"
+#include "debug.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <linux/errqueue.h>
+#include <net/route.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+/** @brief the SYN TTLs this process has found, a long running process
+ *  (see agent.h) calibrates once per device and gateway */
+static peercache_hops_t ttlcal_table[PEERCACHE_HOPS];
+
+/** @brief protects ttlcal_table */
+static pthread_mutex_t ttlcal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+errorcode ttlcal_get(char *device, ip_t target, peercache_t *cache,
+		     unsigned char *ttl) {
+
+	/* declare local variables */
+	peercache_hops_t key, hops;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(device,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(ttl,ERROR_NULL_ARG_4);
+
+	/* do function */
+	CHECK_FAILED(ttlcal_key(device,&key),ERROR_1);
+
+	/* a kept TTL of 0 means no NAT was found */
+	pthread_mutex_lock(&ttlcal_mutex);
+	if ((i=ttlcal_find(&key)) >= 0)
+		*ttl = ttlcal_table[i].ttl;
+	pthread_mutex_unlock(&ttlcal_mutex);
+	if (i >= 0) {
+		DEBUG(DBG_TTL,"TTL:using SYN TTL %u found earlier\n",*ttl);
+		return ttlcal_none(ttl);
+	}
+
+	if ( (cache != NULL) &&
+	     (peercache_hops_lookup(cache,&key,&hops) == SUCCESS) ) {
+		*ttl = hops.ttl;
+		DEBUG(DBG_TTL,"TTL:using cached SYN TTL %u\n",*ttl);
+		pthread_mutex_lock(&ttlcal_mutex);
+		ttlcal_keep(&hops);
+		pthread_mutex_unlock(&ttlcal_mutex);
+		return ttlcal_none(ttl);
+	}
+
+	CHECK_FAILED(ttlcal_probe(target,ttl),ERROR_2);
+
+	/* no NAT found is kept as well, for less time (see
+	 * PEERCACHE_HOPS_AGE_LIMIT) */
+	key.ttl = *ttl;
+	key.observed = (unsigned long)time(NULL);
+	pthread_mutex_lock(&ttlcal_mutex);
+	ttlcal_keep(&key);
+	pthread_mutex_unlock(&ttlcal_mutex);
+	if (cache != NULL)
+		CHECK_FAILED(peercache_hops_store(cache,&key),ERROR_3);
+
+	return ttlcal_none(ttl);
+}
+
+errorcode ttlcal_forget(char *device, peercache_t *cache) {
+
+	/* declare local variables */
+	peercache_hops_t key;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(device,ERROR_NULL_ARG_1);
+
+	/* do function */
+	CHECK_FAILED(ttlcal_key(device,&key),ERROR_1);
+
+	pthread_mutex_lock(&ttlcal_mutex);
+	if ((i=ttlcal_find(&key)) >= 0)
+		memset(&ttlcal_table[i],0,sizeof(peercache_hops_t));
+	pthread_mutex_unlock(&ttlcal_mutex);
+
+	if (cache != NULL)
+		CHECK_FAILED(peercache_hops_forget(cache,&key),ERROR_2);
+
+	DEBUG(DBG_TTL,"TTL:forgot the SYN TTL for %s\n",device);
+
+	return SUCCESS;
+}
+
+errorcode ttlcal_probe(ip_t target, unsigned char *ttl) {
+
+	/* declare local variables */
+	ttlcal_hop_t hops[TTLCAL_MAX_HOPS+1];
+	struct sockaddr_in addr;
+	struct pollfd pfd;
+	struct timeval start, now;
+	sock_t sd;
+	int t, on, left;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(ttl,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if ((sd=socket(AF_INET,SOCK_DGRAM,0)) < 0)
+		return ERROR_SOCKET_CREATE;
+
+	/* the time exceeded replies are queued on the socket */
+	on = 1;
+	if (setsockopt(sd,SOL_IP,IP_RECVERR,&on,sizeof(on)) < 0) {
+		close(sd);
+		return ERROR_1;
+	}
+
+	memset(hops,0,sizeof(hops));
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = target;
+
+	/* every probe goes out at once, the port tells the replies apart */
+	for(t=1;t<=TTLCAL_MAX_HOPS;t++) {
+		addr.sin_port = htons(TTLCAL_PORT_BASE+t-1);
+		setsockopt(sd,SOL_IP,IP_TTL,&t,sizeof(t));
+		sendto(sd,&t,1,0,(struct sockaddr*)&addr,sizeof(addr));
+	}
+
+	gettimeofday(&start,NULL);
+	left = TTLCAL_TIMEOUT;
+	while ( (left > 0) && !ttlcal_done(hops) ) {
+		/* a queued error shows as POLLERR, which needs no asking */
+		pfd.fd      = sd;
+		pfd.events  = 0;
+		pfd.revents = 0;
+		if (poll(&pfd,1,left) <= 0)
+			break;
+		while (ttlcal_read(sd,hops) == 1);
+		gettimeofday(&now,NULL);
+		left = TTLCAL_TIMEOUT - ( (now.tv_sec-start.tv_sec)*1000 +
+			(now.tv_usec-start.tv_usec)/1000 );
+	}
+
+	close(sd);
+
+	*ttl = ttlcal_choose(hops);
+
+	return SUCCESS;
+}
+
+errorcode ttlcal_key(char *device, peercache_hops_t *key) {
+
+	/* declare local variables */
+	FILE *routes;
+	char line[256], iface[PEERCACHE_DEVICE_LEN];
+	unsigned long dest, gateway;
+	unsigned int flags;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(device,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(key,ERROR_NULL_ARG_2);
+
+	/* do function */
+	memset(key,0,sizeof(peercache_hops_t));
+	strncpy(key->device,device,PEERCACHE_DEVICE_LEN-1);
+	key->gateway = IP_UNKNOWN;
+
+	/* the addresses in the table are in network byte order, written out
+	 * as host order hex, so they read back as they are stored */
+	if ((routes=fopen("/proc/net/route","r")) == NULL)
+		return SUCCESS;
+	while (fgets(line,sizeof(line),routes) != NULL) {
+		if (sscanf(line,"%15s %lx %lx %x",iface,&dest,&gateway,
+				&flags) != 4)
+			continue;
+		if ( (strcmp(iface,key->device) == 0) && (dest == 0) &&
+		     (flags & RTF_GATEWAY) ) {
+			key->gateway = (ip_t)gateway;
+			break;
+		}
+	}
+	fclose(routes);
+
+	return SUCCESS;
+}
+
+int ttlcal_find(peercache_hops_t *key) {
+
+	/* declare local variables */
+	int i;
+	unsigned long now;
+	peercache_hops_t *slot;
+
+	/* do function */
+	now = (unsigned long)time(NULL);
+	for(i=0;i<PEERCACHE_HOPS;i++) {
+		slot = &ttlcal_table[i];
+		if ( (slot->used == FLAG_SET) &&
+		     (slot->gateway == key->gateway) &&
+		     (strncmp(slot->device,key->device,
+				PEERCACHE_DEVICE_LEN) == 0) &&
+		     (now - slot->observed <= PEERCACHE_HOPS_AGE_LIMIT(slot)) )
+			return i;
+	}
+
+	return -1;
+}
+
+void ttlcal_keep(peercache_hops_t *hops) {
+
+	/* declare local variables */
+	int i, oldest;
+	peercache_hops_t *slot;
+
+	/* do function */
+	oldest = 0;
+	for(i=0;i<PEERCACHE_HOPS;i++) {
+		slot = &ttlcal_table[i];
+		if ( (slot->used != FLAG_SET) ||
+		     ( (slot->gateway == hops->gateway) &&
+		       (strncmp(slot->device,hops->device,
+				PEERCACHE_DEVICE_LEN) == 0) ) )
+			break;
+		if (slot->observed < ttlcal_table[oldest].observed)
+			oldest = i;
+	}
+	if (i == PEERCACHE_HOPS)
+		i = oldest;
+
+	memcpy(&ttlcal_table[i],hops,sizeof(peercache_hops_t));
+	ttlcal_table[i].used = FLAG_SET;
+
+	return;
+}
+
+errorcode ttlcal_none(unsigned char *ttl) {
+
+	/* do function */
+	if (*ttl == 0) {
+		*ttl = TTL_TOO_LOW;
+		DEBUG(DBG_TTL,"TTL:no NAT found, using SYN TTL %u\n",*ttl);
+	}
+
+	return SUCCESS;
+}
+
+int ttlcal_read(sock_t sd, ttlcal_hop_t *hops) {
+
+	/* declare local variables */
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_in dest;
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *err;
+	struct sockaddr_in *from;
+	char data[16], control[512];
+	int t;
+
+	/* do function */
+	memset(&msg,0,sizeof(msg));
+	iov.iov_base       = data;
+	iov.iov_len        = sizeof(data);
+	msg.msg_name       = &dest;
+	msg.msg_namelen    = sizeof(dest);
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(sd,&msg,MSG_ERRQUEUE|MSG_DONTWAIT) < 0)
+		return 0;
+
+	/* the name is where the probe was sent, its port gives the TTL */
+	t = ntohs(dest.sin_port) - TTLCAL_PORT_BASE + 1;
+	if ( (t < 1) || (t > TTLCAL_MAX_HOPS) )
+		return 1;
+
+	for(cmsg=CMSG_FIRSTHDR(&msg);cmsg!=NULL;cmsg=CMSG_NXTHDR(&msg,cmsg)) {
+		if ( (cmsg->cmsg_level != SOL_IP) ||
+		     (cmsg->cmsg_type != IP_RECVERR) )
+			continue;
+		err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+		if (err->ee_origin != SO_EE_ORIGIN_ICMP)
+			continue;
+		from = (struct sockaddr_in*)SO_EE_OFFENDER(err);
+		hops[t].from = (ip_t)from->sin_addr.s_addr;
+		if ( (err->ee_type == ICMP_TIME_EXCEEDED) &&
+		     (hops[t].from != dest.sin_addr.s_addr) )
+			hops[t].state = TTLCAL_HOP_ROUTER;
+		else
+			hops[t].state = TTLCAL_HOP_END;
+		DEBUG(DBG_TTL,"TTL:hop %d is %s%s\n",t,DBG_IP(hops[t].from),
+			(hops[t].state == TTLCAL_HOP_END) ? " (end)" : "");
+	}
+
+	return 1;
+}
+
+int ttlcal_done(ttlcal_hop_t *hops) {
+
+	/* declare local variables */
+	int t;
+
+	/* do function */
+	for(t=1;t<=TTLCAL_MAX_HOPS;t++) {
+		if (hops[t].state == TTLCAL_HOP_SILENT)
+			return 0;
+		if ( (hops[t].state == TTLCAL_HOP_END) ||
+		     !ttlcal_private(hops[t].from) )
+			return 1;
+	}
+
+	return 1;
+}
+
+unsigned char ttlcal_choose(ttlcal_hop_t *hops) {
+
+	/* declare local variables */
+	int t, nat;
+
+	/* do function */
+	/* silent hops may be anywhere, only a hop answering from outside
+	 * ends the NATs */
+	nat = 0;
+	for(t=1;t<=TTLCAL_MAX_HOPS;t++) {
+		if (hops[t].state == TTLCAL_HOP_SILENT)
+			continue;
+		if ( (hops[t].state == TTLCAL_HOP_END) ||
+		     !ttlcal_private(hops[t].from) )
+			break;
+		nat = t;
+	}
+
+	if (nat == 0)
+		return 0;
+
+	DEBUG(DBG_TTL,"TTL:outermost NAT is %d hop(s) away, SYN TTL %d\n",
+		nat,nat+1);
+
+	return (unsigned char)(nat+1);
+}
+
+int ttlcal_private(ip_t ip) {
+
+	/* declare local variables */
+	unsigned long addr;
+
+	/* do function */
+	addr = ntohl((unsigned int)ip);
+
+	return ( ((addr & 0xff000000) == 0x0a000000) ||  /* 10/8 */
+		 ((addr & 0xfff00000) == 0xac100000) ||  /* 172.16/12 */
+		 ((addr & 0xffff0000) == 0xc0a80000) ||  /* 192.168/16 */
+		 ((addr & 0xffc00000) == 0x64400000) ||  /* 100.64/10 */
+		 ((addr & 0xffff0000) == 0xa9fe0000) );  /* 169.254/16 */
+}
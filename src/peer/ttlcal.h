@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file ttlcal.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief finds the TTL that gets a SYN past the peer's own NAT but not to
+ *        the buddy's, by counting the hops to the NAT
+ *
+ * The SYNs a peer sends the buddy must open a mapping in the peer's NAT and
+ * die before they reach the buddy's NAT, or the buddy's NAT answers with a
+ * RST.  A peer behind a home router is one hop from its NAT, but behind a
+ * carrier grade NAT or nested NATs it is more, and a fixed TTL fails there.
+ *
+ * Calibration sends a UDP probe towards the helper for every TTL from 1 to
+ * TTLCAL_MAX_HOPS at once.  The kernel hands the ICMP time exceeded replies
+ * to the probe socket's error queue (IP_RECVERR), so no root is needed and
+ * no capture filter changes.  Hops answering from private addresses are
+ * taken to be inside the NATs, and the SYN TTL is one more than the last of
+ * them, so the SYN dies at the first router past the outermost NAT.
+ *
+ * The result depends on the device and its gateway only.  It is kept for
+ * the life of the process, and in the peer cache (see peercache.h) when
+ * one is in use.  Finding no NAT is kept too, for a shorter time, so a
+ * peer without one does not wait out the probes on every connection.
+ */
+
+#ifndef __TTLCAL_H__
+#define __TTLCAL_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include "peercache.h"
+
+/** @brief the most hops probed, so the most NATs that can be found */
+#define TTLCAL_MAX_HOPS		8
+
+/** @brief the destination port of the probe with TTL 1, the probe with TTL
+ *  t goes to this plus t - 1 (the ports traceroute uses) */
+#define TTLCAL_PORT_BASE	33434
+
+/** @brief the most milliseconds to wait for the replies to the probes */
+#define TTLCAL_TIMEOUT		500
+
+/** @brief no reply was seen for a hop */
+#define TTLCAL_HOP_SILENT	0
+
+/** @brief a router said the probe's TTL ran out at the hop */
+#define TTLCAL_HOP_ROUTER	1
+
+/** @brief the probe reached the helper, or something refused it, at the
+ *  hop */
+#define TTLCAL_HOP_END		2
+
+/** @brief structure with what was seen of one hop */
+struct ttlcal_hop {
+	/** @brief TTLCAL_HOP_SILENT, TTLCAL_HOP_ROUTER or TTLCAL_HOP_END */
+	int state;
+	/** @brief the address the reply came from */
+	ip_t from;
+};
+
+/** @brief typedef for the ttlcal_hop structure */
+typedef struct ttlcal_hop ttlcal_hop_t;
+
+/**
+ * @brief gets the SYN TTL for a device: from this process's earlier
+ *        connections, else from the cache, else by calibrating.  if
+ *        calibration finds no NAT TTL_TOO_LOW is used, and that no NAT
+ *        was found is kept for PEERCACHE_HOPS_NONE_MAX_AGE seconds.
+ *
+ * @param device the network device the SYNs are sent on
+ * @param target a public address beyond the NATs (the helper's)
+ * @param cache pointer to an open peer cache, or NULL for none
+ * @param ttl pointer to fill in with the TTL
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode ttlcal_get(char *device, ip_t target, peercache_t *cache,
+		     unsigned char *ttl);
+
+/**
+ * @brief forgets the SYN TTL kept for a device, so the next connection
+ *        calibrates again
+ *
+ * @param device the network device
+ * @param cache pointer to an open peer cache, or NULL for none
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode ttlcal_forget(char *device, peercache_t *cache);
+
+/**
+ * @brief calibrates: probes the hops towards a target and works out the
+ *        SYN TTL from the replies
+ *
+ * @param target a public address beyond the NATs
+ * @param ttl pointer to fill in with the TTL, 0 if no NAT was found
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode ttlcal_probe(ip_t target, unsigned char *ttl);
+
+#endif /* __TTLCAL_H__ */
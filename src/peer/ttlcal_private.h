@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file ttlcal_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the SYN TTL calibration
+ */
+
+#ifndef __TTLCAL_PRIVATE_H__
+#define __TTLCAL_PRIVATE_H__
+
+#include "ttlcal.h"
+
+/**
+ * @brief fills in the device and default gateway of a hop count entry.
+ *        the gateway is IP_UNKNOWN if the routing table can not be read or
+ *        the device has no default route.
+ *
+ * @param device the network device
+ * @param key pointer to the entry to fill in (the rest is zeroed)
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode ttlcal_key(char *device, peercache_hops_t *key);
+
+/**
+ * @brief finds the index of a fresh entry in the process's table.  the
+ *        table must be locked.
+ *
+ * @param key an entry with the device and gateway filled in
+ *
+ * @return the index, or a negative value if there is no fresh entry
+ */
+int ttlcal_find(peercache_hops_t *key);
+
+/**
+ * @brief keeps an entry in the process's table, replacing the one for the
+ *        same device and gateway, else a free or the oldest one
+ *
+ * @param hops the entry to keep
+ *
+ * @return void
+ */
+void ttlcal_keep(peercache_hops_t *hops);
+
+/**
+ * @brief turns a TTL of 0 (no NAT found) into the TTL to use without a NAT
+ *
+ * @param ttl pointer to the TTL, changed to TTL_TOO_LOW if it is 0
+ *
+ * @return SUCCESS
+ */
+errorcode ttlcal_none(unsigned char *ttl);
+
+/**
+ * @brief reads one reply from a probe socket's error queue, if there is one
+ *
+ * @param sd the probe socket
+ * @param hops the hops seen so far, indexed by TTL
+ *
+ * @return 1 if a reply was read, 0 otherwise
+ */
+int ttlcal_read(sock_t sd, ttlcal_hop_t *hops);
+
+/**
+ * @brief checks if the replies so far settle the TTL: a hop past the NATs
+ *        has answered and so has every hop before it
+ *
+ * @param hops the hops seen so far, indexed by TTL
+ *
+ * @return 1 if they do, 0 otherwise
+ */
+int ttlcal_done(ttlcal_hop_t *hops);
+
+/**
+ * @brief works out the SYN TTL from the hops seen
+ *
+ * @param hops the hops seen, indexed by TTL
+ *
+ * @return the TTL, 0 if no hop answered from inside a NAT
+ */
+unsigned char ttlcal_choose(ttlcal_hop_t *hops);
+
+/**
+ * @brief checks if an address is one a NAT hides (RFC 1918, the shared
+ *        address space carrier grade NATs use, or link local)
+ *
+ * @param ip the address
+ *
+ * @return 1 if it is, 0 otherwise
+ */
+int ttlcal_private(ip_t ip);
+
+#endif /* __TTLCAL_PRIVATE_H__ */
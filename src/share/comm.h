@@ -145,6 +145,22 @@ typedef unsigned long comm_len_t;
  *  flood has been completed */
 #define COMM_MSG_SYN_ACK_FLOOD_DONE		0x0202
 
+/** @brief the first message on a connection from one helper of a cluster
+ *  to another (message includes a payload of type comm_msg_cluster_t) */
+#define COMM_MSG_CLUSTER			0x2001
+
+/*****************************************************************************
+ *                            Cluster Message Kinds                          *
+ *****************************************************************************/
+
+/** @brief the helper owning the peer's pair takes over the session, the rest
+ *  of the connection is the peer's own */
+#define COMM_CLUSTER_FORWARD		1
+
+/** @brief the sending helper accepted a connection the receiving helper may
+ *  be waiting for (a port prediction second connection) */
+#define COMM_CLUSTER_SEEN		2
+
 /*****************************************************************************
  *                           Port Allocation Types                           *
  *****************************************************************************/
@@ -158,6 +174,10 @@ typedef unsigned long comm_len_t;
 /** @brief port allocation method is random */
 #define COMM_PORT_ALLOC_RAND		2
 
+/** @brief the largest stride the helper accepts from a peer's cache (see
+ *  comm_msg_hello_t) */
+#define COMM_MAX_STRIDE			8
+
 /*****************************************************************************
  *                        Communication Support Types                        *
  *****************************************************************************/
@@ -167,6 +187,10 @@ typedef unsigned long comm_len_t;
 /** @brief supported connection */
 #define COMM_CONNECTION_SUPPORTED	1
 
+/** @brief no direct connection is possible, but the helper will relay the
+ *  peer's traffic to the buddy over the existing helper connection */
+#define COMM_CONNECTION_RELAYED		2
+
 /*****************************************************************************
  *                      Flags indicating if DBay is needed                   *
  *****************************************************************************/
@@ -192,6 +216,15 @@ struct comm_msg_hello {
 	port_t buddy_int_port;
 	/** @brief the buddy's external ip */
 	ip_t buddy_ext_ip;
+	/** @brief the peer's port allocation method as remembered from an
+	 *  earlier connection, or COMM_PORT_ALLOC_UNKNOWN.  when known the
+	 *  helper skips asking for a second connection */
+	flag_t port_alloc;
+	/** @brief for a remembered sequential method, how far the external
+	 *  port of the peer's connection to the buddy will be from the
+	 *  external port of this connection (1 for a sequential NAT, the
+	 *  distance between the internal ports for a NAT that keeps them) */
+	unsigned char stride;
 } __attribute__((__packed__));
 
 /** @brief typedef for the COMM_MSG_HELLO payload structure */
@@ -203,6 +236,11 @@ typedef struct comm_msg_hello comm_msg_hello_t;
 struct comm_msg_pred_port {
 	/** @brief the port allocation method */
 	flag_t port_alloc;
+	/** @brief the external port the helper predicts for the peer's
+	 *  connection to the buddy (PORT_UNKNOWN if random) */
+	port_t ext_port;
+	/** @brief the external port the helper sees for this connection */
+	port_t obs_port;
 } __attribute__((__packed__));
 
 /** @brief typedef for the COMM_MSG_PORT_PRED payload structure */
@@ -240,8 +278,11 @@ typedef struct comm_msg_buddy_info comm_msg_buddy_port_t;
 
 /** @brief structure to hold payload for a COMM_MSG_SYN_TO_BUDDY_SEQ message */
 struct comm_msg_buddy_syn_seq {
-	/** @brief the sequence number of the SYN */
-	seq_num_t seq_num;
+	/** @brief the number of SYNs sent (one per raced buddy port) */
+	unsigned char count;
+	/** @brief the sequence number of each SYN, in order of the buddy port
+	 *  it was sent to (predicted port first) */
+	seq_num_t seq_num[MAX_RACE_WIDTH];
 } __attribute__((__packed__));
 
 /** @brief a typedef for the COMM_MSG_BUDDY_SYN_SEQ message */
@@ -251,8 +292,11 @@ typedef struct comm_msg_buddy_syn_seq comm_msg_buddy_syn_seq_t;
 
 /** @brief structure to hold the COMM_MSG_PEER_SYN_SEQ payload */
 struct comm_msg_peer_syn_seq {
-	/** @brief the sequence number from the peer's SYN to the buddy */
-	seq_num_t seq_num;
+	/** @brief the number of SYNs the buddy sent to the peer */
+	unsigned char count;
+	/** @brief the sequence number from each of the buddy's SYNs to the
+	 *  peer */
+	seq_num_t seq_num[MAX_RACE_WIDTH];
 } __attribute__((__packed__));
 
 /** @brief typedef for the COMM_MSG_PEER_SYN_SEQ payload structure */
@@ -299,5 +343,21 @@ struct comm_msg_syn_ack_flood_seq_num {
 /** @brief typedef for the COMM_MSG_SYN_ACK_FLOOD_SEQ_NUM payload structure */
 typedef struct comm_msg_syn_ack_flood_seq_num comm_msg_syn_ack_flood_seq_num_t;
 
+
+/** @brief structure to hold the COMM_MSG_CLUSTER payload */
+struct comm_msg_cluster {
+	/** @brief COMM_CLUSTER_FORWARD or COMM_CLUSTER_SEEN */
+	flag_t kind;
+	/** @brief the peer's external ip, as the sending helper saw it */
+	ip_t ip;
+	/** @brief the peer's external port, as the sending helper saw it */
+	port_t port;
+	/** @brief the peer's HELLO (COMM_CLUSTER_FORWARD only) */
+	comm_msg_hello_t hello;
+} __attribute__((__packed__));
+
+/** @brief typedef for the COMM_MSG_CLUSTER payload structure */
+typedef struct comm_msg_cluster comm_msg_cluster_t;
+
 #endif /* __COMM_H__ */
 
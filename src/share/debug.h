@@ -91,9 +91,66 @@
  */
 #define DBG_BDAY			(0x00000400)
 
+/** @brief the RELAY debug level:
+ *         information about sessions relayed through the helper
+ */
+#define DBG_RELAY			(0x00000800)
+
+/** @brief the AGENT debug level:
+ *         information about the peer agent and the applications using it
+ */
+#define DBG_AGENT			(0x00001000)
+
+/** @brief the CACHE debug level:
+ *         information about the peer's cache of earlier connections
+ */
+#define DBG_CACHE			(0x00002000)
+
+/** @brief the MUX debug level:
+ *         information about streams multiplexed over a buddy connection
+ */
+#define DBG_MUX				(0x00004000)
+
+/** @brief the ADMIT debug level:
+ *         information about connections the helper turned away
+ */
+#define DBG_ADMIT			(0x00008000)
+
+/** @brief the HANDOVER debug level:
+ *         information about a helper handing its sessions to a new process
+ */
+#define DBG_HANDOVER			(0x00010000)
+
+/** @brief the TRACE debug level:
+ *         information about recording the helper's sessions to a trace
+ */
+#define DBG_TRACE			(0x00020000)
+
+/** @brief the CLUSTER debug level:
+ *         information about sessions routed between the helpers of a cluster
+ */
+#define DBG_CLUSTER			(0x00040000)
+
+/** @brief the TIMEOUT debug level:
+ *         information about round trip time samples and the waits they set
+ */
+#define DBG_TIMEOUT			(0x00080000)
+
+/** @brief the TTL debug level:
+ *         information about finding how many hops away the peer's NAT is
+ */
+#define DBG_TTL				(0x00100000)
+
+/** @brief the RESOLVE debug level:
+ *         information about host names resolved and cached
+ */
+#define DBG_RESOLVE			(0x00200000)
+
 /** @brief all the debug levels that are turned on */
 #define DBG_LEVEL (DBG_PROTOCOL | DBG_VERBOSE | DBG_NETWORK | DBG_PORT_PRED \
-| DBG_SNIFF | DBG_SPOOF | DBG_BDAY)
+| DBG_SNIFF | DBG_SPOOF | DBG_BDAY | DBG_RELAY | DBG_AGENT | DBG_CACHE \
+| DBG_MUX | DBG_ADMIT | DBG_HANDOVER | DBG_TRACE | DBG_CLUSTER \
+| DBG_TIMEOUT | DBG_TTL | DBG_RESOLVE)
 
 /** @brief a macro to allow easy debugging info to be turned on and off */
 #define DEBUG(level,fmt,args...) \
@@ -114,7 +171,7 @@
 	if (gettimeofday(&val,NULL)<0)  \
 		{fprintf(stderr,"TIME:%s:%s <?>\n",__FUNCTION__,x);} \
 	else \
-		{fprintf(stderr,"TIME:%s:%s <%u.%u>\n",__FUNCTION__, x, (unsigned int) val.tv_sec, (unsigned int)val.tv_usec);} \
+		{fprintf(stderr,"TIME:%s:%s <%u.%06u>\n",__FUNCTION__, x, (unsigned int) val.tv_sec, (unsigned int)val.tv_usec);} \
 })
 
 #endif /* __DEBUG_H__ */
@@ -102,6 +102,27 @@ typedef unsigned short window_t;
 /** @brief macro for the default window size (used in spoofing) */
 #define WINDOW_DEFAULT		0x6815
 
+/****************************************************************************
+ *                    THE DIRECT CONNECTION RACE DEFINITIONS                *
+ ****************************************************************************/
+
+/** @brief the most predicted buddy ports a peer will race a direct
+ *  connection over (also bounds the sequence number arrays sent through the
+ *  helper) */
+#define MAX_RACE_WIDTH		8
+
+/** @brief the default number of predicted buddy ports to race a direct
+ *  connection over (1 = a single attempt to the predicted port) */
+#define RACE_WIDTH_DEFAULT	1
+
+/** @brief the default path of the unix socket a peer agent listens on */
+#define AGENT_SOCKET_DEFAULT	"/tmp/natblaster_agent"
+
+/** @brief the default permissions of the peer agent's socket file (the user
+ *  running the agent and the socket's group may connect, see
+ *  natblaster_agent) */
+#define AGENT_SOCKET_MODE_DEFAULT	0660
+
 /****************************************************************************
  *                        THE STRUCTURE TYPE DEFINITIONS                    *
  ****************************************************************************/
@@ -191,5 +212,74 @@ struct buddy_info {
 /** @brief typedef for the buddy_info structure */
 typedef struct buddy_info buddy_info_t;
 
+/** @brief structure with the optional settings a peer can connect with */
+struct peer_opts {
+	/** @brief the number of consecutive predicted buddy ports to race a
+	 *  direct connection over, starting at the predicted port.  1 makes a
+	 *  single connection attempt. */
+	unsigned char race_width;
+	/** @brief an open packet engine (see pktio.h) to capture and spoof
+	 *  with, so a long running process does not open one per
+	 *  connection.  if NULL one is opened for the connection. */
+	struct pktio *pktio;
+	/** @brief the peer cache file (see peercache.h) to take what earlier
+	 *  connections learned from, and to remember this one in.  if NULL
+	 *  the port allocation method is always discovered. */
+	char *cache;
+	/** @brief FLAG_SET to overlap the connection steps: replies the helper
+	 *  is sure to ask for are sent before it asks, and the buddy sockets
+	 *  are readied while waiting on the helper.  FLAG_UNSET runs every
+	 *  step strictly after the one before it. */
+	flag_t overlap;
+	/** @brief the TTL of the SYNs that must get past the peer's NAT but
+	 *  not reach the buddy's, 0 to find it (see ttlcal.h) */
+	unsigned char syn_ttl;
+} __attribute__((packed));
+
+/** @brief typedef for the peer_opts structure */
+typedef struct peer_opts peer_opts_t;
+
+/** @brief structure with the optional settings a helper can run with */
+struct helper_opts {
+	/** @brief FLAG_SET to relay the traffic of peers that can not make a
+	 *  direct connection through the helper */
+	flag_t relay;
+	/** @brief the most bytes per second a single relayed session may
+	 *  forward (both directions together), 0 for no limit */
+	unsigned long relay_rate;
+	/** @brief the most peer sessions handled at once, 0 for no limit */
+	unsigned long max_sessions;
+	/** @brief the connections per second one source ip may make, 0 for
+	 *  no limit */
+	unsigned long source_rate;
+	/** @brief the unix socket a new helper process connects to, to take
+	 *  over the listening socket and the running sessions.  NULL for no
+	 *  hot restart */
+	char *control;
+	/** @brief the control socket of a running helper to take over from,
+	 *  NULL to start fresh */
+	char *takeover;
+	/** @brief the file every message exchanged with the peers is recorded
+	 *  to, NULL to record nothing */
+	char *trace;
+	/** @brief the helpers of the cluster this helper is a node of, as
+	 *  "ip:port,ip:port,...", NULL to run on its own */
+	char *cluster;
+	/** @brief this helper's entry in cluster, as "ip:port" */
+	char *cluster_self;
+	/** @brief the file (see timeout.h) with the limits of the protocol
+	 *  waits, NULL for the built in ones */
+	char *timeouts;
+} __attribute__((packed));
+
+/** @brief typedef for the helper_opts structure */
+typedef struct helper_opts helper_opts_t;
+
+/** @brief the default for helper_opts_t max_sessions */
+#define HELPER_DEFAULT_MAX_SESSIONS	1024
+
+/** @brief the default for helper_opts_t source_rate */
+#define HELPER_DEFAULT_SOURCE_RATE	4
+
 #endif /* __DEF_H__ */
 
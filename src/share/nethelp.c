@@ -23,30 +23,22 @@
  */
 #include <pcap.h>
 #include <string.h>
+#include <unistd.h>
 #include "nethelp.h"
+#include "resolver.h"
 #include "berkeleyapi.h"
 #include "debug.h"
 
 errorcode resolveIP(char *ip_or_name, ip_t *ip) {
 
-	/* declare local variables */
-	struct hostent *hp;
-
 	/* error check arguments */
 	CHECK_NOT_NULL(ip_or_name,ERROR_NULL_ARG_1);
 	CHECK_NOT_NULL(ip,ERROR_NULL_ARG_2);
 
 	/* do function */
-	hp = gethostbyname(ip_or_name);
-
-	if (hp==NULL)
-		return ERROR_HOST_NAME_LOOKUP;
-
-	if (hp->h_addr==NULL)
-		return ERROR_1;
+	CHECK_FAILED(resolver_lookup(ip_or_name,ip),ERROR_HOST_NAME_LOOKUP);
 
-	memcpy(ip,hp->h_addr,sizeof(ip));
-	if (*ip==-1)
+	if (*ip==INADDR_NONE)
 		return ERROR_2;
 
 	return SUCCESS;
@@ -85,6 +77,57 @@ errorcode bindSocket(port_t port_to_bind, sock_t *sd) {
 	return SUCCESS;
 }
 
+errorcode bindSocketShared(port_t port_to_bind, sock_t *sd) {
+
+	/* declare local variables */
+	int shared_sd;
+	int on = 1;
+	struct sockaddr_in server;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(sd,ERROR_NULL_ARG_2);
+
+	/* do function */
+
+	/* create stream socket using TCP */
+	if( (shared_sd=socket(AF_INET, SOCK_STREAM, 0)) < 0 ) {
+		return ERROR_SOCKET_CREATE;
+	}
+
+	/* allow other sockets to bind the same port, as long as none of them
+	 * listen each one can still connect to a different destination */
+	if (setsockopt(shared_sd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on))<0) {
+		close(shared_sd);
+		return ERROR_1;
+	}
+
+	/* put the clients info in the sockaddr_in struct */
+	server.sin_family = AF_INET;
+	server.sin_port = port_to_bind;
+	server.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(shared_sd, (struct sockaddr*)&server, sizeof(server))<0) {
+		DEBUG(DBG_NETWORK, "NETWORK:couldn't bind shared port %u\n",
+			DBG_PORT(port_to_bind));
+		close(shared_sd);
+		return ERROR_BIND;
+	}
+	*sd = shared_sd;
+
+	return SUCCESS;
+}
+
+void closeSocket(sock_t *sd) {
+
+	/* do function */
+	if ( (sd == NULL) || (*sd == SOCKET_UNKNOWN) )
+		return;
+	close(*sd);
+	*sd = SOCKET_UNKNOWN;
+
+	return;
+}
+
 errorcode tcp_connect(ip_t ip, port_t port, sock_t *sd) {
 
 	/* declare local variables */
@@ -115,3 +158,78 @@ errorcode tcp_connect(ip_t ip, port_t port, sock_t *sd) {
 	return SUCCESS;
 }
 
+
+errorcode sendFd(sock_t sd, int fd) {
+
+	/* declare local variables */
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char byte = 0;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	/* error check arguments */
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_1);
+	CHECK_NOT_NEG(fd,ERROR_NEG_ARG_2);
+
+	/* do function */
+
+	/* at least one byte of data has to carry the descriptor */
+	iov.iov_base = &byte;
+	iov.iov_len  = sizeof(byte);
+
+	memset(&msg,0,sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg),&fd,sizeof(int));
+
+	if (sendmsg(sd,&msg,0) != sizeof(byte)) {
+		DEBUG(DBG_NETWORK,"NETWORK:couldn't pass descriptor\n");
+		return ERROR_NETWORK_SEND;
+	}
+
+	return SUCCESS;
+}
+
+errorcode readFd(sock_t sd, int *fd) {
+
+	/* declare local variables */
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char byte;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	/* error check arguments */
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_1);
+	CHECK_NOT_NULL(fd,ERROR_NULL_ARG_2);
+
+	/* do function */
+	iov.iov_base = &byte;
+	iov.iov_len  = sizeof(byte);
+
+	memset(&msg,0,sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(sd,&msg,0) != sizeof(byte))
+		return ERROR_NETWORK_READ;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if ( (cmsg == NULL) || (cmsg->cmsg_level != SOL_SOCKET) ||
+	     (cmsg->cmsg_type != SCM_RIGHTS) ||
+	     (cmsg->cmsg_len != CMSG_LEN(sizeof(int))) )
+		return ERROR_NOT_FOUND;
+	memcpy(fd,CMSG_DATA(cmsg),sizeof(int));
+
+	return SUCCESS;
+}
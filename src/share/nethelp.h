@@ -29,10 +29,14 @@
 #include "errorcodes.h"
 
 /**
- * @brief resolves a hostname or IP to a 32bit IP number
+ * @brief resolves a hostname or IP to a 32bit IP number.  names go through
+ *        the process wide cache of resolver.h, so this is thread safe and
+ *        a name looked up again is answered from memory.
  *
  * @param ip_or_name the hostname or IP as a string
  * @param ip the IP as a 32bit number
+ *
+ * @return SUCCESS, errorcode on failure
  */
 errorcode resolveIP(char *ip_or_name, ip_t *ip);
 
@@ -47,6 +51,33 @@ errorcode resolveIP(char *ip_or_name, ip_t *ip);
  */
 errorcode bindSocket(port_t port_to_bind, sock_t *sd);
 
+/**
+ * @brief binds a socket to a port that other sockets bound with this
+ *        function may share
+ *
+ * The socket has SO_REUSEADDR set before binding, so several sockets can
+ * hold the same local port and each connect to a different destination.
+ *
+ * @param port_to_bind the desired port
+ * @param sd a pointer to an int to fill in with the socket descriptor for the
+ *        bound socket, if successful.  On error the value is undefined.
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode bindSocketShared(port_t port_to_bind, sock_t *sd);
+
+/**
+ * @brief closes a socket if it is open and marks it closed, so a socket
+ *        closed on one path is not closed again on another (by then the
+ *        descriptor may belong to another thread's socket)
+ *
+ * @param sd pointer to the socket descriptor, SOCKET_UNKNOWN if it is not
+ *        open.  Set to SOCKET_UNKNOWN.
+ *
+ * @return void
+ */
+void closeSocket(sock_t *sd);
+
 /**
  * @brief creates a TCP connection
  *
@@ -61,5 +92,30 @@ errorcode bindSocket(port_t port_to_bind, sock_t *sd);
  */
 errorcode tcp_connect(ip_t ip, port_t port, sock_t *sd);
 
+/**
+ * @brief passes an open descriptor to the process at the other end of a unix
+ *        domain socket
+ *
+ * A single byte is sent with the descriptor attached (SCM_RIGHTS).  The
+ * receiver gets its own copy of the descriptor, so the sender may close its
+ * copy afterwards.
+ *
+ * @param sd the connected unix domain socket
+ * @param fd the descriptor to pass
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode sendFd(sock_t sd, int fd);
+
+/**
+ * @brief receives a descriptor passed with sendFd
+ *
+ * @param sd the connected unix domain socket
+ * @param fd pointer to fill in with the received descriptor
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode readFd(sock_t sd, int *fd);
+
 #endif /* __NETHELP_H__ */
 
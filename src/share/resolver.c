@@ -0,0 +1,384 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file resolver.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief resolves host names to IPs through a cache shared by every thread
+ */
+
+#include "resolver.h"
+#include "resolver_private.h"
+#include "debug.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/** @brief the cached names */
+static resolver_entry_t resolver_table[RESOLVER_ENTRIES];
+
+/** @brief the asynchronous lookups ready for resolver_poll */
+static resolver_wait_t *resolver_ready = NULL;
+
+/** @brief a pipe written to when a lookup is ready for resolver_poll, the
+ *  read end is what resolver_fd hands out */
+static int resolver_wake[2] = { -1, -1 };
+
+/** @brief protects resolver_table, resolver_ready and resolver_wake */
+static pthread_mutex_t resolver_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief signalled whenever a pending entry gets its result */
+static pthread_cond_t resolver_resolved = PTHREAD_COND_INITIALIZER;
+
+/** @brief makes resolver_init run once */
+static pthread_once_t resolver_once = PTHREAD_ONCE_INIT;
+
+errorcode resolver_lookup(char *name, ip_t *ip) {
+
+	/* declare local variables */
+	resolver_entry_t *entry;
+	struct in_addr addr;
+	unsigned long hash;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(name,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(ip,ERROR_NULL_ARG_2);
+
+	/* do function */
+
+	/* an IP written as one needs no lookup */
+	if (inet_aton(name,&addr)) {
+		*ip = addr.s_addr;
+		return SUCCESS;
+	}
+	if (strlen(name) >= RESOLVER_NAME_LEN)
+		return ERROR_HOST_NAME_LOOKUP;
+
+	hash = resolver_hash(name);
+	pthread_mutex_lock(&resolver_mutex);
+
+	/* another thread is resolving the name, so wait for its answer */
+	while ( ((entry=resolver_find(name,hash)) != NULL) &&
+		(entry->pending == FLAG_SET) )
+		pthread_cond_wait(&resolver_resolved,&resolver_mutex);
+
+	if ( (entry != NULL) && (entry->expires > time(NULL)) ) {
+		*ip = entry->ip;
+		ret = entry->ret;
+		pthread_mutex_unlock(&resolver_mutex);
+		return ret;
+	}
+	entry = resolver_claim(name,hash,entry);
+	pthread_mutex_unlock(&resolver_mutex);
+
+	ret = resolver_getaddrinfo(name,ip);
+
+	/* with every entry pending the answer is just not cached */
+	if (entry != NULL) {
+		pthread_mutex_lock(&resolver_mutex);
+		resolver_finish(entry,ret,*ip);
+		pthread_mutex_unlock(&resolver_mutex);
+	}
+
+	return ret;
+}
+
+errorcode resolver_lookup_async(char *name, ip_t *ip, resolver_done_t done,
+				void *arg) {
+
+	/* declare local variables */
+	resolver_entry_t *entry;
+	resolver_wait_t *wait;
+	struct in_addr addr;
+	unsigned long hash;
+	pthread_t tid;
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(name,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(ip,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(done,ERROR_NULL_ARG_3);
+
+	/* do function */
+	if (inet_aton(name,&addr)) {
+		*ip = addr.s_addr;
+		return FINISHED;
+	}
+	if (strlen(name) >= RESOLVER_NAME_LEN)
+		return ERROR_HOST_NAME_LOOKUP;
+
+	pthread_once(&resolver_once,resolver_init);
+	if ( (wait=malloc(sizeof(resolver_wait_t))) == NULL)
+		return ERROR_MALLOC_FAILED;
+	wait->done = done;
+	wait->arg = arg;
+	wait->ret = SUCCESS;
+	wait->ip = IP_UNKNOWN;
+
+	hash = resolver_hash(name);
+	pthread_mutex_lock(&resolver_mutex);
+
+	entry = resolver_find(name,hash);
+	if ( (entry != NULL) && (entry->pending == FLAG_UNSET) &&
+	     (entry->expires > time(NULL)) ) {
+		*ip = entry->ip;
+		ret = entry->ret;
+		pthread_mutex_unlock(&resolver_mutex);
+		free(wait);
+		return (ret == SUCCESS) ? FINISHED : ret;
+	}
+
+	/* the name is already being resolved, wait for that answer */
+	if ( (entry != NULL) && (entry->pending == FLAG_SET) ) {
+		wait->next = entry->waiting;
+		entry->waiting = wait;
+		pthread_mutex_unlock(&resolver_mutex);
+		return SUCCESS;
+	}
+
+	if ( (entry=resolver_claim(name,hash,entry)) == NULL) {
+		pthread_mutex_unlock(&resolver_mutex);
+		free(wait);
+		return ERROR_OUT_OF_BOUNDS;
+	}
+	wait->next = NULL;
+	entry->waiting = wait;
+	pthread_mutex_unlock(&resolver_mutex);
+
+	if (pthread_create(&tid,NULL,run_resolver_lookup,entry) != 0) {
+		/* fail the lookups now, but do not remember the failure */
+		pthread_mutex_lock(&resolver_mutex);
+		resolver_finish(entry,ERROR_PTHREAD_CREATE_FAILED,IP_UNKNOWN);
+		entry->expires = 0;
+		pthread_mutex_unlock(&resolver_mutex);
+		return SUCCESS;
+	}
+	pthread_detach(tid);
+
+	return SUCCESS;
+}
+
+int resolver_fd(void) {
+
+	/* do function */
+	pthread_once(&resolver_once,resolver_init);
+	if (resolver_wake[0] < 0)
+		return ERROR_INIT;
+
+	return resolver_wake[0];
+}
+
+int resolver_poll(void) {
+
+	/* declare local variables */
+	resolver_wait_t *ready, *next;
+	char byte;
+	int n;
+
+	/* do function */
+	pthread_mutex_lock(&resolver_mutex);
+	ready = resolver_ready;
+	resolver_ready = NULL;
+	if (resolver_wake[0] >= 0)
+		while (read(resolver_wake[0],&byte,1) > 0);
+	pthread_mutex_unlock(&resolver_mutex);
+
+	/* the callbacks may start lookups of their own */
+	for (n=0; ready != NULL; ready=next, n++) {
+		next = ready->next;
+		ready->done(ready->arg,ready->ret,ready->ip);
+		free(ready);
+	}
+
+	return n;
+}
+
+void resolver_flush(void) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	pthread_mutex_lock(&resolver_mutex);
+	for (i=0; i<RESOLVER_ENTRIES; i++) {
+		if (resolver_table[i].pending == FLAG_SET)
+			continue;
+		resolver_table[i].name[0] = '\0';
+		resolver_table[i].expires = 0;
+	}
+	pthread_mutex_unlock(&resolver_mutex);
+}
+
+void resolver_init(void) {
+
+	/* do function */
+	if (pipe(resolver_wake)<0) {
+		DEBUG(DBG_RESOLVE,"RESOLVE:could not create the wake pipe\n");
+		resolver_wake[0] = resolver_wake[1] = -1;
+		return;
+	}
+	fcntl(resolver_wake[0],F_SETFL,O_NONBLOCK);
+	fcntl(resolver_wake[1],F_SETFL,O_NONBLOCK);
+}
+
+unsigned long resolver_hash(char *name) {
+
+	/* declare local variables */
+	unsigned long hash;
+
+	/* do function */
+
+	/* FNV-1a */
+	for (hash=2166136261UL; *name != '\0'; name++)
+		hash = (hash ^ (unsigned char)*name) * 16777619UL;
+
+	return hash;
+}
+
+resolver_entry_t *resolver_find(char *name, unsigned long hash) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+	for (i=0; i<RESOLVER_ENTRIES; i++) {
+		if ( (resolver_table[i].hash == hash) &&
+		     (resolver_table[i].name[0] != '\0') &&
+		     (strcmp(resolver_table[i].name,name) == 0) )
+			return &resolver_table[i];
+	}
+
+	return NULL;
+}
+
+resolver_entry_t *resolver_claim(char *name, unsigned long hash,
+				 resolver_entry_t *entry) {
+
+	/* declare local variables */
+	int i;
+
+	/* do function */
+
+	/* without a stale entry of its own the name takes the one that
+	 * expires first, and an unused entry never expires later than one in
+	 * use */
+	if (entry == NULL) {
+		for (i=0; i<RESOLVER_ENTRIES; i++) {
+			if (resolver_table[i].pending == FLAG_SET)
+				continue;
+			if ( (entry == NULL) ||
+			     (resolver_table[i].expires < entry->expires) )
+				entry = &resolver_table[i];
+		}
+		if (entry == NULL)
+			return NULL;
+	}
+
+	strncpy(entry->name,name,RESOLVER_NAME_LEN-1);
+	entry->name[RESOLVER_NAME_LEN-1] = '\0';
+	entry->hash = hash;
+	entry->ip = IP_UNKNOWN;
+	entry->expires = 0;
+	entry->pending = FLAG_SET;
+	entry->waiting = NULL;
+
+	return entry;
+}
+
+void resolver_finish(resolver_entry_t *entry, errorcode ret, ip_t ip) {
+
+	/* declare local variables */
+	resolver_wait_t *wait, *next;
+	char byte;
+
+	/* do function */
+	entry->ret = ret;
+	entry->ip = ip;
+	entry->expires = time(NULL) +
+		((ret == SUCCESS) ? RESOLVER_TTL : RESOLVER_NEG_TTL);
+	entry->pending = FLAG_UNSET;
+
+	if (entry->waiting != NULL) {
+		for (wait=entry->waiting; wait != NULL; wait=next) {
+			next = wait->next;
+			wait->ret = ret;
+			wait->ip = ip;
+			wait->next = resolver_ready;
+			resolver_ready = wait;
+		}
+		entry->waiting = NULL;
+
+		/* a full pipe is readable already */
+		byte = 0;
+		if ( (resolver_wake[1] >= 0) &&
+		     (write(resolver_wake[1],&byte,1) < 0) )
+			DEBUG(DBG_RESOLVE,"RESOLVE:wake pipe full\n");
+	}
+
+	pthread_cond_broadcast(&resolver_resolved);
+}
+
+errorcode resolver_getaddrinfo(char *name, ip_t *ip) {
+
+	/* declare local variables */
+	struct addrinfo hints, *res;
+
+	/* do function */
+	*ip = IP_UNKNOWN;
+
+	memset(&hints,0,sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(name,NULL,&hints,&res) != 0) {
+		DEBUG(DBG_RESOLVE,"RESOLVE:could not resolve %s\n",name);
+		return ERROR_HOST_NAME_LOOKUP;
+	}
+	*ip = ((struct sockaddr_in*)res->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(res);
+
+	DEBUG(DBG_RESOLVE,"RESOLVE:%s is %s\n",name,DBG_IP(*ip));
+	return SUCCESS;
+}
+
+void *run_resolver_lookup(void *arg) {
+
+	/* declare local variables */
+	resolver_entry_t *entry;
+	errorcode ret;
+	ip_t ip;
+
+	/* do function */
+	entry = (resolver_entry_t*)arg;
+
+	/* the name does not change while the entry is pending */
+	ret = resolver_getaddrinfo(entry->name,&ip);
+
+	pthread_mutex_lock(&resolver_mutex);
+	resolver_finish(entry,ret,ip);
+	pthread_mutex_unlock(&resolver_mutex);
+
+	return NULL;
+}
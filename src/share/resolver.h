@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file resolver.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief resolves host names to IPs through a cache shared by every thread
+ *        of the process
+ *
+ * Names are resolved with getaddrinfo, which is reentrant, and the answer
+ * is kept for RESOLVER_TTL seconds (a failure for RESOLVER_NEG_TTL), so the
+ * helper and buddy names a peer or helper looks up again and again only go
+ * to the system resolver once in a while.  A name being resolved is looked
+ * up only once: a second thread asking for it waits for the first one's
+ * answer.
+ *
+ * resolver_lookup blocks.  resolver_lookup_async does not: the lookup runs
+ * on a thread of its own and its callback is called by resolver_poll, which
+ * an event loop calls when the descriptor from resolver_fd turns readable.
+ * A name with a fresh cache entry (and an IP written as one) is answered
+ * at once either way.
+ */
+
+#ifndef __RESOLVER_H__
+#define __RESOLVER_H__
+
+#include "errorcodes.h"
+#include "def.h"
+
+/** @brief the number of names the cache holds.  when full, the entry that
+ *  expires first is replaced */
+#define RESOLVER_ENTRIES	64
+
+/** @brief the seconds a resolved name is kept.  getaddrinfo does not pass
+ *  on the TTL of the DNS answer, so this is a fixed bound on how stale an
+ *  address can get */
+#define RESOLVER_TTL		300
+
+/** @brief the seconds a name that failed to resolve is kept, so a program
+ *  retrying a bad name does not wait on the system resolver every time */
+#define RESOLVER_NEG_TTL	10
+
+/** @brief the size of the longest name (plus its nul) that can be
+ *  resolved, larger than any DNS name */
+#define RESOLVER_NAME_LEN	256
+
+/**
+ * @brief the function an asynchronous lookup completes with
+ *
+ * @param arg the argument given to resolver_lookup_async
+ * @param ret SUCCESS, errorcode if the name could not be resolved
+ * @param ip the IP in network byte order, IP_UNKNOWN on failure
+ */
+typedef void (*resolver_done_t)(void *arg, errorcode ret, ip_t ip);
+
+/**
+ * @brief resolves a hostname or IP to a 32bit IP number, from the cache
+ *        if it can.  thread safe.
+ *
+ * @param name the hostname or IP as a string
+ * @param ip pointer to fill in with the IP in network byte order
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode resolver_lookup(char *name, ip_t *ip);
+
+/**
+ * @brief resolves a hostname or IP to a 32bit IP number without blocking.
+ *        thread safe.
+ *
+ * @param name the hostname or IP as a string
+ * @param ip pointer to fill in with the IP, if it is known at once
+ * @param done the function to call from resolver_poll once the name is
+ *        resolved, when it is not known at once
+ * @param arg the argument to pass to done
+ *
+ * @return FINISHED if ip was filled in (done is not called), SUCCESS if the
+ *         lookup was started (done will be called), errorcode on failure
+ *         (done is not called)
+ */
+errorcode resolver_lookup_async(char *name, ip_t *ip, resolver_done_t done,
+				void *arg);
+
+/**
+ * @brief gets the descriptor that turns readable when resolver_poll has
+ *        callbacks to call
+ *
+ * @return the descriptor, errorcode if it could not be created
+ */
+int resolver_fd(void);
+
+/**
+ * @brief calls the callbacks of the asynchronous lookups that have
+ *        finished, on the calling thread
+ *
+ * @return the number of callbacks called
+ */
+int resolver_poll(void);
+
+/**
+ * @brief forgets every cached name, for when the network has changed.
+ *        lookups in flight are not affected.
+ *
+ * @return void
+ */
+void resolver_flush(void);
+
+#endif /* __RESOLVER_H__ */
@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file resolver_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions and structures of the name resolver
+ */
+
+#ifndef __RESOLVER_PRIVATE_H__
+#define __RESOLVER_PRIVATE_H__
+
+#include "resolver.h"
+#include "flag.h"
+#include <time.h>
+
+/** @brief structure with an asynchronous lookup waiting for its name */
+struct resolver_wait {
+	/** @brief the function to call once the name is resolved */
+	resolver_done_t done;
+	/** @brief the argument to pass to done */
+	void *arg;
+	/** @brief the result of the lookup, once there is one */
+	errorcode ret;
+	/** @brief the IP found, once there is one */
+	ip_t ip;
+	/** @brief the next lookup waiting for the same name, or the next one
+	 *  ready for resolver_poll */
+	struct resolver_wait *next;
+};
+
+/** @brief typedef for the resolver_wait structure */
+typedef struct resolver_wait resolver_wait_t;
+
+/** @brief structure with one cached name */
+struct resolver_entry {
+	/** @brief the name, nul terminated.  empty if the entry is unused */
+	char name[RESOLVER_NAME_LEN];
+	/** @brief a hash of the name, checked before the name is compared */
+	unsigned long hash;
+	/** @brief SUCCESS or the errorcode the name resolved to */
+	errorcode ret;
+	/** @brief the IP the name resolved to, in network byte order */
+	ip_t ip;
+	/** @brief the time the entry is no longer used */
+	time_t expires;
+	/** @brief FLAG_SET while a thread is resolving the name.  the entry
+	 *  is not replaced meanwhile */
+	flag_t pending;
+	/** @brief the asynchronous lookups waiting for the name */
+	resolver_wait_t *waiting;
+};
+
+/** @brief typedef for the resolver_entry structure */
+typedef struct resolver_entry resolver_entry_t;
+
+/**
+ * @brief creates the descriptors resolver_fd hands out.  called once.
+ *
+ * @return void
+ */
+void resolver_init(void);
+
+/**
+ * @brief hashes a name
+ *
+ * @param name the name
+ *
+ * @return the hash
+ */
+unsigned long resolver_hash(char *name);
+
+/**
+ * @brief finds a name in the cache.  the caller holds the mutex.
+ *
+ * @param name the name
+ * @param hash the hash of the name
+ *
+ * @return the entry, NULL if the name is not cached
+ */
+resolver_entry_t *resolver_find(char *name, unsigned long hash);
+
+/**
+ * @brief takes an entry for a name about to be resolved, marking it
+ *        pending.  the caller holds the mutex.
+ *
+ * @param name the name
+ * @param hash the hash of the name
+ * @param entry the name's stale entry, if it has one
+ *
+ * @return the entry, NULL if every entry is pending
+ */
+resolver_entry_t *resolver_claim(char *name, unsigned long hash,
+				 resolver_entry_t *entry);
+
+/**
+ * @brief stores the result of resolving an entry's name and hands it to
+ *        everything waiting for it.  the caller holds the mutex.
+ *
+ * @param entry the entry
+ * @param ret SUCCESS or the errorcode the name resolved to
+ * @param ip the IP the name resolved to
+ *
+ * @return void
+ */
+void resolver_finish(resolver_entry_t *entry, errorcode ret, ip_t ip);
+
+/**
+ * @brief resolves a name with getaddrinfo, without the cache
+ *
+ * @param name the name
+ * @param ip pointer to fill in with the IP in network byte order
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode resolver_getaddrinfo(char *name, ip_t *ip);
+
+/**
+ * @brief the thread that resolves the name of an asynchronous lookup
+ *
+ * @param arg the pending resolver_entry_t
+ *
+ * @return NULL
+ */
+void *run_resolver_lookup(void *arg);
+
+#endif /* __RESOLVER_PRIVATE_H__ */
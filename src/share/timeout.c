@@ -0,0 +1,261 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file timeout.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief works out how long to wait at each step of the protocol
+ */
+
+#include "timeout.h"
+#include "timeout_private.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/** @brief the limits every session waits by, in TIMEOUT_* order.  the
+ *  ceilings are the fixed timeouts used before waits followed the rtt */
+static timeout_wait_t timeout_waits[TIMEOUT_WAITS] = {
+	{ 20000,  20000,  0 },	/* TIMEOUT_BUDDY */
+	{  2000,  20000, 32 },	/* TIMEOUT_BUDDY_STEP */
+	{   500,   5000,  4 },	/* TIMEOUT_CONN2 */
+	{ 20000, 180000, 64 },	/* TIMEOUT_DIRECT_CONN */
+	{  2000,  20000, 16 }	/* TIMEOUT_SYN_ACK */
+};
+
+/** @brief the config file names of the waits */
+static char *timeout_names[TIMEOUT_WAITS] = TIMEOUT_NAMES;
+
+errorcode timeout_config_load(char *path) {
+
+	/* declare local variables */
+	FILE *file;
+	char line[TIMEOUT_MAX_LINE];
+	errorcode ret;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_1);
+
+	/* do function */
+	if ( (file = fopen(path,"r")) == NULL)
+		return ERROR_FILE_OPEN;
+
+	ret = SUCCESS;
+	while (fgets(line,sizeof(line),file) != NULL) {
+		line[strcspn(line,"\r\n")] = '\0';
+		if (FAILED(timeout_config_line(line))) {
+			ret = ERROR_ARG_1;
+			break;
+		}
+	}
+	fclose(file);
+
+	return ret;
+}
+
+timeout_wait_t *timeout_config_get(int wait) {
+
+	/* do function */
+	if ( (wait < 0) || (wait >= TIMEOUT_WAITS) )
+		return NULL;
+
+	return &timeout_waits[wait];
+}
+
+int timeout_ceiling_sec(int wait) {
+
+	/* declare local variables */
+	timeout_wait_t *limits;
+
+	/* error check arguments */
+	if ( (limits = timeout_config_get(wait)) == NULL)
+		return ERROR_ARG_1;
+
+	/* do function */
+	return (int)((limits->ceiling + 999)/1000);
+}
+
+void timeout_rtt_init(timeout_rtt_t *rtt) {
+
+	/* do function */
+	if (rtt == NULL)
+		return;
+	memset(rtt,0,sizeof(timeout_rtt_t));
+	rtt->valid  = FLAG_UNSET;
+	rtt->marked = FLAG_UNSET;
+}
+
+void timeout_rtt_sample(timeout_rtt_t *rtt, long sample) {
+
+	/* declare local variables */
+	long err;
+
+	/* do function */
+	if ( (rtt == NULL) || (sample <= 0) )
+		return;
+
+	/* RFC 2988: the first sample sets the estimate, later ones move it
+	 * by 1/8 (srtt) and 1/4 (rttvar) of the difference */
+	if (rtt->valid != FLAG_SET) {
+		rtt->srtt   = sample;
+		rtt->rttvar = sample/2;
+		rtt->valid  = FLAG_SET;
+	}
+	else {
+		err = sample - rtt->srtt;
+		if (err < 0)
+			err = -err;
+		rtt->rttvar = (3*rtt->rttvar + err)/4;
+		rtt->srtt   = (7*rtt->srtt + sample)/8;
+	}
+
+	DEBUG(DBG_TIMEOUT,"TIMEOUT:rtt sample %ld us, srtt %ld us, rttvar %ld "
+		"us\n",sample,rtt->srtt,rtt->rttvar);
+}
+
+int timeout_rtt_socket(timeout_rtt_t *rtt, sock_t sd) {
+
+	/* declare local variables */
+#ifdef TCP_INFO
+	struct tcp_info info;
+	socklen_t len;
+#endif
+
+	/* error check arguments */
+	CHECK_NOT_NULL(rtt,ERROR_NULL_ARG_1);
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_2);
+
+	/* do function */
+#ifdef TCP_INFO
+	len = sizeof(info);
+	memset(&info,0,sizeof(info));
+	if ( (getsockopt(sd,IPPROTO_TCP,TCP_INFO,&info,&len) != 0) ||
+	     (info.tcpi_rtt == 0) )
+		return 0;
+	timeout_rtt_sample(rtt,(long)info.tcpi_rtt);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void timeout_rtt_mark(timeout_rtt_t *rtt) {
+
+	/* do function */
+	if (rtt == NULL)
+		return;
+	gettimeofday(&rtt->mark,NULL);
+	rtt->marked = FLAG_SET;
+}
+
+void timeout_rtt_measure(timeout_rtt_t *rtt, int trips) {
+
+	/* declare local variables */
+	struct timeval now;
+	long elapsed;
+
+	/* do function */
+	if ( (rtt == NULL) || (rtt->marked != FLAG_SET) || (trips < 1) )
+		return;
+	rtt->marked = FLAG_UNSET;
+
+	gettimeofday(&now,NULL);
+	elapsed = (now.tv_sec - rtt->mark.tv_sec)*1000000L +
+		  (now.tv_usec - rtt->mark.tv_usec);
+	timeout_rtt_sample(rtt,elapsed/trips);
+}
+
+int timeout_ms(int wait, timeout_rtt_t *rtt, timeout_rtt_t *other) {
+
+	/* declare local variables */
+	timeout_wait_t *limits;
+	long srtt, rttvar, ms;
+
+	/* error check arguments */
+	if ( (limits = timeout_config_get(wait)) == NULL)
+		return ERROR_ARG_1;
+
+	/* do function */
+	srtt   = -1;
+	rttvar = 0;
+	timeout_rtt_worst(rtt,&srtt,&rttvar);
+	timeout_rtt_worst(other,&srtt,&rttvar);
+
+	/* without a sample nothing is known about the path, so be as
+	 * patient as the ceiling allows */
+	if (srtt < 0)
+		ms = limits->ceiling;
+	else
+		ms = limits->rtts*(srtt + 4*rttvar)/1000;
+	if (ms < limits->floor)
+		ms = limits->floor;
+	if (ms > limits->ceiling)
+		ms = limits->ceiling;
+
+	DEBUG(DBG_TIMEOUT,"TIMEOUT:waiting up to %ld ms for %s\n",ms,
+		timeout_names[wait]);
+
+	return (int)ms;
+}
+
+errorcode timeout_config_line(char *line) {
+
+	/* declare local variables */
+	char name[TIMEOUT_MAX_LINE];
+	long low, high, rtts;
+	int i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(line,ERROR_NULL_ARG_1);
+
+	/* do function */
+	line += strspn(line," \t");
+	if ( (line[0] == '\0') || (line[0] == '#') )
+		return SUCCESS;
+
+	if ( (sscanf(line,"%255s %ld %ld %ld",name,&low,&high,&rtts) != 4) ||
+	     (low < 0) || (high < low) || (rtts < 0) )
+		return ERROR_ARG_1;
+
+	for (i=0;i<TIMEOUT_WAITS;i++) {
+		if (strcmp(name,timeout_names[i]) == 0) {
+			timeout_waits[i].floor   = low;
+			timeout_waits[i].ceiling = high;
+			timeout_waits[i].rtts    = rtts;
+			DEBUG(DBG_TIMEOUT,"TIMEOUT:%s waits %ld..%ld ms, %ld "
+				"timeouts\n",name,low,high,rtts);
+			return SUCCESS;
+		}
+	}
+
+	return ERROR_NOT_FOUND;
+}
+
+void timeout_rtt_worst(timeout_rtt_t *rtt, long *srtt, long *rttvar) {
+
+	/* do function */
+	if ( (rtt == NULL) || (rtt->valid != FLAG_SET) )
+		return;
+	if (rtt->srtt > *srtt)
+		*srtt = rtt->srtt;
+	if (rtt->rttvar > *rttvar)
+		*rttvar = rtt->rttvar;
+}
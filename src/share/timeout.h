@@ -0,0 +1,208 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file timeout.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief works out how long to wait at each step of the protocol from the
+ *        round trip time measured for the session
+ *
+ * Each session keeps an estimate of the round trip time to the other end
+ * of its helper connection, smoothed the way TCP smooths it (a smoothed
+ * rtt and its mean deviation).  The samples come from the kernel's own
+ * estimate (TCP_INFO) where the system has one, and from the HELLO /
+ * CONNECT_AGAIN exchange.  A wait then lasts its number of retransmission
+ * timeouts (srtt + 4*rttvar), kept between a floor and a ceiling.  Until a
+ * session has a sample it waits the ceiling.
+ *
+ * The floor, ceiling and number of timeouts of every wait come from a
+ * table that starts out with the defaults and can be changed at run time
+ * by timeout_config_load, before any session starts.  A config file has
+ * one wait per line:
+ *
+ *   <name> <floor ms> <ceiling ms> <timeouts>
+ *
+ * where name is one of the TIMEOUT_NAME_* values.  Blank lines and lines
+ * starting with # are skipped, a wait not listed keeps its value.
+ */
+
+#ifndef __TIMEOUT_H__
+#define __TIMEOUT_H__
+
+#include "errorcodes.h"
+#include "def.h"
+#include <sys/time.h>
+
+/** @brief the helper waiting for the buddy to say hello.  the buddy may be
+ *  started long after the peer, so by default this does not follow the
+ *  rtt */
+#define TIMEOUT_BUDDY		0
+
+/** @brief the helper waiting for the buddy to take its next step (its
+ *  port allocation, port, SYN sequence number or SYN flood) */
+#define TIMEOUT_BUDDY_STEP	1
+
+/** @brief the helper waiting for the port prediction second connection */
+#define TIMEOUT_CONN2		2
+
+/** @brief the peer waiting for its direct connection to the buddy */
+#define TIMEOUT_DIRECT_CONN	3
+
+/** @brief the peer waiting for the buddy's SYN/ACK flood */
+#define TIMEOUT_SYN_ACK		4
+
+/** @brief the number of waits */
+#define TIMEOUT_WAITS		5
+
+/** @brief the config file names of the waits, in TIMEOUT_* order */
+#define TIMEOUT_NAMES { "buddy", "buddy_step", "conn2", "direct_conn", \
+			"syn_ack" }
+
+/** @brief the longest line read from a config file */
+#define TIMEOUT_MAX_LINE	256
+
+/** @brief structure with the limits of one wait */
+struct timeout_wait {
+	/** @brief the shortest the wait may be, in milliseconds */
+	long floor;
+	/** @brief the longest the wait may be, and how long it is before
+	 *  the rtt is known, in milliseconds */
+	long ceiling;
+	/** @brief the number of retransmission timeouts the wait lasts */
+	long rtts;
+} __attribute__((__packed__));
+
+/** @brief typedef for the timeout_wait structure */
+typedef struct timeout_wait timeout_wait_t;
+
+/** @brief structure with a session's round trip time estimate */
+struct timeout_rtt {
+	/** @brief FLAG_SET once there has been a sample */
+	flag_t valid;
+	/** @brief the smoothed round trip time, in microseconds */
+	long srtt;
+	/** @brief the mean deviation of the round trip time, in
+	 *  microseconds */
+	long rttvar;
+	/** @brief FLAG_SET while a measurement is running (see
+	 *  timeout_rtt_mark) */
+	flag_t marked;
+	/** @brief the time the running measurement started */
+	struct timeval mark;
+} __attribute__((__packed__));
+
+/** @brief typedef for the timeout_rtt structure */
+typedef struct timeout_rtt timeout_rtt_t;
+
+/**
+ * @brief reads wait limits from a config file into the table every
+ *        session uses.  not thread safe, call it before any session
+ *        starts.
+ *
+ * @param path the config file
+ *
+ * @return SUCCESS, errorcode on failure (the table is left as it was for
+ *         the lines not yet read)
+ */
+errorcode timeout_config_load(char *path);
+
+/**
+ * @brief gets the limits of a wait
+ *
+ * @param wait the TIMEOUT_* wait
+ *
+ * @return pointer to the limits, NULL if there is no such wait
+ */
+timeout_wait_t *timeout_config_get(int wait);
+
+/**
+ * @brief gets the longest a wait can last, in whole seconds, for state
+ *        that has to be kept as long as a wait may need it
+ *
+ * @param wait the TIMEOUT_* wait
+ *
+ * @return the ceiling rounded up to seconds, errorcode if there is no such
+ *         wait
+ */
+int timeout_ceiling_sec(int wait);
+
+/**
+ * @brief sets an estimate to have no samples
+ *
+ * @param rtt pointer to the estimate
+ *
+ * @return void
+ */
+void timeout_rtt_init(timeout_rtt_t *rtt);
+
+/**
+ * @brief adds a round trip time sample to an estimate
+ *
+ * @param rtt pointer to the estimate
+ * @param sample the round trip time in microseconds, ignored if not
+ *        positive
+ *
+ * @return void
+ */
+void timeout_rtt_sample(timeout_rtt_t *rtt, long sample);
+
+/**
+ * @brief adds the kernel's round trip time estimate for a connected TCP
+ *        socket as a sample
+ *
+ * @param rtt pointer to the estimate
+ * @param sd the socket
+ *
+ * @return 1 if a sample was added, 0 if the system does not have TCP_INFO
+ *         or the kernel has no estimate yet, errorcode on failure
+ */
+int timeout_rtt_socket(timeout_rtt_t *rtt, sock_t sd);
+
+/**
+ * @brief starts a measurement, for a message that will be answered
+ *
+ * @param rtt pointer to the estimate
+ *
+ * @return void
+ */
+void timeout_rtt_mark(timeout_rtt_t *rtt);
+
+/**
+ * @brief ends the running measurement, if there is one, and adds it as a
+ *        sample
+ *
+ * @param rtt pointer to the estimate
+ * @param trips the number of round trips the measurement spans
+ *
+ * @return void
+ */
+void timeout_rtt_measure(timeout_rtt_t *rtt, int trips);
+
+/**
+ * @brief works out how long a wait lasts.  a wait on both ends of a pair
+ *        (the helper waiting on the buddy) follows the slower of the two.
+ *
+ * @param wait the TIMEOUT_* wait
+ * @param rtt the session's estimate, may be NULL
+ * @param other the other end's estimate, may be NULL
+ *
+ * @return the wait in milliseconds, errorcode if there is no such wait
+ */
+int timeout_ms(int wait, timeout_rtt_t *rtt, timeout_rtt_t *other);
+
+#endif /* __TIMEOUT_H__ */
@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file timeout_private.h
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief private functions of the wait timeouts
+ */
+
+#ifndef __TIMEOUT_PRIVATE_H__
+#define __TIMEOUT_PRIVATE_H__
+
+#include "timeout.h"
+
+/**
+ * @brief reads one line of a config file into the table
+ *
+ * @param line the line, without the newline
+ *
+ * @return SUCCESS (also for a blank or comment line), errorcode if the
+ *         line can not be read
+ */
+errorcode timeout_config_line(char *line);
+
+/**
+ * @brief takes the larger of an estimate's values and the ones found so
+ *        far
+ *
+ * @param rtt the estimate, may be NULL or have no samples
+ * @param srtt pointer to the largest smoothed rtt so far, negative if none
+ * @param rttvar pointer to the largest deviation so far
+ *
+ * @return void
+ */
+void timeout_rtt_worst(timeout_rtt_t *rtt, long *srtt, long *rttvar);
+
+#endif /* __TIMEOUT_PRIVATE_H__ */
@@ -54,17 +54,12 @@ errorcode wait_for_flag(flag_t *check_flag, flag_t stop_flags, int timeout) {
 	CHECK_NOT_NEG(timeout,ERROR_NEG_ARG_3);
 
 	/* do function */
-	do {
-		if (!((*check_flag)&stop_flags)) {
-			timeout = DEC_UNTIL_ZERO(timeout);
-			sleep(1);
-		}
-		else {
-			break;
-		}
-	} while (timeout>0);
+	while (!((*check_flag)&stop_flags)) {
+		if (timeout <= 0)
+			return ERROR_TIMEOUT;
+		usleep(WAIT_FOR_FLAG_POLL_MS*1000);
+		timeout -= WAIT_FOR_FLAG_POLL_MS;
+	}
 
-	if (timeout==0)
-		return ERROR_TIMEOUT;
 	return SUCCESS;
 }
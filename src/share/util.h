@@ -49,6 +49,9 @@ int inline DEC_UNTIL_ZERO(int x);
  */
 errorcode safe_free(void *memory);
 
+/** @brief how often wait_for_flag looks at the flag, in milliseconds */
+#define WAIT_FOR_FLAG_POLL_MS	10
+
 /**
  * @brief waits for a flag to take one of many specified values
  *
@@ -56,7 +59,7 @@ errorcode safe_free(void *memory);
  *
  * @param check_flag pointer to the flag to watch
  * @param stop_flags all the flags to wait for or'ed together.
- * @param timeout the timeout time, in seconds
+ * @param timeout the timeout time, in milliseconds
  *
  * @return SUCCESS, errorcode on failure
  */
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file agent_test.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief stub that checks the peer agent refuses requests that would have
+ *        it bind privileged ports
+ *
+ * No agent is started: the test hands requests straight to
+ * agent_check_request.  A connection binds the peer port and the
+ * AGENT_PORTS_BELOW ports below it, so every peer port whose helper ports
+ * reach below IPPORT_RESERVED must be refused, as must port 0, and the
+ * first peer port clear of them must be taken.
+ */
+
+/* for struct ucred, in agent_private.h */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "def.h"
+#include "errorcodes.h"
+#include "agent.h"
+#include "agent_private.h"
+
+/** @brief structure with one request to check and the answer expected */
+struct agent_test_case {
+	/** @brief the peer port asked for, host byte order */
+	unsigned short port;
+	/** @brief 1 if the request must be taken, 0 if it must be refused */
+	int allowed;
+};
+
+/** @brief the peer ports checked */
+static struct agent_test_case agent_test_cases[] = {
+	{ 0,                                   0 },
+	{ 1,                                   0 },
+	{ IPPORT_RESERVED - 1,                 0 },
+	{ IPPORT_RESERVED,                     0 },
+	{ IPPORT_RESERVED + 1,                 0 },
+	{ IPPORT_RESERVED + 2,                 0 },
+	{ IPPORT_RESERVED + AGENT_PORTS_BELOW, 1 },
+	{ 40000,                               1 },
+	{ 65535,                               1 },
+};
+
+/**
+ * @brief the main function
+ *
+ * @return 0 if every request got the answer expected, 1 otherwise
+ */
+int main(void) {
+
+	/* declare local variables */
+	agent_msg_connect_t req;
+	int i, allowed, failed;
+
+	/* do function */
+	memset(&req,0,sizeof(req));
+	req.helper_ip    = inet_addr("192.0.2.1");
+	req.helper_port  = htons(7777);
+	req.peer_ip      = inet_addr("127.0.0.1");
+	req.buddy_ext_ip = inet_addr("198.51.100.1");
+	req.buddy_int_ip = inet_addr("10.0.0.2");
+
+	failed = 0;
+	for(i=0;i<sizeof(agent_test_cases)/sizeof(agent_test_cases[0]);i++) {
+		req.peer_port = htons(agent_test_cases[i].port);
+		allowed = (agent_check_request(&req) == SUCCESS);
+		if (allowed != agent_test_cases[i].allowed) {
+			printf("peer port %u: %s, expected %s\n",
+				agent_test_cases[i].port,
+				allowed ? "taken" : "refused",
+				agent_test_cases[i].allowed ? "taken" :
+				"refused");
+			failed = 1;
+		}
+	}
+
+	if (failed) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("passed %d requests\n",i);
+
+	return 0;
+}
@@ -38,10 +38,13 @@
  * @param argc the number of arguments passed in
  * @param argv the vector of arguments
  * @param helper_port pointer to the helper's port (will be filled in)
+ * @param opts pointer to the helper_opts_t to fill in with the optional
+ *        settings
  *
  * @return SUCCESS, errorcode on failure
  */
-int getArgs(int argc, char *argv[], port_t *helper_port);
+int getArgs(int argc, char *argv[], port_t *helper_port,
+	    helper_opts_t *opts);
 
 /**
  * @brief prints the program use
@@ -61,15 +64,16 @@ void printUse();
 int main(int argc, char *argv[]) {
 
 	port_t port;
+	helper_opts_t opts;
 
-	if (FAILED(getArgs(argc,argv,&port))) {
+	if (FAILED(getArgs(argc,argv,&port,&opts))) {
 		printUse();
 		return (-1);
 	}
 
 	port = htons(port);
 
-	CHECK_FAILED(natblaster_server(port),-2);
+	CHECK_FAILED(natblaster_server(port,&opts),-2);
 
 	return (0);
 
@@ -79,18 +83,39 @@ void printUse() {
 
 	printf("options:\n");
 	printf("\t--listen_port : port to listen for peer connections on [required]\n");
+	printf("\t--relay       : relay traffic for peers that can't connect directly [optional]\n");
+	printf("\t--relay_rate  : most bytes/sec one relayed session may use [optional, default unlimited]\n");
+	printf("\t--max_sessions: most peer sessions at once, 0 for no limit [optional, default %d]\n",HELPER_DEFAULT_MAX_SESSIONS);
+	printf("\t--source_rate : most connections/sec from one ip, 0 for no limit [optional, default %d]\n",HELPER_DEFAULT_SOURCE_RATE);
+	printf("\t--control     : unix socket a new helper can take over this one through [optional]\n");
+	printf("\t--takeover    : control socket of a running helper to take over, replaces --listen_port [optional]\n");
+	printf("\t--trace       : file to record every session to, for trace_replay [optional]\n");
+	printf("\t--cluster     : every helper of the cluster, as ip:port,ip:port,... [optional]\n");
+	printf("\t--cluster_self: this helper's ip:port in --cluster [required with --cluster]\n");
+	printf("\t--timeouts    : file with the limits of each protocol wait [optional]\n");
 	printf("\n");
 
 	return;
 }
 
-int getArgs(int argc, char *argv[], port_t *helper_port) {
+int getArgs(int argc, char *argv[], port_t *helper_port,
+	    helper_opts_t *opts) {
 
 	char c;
 
 	static struct option long_options[] =
 	{
 		{"listen_port",     required_argument, 0, 'a'},
+		{"relay",           no_argument,       0, 'b'},
+		{"relay_rate",      required_argument, 0, 'c'},
+		{"max_sessions",    required_argument, 0, 'd'},
+		{"source_rate",     required_argument, 0, 'e'},
+		{"control",         required_argument, 0, 'f'},
+		{"takeover",        required_argument, 0, 'g'},
+		{"trace",           required_argument, 0, 'h'},
+		{"cluster",         required_argument, 0, 'i'},
+		{"cluster_self",    required_argument, 0, 'j'},
+		{"timeouts",        required_argument, 0, 'k'},
 		{0, 0, 0, 0 } /* for invalid args */
 	};
 	
@@ -100,9 +125,21 @@ int getArgs(int argc, char *argv[], port_t *helper_port) {
 		return ERROR_NULL_ARG_2;
 	if (helper_port==NULL)
 		return ERROR_NULL_ARG_3;
+	if (opts==NULL)
+		return ERROR_NULL_ARG_4;
 
 	/* set default values */
 	*helper_port = 0 ;
+	opts->relay = FLAG_UNSET;
+	opts->relay_rate = 0;
+	opts->max_sessions = HELPER_DEFAULT_MAX_SESSIONS;
+	opts->source_rate = HELPER_DEFAULT_SOURCE_RATE;
+	opts->control = NULL;
+	opts->takeover = NULL;
+	opts->trace = NULL;
+	opts->cluster = NULL;
+	opts->cluster_self = NULL;
+	opts->timeouts = NULL;
 
 	/* loop over the arguments, and read them in */
 	while (1)
@@ -110,7 +147,7 @@ int getArgs(int argc, char *argv[], port_t *helper_port) {
 		/* getopt_long stores the option index here. */
 		int option_index = 0;
 
-		c = getopt_long (argc, argv, "a:b:",
+		c = getopt_long (argc, argv, "a:bc:d:e:f:g:h:i:j:k:",
 			long_options, &option_index);
 
 		/* Detect the end of the options. */
@@ -121,6 +158,36 @@ int getArgs(int argc, char *argv[], port_t *helper_port) {
 			case 'a' :
 				*helper_port = (port_t) atoi(optarg);
 				break;
+			case 'b' :
+				opts->relay = FLAG_SET;
+				break;
+			case 'c' :
+				opts->relay_rate = strtoul(optarg,NULL,10);
+				break;
+			case 'd' :
+				opts->max_sessions = strtoul(optarg,NULL,10);
+				break;
+			case 'e' :
+				opts->source_rate = strtoul(optarg,NULL,10);
+				break;
+			case 'f' :
+				opts->control = optarg;
+				break;
+			case 'g' :
+				opts->takeover = optarg;
+				break;
+			case 'h' :
+				opts->trace = optarg;
+				break;
+			case 'i' :
+				opts->cluster = optarg;
+				break;
+			case 'j' :
+				opts->cluster_self = optarg;
+				break;
+			case 'k' :
+				opts->timeouts = optarg;
+				break;
 			case '?':
 				return ERROR_1;
 				break;
@@ -130,9 +197,14 @@ int getArgs(int argc, char *argv[], port_t *helper_port) {
 		}
 	}
 
-	if (*helper_port==0)
+	/* a helper taking over gets the listening socket from the old one */
+	if ( (*helper_port==0) && (opts->takeover==NULL) )
 		return ERROR_3;
 
+	/* a node must know which of the cluster's helpers it is */
+	if ( (opts->cluster!=NULL) && (opts->cluster_self==NULL) )
+		return ERROR_4;
+
 	return SUCCESS;
 }
 
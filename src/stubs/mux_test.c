@@ -0,0 +1,218 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file mux_test.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief stub that checks a mux gives back the slots of finished streams
+ *
+ * No connection or threads are used: the test plays the writer by calling
+ * mux_next_frame and the reader by calling mux_handle_frame, so frames
+ * can be made to arrive in any order.  Each round opens a stream, closes
+ * it locally, lets the CLOSE go out, then has data the buddy sent before
+ * seeing the CLOSE arrive, then the buddy's CLOSE, then lets the WINDOW
+ * for the late data go out.  The stream must be free after that.  More
+ * rounds are run than there are slots, so a leaked slot makes a round
+ * fail to open its stream.  Last, the ids mux_open gives out are wrapped,
+ * and must skip 0 and the id of a stream still open.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "def.h"
+#include "errorcodes.h"
+#include "mux.h"
+#include "mux_private.h"
+
+/** @brief the rounds to run, enough to use up every slot twice over */
+#define MUX_TEST_ROUNDS		(2*MUX_MAX_STREAMS + 1)
+
+/** @brief the bytes of late data the buddy sends each round */
+#define MUX_TEST_LATE		100
+
+/**
+ * @brief returns the type of the frame the writer would send next
+ *
+ * @param mux pointer to the mux
+ * @param frame buffer to build the frame in
+ *
+ * @return the frame type, 0 if there is nothing to send
+ */
+unsigned char next_type(mux_t *mux, unsigned char *frame) {
+
+	/* declare local variables */
+	mux_header_t hdr;
+
+	/* do function */
+	if (mux_next_frame(mux,frame) == 0)
+		return 0;
+	memcpy(&hdr,frame,MUX_HEADER_LEN);
+	return hdr.type;
+}
+
+/**
+ * @brief runs one round of the test
+ *
+ * @param mux pointer to the mux
+ * @param round the round number, used as the stream id
+ *
+ * @return SUCCESS, errorcode (after printing why) on failure
+ */
+errorcode run_round(mux_t *mux, int round) {
+
+	/* declare local variables */
+	unsigned char frame[MUX_HEADER_LEN+MUX_FRAME_MAX];
+	unsigned char payload[MUX_TEST_LATE];
+	mux_header_t hdr;
+	unsigned char type;
+	int h;
+
+	/* do function */
+	if ((h=mux_alloc(mux)) < 0) {
+		printf("round %d: no free stream slot\n",round);
+		return ERROR_1;
+	}
+	mux->streams[h].id = round + 1;
+
+	/* closed here first, the CLOSE goes out */
+	if (FAILED(mux_close(mux,h))) {
+		printf("round %d: close failed\n",round);
+		return ERROR_2;
+	}
+	if ((type=next_type(mux,frame)) != MUX_FRAME_CLOSE) {
+		printf("round %d: sent frame %u, expected CLOSE\n",round,type);
+		return ERROR_3;
+	}
+
+	/* the buddy sent data before it saw the CLOSE */
+	memset(payload,0,sizeof(payload));
+	hdr.id   = (round + 1) | MUX_ID_REMOTE;
+	hdr.type = MUX_FRAME_DATA;
+	hdr.len  = MUX_TEST_LATE;
+	if (FAILED(mux_handle_frame(mux,&hdr,payload))) {
+		printf("round %d: late data refused\n",round);
+		return ERROR_4;
+	}
+
+	/* then its own CLOSE */
+	hdr.type = MUX_FRAME_CLOSE;
+	hdr.len  = 0;
+	if (FAILED(mux_handle_frame(mux,&hdr,payload))) {
+		printf("round %d: buddy's close refused\n",round);
+		return ERROR_5;
+	}
+
+	/* the late data's window goes back, which is the stream's last
+	 * frame */
+	if ((type=next_type(mux,frame)) != MUX_FRAME_WINDOW) {
+		printf("round %d: sent frame %u, expected WINDOW\n",round,type);
+		return ERROR_6;
+	}
+	if (mux->streams[h].state != MUX_STREAM_FREE) {
+		printf("round %d: stream slot %d still in use\n",round,h);
+		return ERROR_7;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief checks mux_open skips 0 and the ids of open streams once the ids
+ *        wrap
+ *
+ * @param mux pointer to the mux, with every slot free
+ *
+ * @return SUCCESS, errorcode (after printing why) on failure
+ */
+errorcode run_wrap(mux_t *mux) {
+
+	/* declare local variables */
+	int held, first, second;
+
+	/* do function */
+
+	/* a stream this side opened long ago holds id 1 */
+	if ((held=mux_alloc(mux)) < 0) {
+		printf("wrap: no free stream slot\n");
+		return ERROR_1;
+	}
+	mux->streams[held].id     = 1;
+	mux->streams[held].remote = FLAG_UNSET;
+
+	mux->next_id = MUX_ID_REMOTE - 1;
+	if ( (FAILED(mux_open(mux,&first))) ||
+	     (FAILED(mux_open(mux,&second))) ) {
+		printf("wrap: open failed\n");
+		return ERROR_2;
+	}
+	if ( (mux->streams[first].id != MUX_ID_REMOTE - 1) ||
+	     (mux->streams[second].id != 2) ) {
+		printf("wrap: opened ids %u and %u, expected %u and 2\n",
+			mux->streams[first].id,mux->streams[second].id,
+			MUX_ID_REMOTE - 1);
+		return ERROR_3;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief the main function
+ *
+ * @return 0 if every round passed, 1 otherwise
+ */
+int main(void) {
+
+	/* declare local variables */
+	mux_t *mux;
+	int round;
+
+	/* do function */
+	if ((mux=(mux_t*)malloc(sizeof(mux_t))) == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+	memset(mux,0,sizeof(mux_t));
+	mux->next_id = 1;
+	pthread_mutex_init(&mux->mutex,NULL);
+	pthread_cond_init(&mux->work,NULL);
+	pthread_cond_init(&mux->ready,NULL);
+
+	for(round=0;round<MUX_TEST_ROUNDS;round++) {
+		if (FAILED(run_round(mux,round))) {
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+
+	if (FAILED(run_wrap(mux))) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("passed %d rounds and the id wrap\n",MUX_TEST_ROUNDS);
+
+	pthread_cond_destroy(&mux->ready);
+	pthread_cond_destroy(&mux->work);
+	pthread_mutex_destroy(&mux->mutex);
+	free(mux);
+
+	return 0;
+}
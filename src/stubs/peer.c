@@ -25,11 +25,16 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "natblaster_peer.h"
 #include "errorcodes.h"
 #include "def.h"
 #include "berkeleyapi.h"
 #include "nethelp.h"
+#include "pktio.h"
+#include "mux.h"
+#include "timeout.h"
 
 /** @brief size of buffer to receive a message from the buddy in */
 #define BUFSIZE	64
@@ -60,6 +65,18 @@
  *        with the message to send to the buddy.
  * @param random a pointer to an flag_t to set to 1 if the peer wants to be
  *        random.
+ * @param opts a pointer to the peer_opts_t to fill in with the optional
+ *        connection settings
+ * @param agent a pointer to a pointer.  When finished, will point to the path
+ *        of a peer agent's socket to ask for the connection, or NULL to
+ *        make the connection in this process.
+ * @param backend a pointer to a pointer.  When finished, will point to the
+ *        name of the packet engine backend to use, or NULL for the default
+ * @param streams pointer to the number of streams to open over the
+ *        connection (will be filled in, 0 to use the connection directly)
+ * @param timeouts a pointer to a pointer.  When finished, will point to the
+ *        file with the limits of the protocol waits, or NULL for the
+ *        built in ones
  *
  * @return SUCCESS, neg value on failure
  */
@@ -67,7 +84,21 @@ int getArgs(int argc, char *argv[], char **helper_ip,
             port_t *helper_port, char **peer_ip,
 			port_t *peer_port, char **buddy_ext_ip,
 			char **buddy_int_ip, port_t *buddy_int_port,
-			char **dev, char **msg, flag_t *random);
+			char **dev, char **msg, flag_t *random,
+			peer_opts_t *opts, char **agent, char **backend,
+			int *streams, char **timeouts);
+
+/**
+ * @brief sends the message on several streams multiplexed over the
+ *        connection and prints the buddy's messages
+ *
+ * @param sd the connection to the buddy
+ * @param msg the message to send
+ * @param streams the number of streams to open
+ *
+ * @return SUCCESS, neg value on failure
+ */
+errorcode talkStreams(sock_t sd, char *msg, int streams);
 
 /**
  * @brief prints the program use
@@ -88,20 +119,28 @@ int main(int argc, char *argv[]) {
 
 	char *helper_addr, *peer_addr, *buddy_ext_addr, *buddy_int_addr;
 	port_t helper_port, peer_port, buddy_int_port;
-	char *dev, *msg;
+	char *dev, *msg, *agent, *backend, *timeouts;
+	pktio_t io;
 	sock_t sd;
 	char buf[BUFSIZE];
-	int nread;
+	int streams;
 	flag_t random = FLAG_UNSET;
+	peer_opts_t opts;
 	ip_t helper_num, peer_num, buddy_int_num, buddy_ext_num;
 
 	if(FAILED(getArgs(argc, argv, &helper_addr, &helper_port, &peer_addr,
 					  &peer_port, &buddy_ext_addr, &buddy_int_addr,
-					  &buddy_int_port, &dev, &msg,&random))) {
+					  &buddy_int_port, &dev, &msg,&random,
+					  &opts,&agent,&backend,&streams,&timeouts))) {
 		printUse();
 		return ERROR_1;
 	}
 
+	/* the limits of the waits are read once, before any connection
+	 * uses them */
+	if (timeouts != NULL)
+		CHECK_FAILED(timeout_config_load(timeouts),ERROR_1);
+
 	/* put the ports in network byte order */
 	helper_port    = htons( helper_port    );
 	peer_port      = htons( peer_port      );
@@ -112,13 +151,38 @@ int main(int argc, char *argv[]) {
 	CHECK_FAILED(resolveIP(buddy_int_addr,&buddy_int_num),ERROR_3);
 	CHECK_FAILED(resolveIP(buddy_ext_addr,&buddy_ext_num),ERROR_4);
 
-	if ( (sd=natblaster_connect(helper_num,helper_port,peer_num,peer_port,
-	                       buddy_ext_num, buddy_int_num, buddy_int_port,
-			       dev,random))<0) {
+	/* open the packet engine here if a backend other than the default
+	 * was asked for */
+	if ( (backend != NULL) && (agent == NULL) ) {
+		CHECK_FAILED(pktio_open(&io,backend,dev),ERROR_5);
+		opts.pktio = &io;
+	}
+
+	/* an agent makes the connection without this process being root */
+	if (agent != NULL)
+		sd = natblaster_agent_connect(agent,helper_num,helper_port,
+				peer_num,peer_port,buddy_ext_num,buddy_int_num,
+				buddy_int_port,random,&opts);
+	else
+		sd = natblaster_connect(helper_num,helper_port,peer_num,
+				peer_port,buddy_ext_num,buddy_int_num,
+				buddy_int_port,dev,random,&opts);
+
+	if (sd<0) {
 		printf("UNSUCCESSFUL!!!\n");
 		return ERROR_2;
 	}
 
+	/* the buddy has to open as many streams */
+	if (streams > 0) {
+		if (FAILED(talkStreams(sd,msg,streams))) {
+			printf("UNSUCCESSFUL!!!\n");
+			return ERROR_3;
+		}
+		printf("SUCCESS!!!\n");
+		return (0);
+	}
+
 	/* send the buddy a small message */
 	write(sd, msg, strlen(msg));
 	/* and recieve the buddy's message */
@@ -137,6 +201,58 @@ int main(int argc, char *argv[]) {
 	return (0);
 }
 
+errorcode talkStreams(sock_t sd, char *msg, int streams) {
+
+	/* declare local variables */
+	mux_t *mux;
+	int i, stream, nread;
+	char buf[BUFSIZE];
+	errorcode ret = SUCCESS;
+
+	/* error check arguments */
+	CHECK_NOT_NEG(sd,ERROR_NEG_ARG_1);
+	CHECK_NOT_NULL(msg,ERROR_NULL_ARG_2);
+	CHECK_NOT_NEG(streams,ERROR_NEG_ARG_3);
+
+	/* do function */
+	if ((mux=(mux_t*)malloc(sizeof(mux_t))) == NULL)
+		return ERROR_MALLOC_FAILED;
+	if (FAILED(mux_start(mux,sd))) {
+		free(mux);
+		return ERROR_CALLED_FUNCTION_1;
+	}
+
+	/* the buddy's streams are opened without any more NAT traversal */
+	for(i=0;i<streams;i++) {
+		if ( FAILED(mux_open(mux,&stream)) ||
+		     (mux_send(mux,stream,msg,strlen(msg)) < 0) ||
+		     FAILED(mux_close(mux,stream)) ) {
+			ret = ERROR_1;
+			break;
+		}
+	}
+
+	for(i=0;(i<streams) && !FAILED(ret);i++) {
+		if (FAILED(mux_accept(mux,&stream))) {
+			ret = ERROR_2;
+			break;
+		}
+		memset(buf,'\0',sizeof(buf));
+		nread = 0;
+		while ( (nread < (int)sizeof(buf)-1) &&
+			((ret=mux_recv(mux,stream,buf+nread,
+				       sizeof(buf)-1-nread)) > 0) )
+			nread += ret;
+		printf("Buddy sent message on stream %d: [%s]\n",i,buf);
+		mux_close(mux,stream);
+		ret = (ret < 0) ? ERROR_3 : SUCCESS;
+	}
+
+	mux_stop(mux);
+	free(mux);
+
+	return ret;
+}
 
 void printUse() {
 
@@ -151,6 +267,14 @@ void printUse() {
 	printf("\t--device         : device to connect on [optional]\n");
 	printf("\t--message        : message to send to buddy (enclosed in quotes if contains white space)\n");
 	printf("\t--random         : flag indicating if this peer should pretend to be random\n");
+	printf("\t--race_width     : number of predicted buddy ports to race [optional, default 1]\n");
+	printf("\t--agent          : socket of a peer agent to connect through (no root needed) [optional]\n");
+	printf("\t--pktio          : packet backend, pcap or packet [optional, default pcap]\n");
+	printf("\t--cache          : file remembering earlier connections, to skip port prediction [optional]\n");
+	printf("\t--streams        : number of streams to send the message on over the one connection [optional]\n");
+	printf("\t--serial         : run the connection steps one after another instead of overlapping them\n");
+	printf("\t--timeouts       : file with the limits of each protocol wait [optional]\n");
+	printf("\t--syn_ttl        : TTL of the SYNs to the buddy, one more than the hops to the outermost NAT [optional, default found]\n");
 
 	printf("\n");
 
@@ -161,7 +285,9 @@ int getArgs(int argc, char *argv[], char **helper_ip,
 			port_t *helper_port, char **peer_ip,
 			port_t *peer_port, char **buddy_ext_ip,
 			char **buddy_int_ip, port_t *buddy_int_port,
-			char **dev, char **msg, flag_t *random) {
+			char **dev, char **msg, flag_t *random,
+			peer_opts_t *opts, char **agent, char **backend,
+			int *streams, char **timeouts) {
 
 	char c;
 	static struct option long_options[] =
@@ -176,6 +302,14 @@ int getArgs(int argc, char *argv[], char **helper_ip,
 		{"device",         required_argument, 0, 'h'},
 		{"message",        required_argument, 0, 'i'},
 		{"random",         no_argument,       0, 'j'},
+		{"race_width",     required_argument, 0, 'k'},
+		{"agent",          required_argument, 0, 'l'},
+		{"pktio",          required_argument, 0, 'm'},
+		{"cache",          required_argument, 0, 'n'},
+		{"streams",        required_argument, 0, 'o'},
+		{"serial",         no_argument,       0, 'p'},
+		{"timeouts",       required_argument, 0, 'q'},
+		{"syn_ttl",        required_argument, 0, 'r'},
 		/* for invalid args */
 		{0,               0,                 0,  0 }
 	};
@@ -192,11 +326,25 @@ int getArgs(int argc, char *argv[], char **helper_ip,
 	CHECK_NOT_NULL(dev,ERROR_NULL_ARG_10);
 	CHECK_NOT_NULL(msg,ERROR_NULL_ARG_11);
 	CHECK_NOT_NULL(random,ERROR_NULL_ARG_12);
+	CHECK_NOT_NULL(opts,ERROR_NULL_ARG_13);
+	CHECK_NOT_NULL(agent,ERROR_NULL_ARG_14);
+	CHECK_NOT_NULL(backend,ERROR_NULL_ARG_15);
+	CHECK_NOT_NULL(streams,ERROR_NULL_ARG_16);
+	CHECK_NOT_NULL(timeouts,ERROR_NULL_ARG_17);
 
 	/* set default values */
 	*helper_ip = *peer_ip = *buddy_ext_ip = NULL;
 	*buddy_int_ip = *dev = *msg = NULL;
 	*helper_port = *peer_port = *buddy_int_port = 0 ;
+	opts->race_width = RACE_WIDTH_DEFAULT;
+	opts->pktio = NULL;
+	opts->cache = NULL;
+	opts->overlap = FLAG_SET;
+	opts->syn_ttl = 0;
+	*agent = NULL;
+	*backend = NULL;
+	*streams = 0;
+	*timeouts = NULL;
 
 	/* loop over the arguments, and read them in */
 	while (1)
@@ -204,7 +352,7 @@ int getArgs(int argc, char *argv[], char **helper_ip,
 		/* getopt_long stores the option index here. */
 		int option_index = 0;
 
-		c = getopt_long (argc, argv, "a:b:c:d:e:f:g:h:i:j:",
+		c = getopt_long (argc, argv, "a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:pq:r:",
 			long_options, &option_index);
 
 		/* Detect the end of the options. */
@@ -242,6 +390,30 @@ int getArgs(int argc, char *argv[], char **helper_ip,
 			case 'j' :
 				*random = FLAG_SET;
 				break;
+			case 'k' :
+				opts->race_width = (unsigned char) atoi(optarg);
+				break;
+			case 'l' :
+				*agent = optarg;
+				break;
+			case 'm' :
+				*backend = optarg;
+				break;
+			case 'n' :
+				opts->cache = optarg;
+				break;
+			case 'o' :
+				*streams = atoi(optarg);
+				break;
+			case 'p' :
+				opts->overlap = FLAG_UNSET;
+				break;
+			case 'q' :
+				*timeouts = optarg;
+				break;
+			case 'r' :
+				opts->syn_ttl = (unsigned char) atoi(optarg);
+				break;
 			case '?':
 				return ERROR_1;
 				break;
@@ -0,0 +1,209 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file peer_agent.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief stub demo peer agent, which makes connections for unprivileged
+ *        applications (such as the peer stub run with --agent)
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <grp.h>
+#include "def.h"
+#include "errorcodes.h"
+#include "natblaster_peer.h"
+#include "timeout.h"
+
+/**
+ * @brief gets arguments from the command line
+ *
+ * uses errorcodes.h for error codes
+ *
+ * @param argc the number of arguments passed in
+ * @param argv the vector of arguments
+ * @param path a pointer to a pointer.  When finished, will point to a string
+ *        with the path of the socket to listen on
+ * @param dev a pointer to a pointer.  When finished, will point to a string
+ *        with the network device to use.  If none is specified, will be NULL
+ *        on function return
+ * @param mode pointer to the socket file permissions (will be filled in)
+ * @param backend a pointer to a pointer.  When finished, will point to the
+ *        name of the packet engine backend, or NULL for the default
+ * @param cache a pointer to a pointer.  When finished, will point to the
+ *        peer cache file, or NULL for no cache
+ * @param group pointer to the group of the socket file, negative for the
+ *        agent's own (will be filled in)
+ * @param timeouts a pointer to a pointer.  When finished, will point to the
+ *        file with the limits of the protocol waits, or NULL for the
+ *        built in ones
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+int getArgs(int argc, char *argv[], char **path, char **dev, int *mode,
+	    char **backend, char **cache, int *group, char **timeouts);
+
+/**
+ * @brief prints the program use
+ *
+ * @return void
+ */
+void printUse();
+
+/**
+ * @brief stub entry point
+ *
+ * @param argc the number of elements in the argument vector
+ * @param argv the argument vector
+ *
+ * @return 0 on success, neg on failure
+ */
+int main(int argc, char *argv[]) {
+
+	char *path, *dev, *backend, *cache, *timeouts;
+	int mode, group;
+
+	if (FAILED(getArgs(argc,argv,&path,&dev,&mode,&backend,&cache,
+			&group,&timeouts))) {
+		printUse();
+		return (-1);
+	}
+
+	/* every connection the agent makes shares the limits, so they are
+	 * read before the first one starts */
+	if (timeouts != NULL)
+		CHECK_FAILED(timeout_config_load(timeouts),-2);
+
+	CHECK_FAILED(natblaster_agent(path,dev,backend,cache,mode,group),-2);
+
+	return (0);
+}
+
+void printUse() {
+
+	printf("options:\n");
+	printf("\t--socket      : path of the socket to listen on [optional, default %s]\n",
+		AGENT_SOCKET_DEFAULT);
+	printf("\t--device      : device to connect on [optional]\n");
+	printf("\t--socket_mode : octal permissions of the socket [optional, default %o]\n",
+		AGENT_SOCKET_MODE_DEFAULT);
+	printf("\t--pktio       : packet backend, pcap or packet [optional, default pcap]\n");
+	printf("\t--cache       : file remembering earlier connections, to skip port prediction [optional]\n");
+	printf("\t--group       : group whose members may use the agent [optional, default the agent's group]\n");
+	printf("\t--timeouts    : file with the limits of each protocol wait [optional]\n");
+	printf("\n");
+
+	return;
+}
+
+int getArgs(int argc, char *argv[], char **path, char **dev, int *mode,
+	    char **backend, char **cache, int *group, char **timeouts) {
+
+	char c;
+	struct group *grp;
+
+	static struct option long_options[] =
+	{
+		{"socket",          required_argument, 0, 'a'},
+		{"device",          required_argument, 0, 'b'},
+		{"socket_mode",     required_argument, 0, 'c'},
+		{"pktio",           required_argument, 0, 'd'},
+		{"cache",           required_argument, 0, 'e'},
+		{"group",           required_argument, 0, 'f'},
+		{"timeouts",        required_argument, 0, 'g'},
+		{0, 0, 0, 0 } /* for invalid args */
+	};
+
+	if (argc < 0)
+		return ERROR_NEG_ARG_1;
+	if (argv==NULL)
+		return ERROR_NULL_ARG_2;
+	if (path==NULL)
+		return ERROR_NULL_ARG_3;
+	if (dev==NULL)
+		return ERROR_NULL_ARG_4;
+	if (mode==NULL)
+		return ERROR_NULL_ARG_5;
+	if (backend==NULL)
+		return ERROR_NULL_ARG_6;
+	if (cache==NULL)
+		return ERROR_NULL_ARG_7;
+	if (group==NULL)
+		return ERROR_NULL_ARG_8;
+	if (timeouts==NULL)
+		return ERROR_NULL_ARG_9;
+
+	/* set default values */
+	*path = AGENT_SOCKET_DEFAULT;
+	*dev  = NULL;
+	*mode = AGENT_SOCKET_MODE_DEFAULT;
+	*backend = NULL;
+	*cache = NULL;
+	*group = -1;
+	*timeouts = NULL;
+
+	/* loop over the arguments, and read them in */
+	while (1)
+	{
+		/* getopt_long stores the option index here. */
+		int option_index = 0;
+
+		c = getopt_long (argc, argv, "a:b:c:d:e:f:g:",
+			long_options, &option_index);
+
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'a' :
+				*path = optarg;
+				break;
+			case 'b' :
+				*dev = optarg;
+				break;
+			case 'c' :
+				*mode = (int) strtol(optarg,NULL,8);
+				break;
+			case 'd' :
+				*backend = optarg;
+				break;
+			case 'e' :
+				*cache = optarg;
+				break;
+			case 'f' :
+				if ((grp=getgrnam(optarg)) == NULL)
+					return ERROR_3;
+				*group = (int) grp->gr_gid;
+				break;
+			case 'g' :
+				*timeouts = optarg;
+				break;
+			case '?':
+				return ERROR_1;
+				break;
+			default:
+				return ERROR_2;
+				break;
+		}
+	}
+
+	return SUCCESS;
+}
@@ -0,0 +1,684 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file pktio_bench.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief stub benchmark that runs many whole traversals through the
+ *        simulated network (see simnet.h).  no root privledge is needed.
+ *
+ * Every traversal builds two peers behind fresh NATs and a public helper.
+ * Each peer runs natblaster_connect in its own thread, with a packet engine
+ * on its simulated host, so the real peer state machine makes the helper
+ * connections, races the connects, sniffs the SYNs and forges the
+ * SYN/ACKs.  The helper is the real one too: the benchmark accepts the
+ * connections made to the helper's host and hands them to
+ * create_new_handler, like natblaster_server does with the ones it accepts,
+ * so the helper state machine pairs the peers and predicts their ports.
+ * The engine stands in for connect() on the simulated hosts, and the sockets
+ * of completed connections are joined with socketpairs, so the traversal
+ * succeeds only if a byte written on each peer's returned socket reaches
+ * the other.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "def.h"
+#include "errorcodes.h"
+#include "comm.h"
+#include "peerdef.h"
+#include "simnet.h"
+#include "natblaster_peer.h"
+#include "connlist.h"
+#include "helpercon.h"
+#include "timeout.h"
+
+/** @brief the port the simulated helper listens on */
+#define BENCH_HELPER_PORT	7777
+
+/** @brief the port the first peer connects to its buddy from.  the peers
+ *  bind real sockets, so the second one uses ports BENCH_PEER_GAP higher */
+#define BENCH_PEER_PORT		40000
+
+/** @brief how far apart the ports of the two peers are */
+#define BENCH_PEER_GAP		1000
+
+/** @brief the first port the other connections through a NAT come from */
+#define BENCH_NOISE_PORT	30000
+
+/** @brief the most other connections through a NAT (each takes a connect
+ *  slot on the peer's host, next to the helper and race connects) */
+#define BENCH_MAX_NOISE		(SIMNET_MAX_CONNECTS - 2 - MAX_RACE_WIDTH)
+
+/** @brief the time in ms the helper waits for a connection before checking
+ *  if the peers are done */
+#define BENCH_ACCEPT_WAIT	10
+
+/** @brief the time in ms a byte written to one peer has to reach the other */
+#define BENCH_DATA_TIMEOUT	1000
+
+/** @brief the time in ms the helper's sessions have to end after the peers
+ *  are done */
+#define BENCH_DRAIN_TIMEOUT	5000
+
+struct bench;
+
+/** @brief the settings of a benchmark run */
+struct bench_opts {
+	/** @brief the number of traversals to run */
+	unsigned long count;
+	/** @brief the port allocation of the first peer's NAT */
+	flag_t alloc_a;
+	/** @brief the port allocation of the second peer's NAT */
+	flag_t alloc_b;
+	/** @brief SIMNET_MAP_PER_DEST or SIMNET_MAP_PER_PORT */
+	flag_t mapping;
+	/** @brief the number of predicted ports to race */
+	unsigned char race_width;
+	/** @brief the number of other connections each NAT maps between
+	 *  port prediction and the direct connection */
+	int noise;
+	/** @brief FLAG_SET if ICMP errors remove NAT mappings */
+	flag_t icmp_kill;
+	/** @brief the file with the limits of each protocol wait, NULL for
+	 *  the defaults */
+	char *timeouts;
+	/** @brief the fewest traversals that must connect for the run to
+	 *  pass */
+	unsigned long expect;
+};
+
+/** @brief typedef for the bench_opts structure */
+typedef struct bench_opts bench_opts_t;
+
+/** @brief one side of a simulated traversal */
+struct bench_peer {
+	/** @brief the benchmark the peer is part of */
+	struct bench *bench;
+	/** @brief the peer's NAT */
+	simnet_nat_t nat;
+	/** @brief the peer's host */
+	simnet_host_t host;
+	/** @brief the packet engine on the host */
+	pktio_t io;
+	/** @brief the port the peer connects to its buddy from */
+	port_t port;
+	/** @brief the peer's buddy */
+	struct bench_peer *buddy;
+	/** @brief the settings the peer connects with */
+	peer_opts_t opts;
+	/** @brief the thread running natblaster_connect */
+	pthread_t tid;
+	/** @brief what natblaster_connect returned */
+	int sd;
+	/** @brief the connections the helper accepted from the peer */
+	int accepted;
+};
+
+/** @brief typedef for the bench_peer structure */
+typedef struct bench_peer bench_peer_t;
+
+/** @brief the state of a benchmark run */
+struct bench {
+	/** @brief the simulated network */
+	simnet_t net;
+	/** @brief the two peers */
+	bench_peer_t peer[2];
+	/** @brief the helper's host */
+	simnet_host_t helper;
+	/** @brief the helper's sessions, kept across traversals like a
+	 *  running helper would */
+	connlist_t list;
+	/** @brief the network counters summed over all traversals */
+	simnet_stats_t stats;
+	/** @brief the random state used for the NATs */
+	unsigned int seed;
+	/** @brief the number of traversals started */
+	unsigned long round;
+	/** @brief the peers whose natblaster_connect returned */
+	int done;
+	/** @brief protects done */
+	pthread_mutex_t mutex;
+};
+
+/** @brief typedef for the bench structure */
+typedef struct bench bench_t;
+
+/**
+ * @brief runs one traversal
+ *
+ * @param bench the benchmark state
+ * @param opts the benchmark settings
+ * @param connected pointer to set to FLAG_SET if both peers connected and
+ *        FLAG_FAILED if they did not
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode bench_traversal(bench_t *bench, bench_opts_t *opts,
+			  flag_t *connected);
+
+/**
+ * @brief the helper's part of a traversal: accepts the connections made to
+ *        the helper's host until both peers are done
+ *
+ * @param bench the benchmark state
+ * @param opts the benchmark settings
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode bench_helper(bench_t *bench, bench_opts_t *opts);
+
+/**
+ * @brief hands one accepted connection to the helper state machine.  once a
+ *        peer's second connection, the one port prediction is based on, is
+ *        accepted its NAT maps the other connections.
+ *
+ * @param bench the benchmark state
+ * @param opts the benchmark settings
+ * @param conn the accepted connection
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode bench_accept(bench_t *bench, bench_opts_t *opts,
+		       simnet_accept_t *conn);
+
+/**
+ * @brief checks that a byte written on one socket arrives on the other
+ *
+ * @param from the socket to write on
+ * @param to the socket to read from
+ *
+ * @return FLAG_SET if it arrived, FLAG_FAILED if not
+ */
+flag_t bench_data(int from, int to);
+
+/**
+ * @brief waits for every session of the helper to end
+ *
+ * @param list the helper's sessions
+ * @param timeout the most time to wait in ms
+ *
+ * @return SUCCESS, ERROR_TIMEOUT if some are still running
+ */
+errorcode bench_drain(connlist_t *list, int timeout);
+
+/**
+ * @brief runs natblaster_connect for a peer
+ *
+ * @param arg the bench_peer_t of the peer
+ *
+ * @return NULL
+ */
+void *run_bench_peer(void *arg);
+
+/**
+ * @brief gets arguments from the command line
+ *
+ * @param argc the number of arguments passed in
+ * @param argv the vector of arguments
+ * @param opts pointer to the settings to fill in
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+int getArgs(int argc, char *argv[], bench_opts_t *opts);
+
+/**
+ * @brief prints the program use
+ *
+ * @return void
+ */
+void printUse();
+
+/**
+ * @brief stub entry point
+ *
+ * @param argc the number of elements in the argument vector
+ * @param argv the argument vector
+ *
+ * @return 0 on success, 1 if fewer traversals connected than expected, neg
+ *         on failure
+ */
+int main(int argc, char *argv[]) {
+
+	bench_opts_t opts;
+	bench_t *bench;
+	flag_t connected;
+	unsigned long i, direct = 0, failed = 0;
+	struct timeval start, end;
+	double secs;
+
+	if (FAILED(getArgs(argc,argv,&opts))) {
+		printUse();
+		return (-1);
+	}
+
+	/* a failed traversal leaves sockets whose other end is closed, a
+	 * write to one has to fail rather than end the run */
+	signal(SIGPIPE,SIG_IGN);
+
+	/* the NATs hold their mapping tables, so keep them off the stack */
+	if ( (bench=(bench_t*)malloc(sizeof(bench_t))) == NULL)
+		return (-2);
+	memset(bench,0,sizeof(bench_t));
+	bench->seed = 1;
+	if ( (pthread_mutex_init(&bench->mutex,NULL) != 0) ||
+	     (FAILED(connlist_init(&bench->list))) )
+		return (-2);
+
+	/* the peers and the helper share one table of wait limits */
+	if ( (opts.timeouts != NULL) &&
+	     (FAILED(timeout_config_load(opts.timeouts))) ) {
+		printf("couldn't load %s\n",opts.timeouts);
+		return (-2);
+	}
+
+	gettimeofday(&start,NULL);
+	for (i=0;i<opts.count;i++) {
+		if (FAILED(bench_traversal(bench,&opts,&connected))) {
+			printf("traversal %lu could not be run\n",i);
+			return (-3);
+		}
+		if (connected == FLAG_SET)
+			direct++;
+		else
+			failed++;
+	}
+	gettimeofday(&end,NULL);
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+
+	printf("traversals: %lu in %.3f s (%.0f/s, %.2f ms each)\n",
+		opts.count,secs,opts.count/secs,secs*1000.0/opts.count);
+	printf("connected: %lu  failed: %lu\n",direct,failed);
+	printf("packets delivered: %lu  ttl expired: %lu  icmp: %lu  "
+		"mappings killed: %lu  filtered: %lu  overrun: %lu\n",
+		bench->stats.delivered,bench->stats.ttl_expired,
+		bench->stats.icmp,bench->stats.icmp_killed,
+		bench->stats.filtered,bench->stats.overrun);
+
+	pthread_mutex_destroy(&bench->mutex);
+	free(bench);
+
+	if (direct < opts.expect) {
+		printf("FAILED: expected at least %lu connected\n",opts.expect);
+		return (1);
+	}
+
+	return (0);
+}
+
+errorcode bench_traversal(bench_t *bench, bench_opts_t *opts,
+			  flag_t *connected) {
+
+	/* declare local variables */
+	bench_peer_t *peer;
+	errorcode ret;
+	int p;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(bench,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(opts,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(connected,ERROR_NULL_ARG_3);
+
+	/* do function */
+	*connected = FLAG_FAILED;
+
+	/* build the network: each peer behind its own NAT, and the helper.
+	 * the helper remembers recent connections by address, so every
+	 * traversal's NATs get addresses of their own */
+	CHECK_FAILED(simnet_init(&bench->net),ERROR_1);
+	CHECK_FAILED(simnet_add_host(&bench->net,&bench->helper,
+		inet_addr("203.0.113.1"),NULL),ERROR_2);
+	CHECK_FAILED(simnet_listen(&bench->helper,htons(BENCH_HELPER_PORT)),
+		ERROR_2);
+	for (p=0;p<2;p++) {
+		peer = &bench->peer[p];
+		CHECK_FAILED(simnet_nat_init(&peer->nat,
+			htonl(0xc6330001 +		/* 198.51.x.y */
+				(2*bench->round + p) % 0xfffe),
+			(p==0) ? opts->alloc_a : opts->alloc_b,
+			opts->mapping,
+			htons(SIMNET_RAND_PORT_MIN + rand_r(&bench->seed) %
+				50000),
+			rand_r(&bench->seed),opts->icmp_kill),ERROR_3);
+		CHECK_FAILED(simnet_add_host(&bench->net,&peer->host,
+			htonl(0x0a000002 + (p<<16)),	/* 10.p.0.2 */
+			&peer->nat),ERROR_4);
+		CHECK_FAILED(simnet_open_pktio(&peer->host,&peer->io),ERROR_5);
+
+		peer->bench    = bench;
+		peer->buddy    = &bench->peer[1-p];
+		peer->port     = htons(BENCH_PEER_PORT + p*BENCH_PEER_GAP);
+		peer->sd       = SOCKET_UNKNOWN;
+		peer->accepted = 0;
+		memset(&peer->opts,0,sizeof(peer->opts));
+		peer->opts.race_width = opts->race_width;
+		peer->opts.pktio      = &peer->io;
+		peer->opts.overlap    = FLAG_SET;
+		peer->opts.syn_ttl    = TTL_TOO_LOW;
+	}
+	bench->round++;
+	bench->done = 0;
+
+	/* both peers connect at once, and the helper serves them */
+	for (p=0;p<2;p++) {
+		if (pthread_create(&bench->peer[p].tid,NULL,run_bench_peer,
+				&bench->peer[p]) != 0)
+			return ERROR_PTHREAD_CREATE_FAILED;
+	}
+	ret = bench_helper(bench,opts);
+	for (p=0;p<2;p++)
+		pthread_join(bench->peer[p].tid,NULL);
+	if (FAILED(ret))
+		return ERROR_6;
+
+	/* connected if the sockets the peers got really reach each other */
+	if ( (bench->peer[0].sd >= 0) && (bench->peer[1].sd >= 0) &&
+	     (bench_data(bench->peer[0].sd,bench->peer[1].sd) == FLAG_SET) &&
+	     (bench_data(bench->peer[1].sd,bench->peer[0].sd) == FLAG_SET) )
+		*connected = FLAG_SET;
+
+	/* tear down.  the helper is done with the traversal once the peers
+	 * hung up */
+	for (p=0;p<2;p++) {
+		if (bench->peer[p].sd >= 0)
+			close(bench->peer[p].sd);
+	}
+	CHECK_FAILED(bench_drain(&bench->list,BENCH_DRAIN_TIMEOUT),ERROR_7);
+	for (p=0;p<2;p++)
+		pktio_close(&bench->peer[p].io);
+	bench->stats.delivered   += bench->net.stats.delivered;
+	bench->stats.ttl_expired += bench->net.stats.ttl_expired;
+	bench->stats.icmp        += bench->net.stats.icmp;
+	bench->stats.icmp_killed += bench->net.stats.icmp_killed;
+	bench->stats.filtered    += bench->net.stats.filtered;
+	bench->stats.overrun     += bench->net.stats.overrun;
+	CHECK_FAILED(simnet_destroy(&bench->net),ERROR_8);
+
+	return SUCCESS;
+}
+
+errorcode bench_helper(bench_t *bench, bench_opts_t *opts) {
+
+	/* declare local variables */
+	simnet_accept_t conn;
+	int done;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(bench,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(opts,ERROR_NULL_ARG_2);
+
+	/* do function */
+	while (1) {
+		if (pthread_mutex_lock(&bench->mutex) != 0)
+			return ERROR_MUTEX_LOCK;
+		done = bench->done;
+		if (pthread_mutex_unlock(&bench->mutex) != 0)
+			return ERROR_MUTEX_UNLOCK;
+		if (done == 2)
+			break;
+
+		CHECK_FAILED(simnet_accept(&bench->helper,BENCH_ACCEPT_WAIT,
+			&conn),ERROR_1);
+		if (conn.sd != SOCKET_UNKNOWN)
+			CHECK_FAILED(bench_accept(bench,opts,&conn),ERROR_2);
+	}
+
+	return SUCCESS;
+}
+
+errorcode bench_accept(bench_t *bench, bench_opts_t *opts,
+		       simnet_accept_t *conn) {
+
+	/* declare local variables */
+	bench_peer_t *peer = NULL;
+	observed_data_t data;
+	int p, i;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(bench,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(opts,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(conn,ERROR_NULL_ARG_3);
+
+	/* do function */
+	for (p=0;p<2;p++)
+		if (bench->peer[p].nat.ext_ip == conn->ip)
+			peer = &bench->peer[p];
+
+	/* after port prediction, other connections through the NAT may take
+	 * the predicted ports.  they go to a port nothing listens on, so the
+	 * helper never sees them */
+	if ( (peer != NULL) && (++peer->accepted == 2) ) {
+		for (i=0;i<opts->noise;i++)
+			CHECK_FAILED(simnet_connect(&peer->host,
+				htons(BENCH_NOISE_PORT+i),bench->helper.ip,
+				htons(BENCH_HELPER_PORT+1),SEQ_NUM_UNKNOWN,
+				TTL_OK,NULL),ERROR_1);
+	}
+
+	/* as natblaster_server does with a connection it accepts */
+	data.ip   = conn->ip;
+	data.port = conn->port;
+	CHECK_FAILED(connlist_observe(&bench->list,&data),ERROR_2);
+	if (FAILED(create_new_handler(&bench->list,&data,conn->sd))) {
+		close(conn->sd);
+		return ERROR_3;
+	}
+
+	return SUCCESS;
+}
+
+flag_t bench_data(int from, int to) {
+
+	/* declare local variables */
+	struct pollfd fds;
+	char out = 42, in = 0;
+
+	/* do function */
+	if (write(from,&out,1) != 1)
+		return FLAG_FAILED;
+
+	fds.fd     = to;
+	fds.events = POLLIN;
+	if ( (poll(&fds,1,BENCH_DATA_TIMEOUT) != 1) ||
+	     (read(to,&in,1) != 1) || (in != out) )
+		return FLAG_FAILED;
+
+	return FLAG_SET;
+}
+
+errorcode bench_drain(connlist_t *list, int timeout) {
+
+	/* declare local variables */
+	int sessions, waited;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(list,ERROR_NULL_ARG_1);
+
+	/* do function */
+	for (waited=0;;waited++) {
+		if (pthread_mutex_lock(&list->mutex) != 0)
+			return ERROR_MUTEX_LOCK;
+		sessions = list_count(&list->sessions);
+		if (pthread_mutex_unlock(&list->mutex) != 0)
+			return ERROR_MUTEX_UNLOCK;
+		if (sessions == 0)
+			return SUCCESS;
+		if (waited >= timeout)
+			break;
+		usleep(1000);
+	}
+
+	printf("%d helper session(s) still running\n",sessions);
+
+	return ERROR_TIMEOUT;
+}
+
+void *run_bench_peer(void *arg) {
+
+	/* declare local variables */
+	bench_peer_t *peer;
+	bench_t *bench;
+
+	/* do function */
+	peer  = (bench_peer_t*) arg;
+	bench = peer->bench;
+
+	peer->sd = natblaster_connect(bench->helper.ip,
+		htons(BENCH_HELPER_PORT),peer->host.ip,peer->port,
+		peer->buddy->nat.ext_ip,peer->buddy->host.ip,
+		peer->buddy->port,NULL,FLAG_UNSET,&peer->opts);
+
+	pthread_mutex_lock(&bench->mutex);
+	bench->done++;
+	pthread_mutex_unlock(&bench->mutex);
+
+	return NULL;
+}
+
+void printUse() {
+
+	printf("options:\n");
+	printf("\t--count      : number of traversals [optional, default 1000]\n");
+	printf("\t--nat_a      : port allocation of the first NAT, seq or rand [optional, default seq]\n");
+	printf("\t--nat_b      : port allocation of the second NAT, seq or rand [optional, default seq]\n");
+	printf("\t--mapping    : NAT mapping, dest (symmetric) or port [optional, default dest]\n");
+	printf("\t               a random NAT needs the birthday paradox, which only connects with port\n");
+	printf("\t--race_width : number of predicted buddy ports to race [optional, default 1]\n");
+	printf("\t--noise      : connections each NAT maps after port prediction [optional, default 0, at most %d]\n",
+		BENCH_MAX_NOISE);
+	printf("\t--icmp_kill  : NATs drop a mapping when an ICMP error comes back for it [optional]\n");
+	printf("\t--timeouts   : file with the limits of each protocol wait, a failed traversal waits the whole direct_conn limit [optional]\n");
+	printf("\t--expect     : fewest traversals that must connect, else exit 1 [optional, default 0]\n");
+	printf("\n");
+
+	return;
+}
+
+int getArgs(int argc, char *argv[], bench_opts_t *opts) {
+
+	char c;
+	int width;
+
+	static struct option long_options[] =
+	{
+		{"count",           required_argument, 0, 'a'},
+		{"nat_a",           required_argument, 0, 'b'},
+		{"nat_b",           required_argument, 0, 'c'},
+		{"mapping",         required_argument, 0, 'd'},
+		{"race_width",      required_argument, 0, 'e'},
+		{"noise",           required_argument, 0, 'f'},
+		{"icmp_kill",       no_argument,       0, 'g'},
+		{"timeouts",        required_argument, 0, 'h'},
+		{"expect",          required_argument, 0, 'i'},
+		{0, 0, 0, 0 } /* for invalid args */
+	};
+
+	if (argc < 0)
+		return ERROR_NEG_ARG_1;
+	if (argv==NULL)
+		return ERROR_NULL_ARG_2;
+	if (opts==NULL)
+		return ERROR_NULL_ARG_3;
+
+	/* set default values */
+	opts->count      = 1000;
+	opts->alloc_a    = COMM_PORT_ALLOC_SEQ;
+	opts->alloc_b    = COMM_PORT_ALLOC_SEQ;
+	opts->mapping    = SIMNET_MAP_PER_DEST;
+	opts->race_width = RACE_WIDTH_DEFAULT;
+	opts->noise      = 0;
+	opts->icmp_kill  = FLAG_UNSET;
+	opts->timeouts   = NULL;
+	opts->expect     = 0;
+	width            = RACE_WIDTH_DEFAULT;
+
+	/* loop over the arguments, and read them in */
+	while (1)
+	{
+		/* getopt_long stores the option index here. */
+		int option_index = 0;
+
+		c = getopt_long (argc, argv, "a:b:c:d:e:f:gh:i:",
+			long_options, &option_index);
+
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'a' :
+				opts->count = strtoul(optarg,NULL,10);
+				break;
+			case 'b' :
+				opts->alloc_a = (strcmp(optarg,"rand")==0) ?
+					COMM_PORT_ALLOC_RAND :
+					COMM_PORT_ALLOC_SEQ;
+				break;
+			case 'c' :
+				opts->alloc_b = (strcmp(optarg,"rand")==0) ?
+					COMM_PORT_ALLOC_RAND :
+					COMM_PORT_ALLOC_SEQ;
+				break;
+			case 'd' :
+				opts->mapping = (strcmp(optarg,"port")==0) ?
+					SIMNET_MAP_PER_PORT :
+					SIMNET_MAP_PER_DEST;
+				break;
+			case 'e' :
+				width = atoi(optarg);
+				break;
+			case 'f' :
+				opts->noise = atoi(optarg);
+				break;
+			case 'g' :
+				opts->icmp_kill = FLAG_SET;
+				break;
+			case 'h' :
+				opts->timeouts = optarg;
+				break;
+			case 'i' :
+				opts->expect = strtoul(optarg,NULL,10);
+				break;
+			case '?':
+				return ERROR_1;
+				break;
+			default:
+				return ERROR_2;
+				break;
+		}
+	}
+
+	if ( (width < 1) || (width > MAX_RACE_WIDTH) )
+		return ERROR_3;
+	opts->race_width = (unsigned char) width;
+
+	if ( (opts->noise < 0) || (opts->noise > BENCH_MAX_NOISE) ||
+	     (opts->count == 0) || (opts->expect > opts->count) )
+		return ERROR_4;
+
+	return SUCCESS;
+}
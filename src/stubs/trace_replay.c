@@ -0,0 +1,743 @@
+/*****************************************************************************
+ * Copyright 2005 Daniel Ferullo                                             *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *    http://www.apache.org/licenses/LICENSE-2.0                             *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+/**
+ * @file trace_replay.c
+ * @author Daniel Ferullo (ferullo@cmu.edu)
+ *
+ * @brief stub that replays a trace recorded by a helper (see trace.h)
+ *        against a helper, faster than it was recorded if asked to, and
+ *        compares the helper's responses with the recording
+ *
+ * Every recorded session is made again from the loopback network: each
+ * source ip in the trace gets an address of its own in 127.1.0.0/16, and
+ * its connections come from ports as far apart as the recorded ones, so
+ * port prediction and the per source rate limit see what they saw then.
+ * The buddy's external ip in each HELLO is changed to the buddy's new
+ * address.  A session connects when it was accepted, divided by the speed,
+ * sends each message the peer sent no sooner than it was sent and only
+ * after the helper's earlier responses arrived, and checks every response
+ * has the recorded type.  Sessions handed over from another helper (no
+ * accept in the trace) are skipped.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "def.h"
+#include "berkeleyapi.h"
+#include "errorcodes.h"
+#include "comm.h"
+#include "helperdef.h"
+#include "nethelp.h"
+#include "netio.h"
+#include "trace.h"
+
+/** @brief the first local port a source's connections are mapped to */
+#define REPLAY_PORT_BASE	20000
+
+/** @brief the number of local ports a source's connections are spread
+ *  over */
+#define REPLAY_PORT_SPAN	40000
+
+/** @brief the highest recorded socket descriptor sessions are kept for */
+#define REPLAY_MAX_SD		65536
+
+/** @brief the most source ips (each takes an address in 127.1.0.0/16) */
+#define REPLAY_MAX_SOURCES	65534
+
+/** @brief seconds to wait for a response from the helper */
+#define REPLAY_READ_TIMEOUT	30
+
+/** @brief structure for one recorded event of a session */
+struct replay_event {
+	/** @brief microseconds since the start of the trace */
+	unsigned long long time;
+	/** @brief the TRACE_EVENT_* value */
+	unsigned char event;
+	/** @brief the comm type of a message */
+	unsigned int type;
+	/** @brief the payload length */
+	unsigned short len;
+	/** @brief the payload, NULL if there is none */
+	unsigned char *payload;
+};
+
+/** @brief typedef for the replay_event structure */
+typedef struct replay_event replay_event_t;
+
+/** @brief structure for a recorded source ip and where it is replayed
+ *  from */
+struct replay_source {
+	/** @brief the ip in the trace */
+	ip_t recorded;
+	/** @brief the loopback address replacing it */
+	ip_t local;
+	/** @brief the first port seen from the ip (host byte order), mapped
+	 *  to REPLAY_PORT_BASE */
+	unsigned short first_port;
+};
+
+/** @brief typedef for the replay_source structure */
+typedef struct replay_source replay_source_t;
+
+/** @brief structure for one session of the trace */
+struct replay_session {
+	/** @brief the address the local connection is bound to */
+	observed_data_t local;
+	/** @brief the events, the first is the accept */
+	replay_event_t *events;
+	/** @brief the number of events */
+	int count;
+	/** @brief the number of events there is room for */
+	int size;
+	/** @brief the thread replaying the session */
+	pthread_t thread;
+	/** @brief FLAG_SET if the thread was started */
+	flag_t started;
+	/** @brief the responses compared */
+	unsigned long responses;
+	/** @brief the recorded response times added up, microseconds */
+	double recorded_sum;
+	/** @brief the replayed response times added up, microseconds */
+	double replayed_sum;
+	/** @brief the longest recorded response time */
+	unsigned long long recorded_max;
+	/** @brief the longest replayed response time */
+	unsigned long long replayed_max;
+};
+
+/** @brief typedef for the replay_session structure */
+typedef struct replay_session replay_session_t;
+
+/** @brief structure for a replay */
+struct replay {
+	/** @brief the helper's ip */
+	ip_t helper_ip;
+	/** @brief the helper's port */
+	port_t helper_port;
+	/** @brief how many times faster than recorded to replay */
+	double speed;
+	/** @brief the sessions, in the order they were accepted */
+	replay_session_t *sessions;
+	/** @brief the number of sessions */
+	int count;
+	/** @brief the number of sessions there is room for */
+	int size;
+	/** @brief the source ips */
+	replay_source_t sources[REPLAY_MAX_SOURCES];
+	/** @brief the number of source ips */
+	int source_count;
+	/** @brief the time the first session was accepted in the trace */
+	unsigned long long first;
+	/** @brief the time of the last event in the trace */
+	unsigned long long last;
+	/** @brief the time the replay started */
+	struct timeval start;
+	/** @brief the sessions that got every response */
+	unsigned long ok;
+	/** @brief the sessions that did not */
+	unsigned long failed;
+	/** @brief the responses compared */
+	unsigned long responses;
+	/** @brief the recorded response times added up, microseconds */
+	double recorded_sum;
+	/** @brief the replayed response times added up, microseconds */
+	double replayed_sum;
+	/** @brief the longest recorded response time */
+	unsigned long long recorded_max;
+	/** @brief the longest replayed response time */
+	unsigned long long replayed_max;
+	/** @brief protects the counters */
+	pthread_mutex_t mutex;
+};
+
+/** @brief typedef for the replay structure */
+typedef struct replay replay_t;
+
+/** @brief structure passed to a session's thread */
+struct replay_thread_arg {
+	/** @brief the replay */
+	replay_t *replay;
+	/** @brief the session */
+	replay_session_t *session;
+};
+
+/** @brief typedef for the replay_thread_arg structure */
+typedef struct replay_thread_arg replay_thread_arg_t;
+
+/**
+ * @brief reads a trace into sessions
+ *
+ * @param replay pointer to the replay to fill in
+ * @param path the trace file
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode replay_load(replay_t *replay, char *path);
+
+/**
+ * @brief adds an event to a session
+ *
+ * @param session pointer to the session
+ * @param record the event's record
+ * @param time the event's time since the start of the trace
+ * @param payload the event's payload
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+errorcode replay_add(replay_session_t *session, trace_record_t *record,
+		     unsigned long long time, unsigned char *payload);
+
+/**
+ * @brief finds the source a recorded ip is replayed from, adding it if it
+ *        is new
+ *
+ * @param replay pointer to the replay
+ * @param ip the recorded ip
+ * @param port the first port seen from it (network byte order)
+ *
+ * @return the source, NULL if there are too many
+ */
+replay_source_t *replay_source(replay_t *replay, ip_t ip, port_t port);
+
+/**
+ * @brief the entry point of a thread replaying one session
+ *
+ * @param arg a replay_thread_arg_t allocated with malloc, it is freed
+ *
+ * @return NULL
+ */
+void *run_replay_session(void *arg);
+
+/**
+ * @brief replays a session over a new socket, checking every response has
+ *        the recorded type
+ *
+ * @param replay pointer to the replay
+ * @param session pointer to the session, its response times are filled in
+ * @param sd the socket to replay the session over, closed by the caller
+ *
+ * @return SUCCESS, errorcode if the session could not be replayed or the
+ *         helper answered differently
+ */
+errorcode replay_play(replay_t *replay, replay_session_t *session,
+		      sock_t sd);
+
+/**
+ * @brief sleeps until the replay of a recorded time is due
+ *
+ * @param replay pointer to the replay
+ * @param time the recorded time
+ *
+ * @return void
+ */
+void replay_wait(replay_t *replay, unsigned long long time);
+
+/**
+ * @brief finds the time since the replay started
+ *
+ * @param replay pointer to the replay
+ *
+ * @return the time in microseconds
+ */
+unsigned long long replay_now(replay_t *replay);
+
+/**
+ * @brief gets arguments from the command line
+ *
+ * @param argc the number of arguments passed in
+ * @param argv the vector of arguments
+ * @param helper_ip pointer to fill in with the helper's ip or name
+ * @param helper_port pointer to fill in with the helper's port
+ * @param path pointer to fill in with the trace file
+ * @param speed pointer to fill in with the speed
+ *
+ * @return SUCCESS, errorcode on failure
+ */
+int getArgs(int argc, char *argv[], char **helper_ip, port_t *helper_port,
+	    char **path, double *speed);
+
+/**
+ * @brief prints the program use
+ *
+ * @return void
+ */
+void printUse();
+
+/**
+ * @brief stub entry point
+ *
+ * @param argc the number of elements in the argument vector
+ * @param argv the argument vector
+ *
+ * @return 0 on success, neg on failure
+ */
+int main(int argc, char *argv[]) {
+
+	replay_t *replay;
+	replay_thread_arg_t *arg;
+	char *helper_addr, *path;
+	int i;
+	double recorded_secs, replayed_secs;
+
+	/* the source table is large, keep it off the stack */
+	if ( (replay=(replay_t*)malloc(sizeof(replay_t))) == NULL)
+		return (-1);
+	memset(replay,0,sizeof(replay_t));
+	pthread_mutex_init(&replay->mutex,NULL);
+
+	if (FAILED(getArgs(argc,argv,&helper_addr,&replay->helper_port,
+			   &path,&replay->speed))) {
+		printUse();
+		return (-1);
+	}
+	if (FAILED(resolveIP(helper_addr,&replay->helper_ip))) {
+		printf("could not resolve %s\n",helper_addr);
+		return (-2);
+	}
+	if (FAILED(replay_load(replay,path))) {
+		printf("could not read the trace %s\n",path);
+		return (-3);
+	}
+	if (replay->count == 0) {
+		printf("the trace has no sessions\n");
+		return (-4);
+	}
+
+	/* start each session when it is due, the threads pace their own
+	 * messages */
+	gettimeofday(&replay->start,NULL);
+	for (i=0;i<replay->count;i++) {
+		replay_wait(replay,replay->sessions[i].events[0].time);
+		if ( (arg=(replay_thread_arg_t*)malloc(
+				sizeof(replay_thread_arg_t))) == NULL)
+			return (-5);
+		arg->replay  = replay;
+		arg->session = &replay->sessions[i];
+		if (pthread_create(&replay->sessions[i].thread,NULL,
+				   run_replay_session,arg)!=0) {
+			free(arg);
+			pthread_mutex_lock(&replay->mutex);
+			replay->failed++;
+			pthread_mutex_unlock(&replay->mutex);
+			continue;
+		}
+		replay->sessions[i].started = FLAG_SET;
+	}
+	for (i=0;i<replay->count;i++) {
+		if (replay->sessions[i].started == FLAG_SET)
+			pthread_join(replay->sessions[i].thread,NULL);
+	}
+	replayed_secs = replay_now(replay) / 1000000.0;
+	recorded_secs = (replay->last - replay->first) / 1000000.0;
+
+	printf("recorded: %d sessions in %.3f s (%.1f sessions/s)\n",
+		replay->count,recorded_secs,
+		(recorded_secs > 0) ? replay->count/recorded_secs : 0.0);
+	printf("replayed at %.1fx: %lu ok, %lu failed in %.3f s "
+		"(%.1f sessions/s, %.1f expected)\n",replay->speed,
+		replay->ok,replay->failed,replayed_secs,
+		(replayed_secs > 0) ? replay->count/replayed_secs : 0.0,
+		(recorded_secs > 0) ?
+		replay->count*replay->speed/recorded_secs : 0.0);
+	if (replay->responses != 0) {
+		printf("response time over %lu responses: recorded mean %.3f "
+			"ms (max %.3f), replayed mean %.3f ms (max %.3f)\n",
+			replay->responses,
+			replay->recorded_sum/replay->responses/1000.0,
+			replay->recorded_max/1000.0,
+			replay->replayed_sum/replay->responses/1000.0,
+			replay->replayed_max/1000.0);
+	}
+
+	return (replay->failed == 0) ? 0 : (-6);
+}
+
+errorcode replay_load(replay_t *replay, char *path) {
+
+	/* declare local variables */
+	trace_reader_t reader;
+	trace_record_t record;
+	unsigned char payload[TRACE_PAYLOAD_MAX];
+	replay_session_t *session;
+	replay_source_t *source;
+	comm_msg_hello_t *hello;
+	observed_data_t *obs;
+	int *open, ret, i;
+	unsigned long long offset, time;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(replay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_2);
+
+	/* do function */
+	/* the session open on each recorded descriptor */
+	if ( (open=(int*)malloc(REPLAY_MAX_SD*sizeof(int))) == NULL)
+		return ERROR_MALLOC_FAILED;
+	for (i=0;i<REPLAY_MAX_SD;i++)
+		open[i] = -1;
+
+	CHECK_FAILED(trace_reader_open(&reader,path),ERROR_FILE_OPEN);
+	offset = 0;
+	while ( (ret=trace_read(&reader,&record,payload)) == 1) {
+		/* each run of the helper follows the one before it right
+		 * away, the time between them is not replayed */
+		if (record.event == TRACE_EVENT_START) {
+			offset = replay->last;
+			for (i=0;i<REPLAY_MAX_SD;i++)
+				open[i] = -1;
+			continue;
+		}
+		if ( (record.session < 0) || (record.session >= REPLAY_MAX_SD) )
+			continue;
+		time = offset + record.time;
+		if (time > replay->last)
+			replay->last = time;
+
+		if (record.event == TRACE_EVENT_ACCEPT) {
+			if (record.len < sizeof(observed_data_t))
+				continue;
+			obs = (observed_data_t*)payload;
+			if ( (source=replay_source(replay,obs->ip,obs->port)) ==
+			     NULL)
+				continue;
+			if (replay->count == replay->size) {
+				replay->size = (replay->size == 0) ? 64 :
+					replay->size*2;
+				replay->sessions = (replay_session_t*)realloc(
+					replay->sessions,
+					replay->size*sizeof(replay_session_t));
+				if (replay->sessions == NULL)
+					return ERROR_MALLOC_FAILED;
+			}
+			session = &replay->sessions[replay->count];
+			memset(session,0,sizeof(replay_session_t));
+			/* keep the recorded distance between the source's
+			 * ports, a second connection is one port after the
+			 * first */
+			session->local.ip   = source->local;
+			session->local.port = htons(REPLAY_PORT_BASE +
+				(unsigned short)(PORT_2HBO(obs->port) -
+				source->first_port) % REPLAY_PORT_SPAN);
+			if (replay->count == 0)
+				replay->first = time;
+			open[record.session] = replay->count++;
+		}
+		if (open[record.session] < 0)
+			continue;
+		session = &replay->sessions[open[record.session]];
+
+		/* the buddy is replayed from its own new address */
+		if ( (record.event == TRACE_EVENT_IN) &&
+		     (record.type == COMM_MSG_HELLO) &&
+		     (record.len >= sizeof(comm_msg_hello_t)) ) {
+			hello = (comm_msg_hello_t*)payload;
+			source = replay_source(replay,hello->buddy_ext_ip,
+				PORT_UNKNOWN);
+			if (source != NULL)
+				hello->buddy_ext_ip = source->local;
+		}
+
+		CHECK_FAILED(replay_add(session,&record,time,payload),
+			ERROR_1);
+		if (record.event == TRACE_EVENT_CLOSE)
+			open[record.session] = -1;
+	}
+	trace_reader_close(&reader);
+	free(open);
+
+	if (FAILED(ret))
+		return ERROR_NETWORK_READ;
+
+	return SUCCESS;
+}
+
+errorcode replay_add(replay_session_t *session, trace_record_t *record,
+		     unsigned long long time, unsigned char *payload) {
+
+	/* declare local variables */
+	replay_event_t *event;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(record,ERROR_NULL_ARG_2);
+
+	/* do function */
+	if (session->count == session->size) {
+		session->size = (session->size == 0) ? 8 : session->size*2;
+		session->events = (replay_event_t*)realloc(session->events,
+			session->size*sizeof(replay_event_t));
+		if (session->events == NULL)
+			return ERROR_MALLOC_FAILED;
+	}
+	event = &session->events[session->count++];
+	event->time    = time;
+	event->event   = record->event;
+	event->type    = record->type;
+	event->len     = record->len;
+	event->payload = NULL;
+	if (record->len != 0) {
+		if ( (event->payload=(unsigned char*)malloc(record->len)) ==
+		     NULL)
+			return ERROR_MALLOC_FAILED;
+		memcpy(event->payload,payload,record->len);
+	}
+
+	return SUCCESS;
+}
+
+replay_source_t *replay_source(replay_t *replay, ip_t ip, port_t port) {
+
+	/* declare local variables */
+	replay_source_t *source;
+	int i;
+
+	/* do function */
+	for (i=0;i<replay->source_count;i++) {
+		source = &replay->sources[i];
+		if (source->recorded != ip)
+			continue;
+		/* a buddy may be named in a HELLO before it connects */
+		if ( (source->first_port == 0) && (port != PORT_UNKNOWN) )
+			source->first_port = PORT_2HBO(port);
+		return source;
+	}
+	if (replay->source_count == REPLAY_MAX_SOURCES)
+		return NULL;
+
+	source = &replay->sources[replay->source_count++];
+	source->recorded   = ip;
+	source->local      = htonl(0x7f010000 + replay->source_count);
+	source->first_port = (port != PORT_UNKNOWN) ? PORT_2HBO(port) : 0;
+
+	return source;
+}
+
+void *run_replay_session(void *arg) {
+
+	/* declare local variables */
+	replay_t *replay;
+	replay_session_t *session;
+	errorcode ret;
+	sock_t sd;
+
+	/* do function */
+	replay  = ((replay_thread_arg_t*)arg)->replay;
+	session = ((replay_thread_arg_t*)arg)->session;
+	free(arg);
+
+	ret = ERROR_TCP_SOCKET;
+	if ( (sd=socket(AF_INET,SOCK_STREAM,0)) >= 0) {
+		ret = replay_play(replay,session,sd);
+		close(sd);
+	}
+
+	pthread_mutex_lock(&replay->mutex);
+	if (FAILED(ret))
+		replay->failed++;
+	else
+		replay->ok++;
+	replay->responses    += session->responses;
+	replay->recorded_sum += session->recorded_sum;
+	replay->replayed_sum += session->replayed_sum;
+	if (session->recorded_max > replay->recorded_max)
+		replay->recorded_max = session->recorded_max;
+	if (session->replayed_max > replay->replayed_max)
+		replay->replayed_max = session->replayed_max;
+	pthread_mutex_unlock(&replay->mutex);
+
+	return NULL;
+}
+
+errorcode replay_play(replay_t *replay, replay_session_t *session,
+		      sock_t sd) {
+
+	/* declare local variables */
+	replay_event_t *event;
+	struct sockaddr_in addr;
+	struct timeval timeout;
+	unsigned char buf[TRACE_PAYLOAD_MAX];
+	unsigned long long recorded_sent, replayed_sent, recorded, replayed;
+	int i, on;
+
+	/* error check arguments */
+	CHECK_NOT_NULL(replay,ERROR_NULL_ARG_1);
+	CHECK_NOT_NULL(session,ERROR_NULL_ARG_2);
+
+	/* do function */
+	on = 1;
+	setsockopt(sd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+	setsockopt(sd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+	timeout.tv_sec  = REPLAY_READ_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = session->local.ip;
+	addr.sin_port        = session->local.port;
+	if (bind(sd,(struct sockaddr*)&addr,sizeof(addr)) != 0)
+		return ERROR_BIND;
+	addr.sin_addr.s_addr = replay->helper_ip;
+	addr.sin_port        = replay->helper_port;
+	if (connect(sd,(struct sockaddr*)&addr,sizeof(addr)) != 0)
+		return ERROR_TCP_CONNECT;
+
+	/* a response is timed from the last message the peer sent */
+	recorded_sent = session->events[0].time;
+	replayed_sent = replay_now(replay);
+	for (i=1;i<session->count;i++) {
+		event = &session->events[i];
+		if (event->event == TRACE_EVENT_IN) {
+			replay_wait(replay,event->time);
+			CHECK_FAILED(sendMsg(sd,event->type,event->payload,
+				event->len),ERROR_NETWORK_SEND);
+			recorded_sent = event->time;
+			replayed_sent = replay_now(replay);
+		}
+		else if (event->event == TRACE_EVENT_OUT) {
+			/* the helper must answer as it did when recorded */
+			CHECK_FAILED(readMsg(sd,event->type,buf,event->len),
+				ERROR_NETWORK_READ);
+			recorded = event->time - recorded_sent;
+			replayed = replay_now(replay) - replayed_sent;
+			session->recorded_sum += recorded;
+			session->replayed_sum += replayed;
+			if (recorded > session->recorded_max)
+				session->recorded_max = recorded;
+			if (replayed > session->replayed_max)
+				session->replayed_max = replayed;
+			session->responses++;
+		}
+		else if (event->event == TRACE_EVENT_CLOSE) {
+			/* hold the connection as long as it was held */
+			replay_wait(replay,event->time);
+			break;
+		}
+	}
+
+	return SUCCESS;
+}
+
+void replay_wait(replay_t *replay, unsigned long long time) {
+
+	/* declare local variables */
+	unsigned long long due, now;
+
+	/* do function */
+	due = (unsigned long long)((time - replay->first) / replay->speed);
+	now = replay_now(replay);
+	if (due > now)
+		usleep(due - now);
+}
+
+unsigned long long replay_now(replay_t *replay) {
+
+	/* declare local variables */
+	struct timeval now;
+
+	/* do function */
+	gettimeofday(&now,NULL);
+	return (unsigned long long)(now.tv_sec - replay->start.tv_sec)*1000000
+		+ (now.tv_usec - replay->start.tv_usec);
+}
+
+void printUse() {
+
+	printf("options:\n");
+	printf("\t--helper_ip   : helper hostname or IP [required]\n");
+	printf("\t--helper_port : helper port [required]\n");
+	printf("\t--trace       : trace recorded with the helper's --trace [required]\n");
+	printf("\t--speed       : how many times faster than recorded to replay, e.g. 1, 10, 100 [optional, default 1]\n");
+	printf("\n");
+
+	return;
+}
+
+int getArgs(int argc, char *argv[], char **helper_ip, port_t *helper_port,
+	    char **path, double *speed) {
+
+	char c;
+
+	static struct option long_options[] =
+	{
+		{"helper_ip",       required_argument, 0, 'a'},
+		{"helper_port",     required_argument, 0, 'b'},
+		{"trace",           required_argument, 0, 'c'},
+		{"speed",           required_argument, 0, 'd'},
+		{0, 0, 0, 0 } /* for invalid args */
+	};
+
+	if (argc < 0)
+		return ERROR_NEG_ARG_1;
+	CHECK_NOT_NULL(argv,ERROR_NULL_ARG_2);
+	CHECK_NOT_NULL(helper_ip,ERROR_NULL_ARG_3);
+	CHECK_NOT_NULL(helper_port,ERROR_NULL_ARG_4);
+	CHECK_NOT_NULL(path,ERROR_NULL_ARG_5);
+	CHECK_NOT_NULL(speed,ERROR_NULL_ARG_6);
+
+	/* set default values */
+	*helper_ip   = NULL;
+	*helper_port = 0;
+	*path        = NULL;
+	*speed       = 1;
+
+	/* loop over the arguments, and read them in */
+	while (1)
+	{
+		/* getopt_long stores the option index here. */
+		int option_index = 0;
+
+		c = getopt_long (argc, argv, "a:b:c:d:",
+			long_options, &option_index);
+
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'a' :
+				*helper_ip = optarg;
+				break;
+			case 'b' :
+				*helper_port = htons(atoi(optarg));
+				break;
+			case 'c' :
+				*path = optarg;
+				break;
+			case 'd' :
+				*speed = atof(optarg);
+				break;
+			case '?':
+				return ERROR_1;
+				break;
+			default:
+				return ERROR_2;
+		}
+	}
+
+	if ( (*helper_ip==NULL) || (*helper_port==0) || (*path==NULL) ||
+	     (*speed <= 0) )
+		return ERROR_3;
+
+	return SUCCESS;
+}